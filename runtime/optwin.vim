@@ -275,6 +275,8 @@ call append("$", "casemap\twhat method to use for changing case of letters")
 call <SID>OptionG("cmp", &cmp)
 call append("$", "maxmempattern\tmaximum amount of memory in Kbyte used for pattern matching")
 call append("$", " \tset mmp=" . &mmp)
+call append("$", "regexpengine\tdefault regexp engine to use: 0 automatic, 1 old, 2 NFA")
+call append("$", " \tset re=" . &re)
 call append("$", "define\tpattern for a macro definition line")
 call append("$", "\t(global or local to buffer)")
 call <SID>OptionG("def", &def)
@@ -724,6 +726,8 @@ call <SID>OptionG("km", &km)
 call <SID>Header("editing text")
 call append("$", "undolevels\tmaximum number of changes that can be undone")
 call append("$", " \tset ul=" . &ul)
+call append("$", "undomaxmem\tmaximum Kbyte of undo information kept in memory")
+call append("$", " \tset umm=" . &umm)
 call append("$", "undoreload\tmaximum number lines to save for undo on a buffer reload")
 call append("$", " \tset ur=" . &ur)
 call append("$", "modified\tchanges have been made and not written to a file")
@@ -1016,6 +1020,10 @@ call append("$", "maxmem\tmaximum amount of memory in Kbyte used for one buffer"
 call append("$", " \tset mm=" . &mm)
 call append("$", "maxmemtot\tmaximum amount of memory in Kbyte used for all buffers")
 call append("$", " \tset mmt=" . &mmt)
+if has("mmap")
+  call append("$", "largefilesize\tmap files of this size in Kbyte in memory")
+  call append("$", " \tset lfs=" . &lfs)
+endif
 
 
 call <SID>Header("command line editing")
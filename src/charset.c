@@ -128,6 +128,9 @@ buf_init_chartab(buf, global)
 #endif
     }
 
+    /* Cached regexp matches may depend on the old tables. */
+    ++chartab_tick;
+
     /*
      * Init word char flags all to FALSE
      */
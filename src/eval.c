@@ -655,6 +655,7 @@ static void f_printf __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_pumvisible __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_range __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_readfile __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_regcachestats __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_reltime __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_reltimestr __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_remote_expr __ARGS((typval_T *argvars, typval_T *rettv));
@@ -671,6 +672,7 @@ static void f_reverse __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_round __ARGS((typval_T *argvars, typval_T *rettv));
 #endif
 static void f_search __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_searchcount __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_searchdecl __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_searchpair __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_searchpairpos __ARGS((typval_T *argvars, typval_T *rettv));
@@ -4491,12 +4493,12 @@ eval4(arg, rettv, evaluate)
 			    save_cpo = p_cpo;
 			    p_cpo = (char_u *)"";
 			    regmatch.regprog = vim_regcomp(s2,
-							RE_MAGIC + RE_STRING);
+					     RE_MAGIC + RE_STRING + RE_CACHE);
 			    regmatch.rm_ic = ic;
 			    if (regmatch.regprog != NULL)
 			    {
 				n1 = vim_regexec_nl(&regmatch, s1, (colnr_T)0);
-				vim_free(regmatch.regprog);
+				vim_regfree(regmatch.regprog);
 				if (type == TYPE_NOMATCH)
 				    n1 = !n1;
 			    }
@@ -7831,6 +7833,7 @@ static struct fst
     {"pumvisible",	0, 0, f_pumvisible},
     {"range",		1, 3, f_range},
     {"readfile",	1, 3, f_readfile},
+    {"regcachestats",	0, 0, f_regcachestats},
     {"reltime",		0, 2, f_reltime},
     {"reltimestr",	1, 1, f_reltimestr},
     {"remote_expr",	2, 3, f_remote_expr},
@@ -7847,6 +7850,7 @@ static struct fst
     {"round",		1, 1, f_round},
 #endif
     {"search",		1, 4, f_search},
+    {"searchcount",	0, 1, f_searchcount},
     {"searchdecl",	1, 3, f_searchdecl},
     {"searchpair",	3, 7, f_searchpair},
     {"searchpairpos",	3, 7, f_searchpairpos},
@@ -11953,6 +11957,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_SESSION
 	"mksession",
 #endif
+#ifdef FEAT_MMAP
+	"mmap",
+#endif
 #ifdef FEAT_MODIFY_FNAME
 	"modify_fname",
 #endif
@@ -12072,6 +12079,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_SUN_WORKSHOP
 	"sun_workshop",
 #endif
+#ifdef FEAT_SWAP_THREAD
+	"swapthread",
+#endif
 #ifdef FEAT_NETBEANS_INTG
 	"netbeans_intg",
 #endif
@@ -13489,7 +13499,7 @@ find_some_match(argvars, rettv, type)
 	    goto theend;
     }
 
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING + RE_CACHE);
     if (regmatch.regprog != NULL)
     {
 	regmatch.rm_ic = p_ic;
@@ -13577,7 +13587,7 @@ find_some_match(argvars, rettv, type)
 		rettv->vval.v_number += (varnumber_T)(str - expr);
 	    }
 	}
-	vim_free(regmatch.regprog);
+	vim_regfree(regmatch.regprog);
     }
 
 theend:
@@ -14364,6 +14374,29 @@ list2proftime(arg, tm)
 }
 #endif /* FEAT_RELTIME */
 
+/*
+ * "regcachestats()" function
+ */
+    static void
+f_regcachestats(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    dict_T	*dict;
+    long	hits;
+    long	misses;
+    int		count;
+
+    if (rettv_dict_alloc(rettv) == FAIL)
+	return;
+    dict = rettv->vval.v_dict;
+
+    vim_regcache_stats(&hits, &misses, &count);
+    dict_add_nr_str(dict, "hits", hits, NULL);
+    dict_add_nr_str(dict, "misses", misses, NULL);
+    dict_add_nr_str(dict, "count", (long)count, NULL);
+}
+
 /*
  * "reltime()" function
  */
@@ -15269,6 +15302,38 @@ f_search(argvars, rettv)
     rettv->vval.v_number = search_cmn(argvars, NULL, &flags);
 }
 
+/*
+ * "searchcount([{timeout}])" function
+ */
+    static void
+f_searchcount(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    dict_T	*dict;
+#ifdef FEAT_RELTIME
+    long	msec = p_rdt;
+#else
+    long	msec = 1;	/* without a time limit all is counted */
+#endif
+    long	cur = 0;
+    long	total = 0;
+    int		incomplete = 0;
+
+    if (argvars[0].v_type != VAR_UNKNOWN)
+	msec = get_tv_number(&argvars[0]);
+    if (rettv_dict_alloc(rettv) == FAIL)
+	return;
+    dict = rettv->vval.v_dict;
+
+#ifdef FEAT_SEARCH_EXTRA
+    incomplete = search_count_get(msec, &cur, &total);
+#endif
+    dict_add_nr_str(dict, "current", cur, NULL);
+    dict_add_nr_str(dict, "total", total, NULL);
+    dict_add_nr_str(dict, "incomplete", (long)incomplete, NULL);
+}
+
 /*
  * "searchdecl()" function
  */
@@ -16584,7 +16649,7 @@ f_split(argvars, rettv)
     if (typeerr)
 	return;
 
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING + RE_CACHE);
     if (regmatch.regprog != NULL)
     {
 	regmatch.rm_ic = FALSE;
@@ -16622,7 +16687,7 @@ f_split(argvars, rettv)
 	    str = regmatch.endp[0];
 	}
 
-	vim_free(regmatch.regprog);
+	vim_regfree(regmatch.regprog);
     }
 
     p_cpo = save_cpo;
@@ -20380,7 +20445,7 @@ ex_function(eap)
 			    list_func_head(fp, FALSE);
 		    }
 		}
-		vim_free(regmatch.regprog);
+		vim_regfree(regmatch.regprog);
 	    }
 	}
 	if (*p == '/')
@@ -23386,7 +23451,7 @@ do_string_sub(str, pat, sub, flags)
     do_all = (flags[0] == 'g');
 
     regmatch.rm_ic = p_ic;
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING + RE_CACHE);
     if (regmatch.regprog != NULL)
     {
 	tail = str;
@@ -23435,7 +23500,7 @@ do_string_sub(str, pat, sub, flags)
 	if (ga.ga_data != NULL)
 	    STRCPY((char *)ga.ga_data + ga.ga_len, tail);
 
-	vim_free(regmatch.regprog);
+	vim_regfree(regmatch.regprog);
     }
 
     ret = vim_strsave(ga.ga_data == NULL ? str : (char_u *)ga.ga_data);
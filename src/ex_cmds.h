@@ -158,7 +158,9 @@ EX(CMD_borebuildsln,	"borebuildsln",	ex_borebuild,
 EX(CMD_borebuildproj,	"borebuildproj",ex_borebuild,
 			EXTRA),
 EX(CMD_borebuildfile,	"borebuildfile",ex_borebuild,
-			EXTRA),
+			BANG|EXTRA),
+EX(CMD_borebuildmodified,	"borebuildmodified",ex_borebuild,
+			TRLBAR),
 EX(CMD_boreproj,	"boreproj",	ex_boreproj,
 			WORD1),
 EX(CMD_borefind,	"borefind",	ex_borefind,
@@ -166,7 +168,7 @@ EX(CMD_borefind,	"borefind",	ex_borefind,
 EX(CMD_boreopen,	"boreopen",	ex_boreopen,
 			WORD1),
 EX(CMD_boresln,		"boresln",	ex_boresln,
-			FILE1),
+			BANG|FILE1),
 EX(CMD_boretoggle,	"boretoggle",	ex_boretoggle,
 			WORD1),
 EX(CMD_botright,	"botright",	ex_wrongmodifier,
@@ -937,6 +939,8 @@ EX(CMD_swapname,	"swapname",	ex_swapname,
 			TRLBAR|CMDWIN),
 EX(CMD_syntax,		"syntax",	ex_syntax,
 			EXTRA|NOTRLCOM|CMDWIN),
+EX(CMD_syntime,		"syntime",	ex_syntime,
+			NEEDARG|WORD1|TRLBAR|CMDWIN),
 EX(CMD_syncbind,	"syncbind",	ex_syncbind,
 			TRLBAR),
 EX(CMD_t,		"t",		ex_copymove,
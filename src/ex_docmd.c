@@ -488,6 +488,9 @@ static void	ex_folddo __ARGS((exarg_T *eap));
 #ifndef FEAT_PROFILE
 # define ex_profile		ex_ni
 #endif
+#if !defined(FEAT_PROFILE) || !defined(FEAT_SYN_HL)
+# define ex_syntime		ex_ni
+#endif
 
 /*
  * Declare cmdnames[].
@@ -3859,6 +3862,12 @@ set_one_cmd_context(xp, buff)
 	case CMD_profile:
 	    set_context_in_profile_cmd(xp, arg);
 	    break;
+#endif
+#if defined(FEAT_PROFILE) && defined(FEAT_SYN_HL)
+	case CMD_syntime:
+	    xp->xp_context = EXPAND_SYNTIME;
+	    xp->xp_pattern = arg;
+	    break;
 #endif
 	case CMD_behave:
 	    xp->xp_context = EXPAND_BEHAVE;
@@ -5286,6 +5295,9 @@ static struct
     {EXPAND_MAPPINGS, "mapping"},
     {EXPAND_MENUS, "menu"},
     {EXPAND_OWNSYNTAX, "syntax"},
+#if defined(FEAT_PROFILE) && defined(FEAT_SYN_HL)
+    {EXPAND_SYNTIME, "syntime"},
+#endif
     {EXPAND_SETTINGS, "option"},
     {EXPAND_SHELLCMD, "shellcmd"},
 #if defined(FEAT_SIGNS)
@@ -7538,7 +7550,7 @@ ex_open(eap)
 		curwin->w_cursor.col = (colnr_T)(regmatch.startp[0] - p);
 	    else
 		EMSG(_(e_nomatch));
-	    vim_free(regmatch.regprog);
+	    vim_regfree(regmatch.regprog);
 	}
 	/* Move to the NUL, ignore any other arguments. */
 	eap->arg += STRLEN(eap->arg);
@@ -8510,18 +8522,15 @@ ex_wundo(eap)
 {
     char_u hash[UNDO_HASH_SIZE];
 
-    u_compute_hash(hash);
-    u_write_undo(eap->arg, eap->forceit, curbuf, hash);
+    if (u_compute_hash(curbuf, hash) == OK)
+	u_write_undo(eap->arg, eap->forceit, curbuf, hash);
 }
 
     static void
 ex_rundo(eap)
     exarg_T *eap;
 {
-    char_u hash[UNDO_HASH_SIZE];
-
-    u_compute_hash(hash);
-    u_read_undo(eap->arg, hash, NULL);
+    u_read_undo(eap->arg, NULL);
 }
 #endif
 
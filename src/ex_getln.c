@@ -4573,6 +4573,9 @@ ExpandFromContext(xp, pat, num_file, file, options)
 #ifdef FEAT_PROFILE
 	    {EXPAND_PROFILE, get_profile_name, TRUE},
 #endif
+#if defined(FEAT_PROFILE) && defined(FEAT_SYN_HL)
+	    {EXPAND_SYNTIME, get_syntime_arg, TRUE},
+#endif
 #if (defined(HAVE_LOCALE_H) || defined(X_LOCALE)) \
 	&& (defined(FEAT_GETTEXT) || defined(FEAT_MBYTE))
 	    {EXPAND_LANGUAGE, get_lang_arg, TRUE},
@@ -4596,7 +4599,7 @@ ExpandFromContext(xp, pat, num_file, file, options)
 	    }
     }
 
-    vim_free(regmatch.regprog);
+    vim_regfree(regmatch.regprog);
 
     return ret;
 #endif /* FEAT_CMDL_COMPL */
@@ -5598,7 +5601,7 @@ del_history_entry(histype, str)
 	if (history[histype][idx].hisstr == NULL)
 	    hisidx[histype] = -1;
     }
-    vim_free(regmatch.regprog);
+    vim_regfree(regmatch.regprog);
     return found;
 }
 
@@ -1312,3 +1312,20 @@
 #ifdef FEAT_NORMAL
 # define FEAT_PERSISTENT_UNDO
 #endif
+
+/*
+ * +mmap		'largefilesize' option: map big files instead of reading
+ *			them into the memline.
+ */
+#if defined(FEAT_NORMAL) && defined(UNIX) && defined(HAVE_SYS_MMAN_H)
+# define FEAT_MMAP
+#endif
+
+/*
+ * +swapthread		Write the swap file in a thread when it is synced
+ *			after 'updatetime' or 'updatecount'.
+ */
+#if defined(FEAT_NORMAL) && defined(UNIX) && defined(HAVE_PTHREAD) \
+	&& defined(HAVE_FSYNC)
+# define FEAT_SWAP_THREAD
+#endif
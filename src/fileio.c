@@ -31,6 +31,7 @@
 
 #define BUFSIZE		8192	/* size of normal write buffer */
 #define SMBUFSIZE	256	/* size of emergency write buffer */
+#define LINEBATCH	128	/* lines readfile() appends at once */
 
 #ifdef FEAT_CRYPT
 /* crypt_magic[0] is pkzip crypt, crypt_magic[1] is sha2+blowfish */
@@ -141,6 +142,14 @@ struct bw_info
 
 static int  buf_write_bytes __ARGS((struct bw_info *ip));
 
+static long readfile_textlen __ARGS((char_u *p, long len, int mac));
+static int readfile_append __ARGS((linenr_T lnum, char_u **lines, colnr_T *lens, int *countp, int newfile));
+#ifdef FEAT_MBYTE
+static long readfile_asciilen __ARGS((char_u *p, long len));
+#endif
+#ifdef FEAT_MMAP
+static linenr_T readfile_mmap __ARGS((int fd, int *ffp, int try_dos, int try_unix, int try_mac, off_t *filesizep, int *noeolp));
+#endif
 #ifdef FEAT_MBYTE
 static linenr_T readfile_linenr __ARGS((linenr_T linecnt, char_u *p, char_u *endp));
 static int ucs2bytes __ARGS((unsigned c, char_u **pp, int flags));
@@ -252,6 +261,7 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     int		wasempty;		/* buffer was empty before reading */
     colnr_T	len;
     long	size = 0;
+    long	n;			/* bytes before a line break */
     char_u	*p;
     off_t	filesize = 0;
     int		skip_read = FALSE;
@@ -260,7 +270,6 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     int		did_ask_for_key = FALSE;
 #endif
 #ifdef FEAT_PERSISTENT_UNDO
-    context_sha256_T sha_ctx;
     int		read_undo_file = FALSE;
 #endif
     int		split = 0;		/* number of split lines */
@@ -269,6 +278,9 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     int		error = FALSE;		/* errors encountered */
     int		ff_error = EOL_UNKNOWN; /* file format with errors */
     long	linerest = 0;		/* remaining chars in line */
+    char_u	*batch_lines[LINEBATCH]; /* lines not appended yet */
+    colnr_T	batch_lens[LINEBATCH];
+    int		batch_count = 0;
 #ifdef UNIX
     int		perm = 0;
     int		swap_mode = -1;		/* protection bits for swap file */
@@ -990,8 +1002,9 @@ retry:
 	    goto failed;
 	}
 	/* Delete the previously read lines. */
-	while (lnum > from)
-	    ml_delete(lnum--, FALSE);
+	if (lnum > from)
+	    ml_delete_lines(from + 1, (long)(lnum - from), FALSE);
+	lnum = from;
 	file_rewind = FALSE;
 #ifdef FEAT_MBYTE
 	if (set_options)
@@ -1209,11 +1222,47 @@ retry:
 				  && !filtering
 				  && !read_stdin
 				  && !read_buffer);
-	if (read_undo_file)
-	    sha256_start(&sha_ctx);
 #endif
     }
 
+#ifdef FEAT_MMAP
+    /*
+     * A big file that is read as it is into an empty buffer is mapped
+     * instead, see 'largefilesize'.
+     */
+    if (p_lfs > 0 && newfile && wasempty && !filtering && !read_stdin
+	    && !read_buffer && !recoverymode && !(flags & READ_DUMMY)
+	    && lines_to_skip == 0 && lines_to_read == MAXLNUM
+# ifdef FEAT_MBYTE
+	    && !converted
+# endif
+	    && (fileformat == EOL_UNIX || fileformat == EOL_UNKNOWN))
+    {
+	int	    noeol;
+	linenr_T    n = readfile_mmap(fd, &fileformat, try_dos, try_unix,
+						 try_mac, &filesize, &noeol);
+
+	if (n >= 0)
+	{
+	    if (set_options)
+	    {
+		set_fileformat(fileformat, OPT_LOCAL);
+		if (noeol)
+		    curbuf->b_p_eol = FALSE;
+	    }
+	    lnum += n;
+	    if (noeol)
+		read_no_eol_lnum = lnum;
+	    linerest = 0;
+# ifdef FEAT_PERSISTENT_UNDO
+	    /* Computing the hash would read all the text. */
+	    read_undo_file = FALSE;
+# endif
+	    goto failed;
+	}
+    }
+#endif
+
     while (!error && !got_int)
     {
 	/*
@@ -2005,6 +2054,12 @@ retry:
 
 		    if (todo <= 0)
 			break;
+		    /* Skip over ASCII quickly, it is always valid. */
+		    l = (int)readfile_asciilen(p, (long)todo);
+		    p += l;
+		    if (l == todo)
+			break;
+		    todo -= l;
 		    if (*p >= 0x80)
 		    {
 			/* A length of 1 means it's an illegal byte.  Accept
@@ -2150,7 +2205,12 @@ rewind_retry:
 	    --ptr;
 	    while (++ptr, --size >= 0)
 	    {
-		/* catch most common case first */
+		/* catch most common case first: skip to the next NUL, CR or
+		 * NL */
+		n = readfile_textlen(ptr, size + 1, TRUE);
+		ptr += n;
+		if ((size -= n) < 0)
+		    break;
 		if ((c = *ptr) != NUL && c != CAR && c != NL)
 		    continue;
 		if (c == NUL)
@@ -2163,16 +2223,16 @@ rewind_retry:
 		    {
 			*ptr = NUL;	    /* end of line */
 			len = (colnr_T) (ptr - line_start + 1);
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			batch_lines[batch_count] = line_start;
+			batch_lens[batch_count++] = len;
+			++lnum;
+			if (batch_count == LINEBATCH
+				&& readfile_append(lnum, batch_lines,
+				     batch_lens, &batch_count, newfile) == FAIL)
 			{
 			    error = TRUE;
 			    break;
 			}
-#ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
-#endif
-			++lnum;
 			if (--read_count == 0)
 			{
 			    error = TRUE;	/* break loop */
@@ -2191,7 +2251,12 @@ rewind_retry:
 	    --ptr;
 	    while (++ptr, --size >= 0)
 	    {
-		if ((c = *ptr) != NUL && c != NL)  /* catch most common case */
+		/* catch most common case: skip to the next NUL or NL */
+		n = readfile_textlen(ptr, size + 1, FALSE);
+		ptr += n;
+		if ((size -= n) < 0)
+		    break;
+		if ((c = *ptr) != NUL && c != NL)
 		    continue;
 		if (c == NUL)
 		    *ptr = NL;	/* NULs are replaced by newlines! */
@@ -2226,21 +2291,24 @@ rewind_retry:
 					set_fileformat(EOL_UNIX, OPT_LOCAL);
 				    file_rewind = TRUE;
 				    keep_fileformat = TRUE;
+				    /* drop the lines not appended yet */
+				    lnum -= batch_count;
+				    batch_count = 0;
 				    goto retry;
 				}
 				ff_error = EOL_DOS;
 			    }
 			}
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			batch_lines[batch_count] = line_start;
+			batch_lens[batch_count++] = len;
+			++lnum;
+			if (batch_count == LINEBATCH
+				&& readfile_append(lnum, batch_lines,
+				     batch_lens, &batch_count, newfile) == FAIL)
 			{
 			    error = TRUE;
 			    break;
 			}
-#ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
-#endif
-			++lnum;
 			if (--read_count == 0)
 			{
 			    error = TRUE;	    /* break loop */
@@ -2254,6 +2322,11 @@ rewind_retry:
 		}
 	    }
 	}
+	/* The lines point into the read buffer, append them before it is
+	 * filled again. */
+	if (batch_count > 0 && readfile_append(lnum, batch_lines, batch_lens,
+						&batch_count, newfile) == FAIL)
+	    error = TRUE;
 	linerest = (long)(ptr - line_start);
 	ui_breakcheck();
     }
@@ -2284,13 +2357,7 @@ failed:
 	if (ml_append(lnum, line_start, len, newfile) == FAIL)
 	    error = TRUE;
 	else
-	{
-#ifdef FEAT_PERSISTENT_UNDO
-	    if (read_undo_file)
-		sha256_update(&sha_ctx, line_start, len);
-#endif
 	    read_no_eol_lnum = ++lnum;
-	}
     }
 
     if (set_options)
@@ -2377,6 +2444,10 @@ failed:
 	if (newfile || read_buffer)
 	{
 	    redraw_curbuf_later(NOT_VALID);
+#ifdef FEAT_SEARCH_EXTRA
+	    /* Matches cached for the old text are invalid. */
+	    match_cache_invalidate(curbuf);
+#endif
 #ifdef FEAT_DIFF
 	    /* After reading the text into the buffer the diff info needs to
 	     * be updated. */
@@ -2622,12 +2693,7 @@ failed:
      * When opening a new file locate undo info and read it.
      */
     if (read_undo_file)
-    {
-	char_u	hash[UNDO_HASH_SIZE];
-
-	sha256_finish(&sha_ctx, hash);
-	u_read_undo(NULL, hash, fname);
-    }
+	u_read_undo(NULL, fname);
 #endif
 
 #ifdef FEAT_AUTOCMD
@@ -2689,6 +2755,118 @@ is_dev_fd_file(fname)
 }
 #endif
 
+#ifdef USE_SSE2
+/*
+ * Return the index of the lowest bit set in "mask", which must not be zero.
+ */
+# ifdef __GNUC__
+#  define SSE2_FIRST(mask) __builtin_ctz(mask)
+# else
+static int sse2_first __ARGS((int mask));
+#  define SSE2_FIRST(mask) sse2_first(mask)
+
+    static int
+sse2_first(mask)
+    int		mask;
+{
+    int		idx = 0;
+
+    while (!(mask & 1))
+    {
+	mask >>= 1;
+	++idx;
+    }
+    return idx;
+}
+# endif
+#endif
+
+/*
+ * Append the "*countp" lines in "lines[]" with lengths "lens[]" to the current
+ * buffer, the last one becomes line "lnum".  Resets "*countp" to zero.
+ * Returns FAIL when appending fails.
+ */
+    static int
+readfile_append(lnum, lines, lens, countp, newfile)
+    linenr_T	lnum;
+    char_u	**lines;
+    colnr_T	*lens;
+    int		*countp;
+    int		newfile;
+{
+    int		count = *countp;
+
+    *countp = 0;
+    return ml_append_lines(lnum - count, lines, lens, (long)count, newfile);
+}
+
+/*
+ * Return the number of bytes at "p", at most "len", before the first NUL or
+ * NL.  When "mac" is TRUE also stop at a CR.
+ * This is where readfile() spends its time, with SSE2 it checks 16 bytes at
+ * a time.
+ */
+    static long
+readfile_textlen(p, len, mac)
+    char_u	*p;
+    long	len;
+    int		mac;
+{
+    long	n = 0;
+    int		c;
+#ifdef USE_SSE2
+    __m128i	nul = _mm_setzero_si128();
+    __m128i	nl = _mm_set1_epi8(NL);
+    __m128i	cr = _mm_set1_epi8(mac ? CAR : NL);
+    __m128i	v;
+    int		mask;
+
+    for ( ; n + 16 <= len; n += 16)
+    {
+	v = _mm_loadu_si128((__m128i *)(p + n));
+	mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, nul),
+		       _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr))));
+	if (mask != 0)
+	    return n + SSE2_FIRST(mask);
+    }
+#endif
+    for ( ; n < len; ++n)
+    {
+	c = p[n];
+	if (c == NUL || c == NL || (mac && c == CAR))
+	    break;
+    }
+    return n;
+}
+
+#ifdef FEAT_MBYTE
+/*
+ * Return the number of ASCII bytes at "p", at most "len".
+ * Used to skip over the text that doesn't need a UTF-8 check quickly.
+ */
+    static long
+readfile_asciilen(p, len)
+    char_u	*p;
+    long	len;
+{
+    long	n = 0;
+# ifdef USE_SSE2
+    int		mask;
+
+    for ( ; n + 16 <= len; n += 16)
+    {
+	/* The sign bits are the bytes that are not ASCII. */
+	mask = _mm_movemask_epi8(_mm_loadu_si128((__m128i *)(p + n)));
+	if (mask != 0)
+	    return n + SSE2_FIRST(mask);
+    }
+# endif
+    while (n < len && p[n] < 0x80)
+	++n;
+    return n;
+}
+#endif
+
 #ifdef FEAT_MBYTE
 
 /*
@@ -2713,6 +2891,90 @@ readfile_linenr(linecnt, p, endp)
 }
 #endif
 
+#ifdef FEAT_MMAP
+/*
+ * Map the file "fd" when it is at least 'largefilesize' Kbyte and append its
+ * lines to the empty current buffer.  Only done when the lines end in a NL
+ * and no conversion is needed: "*ffp" must be EOL_UNIX, or EOL_UNKNOWN and
+ * then the same guess as in readfile() must result in EOL_UNIX.
+ * Returns the number of lines, -1 when the file must be read normally.
+ */
+    static linenr_T
+readfile_mmap(fd, ffp, try_dos, try_unix, try_mac, filesizep, noeolp)
+    int		fd;
+    int		*ffp;
+    int		try_dos;
+    int		try_unix;
+    int		try_mac;
+    off_t	*filesizep;
+    int		*noeolp;
+{
+    struct stat	st;
+    char_u	*map;
+    char_u	*p;
+    size_t	size;
+    linenr_T	lines;
+# ifdef FEAT_MBYTE
+    int		l;
+    int		blen;
+# endif
+
+    if (mch_fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+	    || st.st_size < (off_t)p_lfs * 1024
+	    || (off_t)(size_t)st.st_size != st.st_size)
+	return -1;
+    size = (size_t)st.st_size;
+    map = (char_u *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, (off_t)0);
+    if (map == (char_u *)MAP_FAILED)
+	return -1;
+
+    if (*ffp == EOL_UNKNOWN)
+    {
+	p = memchr(map, NL, size);
+	if (p == NULL || !try_unix || (try_dos && p > map && p[-1] == CAR)
+		|| (try_mac && memchr(map, CAR, p - map) != NULL))
+	    goto notmapped;
+    }
+
+# ifdef FEAT_CRYPT
+    if (crypt_method_from_magic((char *)map,
+				    size > INT_MAX ? INT_MAX : (int)size) >= 0)
+	goto notmapped;
+# endif
+# ifdef FEAT_MBYTE
+    if (!curbuf->b_p_bin)
+    {
+	if (check_for_bom(map, size > 4 ? 4 : (long)size, &blen, FIO_ALL)
+								      != NULL)
+	    goto notmapped;
+
+	/* Illegal bytes need the handling in readfile(). */
+	if (enc_utf8)
+	    for (p = map; (p += readfile_asciilen(p, (long)(map + size - p)))
+							  < map + size; p += l)
+	    {
+		l = utf_ptr2len_len(p, (int)(map + size - p > 6
+						      ? 6 : map + size - p));
+		if (l == 1 || l > map + size - p)
+		    goto notmapped;
+	    }
+    }
+# endif
+
+    lines = ml_append_mapped(curbuf, map, size, &st);
+    if (lines < 0)
+	goto notmapped;
+    *ffp = EOL_UNIX;
+    *filesizep = st.st_size;
+    *noeolp = (map[size - 1] != NL);
+    return lines;
+
+notmapped:
+    munmap(map, size);
+    return -1;
+}
+#endif
+
 /*
  * Fill "*eap" to force the 'fileencoding', 'fileformat' and 'binary to be
  * equal to the buffer "buf".  Used for calling readfile().
@@ -3200,7 +3462,6 @@ buf_write(buf, fname, sfname, start, end, eap, append, forceit,
 #endif
 #ifdef FEAT_PERSISTENT_UNDO
     int		    write_undo_file = FALSE;
-    context_sha256_T sha_ctx;
 #endif
 
     if (fname == NULL || *fname == NUL)	/* safety check */
@@ -4336,6 +4597,18 @@ buf_write(buf, fname, sfname, start, end, eap, append, forceit,
     }
 #endif
 
+#ifdef FEAT_MMAP
+    /* Overwriting a file that is mapped for a buffer: read the text from it
+     * first. */
+    if (!append)
+    {
+	buf_T	*b;
+
+	for (b = firstbuf; b != NULL; b = b->b_next)
+	    ml_unmap(b, wfname);
+    }
+#endif
+
     /*
      * Open the file "wfname" for writing.
      * We may try to open the file twice: If we can't write to the
@@ -4518,9 +4791,6 @@ restore_backup:
 #ifdef FEAT_PERSISTENT_UNDO
     write_undo_file = (buf->b_p_udf && overwriting && !append
 					      && !filtering && reset_changed);
-    if (write_undo_file)
-	/* Prepare for computing the hash value of the text. */
-	sha256_start(&sha_ctx);
 #endif
 
     write_info.bw_len = bufsize;
@@ -4537,10 +4807,6 @@ restore_backup:
 	 * Keep it fast!
 	 */
 	ptr = ml_get_buf(buf, lnum, FALSE) - 1;
-#ifdef FEAT_PERSISTENT_UNDO
-	if (write_undo_file)
-	    sha256_update(&sha_ctx, ptr + 1, (UINT32_T)(STRLEN(ptr + 1) + 1));
-#endif
 	while ((c = *++ptr) != NUL)
 	{
 	    if (c == NL)
@@ -5080,8 +5346,8 @@ nofail:
     {
 	char_u	    hash[UNDO_HASH_SIZE];
 
-	sha256_finish(&sha_ctx, hash);
-	u_write_undo(NULL, FALSE, buf, hash);
+	if (u_compute_hash(buf, hash) == OK)
+	    u_write_undo(NULL, FALSE, buf, hash);
     }
 #endif
 
@@ -7911,7 +8177,7 @@ au_cleanup()
 	    if (ap->pat == NULL)
 	    {
 		*prev_ap = ap->next;
-		vim_free(ap->reg_prog);
+		vim_regfree(ap->reg_prog);
 		vim_free(ap);
 	    }
 	    else
@@ -10004,7 +10270,7 @@ match_file_pat(pattern, prog, fname, sfname, tail, allow_dirs)
 	result = TRUE;
 
     if (prog == NULL)
-	vim_free(regmatch.regprog);
+	vim_regfree(regmatch.regprog);
     return result;
 }
 #endif
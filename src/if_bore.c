@@ -38,6 +38,7 @@
 #include <windows.h>
 
 static int bore_canonicalize (const char* src, char* dst, DWORD* attr);
+static u64 bore_file_mtime(const char* path);
 static u32 bore_string_hash(const char* s);
 static u32 bore_string_hash_n(const char* s, int n);
 
@@ -104,6 +105,7 @@ static void bore_free(bore_t* b)
     bore_alloc_free(&b->toggle_index_alloc);
     bore_alloc_free(&b->data_alloc);
     bore_alloc_free(&b->proj_alloc);
+    bore_alloc_free(&b->proj_ref_alloc);
     for (i = 0; i < BORE_SEARCH_JOBS; ++i) {
         bore_alloc_free(&b->search[i].filedata);
     }
@@ -171,6 +173,40 @@ static void bore_append_vcxproj_files(bore_t* b, int proj_index, node_t** result
     bore_alloc_trim(&b->file_alloc, sizeof(bore_file_t)*(result_count - file_index));
 }
 
+static void bore_append_vcxproj_refs(bore_t* b, int proj_index, node_t** result, int result_count,
+        char* filename_buf, char* filename_part, int path_part_len)
+{
+    bore_proj_t* proj = (bore_proj_t*)b->proj_alloc.base;
+    int i, j;
+
+    for(i = 0; i < result_count; ++i) {
+        char buf[BORE_MAX_PATH];
+        const char* fn;
+        int len;
+
+        roxml_get_content(result[i], filename_part, BORE_MAX_PATH - path_part_len, 0);
+        len = strlen(filename_part);
+        /* roxml sometimes returns paths with trailing " */
+        while(len > 0 && filename_part[len - 1] == '\"') {
+            --len;
+            filename_part[len] = 0;
+        }
+        fn = (len >=2 && filename_part[1] == ':') ? filename_part : filename_buf;
+
+        if (FAIL == bore_canonicalize(fn, buf, 0))
+            continue;
+        for (j = 0; j < b->proj_count; ++j) {
+            if (proj[j].project_file_path && 0 == STRICMP(buf, bore_str(b, proj[j].project_file_path))) {
+                bore_proj_ref_t* ref = (bore_proj_ref_t*)bore_alloc(&b->proj_ref_alloc, sizeof(bore_proj_ref_t));
+                ref->proj_index = proj_index;
+                ref->ref_proj_index = j;
+                ++b->proj_ref_count;
+                break;
+            }
+        }
+    }
+}
+
 static void bore_load_vcxproj_filters(bore_t* b, int proj_index, const char* path)
 {
     node_t* root;
@@ -193,6 +229,10 @@ static void bore_load_vcxproj_filters(bore_t* b, int proj_index, const char* pat
     bore_append_vcxproj_files(b, proj_index, result, result_count, filename_buf, filename_part, path_part_len);
     roxml_release(result);
 
+    result = roxml_xpath(root, "//ProjectReference/@Include", &result_count);
+    bore_append_vcxproj_refs(b, proj_index, result, result_count, filename_buf, filename_part, path_part_len);
+    roxml_release(result);
+
     roxml_close(root);
 
 }
@@ -342,7 +382,7 @@ static int bore_extract_projects_and_files_from_sln(bore_t* b, const char* sln_p
     }
 
     fclose(f);
-    vim_free(regmatch.regprog);
+    vim_regfree(regmatch.regprog);
     bore_alloc_free(&guid_map_alloc);
 
     result = OK;
@@ -361,6 +401,7 @@ static int bore_extract_files_from_projects(bore_t* b)
             //char path[BORE_MAX_PATH];
             //sprintf(path, "%s.filters", bore_str(b, proj[i].project_file_path));
             //bore_load_vcxproj_filters(b, path);
+            proj[i].mtime = bore_file_mtime(bore_str(b, proj[i].project_file_path));
             bore_load_vcxproj_filters(b, i, bore_str(b, proj[i].project_file_path));
         }
     }
@@ -383,14 +424,6 @@ static int bore_find_filename(void* ctx, const void* vx, const void* vy)
     return STRICMP(x, bore_str(b, y->file));
 }
 
-static int bore_sort_project_files(void* ctx, const void* vx, const void* vy)
-{
-    bore_t* b = (bore_t*)ctx;
-    bore_file_t* x = (bore_file_t*)vx;
-    bore_file_t* y = (bore_file_t*)vy;
-    return x->proj_index - y->proj_index;
-}
-
 static int bore_sort_and_cleanup_files(bore_t* b)
 {
     bore_file_t* files = (bore_file_t*)b->file_alloc.base;
@@ -424,13 +457,32 @@ static int bore_sort_and_cleanup_files(bore_t* b)
     return OK;
 }
 
+// Bucket the (still unsorted and non-unique) file list by project, so that
+// each project's files is a contiguous range of file_proj_alloc.
+// Must run before bore_sort_and_cleanup_files, which drops files that are
+// shared between projects.
 static int bore_build_project_files(bore_t* b)
 {
     bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    bore_proj_t* proj = (bore_proj_t*)b->proj_alloc.base;
+    bore_file_t* proj_files;
+    u32 i, n;
+
     bore_alloc(&b->file_proj_alloc, b->file_count * sizeof(bore_file_t));
-    bore_file_t* proj_files = (bore_file_t*)b->file_proj_alloc.base;
-    memcpy(proj_files, files, b->file_count * sizeof(bore_file_t));
-    qsort_s(proj_files, b->file_count, sizeof(bore_file_t), bore_sort_project_files, b);
+    proj_files = (bore_file_t*)b->file_proj_alloc.base;
+
+    for (i = 0; i < (u32)b->proj_count; ++i)
+        proj[i].file_end = 0;
+    for (i = 0; i < (u32)b->file_count; ++i)
+        ++proj[files[i].proj_index].file_end;
+    for (i = 0, n = 0; i < (u32)b->proj_count; ++i) {
+        proj[i].file_begin = n;
+        n += proj[i].file_end;
+        proj[i].file_end = proj[i].file_begin;
+    }
+    for (i = 0; i < (u32)b->file_count; ++i)
+        proj_files[proj[files[i].proj_index].file_end++] = files[i];
+
     return OK;
 }
 
@@ -522,7 +574,8 @@ static int bore_write_filelist_to_tempfile(bore_t* b)
     int i;
     char *slndir;
     int slndirlen;
-    b->filelist_tmp_file = vim_tempname('b');
+    if (!b->filelist_tmp_file)
+        b->filelist_tmp_file = vim_tempname('b');
     if (!b->filelist_tmp_file)
         return FAIL;
     f = fopen(b->filelist_tmp_file, "w");
@@ -554,6 +607,9 @@ struct bore_async_execute_context_t
     HANDLE wait_thread;
     PROCESS_INFORMATION spawned_process;
     HANDLE result_handle;
+    int output_count;   // number of times output was added to the quickfix list
+    int line_len;
+    char line[4096];    // incomplete last line of output
 };
 
 static struct bore_async_execute_context_t g_bore_async_execute_context;
@@ -587,6 +643,8 @@ static void bore_load_sln(const char* path)
 
     b->sln_path = bore_strndup(b, buf, strlen(buf));
     b->sln_dir = bore_strndup(b, buf, strlen(buf));
+    b->sln_mtime = bore_file_mtime(buf);
+    b->build_time = (u64)time(NULL);
 
     {
         char* sln_dir_str = bore_str(b, b->sln_dir);
@@ -627,14 +685,14 @@ static void bore_load_sln(const char* path)
     BORE_VIMPROFILE_STOP("bore_extract_files_from_projects");
 
     BORE_VIMPROFILE_START;
-    if (FAIL == bore_sort_and_cleanup_files(b))
+    if (FAIL == bore_build_project_files(b))
         goto fail;
-    BORE_VIMPROFILE_STOP("bore_sort_and_cleanup_files");
+    BORE_VIMPROFILE_STOP("bore_build_project_files");
 
     BORE_VIMPROFILE_START;
-    if (FAIL == bore_build_project_files(b))
+    if (FAIL == bore_sort_and_cleanup_files(b))
         goto fail;
-    BORE_VIMPROFILE_STOP("bore_build_project_files");
+    BORE_VIMPROFILE_STOP("bore_sort_and_cleanup_files");
 
     BORE_VIMPROFILE_START;
     if (FAIL == bore_build_extension_list(b))
@@ -668,6 +726,183 @@ fail:
     return;
 }
 
+// Reload the projects of a loaded solution whose project file changed since
+// it was loaded, and patch the sorted tables in place instead of rebuilding
+// them from scratch. Returns the number of reloaded projects, or -1 if the
+// solution file itself changed and a full reload is needed.
+static int bore_reload_sln(bore_t* b)
+{
+    bore_proj_t* proj = (bore_proj_t*)b->proj_alloc.base;
+    bore_file_t* files;
+    bore_file_t* new_files;
+    bore_file_t* proj_files;
+    bore_file_t* removed;
+    u32* old_ext;
+    u32* ext;
+    bore_alloc_t changed_alloc;
+    bore_alloc_t removed_alloc;
+    bore_alloc_t file_alloc;
+    bore_alloc_t file_proj_alloc;
+    bore_alloc_t file_ext_alloc;
+    u8* changed;
+    u32 old_count = b->file_count;
+    u32 new_count;
+    u32 removed_count = 0;
+    u32 i, j, n;
+    int changed_count = 0;
+
+    if (bore_file_mtime(bore_str(b, b->sln_path)) != b->sln_mtime)
+        return -1;
+
+    bore_prealloc(&changed_alloc, b->proj_count + 1);
+    changed = changed_alloc.base;
+    for (i = 0; i < (u32)b->proj_count; ++i) {
+        changed[i] = 0;
+        if (proj[i].project_file_path) {
+            u64 mtime = bore_file_mtime(bore_str(b, proj[i].project_file_path));
+            if (mtime != proj[i].mtime) {
+                proj[i].mtime = mtime;
+                changed[i] = 1;
+                ++changed_count;
+            }
+        }
+    }
+
+    if (changed_count == 0)
+        goto done;
+
+    // Drop the changed projects' references, they are added again when parsed
+    {
+        bore_proj_ref_t* refs = (bore_proj_ref_t*)b->proj_ref_alloc.base;
+        for (i = 0, n = 0; i < (u32)b->proj_ref_count; ++i)
+            if (!changed[refs[i].proj_index])
+                refs[n++] = refs[i];
+        bore_alloc_trim(&b->proj_ref_alloc, (b->proj_ref_count - n) * sizeof(bore_proj_ref_t));
+        b->proj_ref_count = n;
+    }
+
+    // Parse the changed projects, appending their files after the current
+    // (sorted and unique) file list. Projects are parsed in order, so the
+    // new files are grouped by project.
+    for (i = 0; i < (u32)b->proj_count; ++i) {
+        if (changed[i]) {
+            u32 begin = b->file_count;
+            bore_load_vcxproj_filters(b, i, bore_str(b, proj[i].project_file_path));
+            proj[i].file_begin = begin;
+            proj[i].file_end = b->file_count;
+        }
+    }
+    files = (bore_file_t*)b->file_alloc.base;
+    new_files = files + old_count;
+    new_count = b->file_count - old_count;
+
+    // Replace the changed projects' ranges in the per project file list
+    for (i = 0, n = 0; i < (u32)b->proj_count; ++i)
+        n += proj[i].file_end - proj[i].file_begin;
+    bore_prealloc(&file_proj_alloc, n * sizeof(bore_file_t) + 1);
+    proj_files = (bore_file_t*)b->file_proj_alloc.base;
+    for (i = 0, n = 0; i < (u32)b->proj_count; ++i) {
+        bore_file_t* src = changed[i] ? files : proj_files;
+        u32 count = proj[i].file_end - proj[i].file_begin;
+        bore_file_t* dst = (bore_file_t*)bore_alloc(&file_proj_alloc, count * sizeof(bore_file_t));
+        memcpy(dst, src + proj[i].file_begin, count * sizeof(bore_file_t));
+        proj[i].file_begin = n;
+        proj[i].file_end = n + count;
+        n += count;
+    }
+    bore_alloc_free(&b->file_proj_alloc);
+    b->file_proj_alloc = file_proj_alloc;
+    proj_files = (bore_file_t*)b->file_proj_alloc.base;
+
+    // Files owned by a changed project may still be part of an unchanged
+    // project. Collect them (still sorted), and look up the unchanged
+    // projects' files in that short list.
+    bore_prealloc(&removed_alloc, old_count * sizeof(bore_file_t) + 1);
+    removed = (bore_file_t*)removed_alloc.base;
+    for (i = 0; i < old_count; ++i)
+        if (changed[files[i].proj_index])
+            removed[removed_count++] = files[i];
+    if (removed_count) {
+        for (i = 0; i < (u32)b->proj_count; ++i) {
+            if (changed[i])
+                continue;
+            for (j = proj[i].file_begin; j < proj[i].file_end; ++j) {
+                if (bsearch_s(bore_str(b, proj_files[j].file), removed, removed_count,
+                            sizeof(bore_file_t), bore_find_filename, b)) {
+                    *(bore_file_t*)bore_alloc(&b->file_alloc, sizeof(bore_file_t)) = proj_files[j];
+                    ++new_count;
+                }
+            }
+        }
+        files = (bore_file_t*)b->file_alloc.base;
+        new_files = files + old_count;
+    }
+
+    qsort_s(new_files, new_count, sizeof(bore_file_t), bore_sort_filename, b);
+
+    // Merge the kept files with the new ones, carrying over the extension
+    // hashes of the kept files
+    bore_prealloc(&file_alloc, (old_count + new_count) * sizeof(bore_file_t) + 1);
+    bore_prealloc(&file_ext_alloc, (old_count + new_count) * sizeof(u32) + 1);
+    old_ext = (u32*)b->file_ext_alloc.base;
+    ext = (u32*)file_ext_alloc.base;
+    {
+        bore_file_t* dst = (bore_file_t*)file_alloc.base;
+        i = 0;
+        j = 0;
+        n = 0;
+        for (;;) {
+            int cmp;
+            while (i < old_count && changed[files[i].proj_index])
+                ++i;
+            if (i == old_count && j == new_count)
+                break;
+            if (i == old_count)
+                cmp = 1;
+            else if (j == new_count)
+                cmp = -1;
+            else
+                cmp = STRICMP(bore_str(b, files[i].file), bore_str(b, new_files[j].file));
+
+            if (cmp <= 0) {
+                if (cmp == 0)
+                    ++j;
+                dst[n] = files[i];
+                ext[n] = old_ext[i];
+                ++i;
+            }
+            else {
+                char* path = bore_str(b, new_files[j].file);
+                char* e = vim_strrchr(path, '.');
+                dst[n] = new_files[j];
+                ext[n] = bore_string_hash(e ? e + 1 : path + strlen(path));
+                ++j;
+            }
+
+            // new files are not unique, skip duplicates
+            while (j < new_count && 0 == STRICMP(bore_str(b, dst[n].file), bore_str(b, new_files[j].file)))
+                ++j;
+            ++n;
+        }
+        bore_alloc(&file_alloc, n * sizeof(bore_file_t));
+        bore_alloc(&file_ext_alloc, n * sizeof(u32));
+    }
+    bore_alloc_free(&b->file_alloc);
+    bore_alloc_free(&b->file_ext_alloc);
+    b->file_alloc = file_alloc;
+    b->file_ext_alloc = file_ext_alloc;
+    b->file_count = n;
+
+    bore_alloc_free(&b->toggle_index_alloc);
+    bore_build_toggle_index(b);
+    bore_write_filelist_to_tempfile(b);
+
+    bore_alloc_free(&removed_alloc);
+done:
+    bore_alloc_free(&changed_alloc);
+    return changed_count;
+}
+
 static void bore_print_sln(DWORD elapsed)
 {
     if (g_bore) {
@@ -708,6 +943,17 @@ static int bore_canonicalize(const char* src, char* dst, DWORD* attr)
     return OK;
 }
 
+static u64 bore_file_mtime(const char* path)
+{
+    WCHAR wbuf[BORE_MAX_PATH];
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wbuf, BORE_MAX_PATH) <= 0)
+        return 0;
+    if (!GetFileAttributesExW(wbuf, GetFileExInfoStandard, &data))
+        return 0;
+    return ((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
 static u32 bore_string_hash(const char *str)
 {
     return bore_string_hash_n(str, -1);
@@ -757,17 +1003,165 @@ static void bore_save_match_to_file(bore_t* b, FILE* cf, const bore_match_t* mat
     }
 }
 
-static int bore_find(bore_t* b, char* what, char* what_ext)
+typedef struct bore_find_options_t {
+    char* what;
+    char* ext;      // -e ext1,ext2,...
+    char* proj;     // -p project
+    char* dir;      // -d directory
+    int buffers;    // -b
+} bore_find_options_t;
+
+static bore_proj_t* bore_find_project_by_name(bore_t* b, const char* name)
+{
+    bore_proj_t* projects = (bore_proj_t*)b->proj_alloc.base;
+    int i;
+    for (i = 0; i < b->proj_count; ++i) {
+        if (0 == STRICMP(name, bore_str(b, projects[i].project_sln_name)))
+            return &projects[i];
+    }
+    return NULL;
+}
+
+// Find the range of files in file_alloc whose path start with prefix.
+// file_alloc is sorted case insensitively, so the range is contiguous.
+static void bore_file_prefix_range(bore_t* b, const char* prefix, u32* begin, u32* end)
 {
-    enum { MaxMatch = 1000 };
     bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    int len = strlen(prefix);
+    u32 lo = 0, hi = b->file_count;
+
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (STRNICMP(bore_str(b, files[mid].file), prefix, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *begin = lo;
+
+    hi = b->file_count;
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (STRNICMP(bore_str(b, files[mid].file), prefix, len) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *end = lo;
+}
+
+static int bore_sort_u32(const void* vx, const void* vy)
+{
+    u32 x = *(const u32*)vx;
+    u32 y = *(const u32*)vy;
+    return x < y ? -1 : x > y;
+}
+
+// Map the project's range of file_proj_alloc to a sorted list of unique
+// indices into file_alloc. Returns the number of indices.
+static u32 bore_project_file_index(bore_t* b, bore_proj_t* proj, bore_alloc_t* index_alloc)
+{
+    bore_file_t* proj_files = (bore_file_t*)b->file_proj_alloc.base;
+    u32* index;
+    u32 i, n = 0;
+
+    bore_prealloc(index_alloc, (proj->file_end - proj->file_begin + 1) * sizeof(u32));
+    index = (u32*)index_alloc->base;
+    for (i = proj->file_begin; i < proj->file_end; ++i) {
+        bore_file_t* file = (bore_file_t*)bsearch_s(
+            bore_str(b, proj_files[i].file),
+            b->file_alloc.base,
+            b->file_count,
+            sizeof(bore_file_t),
+            bore_find_filename,
+            b);
+        if (file)
+            index[n++] = file - (bore_file_t*)b->file_alloc.base;
+    }
+
+    qsort(index, n, sizeof(u32), bore_sort_u32);
+    if (n > 1) {
+        u32 j;
+        for (i = 1, j = 1; i < n; ++i)
+            if (index[i] != index[j - 1])
+                index[j++] = index[i];
+        n = j;
+    }
+    return n;
+}
+
+static int bore_search_ext_match(const bore_search_t* search, u32 ext_hash)
+{
+    int i;
+    if (search->ext_count == 0)
+        return 1;
+    for (i = 0; i < search->ext_count; ++i)
+        if (ext_hash == search->ext[i])
+            return 1;
+    return 0;
+}
+
+// Search the text of all loaded buffers, including unsaved changes.
+// Writes the matches directly to the quickfix file cf.
+static int bore_find_buffers(bore_t* b, FILE* cf, const bore_search_t* search, int match_size, int* truncated)
+{
+    char *slndir = bore_str(b, b->sln_dir);
+    int slndirlen = strlen(slndir);
+    int found = 0;
+    buf_T* buf;
+
+    for (buf = firstbuf; buf != NULL && found < match_size; buf = buf->b_next) {
+        char* fn = (char*)buf->b_ffname;
+        char* ext;
+        linenr_T lnum;
+        int hits = 0;
+
+        if (buf->b_ml.ml_mfp == NULL || fn == NULL || buf->b_help || buf->b_borebuf)
+            continue;
+
+        ext = vim_strrchr(gettail(fn), '.');
+        if (!bore_search_ext_match(search, bore_string_hash(ext ? ext + 1 : "")))
+            continue;
+
+        if (STRNICMP(fn, slndir, slndirlen) == 0)
+            fn += slndirlen;
+
+        for (lnum = 1; lnum <= buf->b_ml.ml_line_count; ++lnum) {
+            char* line = (char*)ml_get_buf(buf, lnum, FALSE);
+            char* p = line;
+            while (NULL != (p = strstr(p, search->what))) {
+                if (hits == BORE_MAXMATCHPERFILE) {
+                    *truncated = 1;
+                    break;
+                }
+                if (found == match_size) {
+                    *truncated = 2;
+                    break;
+                }
+                fprintf(cf, "%s:%ld:%d:%s\n", fn, (long)lnum, (int)(p - line) + 1, line);
+                ++hits;
+                ++found;
+                p += search->what_len;
+            }
+            if (p)
+                break;
+        }
+    }
+
+    return found;
+}
+
+static int bore_find(bore_t* b, bore_find_options_t* opt)
+{
+    enum { MaxMatch = 1000 };
     int found = 0;
     char_u *tmp = vim_tempname('f');
     FILE* cf = 0;
     bore_match_t* match = 0;
+    bore_alloc_t index_alloc;
     int truncated = 0;
 
-    match = (bore_match_t*)alloc(MaxMatch * sizeof(bore_match_t));
+    memset(&index_alloc, 0, sizeof(index_alloc));
 
     int threadCount = 4;
     const char_u* threadCountStr = get_var_value((char_u *)"g:bore_search_thread_count");
@@ -777,15 +1171,18 @@ static int bore_find(bore_t* b, char* what, char* what_ext)
     }
 
     bore_search_t search;
-    search.what = what;
-    search.what_len = strlen(what);
+    search.what = opt->what;
+    search.what_len = strlen(opt->what);
     search.ext_count = 0;
+    search.file_index = NULL;
+    search.file_begin = 0;
+    search.file_end = b->file_count;
 
     // parse comma separated list of file extensions into list of hashes
-    if (what_ext)
+    if (opt->ext)
     {
         int len = 0;
-        char* ext = what_ext;
+        char* ext = opt->ext;
         char* c;
         for (c = ext; search.ext_count < BORE_MAX_SEARCH_EXTENSIONS; ++c)
         {
@@ -805,24 +1202,60 @@ static int bore_find(bore_t* b, char* what, char* what_ext)
         }
     }
 
-    found = bore_dofind(b, threadCount, &truncated, match, MaxMatch, &search);
-    if (0 == found)
-        goto fail;
+    // narrow the search to a range of files
+    if (opt->proj)
+    {
+        bore_proj_t* proj = bore_find_project_by_name(b, opt->proj);
+        if (NULL == proj) {
+            EMSG2(_("borefind: Failed to lookup project %s"), opt->proj);
+            goto fail;
+        }
+        search.file_end = bore_project_file_index(b, proj, &index_alloc);
+        search.file_index = (u32*)index_alloc.base;
+    }
+    else if (opt->dir)
+    {
+        char dir[BORE_MAX_PATH];
+        int len;
+        if (FAIL == bore_canonicalize(opt->dir, dir, 0)) {
+            EMSG2(_("borefind: Failed to lookup directory %s"), opt->dir);
+            goto fail;
+        }
+        len = strlen(dir);
+        if (len > 0 && dir[len - 1] != '\\' && len < BORE_MAX_PATH - 1) {
+            dir[len] = '\\';
+            dir[len + 1] = 0;
+        }
+        bore_file_prefix_range(b, dir, &search.file_begin, &search.file_end);
+    }
 
     cf = mch_fopen((char *)tmp, "wb");
     if (cf == NULL) {
         EMSG2(_(e_notopen), tmp);
         goto fail;
     }
-    bore_save_match_to_file(b, cf, match, found);
+
+    if (opt->buffers)
+    {
+        found = bore_find_buffers(b, cf, &search, MaxMatch, &truncated);
+    }
+    else
+    {
+        match = (bore_match_t*)alloc(MaxMatch * sizeof(bore_match_t));
+        found = bore_dofind(b, threadCount, &truncated, match, MaxMatch, &search);
+        bore_save_match_to_file(b, cf, match, found);
+    }
 
     fclose(cf);
+    cf = 0;
 
-    bore_display_search_result(b, tmp, what, truncated ? -found : found);
+    if (found)
+        bore_display_search_result(b, tmp, opt->what, truncated ? -found : found);
     mch_remove(tmp);
 fail:
     vim_free(tmp);
     vim_free(match);
+    bore_alloc_free(&index_alloc);
     if (cf) fclose(cf);
     return truncated ? -found : found;
 }
@@ -940,20 +1373,60 @@ erret:
     EMSG(_("Could not open borebuf"));
 }
 
+// Add lines of output to the quickfix list. text must have one byte of room
+// before it and two after it.
+static void bore_async_add_output(char* text, int len)
+{
+    // format as string expression
+    char* buffer = text - 1;
+    buffer[0] = '\'';
+    buffer[len + 1] = '\'';
+    buffer[len + 2] = '\0';
+
+    // TODO-pkack: Is there a way to make cgetexpr/caddexpr handle output the same way as cgetfile/caddfile
+    // quick and dirty replace of ' with " instead of escaping correctly
+    char* c = text;
+    char* end = c + len;
+    for (; c != end; ++c)
+        if (*c == '\'')
+            *c = '\"';
+
+    // add output as error expressions
+    char* title = (char*)alloc(100);
+    vim_snprintf(title, 100, "borebuild");
+    exarg_T eap;
+    memset(&eap, 0, sizeof(eap));
+    eap.cmdidx = g_bore_async_execute_context.output_count == 0 ? CMD_cgetexpr : CMD_caddexpr;
+    eap.cmdlinep = &title;
+    eap.arg = buffer;
+    ex_cexpr(&eap);
+    vim_free(title);
+
+    if (g_bore_async_execute_context.output_count++ == 0) {
+        memset(&eap, 0, sizeof(eap));
+        eap.cmdidx = CMD_cwindow;
+        ex_copen(&eap);
+    }
+}
+
 void bore_async_execute_update(DWORD flags)
 {
-    DWORD first = 0x80000000 & flags;
     DWORD completed = 0x40000000 & flags;
     DWORD bytes_read = 0;
     DWORD bytes_avail = 0;
-    int errors = 0;
     char buffer[4096];
+    char* text = &buffer[1];
+    const int text_size = sizeof(buffer) - 3;
+    int added = 0;
 
     BORE_VIMPROFILE_INIT;
     BORE_VIMPROFILE_START;
 
     for (;;)
     {
+        int line_len = g_bore_async_execute_context.line_len;
+        int len;
+
         BOOL result = PeekNamedPipe(
             g_bore_async_execute_context.result_handle, 
             NULL,
@@ -973,10 +1446,14 @@ void bore_async_execute_update(DWORD flags)
             break;
         }
 
+        // continue the incomplete last line of the previous read
+        memcpy(text, g_bore_async_execute_context.line, line_len);
+        g_bore_async_execute_context.line_len = 0;
+
         result = ReadFile(
             g_bore_async_execute_context.result_handle,
-            &buffer[1],
-            sizeof(buffer) - 3,
+            text + line_len,
+            text_size - line_len,
             &bytes_read,
             NULL);
 
@@ -989,43 +1466,37 @@ void bore_async_execute_update(DWORD flags)
             goto done;
         }
 
-        // TODO-pkack: Handle partial read lines and bytes_avail > 4093 correctly
-        // format as string expression
-        buffer[0] = '\'';
-        buffer[bytes_read + 1] = '\'';
-        buffer[bytes_read + 2] = '\0';
-
-        // TODO-pkack: Is there a way to make cgetexpr/caddexpr handle output the same way as cgetfile/caddfile
-        // quick and dirty replace of ' with " instead of escaping correctly
-        char* c = buffer + 1;
-        char* end = c + bytes_read;
-        for (; c != end; ++c)
-            if (*c == '\'')
-                *c = '\"';
-
-        // add output as error expressions
-        char* title = (char*)alloc(100);
-        vim_snprintf(title, 100, "borebuild");
-        exarg_T eap;
-        memset(&eap, 0, sizeof(eap));
-        eap.cmdidx = (first && !errors) ? CMD_cgetexpr : CMD_caddexpr;
-        eap.cmdlinep = &title;
-        eap.arg = buffer;
-        ex_cexpr(&eap);
-        vim_free(title);
+        // Only add complete lines, so that a diagnostic split between two
+        // reads is not added as two broken entries. Keep the rest for the
+        // next read, unless the line fills the whole buffer.
+        len = line_len + bytes_read;
+        if (len < text_size) {
+            int end = len;
+            while (end > 0 && text[end - 1] != '\n')
+                --end;
+            memcpy(g_bore_async_execute_context.line, text + end, len - end);
+            g_bore_async_execute_context.line_len = len - end;
+            len = end;
+        }
+
+        if (len > 0) {
+            bore_async_add_output(text, len);
+            ++added;
+        }
 
-        ++errors;
         if (bytes_read == bytes_avail)
             break;
     }
 
-    if (first && errors) {
-        exarg_T eap;
-        memset(&eap, 0, sizeof(eap));
-        eap.cmdidx = CMD_cwindow;
-        ex_copen(&eap);
+    if (completed && g_bore_async_execute_context.line_len > 0) {
+        memcpy(text, g_bore_async_execute_context.line, g_bore_async_execute_context.line_len);
+        bore_async_add_output(text, g_bore_async_execute_context.line_len);
+        g_bore_async_execute_context.line_len = 0;
+        ++added;
     }
-    update_screen(VALID);
+
+    if (added)
+        update_screen(VALID);
     
 done:
     if (completed) {
@@ -1037,7 +1508,7 @@ done:
         g_bore_async_execute_context.spawned_process.hThread = INVALID_HANDLE_VALUE;
         g_bore_async_execute_context.spawned_process.hProcess = INVALID_HANDLE_VALUE;
         g_bore_async_execute_context.result_handle = INVALID_HANDLE_VALUE;
-        if (first && !errors)
+        if (g_bore_async_execute_context.output_count == 0)
             MSG(_("Build success"));
         else
             MSG(_("Build done"));
@@ -1055,7 +1526,7 @@ static DWORD WINAPI bore_async_execute_wait_thread(LPVOID param)
     DWORD completed = 0;
 
     do {
-        result = WaitForSingleObject(g_bore_async_execute_context.spawned_process.hProcess, 1000);
+        result = WaitForSingleObject(g_bore_async_execute_context.spawned_process.hProcess, 100);
 
         if (result == WAIT_TIMEOUT)
         {
@@ -1099,6 +1570,9 @@ static void bore_async_execute(const char* cmdline)
     eap.cmdidx = CMD_cwindow;
     ex_cclose(&eap);
 
+    g_bore_async_execute_context.output_count = 0;
+    g_bore_async_execute_context.line_len = 0;
+
     HANDLE output_handle;
     HANDLE error_handle;
 
@@ -1143,7 +1617,7 @@ static void bore_async_execute(const char* cmdline)
     }
 
     STARTUPINFO startup_info = {0};
-    char cmd[1024];
+    char cmd[BORE_MAX_CMDLINE];
 
     startup_info.cb = sizeof(startup_info);
     startup_info.dwFlags = STARTF_USESTDHANDLES;
@@ -1212,6 +1686,595 @@ fail:
 }
 
 
+static bore_compdb_t* g_bore_compdb = 0;
+
+static void bore_compdb_free(bore_compdb_t* db)
+{
+    if (!db) return;
+    bore_alloc_free(&db->entry_alloc);
+    bore_alloc_free(&db->data_alloc);
+    vim_free(db);
+}
+
+static char* bore_compdb_str(bore_compdb_t* db, u32 offset)
+{
+    return (char*)(db->data_alloc.base + offset);
+}
+
+static const char* bore_json_skip_ws(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        ++p;
+    return p;
+}
+
+// Decode the JSON string at p (pointing at the opening quote) and append it
+// to out, without a terminating NUL. Returns the position after the closing
+// quote, or NULL on error.
+static const char* bore_json_string(const char* p, const char* end, bore_alloc_t* out)
+{
+    if (p >= end || *p != '"')
+        return NULL;
+    for (++p; p < end && *p != '"'; ++p) {
+        char c = *p;
+        if (c == '\\') {
+            if (++p == end)
+                return NULL;
+            switch (*p) {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    char_u utf8[MB_MAXBYTES + 1];
+                    int n, code = 0;
+                    for (n = 0; n < 4; ++n) {
+                        if (++p == end || !vim_isxdigit(*p))
+                            return NULL;
+                        code = code * 16 + hex2nr(*p);
+                    }
+                    n = utf_char2bytes(code, utf8);
+                    memcpy(bore_alloc(out, n), utf8, n);
+                    continue;
+                }
+                default: c = *p; break; // \" \\ \/
+            }
+        }
+        *(char*)bore_alloc(out, 1) = c;
+    }
+    return p < end ? p + 1 : NULL;
+}
+
+// Skip any JSON value. Returns the position after it, or NULL on error.
+static const char* bore_json_skip_value(const char* p, const char* end)
+{
+    int depth = 0;
+    do {
+        p = bore_json_skip_ws(p, end);
+        if (p >= end)
+            return NULL;
+        if (*p == '"') {
+            for (++p; p < end && *p != '"'; ++p)
+                if (*p == '\\')
+                    ++p;
+            if (p >= end)
+                return NULL;
+            ++p;
+        }
+        else if (*p == '[' || *p == '{') {
+            ++depth;
+            ++p;
+        }
+        else if (*p == ']' || *p == '}') {
+            --depth;
+            ++p;
+        }
+        else {
+            // number, literal, or the separators inside an array or object
+            ++p;
+        }
+    } while (depth > 0);
+    return p;
+}
+
+// Append a command line argument, quoted if needed
+static void bore_compdb_append_arg(bore_alloc_t* out, const char* arg, int len)
+{
+    int quote = (len == 0);
+    int i;
+    for (i = 0; i < len; ++i)
+        if (arg[i] == ' ' || arg[i] == '\t' || arg[i] == '"')
+            quote = 1;
+    if (quote)
+        *(char*)bore_alloc(out, 1) = '"';
+    for (i = 0; i < len; ++i) {
+        if (arg[i] == '"')
+            *(char*)bore_alloc(out, 1) = '\\';
+        *(char*)bore_alloc(out, 1) = arg[i];
+    }
+    if (quote)
+        *(char*)bore_alloc(out, 1) = '"';
+}
+
+static int bore_compdb_sort_file(void* ctx, const void* vx, const void* vy)
+{
+    bore_compdb_t* db = (bore_compdb_t*)ctx;
+    const bore_compdb_entry_t* x = (const bore_compdb_entry_t*)vx;
+    const bore_compdb_entry_t* y = (const bore_compdb_entry_t*)vy;
+    return STRICMP(bore_compdb_str(db, x->file), bore_compdb_str(db, y->file));
+}
+
+static int bore_compdb_find_file(void* ctx, const void* vx, const void* vy)
+{
+    bore_compdb_t* db = (bore_compdb_t*)ctx;
+    const bore_compdb_entry_t* y = (const bore_compdb_entry_t*)vy;
+    return STRICMP((const char*)vx, bore_compdb_str(db, y->file));
+}
+
+// Parse compile_commands.json: an array of objects with "directory", "file"
+// and either "command" or "arguments".
+static bore_compdb_t* bore_compdb_load(const char* path)
+{
+    bore_compdb_t* db = (bore_compdb_t*)alloc(sizeof(bore_compdb_t));
+    bore_alloc_t text_alloc;
+    bore_alloc_t tmp_alloc;
+    bore_compdb_entry_t* entries;
+    const char* p;
+    const char* end;
+    FILE* f;
+    long size;
+    int i;
+
+    memset(db, 0, sizeof(bore_compdb_t));
+    memset(&text_alloc, 0, sizeof(text_alloc));
+    vim_strncpy(db->path, (char*)path, BORE_MAX_PATH - 1);
+    db->mtime = bore_file_mtime(path);
+
+    f = mch_fopen(path, "rb");
+    if (!f)
+        goto fail;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bore_prealloc(&text_alloc, size + 1);
+    if (size > 0 && fread(text_alloc.base, 1, size, f) != (size_t)size) {
+        fclose(f);
+        goto fail;
+    }
+    fclose(f);
+
+    bore_prealloc(&db->data_alloc, size + 1024);
+    bore_prealloc(&db->entry_alloc, 1024 * sizeof(bore_compdb_entry_t));
+    bore_prealloc(&tmp_alloc, 4096);
+    bore_alloc(&db->data_alloc, 1); // offset 0 is NULL
+
+    p = bore_json_skip_ws((char*)text_alloc.base, (char*)text_alloc.base + size);
+    end = (char*)text_alloc.base + size;
+    if (p >= end || *p++ != '[')
+        goto fail;
+
+    for (;;) {
+        bore_compdb_entry_t entry = {0};
+        u32 file = 0;
+
+        p = bore_json_skip_ws(p, end);
+        if (p < end && *p == ',')
+            p = bore_json_skip_ws(p + 1, end);
+        if (p < end && *p == ']')
+            break;
+        if (p >= end || *p++ != '{')
+            goto fail;
+
+        for (;;) {
+            char* key;
+            bore_alloc_t* value_alloc = &db->data_alloc;
+            u32 value;
+
+            p = bore_json_skip_ws(p, end);
+            if (p < end && *p == ',')
+                p = bore_json_skip_ws(p + 1, end);
+            if (p < end && *p == '}') {
+                ++p;
+                break;
+            }
+
+            tmp_alloc.cursor = tmp_alloc.base;
+            p = bore_json_string(p, end, &tmp_alloc);
+            if (!p)
+                goto fail;
+            *(char*)bore_alloc(&tmp_alloc, 1) = 0;
+            key = (char*)tmp_alloc.base;
+            p = bore_json_skip_ws(p, end);
+            if (p >= end || *p++ != ':')
+                goto fail;
+            p = bore_json_skip_ws(p, end);
+
+            value = db->data_alloc.cursor - db->data_alloc.base;
+            if (p < end && *p == '"'
+                    && (0 == STRCMP(key, "directory") || 0 == STRCMP(key, "file") || 0 == STRCMP(key, "command"))) {
+                p = bore_json_string(p, end, value_alloc);
+                if (!p)
+                    goto fail;
+                *(char*)bore_alloc(value_alloc, 1) = 0;
+                if (key[0] == 'd')
+                    entry.directory = value;
+                else if (key[0] == 'f')
+                    file = value;
+                else if (!entry.command)
+                    entry.command = value;
+            }
+            else if (p < end && *p == '[' && 0 == STRCMP(key, "arguments")) {
+                // join the arguments to a command line
+                int first = 1;
+                for (++p;;) {
+                    u8* arg;
+                    p = bore_json_skip_ws(p, end);
+                    if (p < end && *p == ',')
+                        p = bore_json_skip_ws(p + 1, end);
+                    if (p < end && *p == ']') {
+                        ++p;
+                        break;
+                    }
+                    tmp_alloc.cursor = tmp_alloc.base;
+                    p = bore_json_string(p, end, &tmp_alloc);
+                    if (!p)
+                        goto fail;
+                    arg = tmp_alloc.base;
+                    if (!first)
+                        *(char*)bore_alloc(&db->data_alloc, 1) = ' ';
+                    bore_compdb_append_arg(&db->data_alloc, (char*)arg, tmp_alloc.cursor - arg);
+                    first = 0;
+                }
+                *(char*)bore_alloc(&db->data_alloc, 1) = 0;
+                entry.command = value;
+            }
+            else {
+                p = bore_json_skip_value(p, end);
+                if (!p)
+                    goto fail;
+            }
+        }
+
+        if (file && entry.command) {
+            char buf[BORE_MAX_PATH];
+            char canonical[BORE_MAX_PATH];
+            char* fn = bore_compdb_str(db, file);
+            // file is relative to directory unless absolute
+            if (entry.directory && !mch_isFullName((char_u*)fn))
+                vim_snprintf(buf, BORE_MAX_PATH, "%s\\%s", bore_compdb_str(db, entry.directory), fn);
+            else
+                vim_strncpy(buf, fn, BORE_MAX_PATH - 1);
+            if (FAIL != bore_canonicalize(buf, canonical, 0)) {
+                int len = strlen(canonical);
+                char* dst = (char*)bore_alloc(&db->data_alloc, len + 1);
+                memcpy(dst, canonical, len + 1);
+                entry.file = dst - (char*)db->data_alloc.base;
+                *(bore_compdb_entry_t*)bore_alloc(&db->entry_alloc, sizeof(bore_compdb_entry_t)) = entry;
+                ++db->entry_count;
+            }
+        }
+    }
+
+    entries = (bore_compdb_entry_t*)db->entry_alloc.base;
+    qsort_s(entries, db->entry_count, sizeof(bore_compdb_entry_t), bore_compdb_sort_file, db);
+
+    bore_alloc_free(&tmp_alloc);
+    bore_alloc_free(&text_alloc);
+    return db;
+
+fail:
+    EMSG2(_("Could not parse compile commands %s"), path);
+    bore_alloc_free(&tmp_alloc);
+    bore_alloc_free(&text_alloc);
+    bore_compdb_free(db);
+    return NULL;
+}
+
+// The compile_commands.json to use: g:bore_compile_commands, or the one in
+// the solution directory.
+static int bore_compdb_path(char* path)
+{
+    const char_u* var = get_var_value((char_u *)"g:bore_compile_commands");
+    char buf[BORE_MAX_PATH];
+    DWORD attr;
+
+    if (var && *var)
+        vim_strncpy(buf, (char*)var, BORE_MAX_PATH - 1);
+    else if (g_bore)
+        vim_snprintf(buf, BORE_MAX_PATH, "%scompile_commands.json", bore_str(g_bore, g_bore->sln_dir));
+    else
+        return FAIL;
+
+    if (FAIL == bore_canonicalize(buf, path, &attr) || (FILE_ATTRIBUTE_DIRECTORY & attr))
+        return FAIL;
+    return OK;
+}
+
+// Compile a single file with its command from compile_commands.json.
+// Returns FALSE if there is no compile_commands.json to use.
+static int bore_build_file_compdb(exarg_T* eap)
+{
+    char path[BORE_MAX_PATH];
+    char src[BORE_MAX_PATH];
+    char cmd[BORE_MAX_CMDLINE];
+    char* fn = (NULL != eap->arg && '\0' != eap->arg[0]) ? (char*)eap->arg : (char*)curbuf->b_ffname;
+    bore_compdb_entry_t* entry;
+    char* command;
+    const char* syntax_only = "";
+
+    if (FAIL == bore_compdb_path(path))
+        return FALSE;
+
+    if (!g_bore_compdb || 0 != STRICMP(g_bore_compdb->path, path)
+            || g_bore_compdb->mtime != bore_file_mtime(path)) {
+        bore_compdb_free(g_bore_compdb);
+        g_bore_compdb = bore_compdb_load(path);
+        if (!g_bore_compdb)
+            return TRUE;
+    }
+
+    if (NULL == fn || FAIL == bore_canonicalize(fn, src, 0)) {
+        EMSG(_("borebuildfile: No file specified, and no current buffer"));
+        return TRUE;
+    }
+
+    entry = (bore_compdb_entry_t*)bsearch_s(
+        src,
+        g_bore_compdb->entry_alloc.base,
+        g_bore_compdb->entry_count,
+        sizeof(bore_compdb_entry_t),
+        bore_compdb_find_file,
+        g_bore_compdb);
+    if (NULL == entry) {
+        EMSG2(_("borebuildfile: %s is not in the compile commands"), src);
+        return TRUE;
+    }
+
+    command = bore_compdb_str(g_bore_compdb, entry->command);
+    if (eap->forceit) {
+        // check syntax only, with the flag of the compiler's flavor
+        char* exe_end = command;
+        char* exe;
+        while (*exe_end && *exe_end != ' ')
+            ++exe_end;
+        exe = exe_end;
+        while (exe > command && exe[-1] != '\\' && exe[-1] != '/' && exe[-1] != '"')
+            --exe;
+        syntax_only = (0 == STRNICMP(exe, "cl", 2) && (exe + 2 == exe_end || exe[2] == '.' || exe[2] == '"'))
+            || 0 == STRNICMP(exe, "clang-cl", 8) ? " /Zs" : " -fsyntax-only";
+    }
+
+    if (entry->directory)
+        vim_snprintf(cmd, BORE_MAX_CMDLINE, "cd /d \"%s\" && %s%s",
+                bore_compdb_str(g_bore_compdb, entry->directory), command, syntax_only);
+    else
+        vim_snprintf(cmd, BORE_MAX_CMDLINE, "%s%s", command, syntax_only);
+
+    if (g_bore)
+        g_bore->build_time = (u64)time(NULL);
+    bore_async_execute(cmd);
+    vim_snprintf(cmd, BORE_MAX_CMDLINE, "borebuildfile%s: %s", eap->forceit ? "!" : "", src);
+    MSG(_(cmd));
+    return TRUE;
+}
+
+static const char* bore_msbuild(void)
+{
+    const char_u* msbuild = get_var_value((char_u *)"g:bore_msbuild");
+    return (msbuild && *msbuild) ? (const char*)msbuild : "msbuild.exe";
+}
+
+// Mark the projects containing a file that changed since the last build,
+// i.e. buffers with unsaved changes or written after the last build.
+// A file can be part of several projects.
+static int bore_mark_changed_projects(bore_t* b, u8* affected)
+{
+    bore_proj_t* proj = (bore_proj_t*)b->proj_alloc.base;
+    bore_file_t* proj_files = (bore_file_t*)b->file_proj_alloc.base;
+    buf_T* buf;
+    int count = 0;
+    u32 i, j;
+
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next) {
+        char path[BORE_MAX_PATH];
+
+        if (buf->b_ffname == NULL || buf->b_help || buf->b_borebuf)
+            continue;
+        if (!bufIsChanged(buf) && (u64)buf->b_mtime < b->build_time)
+            continue;
+        if (FAIL == bore_canonicalize(buf->b_ffname, path, 0))
+            continue;
+
+        for (i = 0; i < (u32)b->proj_count; ++i) {
+            if (affected[i])
+                continue;
+            for (j = proj[i].file_begin; j < proj[i].file_end; ++j) {
+                if (0 == STRICMP(path, bore_str(b, proj_files[j].file))) {
+                    affected[i] = 1;
+                    ++count;
+                    break;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Extend the affected projects with every project that depends on them, and
+// sort them into waves. A project only references projects of earlier waves
+// (or unaffected projects), so the projects of a wave can be built in
+// parallel. order receives the affected projects sorted by wave, and wave the
+// wave of each project. Returns the number of waves, or -1 if the project
+// references have a cycle.
+static int bore_plan_build(bore_t* b, u8* affected, u32* order, int* order_count, u32* wave)
+{
+    bore_proj_ref_t* refs = (bore_proj_ref_t*)b->proj_ref_alloc.base;
+    u32 proj_count = (u32)b->proj_count;
+    u32 ref_count = (u32)b->proj_ref_count;
+    bore_alloc_t tmp;
+    u32* dep_begin;     // dependents of project i are deps[dep_begin[i]..dep_begin[i+1])
+    u32* deps;
+    u32* pending;       // number of affected projects a project still waits for
+    u32* queue;
+    u32 head = 0, tail = 0;
+    u32 i, j, n;
+    int waves = 0;
+
+    bore_prealloc(&tmp, (3 * proj_count + 1 + ref_count) * sizeof(u32));
+    dep_begin = (u32*)tmp.base;
+    pending = dep_begin + proj_count + 1;
+    queue = pending + proj_count;
+    deps = queue + proj_count;
+
+    // reverse the references
+    memset(dep_begin, 0, (proj_count + 1) * sizeof(u32));
+    for (i = 0; i < ref_count; ++i)
+        ++dep_begin[refs[i].ref_proj_index + 1];
+    for (i = 0; i < proj_count; ++i)
+        dep_begin[i + 1] += dep_begin[i];
+    for (i = 0; i < ref_count; ++i)
+        deps[dep_begin[refs[i].ref_proj_index]++] = refs[i].proj_index;
+    for (i = proj_count; i > 0; --i)
+        dep_begin[i] = dep_begin[i - 1];
+    dep_begin[0] = 0;
+
+    // everything that depends on an affected project is affected too
+    for (i = 0; i < proj_count; ++i)
+        if (affected[i])
+            queue[tail++] = i;
+    while (head < tail) {
+        u32 p = queue[head++];
+        for (j = dep_begin[p]; j < dep_begin[p + 1]; ++j) {
+            if (!affected[deps[j]]) {
+                affected[deps[j]] = 1;
+                queue[tail++] = deps[j];
+            }
+        }
+    }
+
+    // topological sort of the affected projects, each wave one more than the
+    // latest wave of the projects it references
+    memset(pending, 0, proj_count * sizeof(u32));
+    for (i = 0; i < proj_count; ++i) {
+        wave[i] = 0;
+        if (affected[i])
+            for (j = dep_begin[i]; j < dep_begin[i + 1]; ++j)
+                ++pending[deps[j]];
+    }
+    head = tail = 0;
+    for (i = 0; i < proj_count; ++i)
+        if (affected[i] && pending[i] == 0)
+            queue[tail++] = i;
+    while (head < tail) {
+        u32 p = queue[head++];
+        if ((int)wave[p] >= waves)
+            waves = wave[p] + 1;
+        for (j = dep_begin[p]; j < dep_begin[p + 1]; ++j) {
+            u32 d = deps[j];
+            if (wave[d] < wave[p] + 1)
+                wave[d] = wave[p] + 1;
+            if (--pending[d] == 0)
+                queue[tail++] = d;
+        }
+    }
+
+    for (i = 0, n = 0; i < proj_count; ++i)
+        n += affected[i];
+    if (tail != n) {
+        bore_alloc_free(&tmp);
+        return -1;
+    }
+
+    // stable bucket by wave
+    n = 0;
+    for (j = 0; j < (u32)waves; ++j)
+        for (i = 0; i < tail; ++i)
+            if (wave[queue[i]] == j)
+                order[n++] = queue[i];
+    *order_count = n;
+
+    bore_alloc_free(&tmp);
+    return waves;
+}
+
+// Build only the projects affected by the changed files, wave by wave, with
+// the projects of each wave built in parallel by one msbuild invocation.
+static void bore_build_modified(bore_t* b, const char* platform, const char* configuration)
+{
+    bore_proj_t* proj = (bore_proj_t*)b->proj_alloc.base;
+    char* slndir = bore_str(b, b->sln_dir);
+    char* sln_file = bore_str(b, b->sln_path) + strlen(slndir);
+    bore_alloc_t plan;
+    u8* affected;
+    u32* order;
+    u32* wave;
+    int order_count = 0;
+    int waves;
+    char* cmd = NULL;
+    char* mess = NULL;
+    int len = 0, mess_len = 0;
+    int i;
+
+    bore_prealloc(&plan, b->proj_count * (1 + 2 * sizeof(u32)) + 1);
+    order = (u32*)plan.base;
+    wave = order + b->proj_count;
+    affected = (u8*)(wave + b->proj_count);
+    memset(affected, 0, b->proj_count);
+
+    if (0 == bore_mark_changed_projects(b, affected)) {
+        MSG(_("borebuildmodified: No changed files in the solution"));
+        goto done;
+    }
+
+    waves = bore_plan_build(b, affected, order, &order_count, wave);
+    if (waves < 0) {
+        EMSG(_("borebuildmodified: Cyclic project references"));
+        goto done;
+    }
+
+    cmd = (char*)alloc(BORE_MAX_CMDLINE);
+    mess = (char*)alloc(BORE_MAX_CMDLINE);
+    mess_len = vim_snprintf(mess, BORE_MAX_CMDLINE, "borebuildmodified: %d projects in %d waves:",
+            order_count, waves);
+    for (i = 0; i < order_count; ++i) {
+        const char* target = bore_str(b, proj[order[i]].project_sln_name);
+        int first = (i == 0 || wave[order[i]] != wave[order[i - 1]]);
+        int last = (i + 1 == order_count || wave[order[i]] != wave[order[i + 1]]);
+
+        if (first) {
+            len += vim_snprintf(cmd + len, BORE_MAX_CMDLINE - len, "%s%s %s /t:",
+                    i ? " && " : "", bore_msbuild(), sln_file);
+            if (i && mess_len < BORE_MAX_CMDLINE)
+                mess_len += vim_snprintf(mess + mess_len, BORE_MAX_CMDLINE - mess_len, " |");
+        }
+        if (len < BORE_MAX_CMDLINE)
+            len += vim_snprintf(cmd + len, BORE_MAX_CMDLINE - len, "%s%s", first ? "" : ";", target);
+        if (mess_len < BORE_MAX_CMDLINE)
+            mess_len += vim_snprintf(mess + mess_len, BORE_MAX_CMDLINE - mess_len, " %s", target);
+        if (last && len < BORE_MAX_CMDLINE)
+            len += vim_snprintf(cmd + len, BORE_MAX_CMDLINE - len,
+                " /p:Platform=%s /p:Configuration=%s " \
+                "/v:q /nologo " \
+                "/p:BuildProjectReferences=false " \
+                "/m:%d /p:MultiProcessorCompilation=true;CL_MPCount=%d",
+                platform, configuration, b->ini.cpu_cores, b->ini.cpu_cores);
+        if (len >= BORE_MAX_CMDLINE - 1) {
+            EMSG(_("borebuildmodified: Command line is too long"));
+            goto done;
+        }
+    }
+
+    b->build_time = (u64)time(NULL);
+    bore_async_execute(cmd);
+    MSG(_(mess));
+
+done:
+    vim_free(cmd);
+    vim_free(mess);
+    bore_alloc_free(&plan);
+}
+
 #endif
 
 /* Only do the following when the feature is enabled.  Needed for "make
@@ -1220,6 +2283,29 @@ fail:
 
 void ex_boresln __ARGS((exarg_T *eap))
 {
+    if (eap->forceit && g_bore) {
+        // reload the changed projects of the loaded solution
+        char path[BORE_MAX_PATH];
+        if (*eap->arg == NUL
+                || (FAIL != bore_canonicalize((char*)eap->arg, path, 0)
+                    && 0 == STRICMP(path, bore_str(g_bore, g_bore->sln_path)))) {
+            DWORD start = GetTickCount();
+            int reloaded = bore_reload_sln(g_bore);
+            if (reloaded < 0) {
+                vim_strncpy(path, bore_str(g_bore, g_bore->sln_path), BORE_MAX_PATH - 1);
+                bore_load_sln(path);
+                bore_print_sln(GetTickCount() - start);
+            } else {
+                char mess[BORE_MAX_PATH];
+                vim_snprintf(mess, BORE_MAX_PATH, "%s, %d of %d projects reloaded, %d files (%u ms)",
+                        bore_str(g_bore, g_bore->sln_path), reloaded,
+                        g_bore->proj_count, g_bore->file_count, GetTickCount() - start);
+                MSG(_(mess));
+            }
+            return;
+        }
+    }
+
     if (*eap->arg == NUL) {
         bore_print_sln(0);
     } else {
@@ -1231,54 +2317,73 @@ void ex_boresln __ARGS((exarg_T *eap))
     }
 }
 
-void borefind_parse_options(char* arg, char** what, char** what_ext)
+void borefind_parse_options(char* arg, bore_find_options_t* opt)
 {
     // Usage: [option(s)] what
     //   -e ext1,ext2,...,ext12
     //      filters the search based on a list of file extensions
+    //   -p project
+    //      only search the files of a project (name as shown by boreproj)
+    //   -d directory
+    //      only search the files below a directory
+    //   -b
+    //      search the text of the loaded buffers instead of the files on disk
     //   - 
     //   -u
     //      an empty (or any unknown) option will force the remainder to be treated as the search string
+    //   -p, -d and -b are mutually exclusive, the last one wins.
 
-    char* opt = NUL;
-    *what = arg;
-    *what_ext = NUL;
+    memset(opt, 0, sizeof(*opt));
+    opt->what = arg;
 
-    for (; *arg; ++arg)
+    while ('-' == *arg)
     {
-        if (NUL == opt)
+        char c = arg[1];
+        char** value = NULL;
+
+        if (c == 'b' && (arg[2] == ' ' || arg[2] == '\0'))
         {
-            if ('-' == *arg)
-            {
-                // found new option marker
+            opt->buffers = 1;
+            opt->proj = opt->dir = NULL;
+            arg = skipwhite(arg + 2);
+            opt->what = arg;
+            continue;
+        }
+
+        if (c == 'e' && arg[2] == ' ')
+            value = &opt->ext;
+        else if (c == 'p' && arg[2] == ' ')
+            value = &opt->proj;
+        else if (c == 'd' && arg[2] == ' ')
+            value = &opt->dir;
+
+        if (NULL == value)
+        {
+            // empty or unknown option, treat the rest as the search string
+            ++arg;
+            if (*arg && *arg != ' ')
                 ++arg;
-                if (*arg == 'e' && arg[1] == ' ')
-                {
-                    // found extension option argument start, loop until next space
-                    opt = arg;
-                    *what_ext = &opt[2];
-                    arg += 2;
-                }
-                else
-                {
-                    // empty or unknown option, treat the rest as the search string
-                    *what = arg + 1;
-                    break;
-                }
-            }
-            else
-            {
-                // no option found, treat the rest as the search string
-                *what = arg;
-                break;
-            }
+            if (*arg == ' ')
+                ++arg;
+            opt->what = arg;
+            return;
         }
-        else if (' ' == *arg)
+
+        if (value != &opt->ext)
         {
-            // end current option argument string and search for next option
-            opt = NUL;
-            *arg = '\0';
+            opt->proj = opt->dir = NULL;
+            opt->buffers = 0;
         }
+
+        // option argument, loop until next space
+        arg = skipwhite(arg + 3);
+        *value = arg;
+        while (*arg && ' ' != *arg)
+            ++arg;
+        if (*arg)
+            *arg++ = '\0';
+        arg = skipwhite(arg);
+        opt->what = arg;
     }
 }
 
@@ -1291,11 +2396,14 @@ void ex_borefind __ARGS((exarg_T *eap))
         DWORD start = GetTickCount();
         DWORD elapsed;
         char mess[100];
-        char* what;
-        char* what_ext;
+        bore_find_options_t opt;
 
-        borefind_parse_options((char*)eap->arg, &what, &what_ext);
-        int found = bore_find(g_bore, what, what_ext);
+        borefind_parse_options((char*)eap->arg, &opt);
+        if (*opt.what == NUL) {
+            EMSG(_(e_argreq));
+            return;
+        }
+        int found = bore_find(g_bore, &opt);
         elapsed = GetTickCount() - start;
         if (found)
         {
@@ -1304,7 +2412,7 @@ void ex_borefind __ARGS((exarg_T *eap))
         }
         else
         {
-            vim_snprintf(mess, 100, "No matching lines for \"%s\": Elapsed time: %u ms", what, elapsed);
+            vim_snprintf(mess, 100, "No matching lines for \"%s\": Elapsed time: %u ms", opt.what, elapsed);
             EMSG(_(mess));
         }
     }
@@ -1507,10 +2615,13 @@ void ex_boretoggle __ARGS((exarg_T *eap))
 
 void ex_borebuild __ARGS((exarg_T *eap))
 {
-    if (!g_bore) {
+    if (eap->cmdidx == CMD_borebuildfile && bore_build_file_compdb(eap)) {
+        // built with compile_commands.json
+    }
+    else if (!g_bore) {
         EMSG(_("Load a solution first with boresln"));
     } else {
-        char cmd[1024];
+        char cmd[BORE_MAX_CMDLINE];
         bore_proj_t* proj = NULL;
         char* src_file = NULL;
         char* platform = strstr(bore_str(g_bore, g_bore->sln_path), "vim_vs2010") != 0 ? "Win32" : "x64";
@@ -1518,6 +2629,11 @@ void ex_borebuild __ARGS((exarg_T *eap))
         char* slndir = bore_str(g_bore, g_bore->sln_dir);
         int slndirlen = strlen(slndir);
 
+        if (eap->cmdidx == CMD_borebuildmodified) {
+            bore_build_modified(g_bore, platform, configuration);
+            return;
+        }
+
         if (eap->cmdidx == CMD_borebuildfile) {
             // Specififed source file argument
             if (NULL != eap->arg && '\0' != eap->arg[0]) {
@@ -1545,14 +2661,7 @@ void ex_borebuild __ARGS((exarg_T *eap))
         else if (eap->cmdidx == CMD_borebuildproj) {
             // Specififed project name argument
             if (NULL != eap->arg && '\0' != eap->arg[0]) {
-                bore_proj_t* projects = (bore_proj_t*)g_bore->proj_alloc.base;
-                int i;
-                for (i = 0; i < g_bore->proj_count; ++i) {
-                    if (0 == STRICMP(eap->arg, bore_str(g_bore, projects[i].project_sln_name))) {
-                        proj = &projects[i];
-                        break;
-                    }
-                }
+                proj = bore_find_project_by_name(g_bore, eap->arg);
                 if (NULL == proj) {
                     EMSG(_("borebuildproj: Failed to lookup specified project"));
                     return;
@@ -1585,10 +2694,10 @@ void ex_borebuild __ARGS((exarg_T *eap))
             if (STRNICMP(src_file, slndir, slndirlen) == 0)
                 src_file += slndirlen;
 
-            vim_snprintf(cmd, 1024,
-                "msbuild.exe %s /t:ClCompile /p:SelectedFiles=\"%s\" /p:Platform=%s /p:Configuration=%s " \
+            vim_snprintf(cmd, BORE_MAX_CMDLINE,
+                "%s %s /t:ClCompile /p:SelectedFiles=\"%s\" /p:Platform=%s /p:Configuration=%s " \
                 "/v:q /nologo",
-                proj_file, src_file, platform, configuration);
+                bore_msbuild(), proj_file, src_file, platform, configuration);
         }
         else {
             char* sln_file = bore_str(g_bore, g_bore->sln_path) + slndirlen;
@@ -1598,15 +2707,16 @@ void ex_borebuild __ARGS((exarg_T *eap))
             else
                 target = eap->forceit ? "Rebuild" : "Build";
 
-            vim_snprintf(cmd, 1024,
-                "msbuild.exe %s /t:%s /p:Platform=%s /p:Configuration=%s " \
+            vim_snprintf(cmd, BORE_MAX_CMDLINE,
+                "%s %s /t:%s /p:Platform=%s /p:Configuration=%s " \
                 "/v:q /nologo " \
                 "/p:BuildProjectReferences=true " \
                 "/m:%d /p:MultiProcessorCompilation=true;CL_MPCount=%d",
-                sln_file, target, platform, configuration,
+                bore_msbuild(), sln_file, target, platform, configuration,
                 g_bore->ini.cpu_cores, g_bore->ini.cpu_cores);
         }
 
+        g_bore->build_time = (u64)time(NULL);
         bore_async_execute(cmd);
         char* c = strstr(cmd, " /v:");
         if (c)
@@ -9,9 +9,11 @@
 #define BORE_CACHELINE 64 
 #define BORE_MAXMATCHPERFILE 100
 #define BORE_MAX_SEARCH_EXTENSIONS 12
+#define BORE_MAX_CMDLINE 8192
 
 typedef unsigned char u8;
 typedef unsigned int u32;
+typedef unsigned long long u64;
 
 typedef struct bore_alloc_t {
     u8* base; // cacheline aligned
@@ -25,13 +27,26 @@ typedef struct bore_proj_t {
     u32 project_sln_guid;
     u32 project_sln_path;
     u32 project_file_path;
+    u32 file_begin; // range of the project's files in file_proj_alloc
+    u32 file_end;
+    u64 mtime; // last write time of project_file_path when it was loaded
 } bore_proj_t;
 
+typedef struct bore_proj_ref_t {
+    u32 proj_index;     // project with the ProjectReference
+    u32 ref_proj_index; // referenced project
+} bore_proj_ref_t;
+
 typedef struct bore_search_t {
     const char* what;
     int what_len;
     int ext_count;
-    u32 ext[BORE_MAX_SEARCH_EXTENSIONS]; // (64-16)/4
+    u32 ext[BORE_MAX_SEARCH_EXTENSIONS];
+
+    // files to search: [file_begin, file_end) of file_index if set, otherwise of file_alloc
+    const u32* file_index;
+    u32 file_begin;
+    u32 file_end;
 } bore_search_t;
 
 typedef struct bore_match_t {
@@ -67,9 +82,26 @@ typedef struct bore_toggle_entry_t {
     u32 file;
 } bore_toggle_entry_t;
 
+typedef struct bore_compdb_entry_t {
+    u32 file;      // canonical path of the source file
+    u32 directory; // working directory of the command
+    u32 command;   // compiler command line
+} bore_compdb_entry_t;
+
+// compile_commands.json, parsed once and kept until the file changes
+typedef struct bore_compdb_t {
+    char path[BORE_MAX_PATH];
+    u64 mtime;
+    int entry_count;
+    bore_alloc_t entry_alloc; // array of bore_compdb_entry_t sorted by file
+    bore_alloc_t data_alloc;  // strings
+} bore_compdb_t;
+
 typedef struct bore_t {
     u32 sln_path; // abs path of solution
     u32 sln_dir;  // abs dir of solution
+    u64 sln_mtime; // last write time of the solution file when it was loaded
+    u64 build_time; // time of the last borebuild (or load), to find files written since
 
     char* filelist_tmp_file; // name of temporary filelist file
 
@@ -77,10 +109,14 @@ typedef struct bore_t {
     int proj_count;
     bore_alloc_t proj_alloc; 
 
+    // array of bore_proj_ref_t (project references between projects)
+    int proj_ref_count;
+    bore_alloc_t proj_ref_alloc;
+
     // array of files in the solution
     int file_count;
     bore_alloc_t file_alloc;      // array of bore_file_t sorted by file name
-    bore_alloc_t file_proj_alloc; // array of bore_file_t sorted by project index
+    bore_alloc_t file_proj_alloc; // array of bore_file_t sorted by project index (one entry per project and file)
     bore_alloc_t file_ext_alloc;  // array of extension hashes
 
     // array of bore_toggle_entry_t;
@@ -7,6 +7,7 @@ extern "C" {
 }
 #include <windows.h>
 #include <winnt.h>
+#include <emmintrin.h>
 
 //#define BORE_CVPROFILE
 
@@ -117,6 +118,71 @@ done:
 
 #undef BTSOUTPUT
 
+// Count the newlines in [p, end). 16 bytes at a time, the compare masks are
+// summed bytewise for up to 255 blocks and then added up with psadbw.
+static int bore_count_newlines(const char* p, const char* end)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    int count = 0;
+
+    while (end - p >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        int blocks = (int)((end - p) / 16);
+        if (blocks > 255)
+            blocks = 255;
+        for (int i = 0; i < blocks; ++i, p += 16) {
+            __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl);
+            acc = _mm_sub_epi8(acc, eq); // eq is -1 per newline
+        }
+        __m128i sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+    }
+    while (p < end)
+        count += (*p++ == '\n');
+    return count;
+}
+
+// Return the start of the line containing end, not searching before begin.
+static const char* bore_line_begin(const char* begin, const char* end)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    const char* p = end;
+    unsigned long bit;
+
+    while (p - begin >= 16) {
+        p -= 16;
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl));
+        if (mask) {
+            _BitScanReverse(&bit, mask);
+            return p + bit + 1;
+        }
+    }
+    while (p > begin && p[-1] != '\n')
+        --p;
+    return p;
+}
+
+// Return the first '\r' or '\n' at or after p, or end.
+static const char* bore_line_end(const char* p, const char* end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i nl = _mm_set1_epi8('\n');
+    unsigned long bit;
+
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, cr), _mm_cmpeq_epi8(x, nl)));
+        if (mask) {
+            _BitScanForward(&bit, mask);
+            return p + bit;
+        }
+        p += 16;
+    }
+    while (p < end && *p != '\r' && *p != '\n')
+        ++p;
+    return p;
+}
+
 static void bore_resolve_match_location(int file_index, const char* p, u32 filesize, 
         bore_match_t* match, bore_match_t* match_end, int* offset, int offset_count)
 {
@@ -128,15 +194,12 @@ static void bore_resolve_match_location(int file_index, const char* p, u32 files
 
     while(offset < offset_end && match < match_end) {
         const char* pend = pbegin + *offset;
-        while (p < pend) {
-            if (*p++ == '\n') {
-                ++line;
-                linebegin = p;
-            }
+        if (p < pend) {
+            line += bore_count_newlines(p, pend);
+            linebegin = bore_line_begin(linebegin, pend);
+            p = pend;
         }
-        const char* lineend = pend;
-        while (lineend < fileend && *lineend != '\r' && *lineend != '\n')
-            ++lineend;
+        const char* lineend = bore_line_end(pend, fileend);
         size_t linelen = lineend - linebegin;
         if (linelen > sizeof(match->line) - 1)
             linelen = sizeof(match->line) - 1;
@@ -270,10 +333,15 @@ static DWORD WINAPI search_worker(struct search_context_t* search_context)
 {
     for (;;)
     {
-        LONG file_index = InterlockedDecrement(search_context->remaining_file_count);
-        if (file_index < 0)
+        LONG scope_index = InterlockedDecrement(search_context->remaining_file_count);
+        if (scope_index < 0)
             break;
 
+        const bore_search_t* search = search_context->search;
+        u32 file_index = search->file_begin + scope_index;
+        if (search->file_index)
+            file_index = search->file_index[file_index];
+
         // skip files based on file extension filter
         if (search_context->search->ext_count > 0)
         {
@@ -315,7 +383,7 @@ int bore_dofind(bore_t* b, int thread_count, int* truncated_, bore_match_t* matc
     }
 #endif  
 
-    LONG file_count = b->file_count;
+    LONG file_count = search->file_end - search->file_begin;
     *truncated_ = 0;    
 
     quick_search_t string_search(search->what, search->what_len);
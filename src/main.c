@@ -1210,6 +1210,14 @@ main_loop(cmdwin, noexmode)
 # endif
 	    setcursor();
 	    cursor_on();
+#ifdef FEAT_SEARCH_EXTRA
+	    /* Count search matches until a key is typed. */
+	    search_count_idle();
+#endif
+#ifdef FEAT_SYN_HL
+	    /* Parse syntax ahead until a key is typed. */
+	    syntax_idle();
+#endif
 
 	    do_redraw = FALSE;
 
@@ -1315,6 +1323,9 @@ getout(exitval)
     hash_debug_results();
 #endif
 
+    /* Optionally print data block cache efficiency. */
+    ml_cache_debug_results();
+
 #ifdef FEAT_GUI
     msg_didany = FALSE;
 #endif
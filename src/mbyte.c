@@ -768,6 +768,9 @@ codepage_invalid:
     /* When enc_utf8 is set or reset, (de)allocate ScreenLinesUC[] */
     screenalloc(FALSE);
 
+    /* Compiled patterns depend on the encoding. */
+    vim_regcache_clear();
+
     /* When using Unicode, set default for 'fileencodings'. */
     if (enc_utf8 && !option_was_set((char_u *)"fencs"))
 	set_string_option_direct((char_u *)"fencs", -1,
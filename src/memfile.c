@@ -26,6 +26,10 @@
  * Each block can be in memory and/or in a file. The block stays in memory
  * as long as it is locked. If it is no longer locked it can be swapped out to
  * the file. It is only written to the file if it has been changed.
+ * Before swapping out a block it is compressed and kept in memory, if that
+ * makes it substantially smaller.  Compressed blocks are only written and
+ * removed from memory when all memfiles together use more than 'maxmemtot'.
+ * Blocks of hidden buffers go first then.
  *
  * Under normal operation the file is created when opening the memory file and
  * deleted when closing the memory file. Only with recovery an existing memory
@@ -38,6 +42,10 @@
 
 #include "vim.h"
 
+#ifdef FEAT_SWAP_THREAD
+# include <pthread.h>
+#endif
+
 /*
  * Some systems have the page size in statfs.f_bsize, some in stat.st_blksize
  */
@@ -72,13 +80,90 @@ extern int dos2;			/* this is in os_amiga.c */
 #define MEMFILE_PAGE_SIZE 4096		/* default page size */
 
 static long_u	total_mem_used = 0;	/* total memory used for memfiles */
+static long_u	total_zip_used = 0;	/* part of it for compressed blocks */
+
+/* TRUE when the memfiles together use more memory than 'maxmemtot' */
+#define MF_OVER_TOTAL	((total_mem_used >> 10) >= (long_u)p_mmt)
+
+/* TRUE when compressed blocks use half of 'maxmemtot', compressing more would
+ * mostly be wasted on blocks that are written out soon after. */
+#define MF_ZIP_FULL	((total_zip_used >> 9) >= (long_u)p_mmt)
+
+/* Last block in memory, see mf_prev_block() */
+#define MF_LAST_BLOCK(mfp) ((mfp)->mf_used_last != NULL \
+				 ? (mfp)->mf_used_last : (mfp)->mf_zip_last)
+
+/*
+ * Blocks are compressed with a simple LZ77 method, in the format of LZF:
+ * 000LLLLL <L+1 literal bytes>
+ * LLLooooo oooooooo		    match of L+2 bytes, offset o+1 back
+ * 111ooooo LLLLLLLL oooooooo	    match of L+9 bytes, offset o+1 back
+ */
+#define MF_ZIP_HBITS	12		/* number of bits for the hash table */
+#define MF_ZIP_MAXOFF	8192		/* maximum match offset */
+#define MF_ZIP_MAXLEN	264		/* maximum match length */
+#define MF_ZIP_MAXLIT	32		/* maximum literal run */
+
+static unsigned	mf_zip_htab[1 << MF_ZIP_HBITS];	/* position + base */
+static unsigned	mf_zip_base = 0;	/* position zero for mf_zip_htab[] */
+static char_u	*mf_zip_buf = NULL;	/* buffer for (un)compressing */
+static unsigned	mf_zip_buf_size = 0;
+
+#ifdef FEAT_SWAP_THREAD
+/*
+ * When syncing with MFS_ASYNC the dirty blocks are copied into jobs and a
+ * thread writes them to the swap file, followed by a job to flush the file.
+ * The jobs are done in the order they were queued, thus the swap file goes
+ * through the same states as when it is written directly.  The thread only
+ * does the system calls, memory is allocated and freed by the main thread.
+ * mf_async_wait() must be called before the swap file is used for anything
+ * else.
+ */
+typedef struct mf_job_S mf_job_T;
+
+struct mf_job_S
+{
+    mf_job_T	*mj_next;
+    memfile_T	*mj_mfp;	/* memfile the job is for */
+    int		mj_fd;		/* file descriptor to write to */
+    off_t	mj_offset;	/* offset in the file */
+    char_u	*mj_data;	/* data to write, NULL to flush the file */
+    unsigned	mj_size;	/* number of bytes in mj_data */
+    int		mj_sync;	/* flush with sync() instead of fsync() */
+    int		mj_failed;	/* set by the thread when the job failed */
+};
+
+static pthread_mutex_t	mf_job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	mf_job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	mf_done_cond = PTHREAD_COND_INITIALIZER;
+static mf_job_T		*mf_job_first = NULL;	/* jobs for the thread */
+static mf_job_T		*mf_job_last = NULL;
+static mf_job_T		*mf_done_first = NULL;	/* jobs it has finished */
+static int		mf_thread_state = 0;	/* 1: running, -1: failed */
+static int		mf_in_job_mutex = FALSE; /* main thread has the mutex */
+static int		mf_write_async = FALSE;	/* mf_write_block() queues */
+#endif
 
 static void mf_ins_hash __ARGS((memfile_T *, bhdr_T *));
 static void mf_rem_hash __ARGS((memfile_T *, bhdr_T *));
+static void mf_grow_hash __ARGS((memfile_T *));
 static bhdr_T *mf_find_hash __ARGS((memfile_T *, blocknr_T));
 static void mf_ins_used __ARGS((memfile_T *, bhdr_T *));
 static void mf_rem_used __ARGS((memfile_T *, bhdr_T *));
+static void mf_ins_zip __ARGS((memfile_T *, bhdr_T *));
+static void mf_rem_zip __ARGS((memfile_T *, bhdr_T *));
+static bhdr_T *mf_prev_block __ARGS((memfile_T *, bhdr_T *));
 static bhdr_T *mf_release __ARGS((memfile_T *, int));
+static int  mf_evict __ARGS((memfile_T *, bhdr_T *, int));
+static void mf_trim __ARGS((memfile_T *));
+static int  mf_zip_block __ARGS((memfile_T *, bhdr_T *));
+static int  mf_unzip __ARGS((memfile_T *, bhdr_T *, char_u *));
+static int  mf_write_zip __ARGS((memfile_T *, bhdr_T *));
+static int  mf_spill_zip __ARGS((memfile_T *, bhdr_T *));
+static int  mf_zip_buf_grow __ARGS((unsigned));
+static int  mf_zip_literals __ARGS((char_u *, unsigned, unsigned, char_u *, unsigned *, unsigned));
+static unsigned mf_compress __ARGS((char_u *, unsigned, char_u *, unsigned));
+static int  mf_decompress __ARGS((char_u *, unsigned, char_u *, unsigned));
 static bhdr_T *mf_alloc_bhdr __ARGS((memfile_T *, int));
 static void mf_free_bhdr __ARGS((bhdr_T *));
 static void mf_ins_free __ARGS((memfile_T *, bhdr_T *));
@@ -88,6 +173,13 @@ static int  mf_write __ARGS((memfile_T *, bhdr_T *));
 static int  mf_write_block __ARGS((memfile_T *mfp, bhdr_T *hp, off_t offset, unsigned size));
 static int  mf_trans_add __ARGS((memfile_T *, bhdr_T *));
 static void mf_do_open __ARGS((memfile_T *, char_u *, int));
+#ifdef FEAT_SWAP_THREAD
+static void mf_job_lock __ARGS((void));
+static void mf_job_unlock __ARGS((void));
+static void *mf_thread_main __ARGS((void *));
+static int  mf_async_queue __ARGS((memfile_T *, char_u *, off_t, unsigned, int));
+static int  mf_async_busy __ARGS((memfile_T *));
+#endif
 
 /*
  * The functions for using a memfile:
@@ -154,17 +246,32 @@ mf_open(fname, flags)
     mfp->mf_free_first = NULL;		/* free list is empty */
     mfp->mf_used_first = NULL;		/* used list is empty */
     mfp->mf_used_last = NULL;
+    mfp->mf_zip_first = NULL;		/* zip list is empty */
+    mfp->mf_zip_last = NULL;
     mfp->mf_dirty = FALSE;
     mfp->mf_used_count = 0;
     for (i = 0; i < MEMHASHSIZE; ++i)
     {
-	mfp->mf_hash[i] = NULL;		/* hash lists are empty */
+	mfp->mf_hash_init[i] = NULL;	/* hash lists are empty */
 	mfp->mf_trans[i] = NULL;	/* trans lists are empty */
     }
+    mfp->mf_hash = mfp->mf_hash_init;
+    mfp->mf_hash_mask = MEMHASHSIZE - 1;
+    mfp->mf_hash_count = 0;
     mfp->mf_page_size = MEMFILE_PAGE_SIZE;
 #ifdef FEAT_CRYPT
     mfp->mf_old_key = NULL;
 #endif
+#ifdef FEAT_MMAP
+    mfp->mf_map = NULL;
+    mfp->mf_map_offset = NULL;
+    mfp->mf_map_count = 0;
+#endif
+#ifdef FEAT_SWAP_THREAD
+    mfp->mf_async_count = 0;
+    mfp->mf_async_done = 0;
+    mfp->mf_async_off = FALSE;
+#endif
 
 #ifdef USE_FSTATFS
     /*
@@ -189,6 +296,7 @@ mf_open(fname, flags)
 							 / mfp->mf_page_size);
     mfp->mf_blocknr_min = -1;
     mfp->mf_neg_count = 0;
+    mfp->mf_renum_count = 0;
     mfp->mf_infile_count = mfp->mf_blocknr_max;
 
     /*
@@ -253,6 +361,9 @@ mf_close(mfp, del_file)
 	return;
     if (mfp->mf_fd >= 0)
     {
+#ifdef FEAT_SWAP_THREAD
+	(void)mf_async_wait(mfp);
+#endif
 	if (close(mfp->mf_fd) < 0)
 	    EMSG(_(e_swapclose));
     }
@@ -265,6 +376,12 @@ mf_close(mfp, del_file)
 	nextp = hp->bh_next;
 	mf_free_bhdr(hp);
     }
+    for (hp = mfp->mf_zip_first; hp != NULL; hp = nextp)
+    {					    /* free entries in zip list */
+	total_mem_used -= hp->bh_zip_len;
+	nextp = hp->bh_next;
+	mf_free_bhdr(hp);
+    }
     while (mfp->mf_free_first != NULL)	    /* free entries in free list */
 	vim_free(mf_rem_free(mfp));
     for (i = 0; i < MEMHASHSIZE; ++i)	    /* free entries in trans lists */
@@ -273,6 +390,13 @@ mf_close(mfp, del_file)
 	    tpnext = tp->nt_next;
 	    vim_free(tp);
 	}
+    if (mfp->mf_hash != mfp->mf_hash_init)
+	vim_free(mfp->mf_hash);
+#ifdef FEAT_MMAP
+    if (mfp->mf_map != NULL)
+	munmap(mfp->mf_map, mfp->mf_map_size);
+    vim_free(mfp->mf_map_offset);
+#endif
     vim_free(mfp->mf_fname);
     vim_free(mfp->mf_ffname);
     vim_free(mfp);
@@ -303,6 +427,9 @@ mf_close_file(buf, getlines)
 	/* TODO: should check if all blocks are really in core */
     }
 
+#ifdef FEAT_SWAP_THREAD
+    (void)mf_async_wait(mfp);
+#endif
     if (close(mfp->mf_fd) < 0)			/* close the file */
 	EMSG(_(e_swapclose));
     mfp->mf_fd = -1;
@@ -437,6 +564,7 @@ mf_get(mfp, nr, page_count)
     int		page_count;
 {
     bhdr_T    *hp;
+    char_u    *p;
 						/* doesn't exist */
     if (nr >= mfp->mf_blocknr_max || nr <= mfp->mf_blocknr_min)
 	return NULL;
@@ -447,7 +575,11 @@ mf_get(mfp, nr, page_count)
     hp = mf_find_hash(mfp, nr);
     if (hp == NULL)	/* not in the hash list */
     {
-	if (nr < 0 || nr >= mfp->mf_infile_count)   /* can't be in the file */
+	if ((nr < 0 || nr >= mfp->mf_infile_count)   /* can't be in the file */
+#ifdef FEAT_MMAP
+		&& !MF_MAPPED(mfp, nr)
+#endif
+		)
 	    return NULL;
 
 	/* could check here if the block is in the free list */
@@ -464,12 +596,34 @@ mf_get(mfp, nr, page_count)
 	hp->bh_bnum = nr;
 	hp->bh_flags = 0;
 	hp->bh_page_count = page_count;
+#ifdef FEAT_MMAP
+	if (MF_MAPPED(mfp, nr))
+	    ml_fill_mapped(mfp, hp);	    /* fill it from the mapped file */
+	else
+#endif
 	if (mf_read(mfp, hp) == FAIL)	    /* cannot read the block! */
 	{
 	    mf_free_bhdr(hp);
 	    return NULL;
 	}
     }
+    else if (hp->bh_flags & BH_ZIPPED)
+    {
+	/* Uncompress the block into new memory.  Take it out of the zip list
+	 * first, so that it is not dropped when memory runs out. */
+	mf_rem_zip(mfp, hp);
+	p = alloc(mfp->mf_page_size * hp->bh_page_count);
+	if (p == NULL || mf_unzip(mfp, hp, p) == FAIL)
+	{
+	    vim_free(p);
+	    mf_ins_zip(mfp, hp);
+	    return NULL;
+	}
+	vim_free(hp->bh_data);
+	hp->bh_data = p;
+	hp->bh_flags &= ~BH_ZIPPED;
+	mf_rem_hash(mfp, hp);
+    }
     else
     {
 	mf_rem_used(mfp, hp);	/* remove from list, insert in front below */
@@ -483,6 +637,20 @@ mf_get(mfp, nr, page_count)
     return hp;
 }
 
+/*
+ * Return the header of block "nr" when it is in memory, also when it is
+ * compressed.  The block is not locked and its data may not be usable, this
+ * is only for looking at the header.
+ * Returns NULL when the block is not in memory.
+ */
+    bhdr_T *
+mf_peek(mfp, nr)
+    memfile_T	*mfp;
+    blocknr_T	nr;
+{
+    return mf_find_hash(mfp, nr);
+}
+
 /*
  * release the block *hp
  *
@@ -508,6 +676,7 @@ mf_put(mfp, hp, dirty, infile)
     if (dirty)
     {
 	flags |= BH_DIRTY;
+	flags &= ~BH_SUMMED;
 	mfp->mf_dirty = TRUE;
     }
     hp->bh_flags = flags;
@@ -528,8 +697,12 @@ mf_free(mfp, hp)
     mf_rem_used(mfp, hp);	/* get *hp out of the used list */
     if (hp->bh_bnum < 0)
     {
+#ifdef FEAT_MMAP
+	/* mapped blocks are only counted once they have been written */
+	if (!MF_MAPPED(mfp, hp->bh_bnum))
+#endif
+	    mfp->mf_neg_count--;
 	vim_free(hp);		/* don't want negative numbers in free list */
-	mfp->mf_neg_count--;
     }
     else
 	mf_ins_free(mfp, hp);	/* put *hp in the free list */
@@ -556,6 +729,9 @@ fdtofh(int filedescriptor)
  *  MFS_FLUSH	Make sure buffers are flushed to disk, so they will survive a
  *		system crash.
  *  MFS_ZERO	Only write block 0.
+ *  MFS_ASYNC	Let the swap thread write the blocks and flush the file.
+ *		A write error is only noticed at the next sync.  Nothing is
+ *		done while the thread is still busy with a previous sync.
  *
  * Return FAIL for failure, OK otherwise
  */
@@ -577,6 +753,20 @@ mf_sync(mfp, flags)
 	return FAIL;
     }
 
+#ifdef FEAT_SWAP_THREAD
+    if ((flags & MFS_ASYNC) && !mfp->mf_async_off)
+    {
+	if (mf_async_busy(mfp))
+	    return OK;
+    }
+    else
+	flags &= ~MFS_ASYNC;
+    /* Collect finished jobs.  When one failed write synchronously. */
+    if (mf_async_wait(mfp) == FAIL)
+	flags &= ~MFS_ASYNC;
+    mf_write_async = (flags & MFS_ASYNC) != 0;
+#endif
+
     /* Only a CTRL-C while writing will break us here, not one typed
      * previously. */
     got_int = FALSE;
@@ -588,7 +778,7 @@ mf_sync(mfp, flags)
      * fails then we give up.
      */
     status = OK;
-    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+    for (hp = MF_LAST_BLOCK(mfp); hp != NULL; hp = mf_prev_block(mfp, hp))
 	if (((flags & MFS_ALL) || hp->bh_bnum >= 0)
 		&& (hp->bh_flags & BH_DIRTY)
 		&& (status == OK || (hp->bh_bnum >= 0
@@ -596,7 +786,8 @@ mf_sync(mfp, flags)
 	{
 	    if ((flags & MFS_ZERO) && hp->bh_bnum != 0)
 		continue;
-	    if (mf_write(mfp, hp) == FAIL)
+	    if (((hp->bh_flags & BH_ZIPPED) ? mf_write_zip(mfp, hp)
+					    : mf_write(mfp, hp)) == FAIL)
 	    {
 		if (status == FAIL)	/* double error: quit syncing */
 		    break;
@@ -613,6 +804,9 @@ mf_sync(mfp, flags)
 	    if (got_int)
 		break;
 	}
+#ifdef FEAT_SWAP_THREAD
+    mf_write_async = FALSE;
+#endif
 
     /*
      * If the whole list is flushed, the memfile is not dirty anymore.
@@ -621,8 +815,17 @@ mf_sync(mfp, flags)
     if (hp == NULL || status == FAIL)
 	mfp->mf_dirty = FALSE;
 
-    if ((flags & MFS_FLUSH) && *p_sws != NUL)
+    if ((flags & MFS_FLUSH) && *p_sws != NUL
+#ifdef FEAT_SWAP_THREAD
+	    && !((flags & MFS_ASYNC) && mf_async_queue(mfp, NULL, (off_t)0, 0,
+					  STRCMP(p_sws, "fsync") != 0) == OK)
+#endif
+	    )
     {
+#ifdef FEAT_SWAP_THREAD
+	/* Writes that were queued must be done before flushing. */
+	(void)mf_async_wait(mfp);
+#endif
 #if defined(UNIX)
 # ifdef HAVE_FSYNC
 	/*
@@ -733,12 +936,224 @@ mf_set_dirty(mfp)
 {
     bhdr_T	*hp;
 
-    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+    for (hp = MF_LAST_BLOCK(mfp); hp != NULL; hp = mf_prev_block(mfp, hp))
 	if (hp->bh_bnum > 0)
 	    hp->bh_flags |= BH_DIRTY;
     mfp->mf_dirty = TRUE;
 }
 
+#if defined(FEAT_SWAP_THREAD) || defined(PROTO)
+/*
+ * Lock the job mutex from the main thread.
+ */
+    static void
+mf_job_lock()
+{
+    pthread_mutex_lock(&mf_job_mutex);
+    mf_in_job_mutex = TRUE;
+}
+
+    static void
+mf_job_unlock()
+{
+    mf_in_job_mutex = FALSE;
+    pthread_mutex_unlock(&mf_job_mutex);
+}
+
+/*
+ * The swap thread: do the queued jobs one by one.  Runs forever.
+ */
+    static void *
+mf_thread_main(arg)
+    void	*arg UNUSED;
+{
+    mf_job_T	*jp;
+    unsigned	done;
+    long	n;
+
+    pthread_mutex_lock(&mf_job_mutex);
+    for (;;)
+    {
+	while (mf_job_first == NULL)
+	    pthread_cond_wait(&mf_job_cond, &mf_job_mutex);
+	jp = mf_job_first;
+	mf_job_first = jp->mj_next;
+	if (mf_job_first == NULL)
+	    mf_job_last = NULL;
+	pthread_mutex_unlock(&mf_job_mutex);
+
+	if (jp->mj_data != NULL)
+	{
+	    for (done = 0; done < jp->mj_size; done += n)
+	    {
+		n = (long)pwrite(jp->mj_fd, jp->mj_data + done,
+				   jp->mj_size - done, jp->mj_offset + done);
+		if (n < 0 && errno == EINTR)
+		    n = 0;
+		else if (n <= 0)
+		{
+		    jp->mj_failed = TRUE;
+		    break;
+		}
+	    }
+	}
+	else if (jp->mj_sync)
+	    sync();
+	else if (fsync(jp->mj_fd) != 0)
+	    jp->mj_failed = TRUE;
+
+	pthread_mutex_lock(&mf_job_mutex);
+	jp->mj_next = mf_done_first;
+	mf_done_first = jp;
+	++jp->mj_mfp->mf_async_done;
+	pthread_cond_broadcast(&mf_done_cond);
+    }
+    /*NOTREACHED*/
+    return NULL;
+}
+
+/*
+ * Queue a job for the swap thread to write "size" bytes of "data" at "offset"
+ * in the swap file of "mfp".  When "data" is NULL flush the file instead,
+ * with sync() if "use_sync" is TRUE.
+ * The job takes over "data", it is freed when the job is done.
+ * Starts the thread when needed.
+ * Return FAIL when there is no thread or no memory, "data" is not used then.
+ */
+    static int
+mf_async_queue(mfp, data, offset, size, use_sync)
+    memfile_T	*mfp;
+    char_u	*data;
+    off_t	offset;
+    unsigned	size;
+    int		use_sync;
+{
+    mf_job_T	*jp;
+
+    if (mf_thread_state == 0)
+    {
+	pthread_t   thread;
+	sigset_t    all, save;
+
+	/* The thread must not handle any signals, block them all.  It
+	 * inherits the signal mask. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &save);
+	if (pthread_create(&thread, NULL, mf_thread_main, NULL) == 0)
+	{
+	    pthread_detach(thread);
+	    mf_thread_state = 1;
+	}
+	else
+	    mf_thread_state = -1;
+	pthread_sigmask(SIG_SETMASK, &save, NULL);
+    }
+    if (mf_thread_state < 0)
+	return FAIL;
+
+    jp = (mf_job_T *)alloc_clear((unsigned)sizeof(mf_job_T));
+    if (jp == NULL)
+	return FAIL;
+    jp->mj_mfp = mfp;
+    jp->mj_fd = mfp->mf_fd;
+    jp->mj_offset = offset;
+    jp->mj_data = data;
+    jp->mj_size = size;
+    jp->mj_sync = use_sync;
+
+    mf_job_lock();
+    if (mf_job_last == NULL)
+	mf_job_first = jp;
+    else
+	mf_job_last->mj_next = jp;
+    mf_job_last = jp;
+    pthread_cond_signal(&mf_job_cond);
+    mf_job_unlock();
+
+    ++mfp->mf_async_count;
+    return OK;
+}
+
+/*
+ * Return TRUE if the swap thread has not finished all jobs for "mfp".
+ */
+    static int
+mf_async_busy(mfp)
+    memfile_T	*mfp;
+{
+    int		busy;
+
+    if (mfp->mf_async_count == 0)
+	return FALSE;
+    mf_job_lock();
+    busy = mfp->mf_async_done < mfp->mf_async_count;
+    mf_job_unlock();
+    return busy;
+}
+
+/*
+ * Wait for the swap thread to finish all jobs for "mfp" and free them.
+ * When a job failed the blocks in memory are marked dirty, so that they are
+ * written again, and the thread is not used for "mfp" anymore.
+ * Return FAIL when a job failed.
+ */
+    int
+mf_async_wait(mfp)
+    memfile_T	*mfp;
+{
+    mf_job_T	**jpp;
+    mf_job_T	*jp;
+    mf_job_T	*done = NULL;
+    int		failed = FALSE;
+    bhdr_T	*hp;
+
+    if (mfp->mf_async_count == 0)
+	return OK;
+    /* In a signal handler that interrupted us while holding the mutex
+     * (e.g. when preserving files for a deadly signal): can't wait. */
+    if (mf_in_job_mutex)
+	return OK;
+
+    mf_job_lock();
+    while (mfp->mf_async_done < mfp->mf_async_count)
+	pthread_cond_wait(&mf_done_cond, &mf_job_mutex);
+    for (jpp = &mf_done_first; *jpp != NULL; )
+    {
+	jp = *jpp;
+	if (jp->mj_mfp == mfp)
+	{
+	    *jpp = jp->mj_next;
+	    jp->mj_next = done;
+	    done = jp;
+	}
+	else
+	    jpp = &jp->mj_next;
+    }
+    mfp->mf_async_count = 0;
+    mfp->mf_async_done = 0;
+    mf_job_unlock();
+
+    while (done != NULL)
+    {
+	jp = done;
+	done = jp->mj_next;
+	if (jp->mj_failed)
+	    failed = TRUE;
+	vim_free(jp->mj_data);
+	vim_free(jp);
+    }
+
+    if (!failed)
+	return OK;
+    for (hp = MF_LAST_BLOCK(mfp); hp != NULL; hp = mf_prev_block(mfp, hp))
+	if (hp->bh_bnum >= 0)
+	    hp->bh_flags |= BH_DIRTY;
+    mfp->mf_dirty = TRUE;
+    mfp->mf_async_off = TRUE;
+    return FAIL;
+}
+#endif
+
 /*
  * insert block *hp in front of hashlist of memfile *mfp
  */
@@ -748,15 +1163,18 @@ mf_ins_hash(mfp, hp)
     bhdr_T	*hp;
 {
     bhdr_T	*hhp;
-    int		hash;
+    long	hash;
 
-    hash = MEMHASH(hp->bh_bnum);
+    hash = hp->bh_bnum & mfp->mf_hash_mask;
     hhp = mfp->mf_hash[hash];
     hp->bh_hash_next = hhp;
     hp->bh_hash_prev = NULL;
     if (hhp != NULL)
 	hhp->bh_hash_prev = hp;
     mfp->mf_hash[hash] = hp;
+
+    if (++mfp->mf_hash_count > mfp->mf_hash_mask + 1)
+	mf_grow_hash(mfp);
 }
 
 /*
@@ -768,12 +1186,49 @@ mf_rem_hash(mfp, hp)
     bhdr_T	*hp;
 {
     if (hp->bh_hash_prev == NULL)
-	mfp->mf_hash[MEMHASH(hp->bh_bnum)] = hp->bh_hash_next;
+	mfp->mf_hash[hp->bh_bnum & mfp->mf_hash_mask] = hp->bh_hash_next;
     else
 	hp->bh_hash_prev->bh_hash_next = hp->bh_hash_next;
 
     if (hp->bh_hash_next)
 	hp->bh_hash_next->bh_hash_prev = hp->bh_hash_prev;
+    --mfp->mf_hash_count;
+}
+
+/*
+ * Double the number of hash lists of memfile *mfp and move the blocks over.
+ * When out of memory the lists just get longer.
+ */
+    static void
+mf_grow_hash(mfp)
+    memfile_T	*mfp;
+{
+    long	size = (mfp->mf_hash_mask + 1) * 2;
+    bhdr_T	**new_hash;
+    bhdr_T	*hp;
+    bhdr_T	*hp_next;
+    long	hash;
+    long	i;
+
+    new_hash = (bhdr_T **)lalloc_clear((long_u)(size * sizeof(bhdr_T *)),
+									FALSE);
+    if (new_hash == NULL)
+	return;
+    for (i = 0; i <= mfp->mf_hash_mask; ++i)
+	for (hp = mfp->mf_hash[i]; hp != NULL; hp = hp_next)
+	{
+	    hp_next = hp->bh_hash_next;
+	    hash = hp->bh_bnum & (size - 1);
+	    hp->bh_hash_next = new_hash[hash];
+	    hp->bh_hash_prev = NULL;
+	    if (new_hash[hash] != NULL)
+		new_hash[hash]->bh_hash_prev = hp;
+	    new_hash[hash] = hp;
+	}
+    if (mfp->mf_hash != mfp->mf_hash_init)
+	vim_free(mfp->mf_hash);
+    mfp->mf_hash = new_hash;
+    mfp->mf_hash_mask = size - 1;
 }
 
 /*
@@ -786,7 +1241,8 @@ mf_find_hash(mfp, nr)
 {
     bhdr_T	*hp;
 
-    for (hp = mfp->mf_hash[MEMHASH(nr)]; hp != NULL; hp = hp->bh_hash_next)
+    for (hp = mfp->mf_hash[nr & mfp->mf_hash_mask]; hp != NULL;
+							  hp = hp->bh_hash_next)
 	if (hp->bh_bnum == nr)
 	    break;
     return hp;
@@ -831,6 +1287,59 @@ mf_rem_used(mfp, hp)
     total_mem_used -= hp->bh_page_count * mfp->mf_page_size;
 }
 
+/*
+ * insert compressed block *hp in front of zip list of memfile *mfp
+ */
+    static void
+mf_ins_zip(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    hp->bh_next = mfp->mf_zip_first;
+    mfp->mf_zip_first = hp;
+    hp->bh_prev = NULL;
+    if (hp->bh_next == NULL)	    /* list was empty, adjust last pointer */
+	mfp->mf_zip_last = hp;
+    else
+	hp->bh_next->bh_prev = hp;
+    total_mem_used += hp->bh_zip_len;
+    total_zip_used += hp->bh_zip_len;
+}
+
+/*
+ * remove compressed block *hp from zip list of memfile *mfp
+ */
+    static void
+mf_rem_zip(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    if (hp->bh_next == NULL)	    /* last block in zip list */
+	mfp->mf_zip_last = hp->bh_prev;
+    else
+	hp->bh_next->bh_prev = hp->bh_prev;
+    if (hp->bh_prev == NULL)	    /* first block in zip list */
+	mfp->mf_zip_first = hp->bh_next;
+    else
+	hp->bh_prev->bh_next = hp->bh_next;
+    total_mem_used -= hp->bh_zip_len;
+    total_zip_used -= hp->bh_zip_len;
+}
+
+/*
+ * Return the block before "hp" when going through all blocks in memory from
+ * the end of the used list, continuing at the end of the zip list.
+ */
+    static bhdr_T *
+mf_prev_block(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    if (hp->bh_prev == NULL && !(hp->bh_flags & BH_ZIPPED))
+	return mfp->mf_zip_last;
+    return hp->bh_prev;
+}
+
 /*
  * Release the least recently used block from the used list if the number
  * of used memory blocks gets to big.
@@ -872,16 +1381,19 @@ mf_release(mfp, page_count)
 	    ml_open_file(buf);
     }
 
+    if (!need_release)
+	return NULL;
+
     /*
-     * don't release a block if
-     *	there is no file for this memfile
-     * or
-     *	the number of blocks for this memfile is lower than the maximum
-     *	  and
-     *	total memory used is not up to 'maxmemtot'
+     * When all memfiles together use too much memory, first make room in
+     * the memfiles of hidden buffers.
      */
-    if (mfp->mf_fd < 0 || !need_release)
-	return NULL;
+    if (MF_OVER_TOTAL)
+    {
+	mf_trim(mfp);
+	if (mfp->mf_used_count < mfp->mf_used_count_max && !MF_OVER_TOTAL)
+	    return NULL;
+    }
 
     for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
 	if (!(hp->bh_flags & BH_LOCKED))
@@ -889,15 +1401,20 @@ mf_release(mfp, page_count)
     if (hp == NULL)	/* not a single one that can be released */
 	return NULL;
 
-    /*
-     * If the block is dirty, write it.
-     * If the write fails we don't free it.
-     */
-    if ((hp->bh_flags & BH_DIRTY) && mf_write(mfp, hp) == FAIL)
+    if (mf_evict(mfp, hp, TRUE) == FAIL)
+    {
+#ifdef FEAT_MMAP
+	/* Without a file only an unchanged mapped block can be released.
+	 * Move any other block to the front, the next call tries another
+	 * one. */
+	if (mfp->mf_fd < 0 && mfp->mf_map != NULL)
+	{
+	    mf_rem_used(mfp, hp);
+	    mf_ins_used(mfp, hp);
+	}
+#endif
 	return NULL;
-
-    mf_rem_used(mfp, hp);
-    mf_rem_hash(mfp, hp);
+    }
 
     /*
      * If a bhdr_T is returned, make sure that the page_count of bh_data is
@@ -916,6 +1433,92 @@ mf_release(mfp, page_count)
     return hp;
 }
 
+/*
+ * Take unlocked block "hp" out of the used and hash lists.  When "zip" is
+ * TRUE it is compressed and put in the zip list when that works, otherwise it
+ * is written to the swap file when it is dirty.  The memory of "hp" can be
+ * re-used.
+ * Return FAIL when the block must stay in memory.
+ */
+    static int
+mf_evict(mfp, hp, zip)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+    int		zip;
+{
+    if (zip && mf_zip_block(mfp, hp) == OK)
+	return OK;
+
+    /* Without a file only an unchanged mapped block can be released, it is
+     * filled again from the mapped file when needed. */
+    if (mfp->mf_fd < 0
+#ifdef FEAT_MMAP
+	    && ((hp->bh_flags & BH_DIRTY) || !MF_MAPPED(mfp, hp->bh_bnum))
+#endif
+	    )
+	return FAIL;
+
+#ifdef FEAT_SWAP_THREAD
+    /* A block may only be released after the swap thread wrote it.  Rather
+     * use some more memory than wait for the thread. */
+    if (mf_async_busy(mfp))
+	return FAIL;
+    (void)mf_async_wait(mfp);
+#endif
+
+    /*
+     * If the block is dirty, write it.
+     * If the write fails we don't free it.
+     */
+    if ((hp->bh_flags & BH_DIRTY) && mf_write(mfp, hp) == FAIL)
+	return FAIL;
+
+    mf_rem_used(mfp, hp);
+    mf_rem_hash(mfp, hp);
+    return OK;
+}
+
+/*
+ * Called when all memfiles together use more than 'maxmemtot'.  Take blocks
+ * out of memory until below it again: first the blocks of hidden buffers,
+ * the oldest compressed ones and then the others.  Compressing those would
+ * be wasted, they are not going to be used soon.  At last drop the oldest
+ * compressed blocks of "curmfp".
+ */
+    static void
+mf_trim(curmfp)
+    memfile_T	*curmfp;
+{
+    buf_T	*buf;
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+    bhdr_T	*prev;
+
+    for (buf = firstbuf; buf != NULL && MF_OVER_TOTAL; buf = buf->b_next)
+    {
+	mfp = buf->b_ml.ml_mfp;
+	if (mfp == NULL || mfp == curmfp || buf->b_nwindows > 0)
+	    continue;
+	for (hp = mfp->mf_zip_last; hp != NULL && MF_OVER_TOTAL; hp = prev)
+	{
+	    prev = hp->bh_prev;
+	    (void)mf_spill_zip(mfp, hp);
+	}
+	for (hp = mfp->mf_used_last; hp != NULL && MF_OVER_TOTAL; hp = prev)
+	{
+	    prev = hp->bh_prev;
+	    if (!(hp->bh_flags & BH_LOCKED) && mf_evict(mfp, hp, FALSE) == OK)
+		mf_free_bhdr(hp);
+	}
+    }
+
+    for (hp = curmfp->mf_zip_last; hp != NULL && MF_OVER_TOTAL; hp = prev)
+    {
+	prev = hp->bh_prev;
+	(void)mf_spill_zip(curmfp, hp);
+    }
+}
+
 /*
  * release as many blocks as possible
  * Used in case of out of memory
@@ -928,6 +1531,7 @@ mf_release_all()
     buf_T	*buf;
     memfile_T	*mfp;
     bhdr_T	*hp;
+    bhdr_T	*prev;
     int		retval = FALSE;
 
     for (buf = firstbuf; buf != NULL; buf = buf->b_next)
@@ -942,6 +1546,9 @@ mf_release_all()
 	    /* only if there is a swapfile */
 	    if (mfp->mf_fd >= 0)
 	    {
+#ifdef FEAT_SWAP_THREAD
+		(void)mf_async_wait(mfp);
+#endif
 		for (hp = mfp->mf_used_last; hp != NULL; )
 		{
 		    if (!(hp->bh_flags & BH_LOCKED)
@@ -957,6 +1564,15 @@ mf_release_all()
 		    else
 			hp = hp->bh_prev;
 		}
+		/* Compressed blocks that are in the file can go as well.
+		 * Dirty ones are kept, writing them needs memory. */
+		for (hp = mfp->mf_zip_last; hp != NULL; hp = prev)
+		{
+		    prev = hp->bh_prev;
+		    if (!(hp->bh_flags & BH_DIRTY)
+					   && mf_spill_zip(mfp, hp) == OK)
+			retval = TRUE;
+		}
 	    }
 	}
     }
@@ -1103,6 +1719,9 @@ mf_write(mfp, hp)
 	{
 	    nr = mfp->mf_infile_count;
 	    hp2 = mf_find_hash(mfp, nr);	/* NULL catched below */
+	    /* A compressed block is written later, fill with dummy data. */
+	    if (hp2 != NULL && (hp2->bh_flags & BH_ZIPPED))
+		hp2 = NULL;
 	}
 	else
 	    hp2 = hp;
@@ -1168,10 +1787,28 @@ mf_write_block(mfp, hp, offset, size)
     }
 #endif
 
+#ifdef FEAT_SWAP_THREAD
+    if (mf_write_async)
+    {
+	/* The thread writes a copy, the block can be changed right away. */
+	if (data == hp->bh_data && (data = alloc(size)) != NULL)
+	    mch_memmove(data, hp->bh_data, size);
+	if (data != NULL && mf_async_queue(mfp, data, offset, size, FALSE)
+									 == OK)
+	    return OK;
+	/* Can't queue it, write the rest of the blocks directly. */
+	mf_write_async = FALSE;
+	if (data == NULL)
+	    data = hp->bh_data;
+    }
+    /* Queued writes must be done first. */
+    (void)mf_async_wait(mfp);
+#endif
+
     if ((unsigned)vim_write(mfp->mf_fd, data, size) != size)
 	result = FAIL;
 
-#ifdef FEAT_CRYPT
+#if defined(FEAT_CRYPT) || defined(FEAT_SWAP_THREAD)
     if (data != hp->bh_data)
 	vim_free(data);
 #endif
@@ -1179,6 +1816,296 @@ mf_write_block(mfp, hp, offset, size)
     return result;
 }
 
+/*
+ * Compress block "hp" from the used list.  A new block header with the
+ * compressed data takes its place in the hash list and is put in the zip
+ * list.  "hp" is removed from the used and hash lists, its memory can be
+ * re-used.
+ * Return FAIL when the block is not compressed: for block zero, which memline
+ * expects in the used list, for an unchanged mapped block, which is cheaper
+ * to drop, when compressed blocks already use half of 'maxmemtot', when it
+ * doesn't get a quarter smaller or when out of memory.
+ */
+    static int
+mf_zip_block(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    unsigned	size = mfp->mf_page_size * hp->bh_page_count;
+    unsigned	len;
+    bhdr_T	*zp;
+
+    if (hp->bh_bnum == 0
+#ifdef FEAT_MMAP
+	    || (!(hp->bh_flags & BH_DIRTY) && MF_MAPPED(mfp, hp->bh_bnum))
+#endif
+	    || MF_ZIP_FULL
+	    || mf_zip_buf_grow(size) == FAIL)
+	return FAIL;
+    len = mf_compress(hp->bh_data, size, mf_zip_buf, size - size / 4);
+    if (len == 0)
+	return FAIL;
+
+    if ((zp = (bhdr_T *)alloc((unsigned)sizeof(bhdr_T))) == NULL)
+	return FAIL;
+    if ((zp->bh_data = alloc(len)) == NULL)
+    {
+	vim_free(zp);
+	return FAIL;
+    }
+    mch_memmove(zp->bh_data, mf_zip_buf, (size_t)len);
+    zp->bh_bnum = hp->bh_bnum;
+    zp->bh_page_count = hp->bh_page_count;
+    zp->bh_zip_len = len;
+    zp->bh_flags = (hp->bh_flags & (BH_DIRTY | BH_SUMMED)) | BH_ZIPPED;
+#ifdef FEAT_PERSISTENT_UNDO
+    if (hp->bh_flags & BH_SUMMED)
+	mch_memmove(zp->bh_sum, hp->bh_sum, sizeof(hp->bh_sum));
+#endif
+
+    mf_rem_used(mfp, hp);
+    mf_rem_hash(mfp, hp);
+    mf_ins_hash(mfp, zp);
+    mf_ins_zip(mfp, zp);
+    return OK;
+}
+
+/*
+ * Uncompress the data of block "hp" into "data".
+ * Return FAIL if the compressed data is invalid.
+ */
+    static int
+mf_unzip(mfp, hp, data)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+    char_u	*data;
+{
+    if (mf_decompress(hp->bh_data, hp->bh_zip_len, data,
+				mfp->mf_page_size * hp->bh_page_count) == OK)
+	return OK;
+    EMSG2(_(e_intern2), "mf_unzip()");
+    return FAIL;
+}
+
+/*
+ * Write compressed block "hp" to the swap file.  It stays in the zip list.
+ * Return FAIL for failure, OK otherwise
+ */
+    static int
+mf_write_zip(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    char_u	*zdata = hp->bh_data;
+    int		retval;
+
+    if (mf_zip_buf_grow(mfp->mf_page_size * hp->bh_page_count) == FAIL
+	    || mf_unzip(mfp, hp, mf_zip_buf) == FAIL)
+	return FAIL;
+    hp->bh_data = mf_zip_buf;
+    hp->bh_flags &= ~BH_ZIPPED;
+    retval = mf_write(mfp, hp);
+    hp->bh_data = zdata;
+    hp->bh_flags |= BH_ZIPPED;
+    return retval;
+}
+
+/*
+ * Remove compressed block "hp" from memory, writing it to the swap file first
+ * when it is dirty.
+ * Return FAIL when it must stay in memory.
+ */
+    static int
+mf_spill_zip(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    if (mfp->mf_fd < 0)
+	return FAIL;
+#ifdef FEAT_SWAP_THREAD
+    if (mf_async_busy(mfp))
+	return FAIL;
+    (void)mf_async_wait(mfp);
+#endif
+    if ((hp->bh_flags & BH_DIRTY) && mf_write_zip(mfp, hp) == FAIL)
+	return FAIL;
+    mf_rem_zip(mfp, hp);
+    mf_rem_hash(mfp, hp);
+    mf_free_bhdr(hp);
+    return OK;
+}
+
+/*
+ * Make sure "mf_zip_buf" can hold "size" bytes.
+ */
+    static int
+mf_zip_buf_grow(size)
+    unsigned	size;
+{
+    char_u	*p;
+
+    if (size <= mf_zip_buf_size)
+	return OK;
+    if ((p = alloc(size)) == NULL)
+	return FAIL;
+    vim_free(mf_zip_buf);
+    mf_zip_buf = p;
+    mf_zip_buf_size = size;
+    return OK;
+}
+
+/*
+ * Add literals "src[start]" up to "src[end]" to "dst" at "*opp".
+ * Return FAIL when they don't fit in "dstlen" bytes.
+ */
+    static int
+mf_zip_literals(src, start, end, dst, opp, dstlen)
+    char_u	*src;
+    unsigned	start;
+    unsigned	end;
+    char_u	*dst;
+    unsigned	*opp;
+    unsigned	dstlen;
+{
+    unsigned	n;
+
+    while (start < end)
+    {
+	n = end - start;
+	if (n > MF_ZIP_MAXLIT)
+	    n = MF_ZIP_MAXLIT;
+	if (*opp + n + 1 > dstlen)
+	    return FAIL;
+	dst[(*opp)++] = n - 1;
+	mch_memmove(dst + *opp, src + start, (size_t)n);
+	*opp += n;
+	start += n;
+    }
+    return OK;
+}
+
+/*
+ * Compress "srclen" bytes at "src" into "dst".
+ * Return the compressed size, zero when it doesn't fit in "dstlen" bytes.
+ */
+    static unsigned
+mf_compress(src, srclen, dst, dstlen)
+    char_u	*src;
+    unsigned	srclen;
+    char_u	*dst;
+    unsigned	dstlen;
+{
+    unsigned	base;		/* position zero in mf_zip_htab[] */
+    unsigned	ip = 0;		/* current position in "src" */
+    unsigned	lit = 0;	/* start of literals not added yet */
+    unsigned	op = 0;		/* current position in "dst" */
+    unsigned	v, h;
+    unsigned	ref;
+    unsigned	len, maxlen;
+    unsigned	off;
+
+    /* Entries from before are below the new base, this avoids clearing the
+     * table for every block. */
+    if (mf_zip_base == 0 || mf_zip_base > (unsigned)-1 - srclen)
+    {
+	vim_memset(mf_zip_htab, 0, sizeof(mf_zip_htab));
+	mf_zip_base = 1;
+    }
+    base = mf_zip_base;
+    mf_zip_base += srclen;
+    while (ip + 2 < srclen)
+    {
+	/* Find the last position where the next three bytes were seen. */
+	v = (src[ip] << 16) | (src[ip + 1] << 8) | src[ip + 2];
+	h = ((v >> (24 - MF_ZIP_HBITS)) - v * 5) & ((1 << MF_ZIP_HBITS) - 1);
+	ref = mf_zip_htab[h];
+	mf_zip_htab[h] = base + ip;
+	if (ref < base || base + ip - ref > MF_ZIP_MAXOFF
+		|| src[ref -= base] != src[ip]
+		|| src[ref + 1] != src[ip + 1]
+		|| src[ref + 2] != src[ip + 2])
+	{
+	    ++ip;
+	    continue;
+	}
+
+	maxlen = srclen - ip;
+	if (maxlen > MF_ZIP_MAXLEN)
+	    maxlen = MF_ZIP_MAXLEN;
+	for (len = 3; len < maxlen && src[ref + len] == src[ip + len]; ++len)
+	    ;
+
+	if (mf_zip_literals(src, lit, ip, dst, &op, dstlen) == FAIL
+							|| op + 3 > dstlen)
+	    return 0;
+	off = ip - ref - 1;
+	if (len - 2 < 7)
+	    dst[op++] = ((len - 2) << 5) | (off >> 8);
+	else
+	{
+	    dst[op++] = (7 << 5) | (off >> 8);
+	    dst[op++] = len - 9;
+	}
+	dst[op++] = off & 0xff;
+	ip += len;
+	lit = ip;
+    }
+    if (mf_zip_literals(src, lit, srclen, dst, &op, dstlen) == FAIL)
+	return 0;
+    return op;
+}
+
+/*
+ * Uncompress "srclen" bytes at "src" into "dstlen" bytes at "dst".
+ * Return FAIL if the data is invalid or does not have the expected size.
+ */
+    static int
+mf_decompress(src, srclen, dst, dstlen)
+    char_u	*src;
+    unsigned	srclen;
+    char_u	*dst;
+    unsigned	dstlen;
+{
+    unsigned	ip = 0;
+    unsigned	op = 0;
+    unsigned	n;
+    unsigned	off;
+    int		c;
+
+    while (ip < srclen)
+    {
+	c = src[ip++];
+	if (c < MF_ZIP_MAXLIT)		    /* literals */
+	{
+	    n = c + 1;
+	    if (ip + n > srclen || op + n > dstlen)
+		return FAIL;
+	    mch_memmove(dst + op, src + ip, (size_t)n);
+	    ip += n;
+	    op += n;
+	}
+	else				    /* match, may overlap */
+	{
+	    n = c >> 5;
+	    if (n == 7)
+	    {
+		if (ip >= srclen)
+		    return FAIL;
+		n += src[ip++];
+	    }
+	    n += 2;
+	    if (ip >= srclen)
+		return FAIL;
+	    off = ((c & 0x1f) << 8) + src[ip++] + 1;
+	    if (off > op || op + n > dstlen)
+		return FAIL;
+	    for ( ; n > 0; --n, ++op)
+		dst[op] = dst[op - off];
+	}
+    }
+    return op == dstlen ? OK : FAIL;
+}
+
 /*
  * Make block number for *hp positive and add it to the translation list
  *
@@ -1234,10 +2161,17 @@ mf_trans_add(mfp, hp)
 
     np->nt_old_bnum = hp->bh_bnum;	    /* adjust number */
     np->nt_new_bnum = new_bnum;
+#ifdef FEAT_MMAP
+    /* mf_trans_del() will decrement the count for a mapped block too */
+    if (MF_MAPPED(mfp, hp->bh_bnum))
+	mfp->mf_neg_count++;
+#endif
 
     mf_rem_hash(mfp, hp);		    /* remove from old hash list */
     hp->bh_bnum = new_bnum;
     mf_ins_hash(mfp, hp);		    /* insert in new hash list */
+    ++mfp->mf_renum_count;		    /* block numbers kept elsewhere are
+					       invalid now */
 
     hash = MEMHASH(np->nt_old_bnum);	    /* insert in trans list */
     np->nt_next = mfp->mf_trans[hash];
@@ -226,6 +226,14 @@ static linenr_T	lowest_marked = 0;
 #define ML_FLUSH	0x02	    /* flush locked block */
 #define ML_SIMPLE(x)	(x & 0x10)  /* DEL, INS or FIND */
 
+#if 0
+# define ML_CACHE_DEBUG	/* statistics for the cache of data blocks */
+
+static long ml_count_locked = 0;    /* count lines found in ml_locked */
+static long ml_count_cached = 0;    /* count lines found in ml_cache */
+static long ml_count_walked = 0;    /* count lines found in the tree */
+#endif
+
 /* argument for ml_upd_block0() */
 typedef enum {
       UB_FNAME = 0	/* update timestamp and filename */
@@ -246,12 +254,17 @@ static void add_b0_fenc __ARGS((ZERO_BL *b0p, buf_T *buf));
 static time_t swapfile_info __ARGS((char_u *));
 static int recov_file_names __ARGS((char_u **, char_u *, int prepend_dot));
 static int ml_append_int __ARGS((buf_T *, linenr_T, char_u *, colnr_T, int, int));
+static long ml_append_fill __ARGS((buf_T *buf, linenr_T lnum, char_u **lines, colnr_T *lens, long count, int newfile));
 static int ml_delete_int __ARGS((buf_T *, linenr_T, int));
+static long ml_delete_range __ARGS((buf_T *buf, linenr_T lnum, long count));
 static char_u *findswapname __ARGS((buf_T *, char_u **, char_u *));
 static void ml_flush_line __ARGS((buf_T *));
 static bhdr_T *ml_new_data __ARGS((memfile_T *, int, int));
 static bhdr_T *ml_new_ptr __ARGS((memfile_T *));
 static bhdr_T *ml_find_line __ARGS((buf_T *, linenr_T, int));
+static bhdr_T *ml_cache_find __ARGS((buf_T *buf, linenr_T lnum));
+static void ml_cache_add __ARGS((buf_T *buf, bhdr_T *hp));
+static void ml_cache_clear __ARGS((buf_T *buf));
 static int ml_add_stack __ARGS((buf_T *));
 static void ml_lineadd __ARGS((buf_T *, int));
 static int b0_magic_wrong __ARGS((ZERO_BL *));
@@ -267,7 +280,11 @@ static char_u *make_percent_swname __ARGS((char_u *dir, char_u *name));
 static void ml_crypt_prepare __ARGS((memfile_T *mfp, off_t offset, int reading));
 #endif
 #ifdef FEAT_BYTEOFF
-static void ml_updatechunk __ARGS((buf_T *buf, long line, long len, int updtype));
+static void ml_updatechunk __ARGS((buf_T *buf, long line, long count, long len, int updtype));
+static linenr_T ml_chunk_end __ARGS((buf_T *buf, linenr_T line));
+static int ml_chunktree_build __ARGS((buf_T *buf));
+static void ml_chunktree_add __ARGS((buf_T *buf, int ix, long lines, long size));
+static int ml_find_chunk __ARGS((buf_T *buf, linenr_T lnum, long offset, int ffdos, linenr_T *curlinep, long *sizep));
 #endif
 
 /*
@@ -295,6 +312,9 @@ ml_open(buf)
     buf->b_ml.ml_line_lnum = 0;	/* no cached line */
 #ifdef FEAT_BYTEOFF
     buf->b_ml.ml_chunksize = NULL;
+    buf->b_ml.ml_chunktree = NULL;
+    buf->b_ml.ml_chunktree_len = 0;
+    buf->b_ml.ml_chunktree_max = 0;
 #endif
 
     /*
@@ -316,6 +336,7 @@ ml_open(buf)
 #ifdef FEAT_CRYPT
     mfp->mf_buffer = buf;
 #endif
+    ml_cache_clear(buf);
     buf->b_ml.ml_flags = ML_EMPTY;
     buf->b_ml.ml_line_count = 1;
 #ifdef FEAT_LINEBREAK
@@ -650,6 +671,9 @@ ml_setname(buf)
 	/* need to close the swap file before renaming */
 	if (mfp->mf_fd >= 0)
 	{
+#ifdef FEAT_SWAP_THREAD
+	    (void)mf_async_wait(mfp);
+#endif
 	    close(mfp->mf_fd);
 	    mfp->mf_fd = -1;
 	}
@@ -821,6 +845,10 @@ ml_close(buf, del_file)
 #ifdef FEAT_BYTEOFF
     vim_free(buf->b_ml.ml_chunksize);
     buf->b_ml.ml_chunksize = NULL;
+    vim_free(buf->b_ml.ml_chunktree);
+    buf->b_ml.ml_chunktree = NULL;
+    buf->b_ml.ml_chunktree_len = 0;
+    buf->b_ml.ml_chunktree_max = 0;
 #endif
     buf->b_ml.ml_mfp = NULL;
 
@@ -1084,6 +1112,7 @@ ml_recover()
     long	error;
     int		cannot_open;
     linenr_T	line_count;
+    linenr_T	old_lnum;
     int		has_error;
     int		idx;
     int		top;
@@ -1192,6 +1221,7 @@ ml_recover()
 #ifdef FEAT_CRYPT
     mfp->mf_buffer = buf;
 #endif
+    ml_cache_clear(buf);
 
     /*
      * The page size set in mf_open() might be different from the page size
@@ -1477,12 +1507,19 @@ ml_recover()
 			 * Try to read lines from the original file.
 			 * This is slow, but it works.
 			 */
+			line_count = pp->pb_pointer[idx].pe_line_count;
+			old_lnum = pp->pb_pointer[idx].pe_old_lnum;
+			/* Read following blocks that continue in the original
+			 * file at the same time, each read starts at the top. */
+			while (idx + 1 < (int)pp->pb_count
+				&& pp->pb_pointer[idx + 1].pe_bnum < 0
+				&& pp->pb_pointer[idx + 1].pe_old_lnum
+						       == old_lnum + line_count)
+			    line_count += pp->pb_pointer[++idx].pe_line_count;
 			if (!cannot_open)
 			{
-			    line_count = pp->pb_pointer[idx].pe_line_count;
 			    if (readfile(curbuf->b_ffname, NULL, lnum,
-					pp->pb_pointer[idx].pe_old_lnum - 1,
-					line_count, NULL, 0) == FAIL)
+					old_lnum - 1, line_count, NULL, 0) == FAIL)
 				cannot_open = TRUE;
 			    else
 				lnum += line_count;
@@ -1512,6 +1549,7 @@ ml_recover()
 		    bnum = pp->pb_pointer[idx].pe_bnum;
 		    line_count = pp->pb_pointer[idx].pe_line_count;
 		    page_count = pp->pb_pointer[idx].pe_page_count;
+		    idx = 0;
 		    continue;
 		}
 	    }
@@ -2285,7 +2323,10 @@ ml_sync_all(check_file, check_char)
 	}
 	if (buf->b_ml.ml_mfp->mf_dirty)
 	{
-	    (void)mf_sync(buf->b_ml.ml_mfp, (check_char ? MFS_STOP : 0)
+	    /* When waiting for a character let the swap thread do the
+	     * writing, so that typing is not delayed. */
+	    (void)mf_sync(buf->b_ml.ml_mfp,
+			       (check_char ? MFS_STOP | MFS_ASYNC : 0)
 					| (bufIsChanged(buf) ? MFS_FLUSH : 0));
 	    if (check_char && ui_char_avail())	/* character available now */
 		break;
@@ -2473,11 +2514,12 @@ errorret:
 	ml_flush_line(buf);
 
 	/*
-	 * Find the data block containing the line.
-	 * This also fills the stack with the blocks from the root to the data
-	 * block and releases any locked block.
+	 * Find the data block containing the line.  First try the recently
+	 * used blocks.  Otherwise this fills the stack with the blocks from the
+	 * root to the data block and releases any locked block.
 	 */
-	if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+	if ((hp = ml_cache_find(buf, lnum)) == NULL
+		&& (hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
 	{
 	    if (recursive == 0)
 	    {
@@ -2513,6 +2555,122 @@ ml_line_alloced()
     return (curbuf->b_ml.ml_flags & ML_LINE_DIRTY);
 }
 
+static char_u *ml_memfind __ARGS((char_u *p, char_u *end, char_u *str, int len));
+
+/*
+ * Find the "len" bytes of "str" in the text from "p" to "end".
+ * With SSE2 16 positions are checked at a time for the first and last byte
+ * of "str", only where both are found the rest is compared.
+ * Returns a pointer to the first occurrence, NULL if there is none.
+ */
+    static char_u *
+ml_memfind(p, end, str, len)
+    char_u	*p;
+    char_u	*end;
+    char_u	*str;
+    int		len;
+{
+#ifdef USE_SSE2
+    __m128i	first = _mm_set1_epi8((char)str[0]);
+    __m128i	last = _mm_set1_epi8((char)str[len - 1]);
+    int		mask;
+    int		i;
+#endif
+
+    /* "end" is where the last possible match starts. */
+    end -= len - 1;
+#ifdef USE_SSE2
+    for ( ; p + 16 <= end; p += 16)
+    {
+	mask = _mm_movemask_epi8(_mm_and_si128(
+		    _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)p), first),
+		    _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(p + len - 1)),
+								       last)));
+	for (i = 0; mask != 0; ++i, mask >>= 1)
+	    if ((mask & 1) && memcmp(p + i, str, (size_t)len) == 0)
+		return p + i;
+    }
+#endif
+    while (p < end && (p = memchr(p, *str, (size_t)(end - p))) != NULL)
+    {
+	if (memcmp(p + 1, str + 1, (size_t)(len - 1)) == 0)
+	    return p;
+	++p;
+    }
+    return NULL;
+}
+
+/*
+ * Find the first line from "lnum" to "last" in buffer "buf" that contains
+ * the "len" bytes of "str", which must not include a NUL.
+ * The text of a data block is searched at once, thus a block without "str"
+ * is skipped without looking at its lines.  Used to avoid trying a pattern
+ * on lines that can't match.
+ * Returns the line number, "last" + 1 when not found.  When interrupted
+ * returns the first line not searched yet.
+ */
+    linenr_T
+ml_find_text(buf, lnum, last, str, len)
+    buf_T	*buf;
+    linenr_T	lnum;
+    linenr_T	last;
+    char_u	*str;
+    int		len;
+{
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    linenr_T	high;
+    int		idx;
+    char_u	*start;
+    char_u	*end;
+
+    if (buf->b_ml.ml_mfp == NULL || len <= 0)
+	return lnum;
+    if (last > buf->b_ml.ml_line_count)
+	last = buf->b_ml.ml_line_count;
+
+    /* A changed line is not in its data block yet. */
+    ml_flush_line(buf);
+
+    while (lnum <= last)
+    {
+	if ((hp = ml_cache_find(buf, lnum)) == NULL
+		&& (hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+	    break;	/* let ml_get() give the error message */
+	dp = (DATA_BL *)(hp->bh_data);
+	idx = lnum - buf->b_ml.ml_locked_low;
+	high = buf->b_ml.ml_locked_high;
+	if (high > last)
+	    high = last;
+
+	/* The text of the first line is at the end of the block, thus lines
+	 * "lnum" to "high" are in one piece starting at line "high". */
+	start = (char_u *)dp + (dp->db_index[high - buf->b_ml.ml_locked_low]
+							      & DB_INDEX_MASK);
+	if (idx == 0)
+	    end = (char_u *)dp + dp->db_txt_end;
+	else
+	    end = (char_u *)dp + (dp->db_index[idx - 1] & DB_INDEX_MASK);
+	if (ml_memfind(start, end, str, len) != NULL)
+	{
+	    /* Found it somewhere, find the first line that has it. */
+	    for ( ; lnum <= high; ++lnum, ++idx)
+	    {
+		start = (char_u *)dp + (dp->db_index[idx] & DB_INDEX_MASK);
+		if (ml_memfind(start, end, str, len) != NULL)
+		    return lnum;
+		end = start;
+	    }
+	}
+	lnum = high + 1;
+
+	line_breakcheck();
+	if (got_int)
+	    break;
+    }
+    return lnum;
+}
+
 /*
  * Append a line after lnum (may be 0 to insert a line in front of the file).
  * "line" does not need to be allocated, but can't be another line in a
@@ -3047,7 +3205,7 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
 
 #ifdef FEAT_BYTEOFF
     /* The line was inserted below 'lnum' */
-    ml_updatechunk(buf, lnum + 1, (long)len, ML_CHNK_ADDLINE);
+    ml_updatechunk(buf, lnum + 1, 1L, (long)len, ML_CHNK_ADDLINE);
 #endif
 #ifdef FEAT_NETBEANS_INTG
     if (netbeans_active())
@@ -3061,6 +3219,167 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
     return OK;
 }
 
+/*
+ * Append "count" lines after lnum (may be 0 to insert in front of the file).
+ * "lines[]" has the text of the lines, "lens[]" their lengths including the
+ * NUL, or "lens" is NULL to use STRLEN().
+ * Does the same as calling ml_append() for each line, but fills a data block
+ * with as many lines as fit in one go.
+ * Check: The caller of this function should probably also call
+ * appended_lines().
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_append_lines(lnum, lines, lens, count, newfile)
+    linenr_T	lnum;		/* append after this line (can be 0) */
+    char_u	**lines;	/* text of the new lines */
+    colnr_T	*lens;		/* lengths of the new lines or NULL */
+    long	count;		/* number of lines in "lines" */
+    int		newfile;	/* flag, see ml_append() */
+{
+    long	n;
+
+    /* When starting up, we might still need to create the memfile */
+    if (curbuf->b_ml.ml_mfp == NULL && open_buffer(FALSE, NULL, 0) == FAIL)
+	return FAIL;
+
+    if (curbuf->b_ml.ml_line_lnum != 0)
+	ml_flush_line(curbuf);
+    while (count > 0)
+    {
+	n = ml_append_fill(curbuf, lnum, lines, lens, count, newfile);
+	if (n < 0)
+	    return FAIL;
+	if (n == 0)
+	{
+	    /* Block is full, let ml_append_int() split it. */
+	    if (ml_append_int(curbuf, lnum, lines[0],
+			    lens == NULL ? (colnr_T)0 : lens[0],
+							newfile, FALSE) == FAIL)
+		return FAIL;
+	    n = 1;
+	}
+	lnum += n;
+	lines += n;
+	if (lens != NULL)
+	    lens += n;
+	count -= n;
+    }
+    return OK;
+}
+
+/*
+ * Insert lines after "lnum" in the data block that contains "lnum", as many
+ * of the "count" lines in "lines[]" as there is room for.
+ * Returns the number of lines inserted, zero when not even one line fits and
+ * -1 for failure.
+ */
+    static long
+ml_append_fill(buf, lnum, lines, lens, count, newfile)
+    buf_T	*buf;
+    linenr_T	lnum;
+    char_u	**lines;
+    colnr_T	*lens;
+    long	count;
+    int		newfile;
+{
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    int		db_idx;		/* index for lnum in data block */
+    int		line_count;	/* number of indexes in current block */
+    int		offset;
+    int		text_len = 0;	/* total length of the new lines */
+    int		len;
+    long	n;
+    int		i;
+
+					/* lnum out of range */
+    if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
+	return -1;
+
+    if ((hp = ml_find_line(buf, lnum == 0 ? (linenr_T)1 : lnum,
+							    ML_FIND)) == NULL)
+	return -1;
+    dp = (DATA_BL *)(hp->bh_data);
+
+    /* Find out how many lines fit in the block. */
+    for (n = 0; n < count; ++n)
+    {
+	len = lens == NULL ? (int)STRLEN(lines[n]) + 1 : (int)lens[n];
+	if (text_len + len + (n + 1) * INDEX_SIZE > (long)dp->db_free)
+	    break;
+	text_len += len;
+    }
+    if (n == 0)
+	return 0;
+
+    if (lowest_marked && lowest_marked > lnum)
+	lowest_marked = lnum + 1;
+    ml_cache_clear(buf);
+
+    if (lnum == 0)		/* got line one instead, correct db_idx */
+	db_idx = -1;		/* careful, it is negative! */
+    else
+	db_idx = lnum - buf->b_ml.ml_locked_low;
+    line_count = buf->b_ml.ml_locked_high - buf->b_ml.ml_locked_low + 1;
+
+    /*
+     * Offset is the start of the text of line "lnum", the new lines go just
+     * below it.  Move the text of the lines that follow to the front and
+     * adjust their indexes.
+     */
+    if (db_idx < 0)
+	offset = dp->db_txt_end;
+    else
+	offset = ((dp->db_index[db_idx]) & DB_INDEX_MASK);
+    if (line_count > db_idx + 1)
+    {
+	mch_memmove((char *)dp + dp->db_txt_start - text_len,
+					       (char *)dp + dp->db_txt_start,
+				      (size_t)(offset - dp->db_txt_start));
+	for (i = line_count - 1; i > db_idx; --i)
+	    dp->db_index[i + n] = dp->db_index[i] - text_len;
+    }
+    dp->db_txt_start -= text_len;
+    dp->db_free -= text_len + n * INDEX_SIZE;
+    dp->db_line_count += n;
+
+    /* Copy the text of the new lines into the block. */
+    for (i = 0; i < n; ++i)
+    {
+	len = lens == NULL ? (int)STRLEN(lines[i]) + 1 : (int)lens[i];
+	offset -= len;
+	dp->db_index[db_idx + 1 + i] = offset;
+	mch_memmove((char *)dp + offset, lines[i], (size_t)len);
+    }
+
+    /* The pointer blocks are updated from ml_locked_lineadd later. */
+    buf->b_ml.ml_locked_high += n;
+    buf->b_ml.ml_locked_lineadd += n;
+    buf->b_ml.ml_line_count += n;
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+    buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+    if (!newfile)
+	buf->b_ml.ml_flags |= ML_LOCKED_POS;
+
+#ifdef FEAT_BYTEOFF
+    ml_updatechunk(buf, lnum + 1, n, (long)text_len, ML_CHNK_ADDLINE);
+#endif
+#ifdef FEAT_NETBEANS_INTG
+    if (netbeans_active())
+	for (i = 0; i < n; ++i)
+	{
+	    len = (int)STRLEN(lines[i]);
+	    if (len > 0)
+		netbeans_inserted(buf, lnum + 1 + i, (colnr_T)0, lines[i], len);
+	    netbeans_inserted(buf, lnum + 1 + i, (colnr_T)len,
+							   (char_u *)"\n", 1);
+	}
+#endif
+    return n;
+}
+
 /*
  * Replace line lnum, with buffering, in current buffer.
  *
@@ -3276,11 +3595,151 @@ ml_delete_int(buf, lnum, message)
     }
 
 #ifdef FEAT_BYTEOFF
-    ml_updatechunk(buf, lnum, line_size, ML_CHNK_DELLINE);
+    ml_updatechunk(buf, lnum, 1L, line_size, ML_CHNK_DELLINE);
 #endif
     return OK;
 }
 
+/*
+ * Delete "count" lines, starting at "lnum", in the current buffer.
+ * Does the same as calling ml_delete() "count" times, but removes the lines
+ * of a data block in one go.
+ * Check: The caller of this function should probably also call
+ * deleted_lines() after this.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_delete_lines(lnum, count, message)
+    linenr_T	lnum;
+    long	count;
+    int		message;
+{
+    long	n;
+
+    ml_flush_line(curbuf);
+    while (count > 0)
+    {
+	n = ml_delete_range(curbuf, lnum, count);
+	if (n < 0)
+	    return FAIL;
+	if (n == 0)
+	{
+	    /* Last line in the block, let ml_delete_int() free the block. */
+	    if (ml_delete_int(curbuf, lnum, message) == FAIL)
+		return FAIL;
+	    n = 1;
+	}
+	count -= n;
+    }
+    return OK;
+}
+
+/*
+ * Delete up to "count" lines from "lnum" in the data block that contains
+ * "lnum".  Never deletes the last line left in the block.
+ * Returns the number of lines deleted, zero when none were deleted and -1 for
+ * failure.
+ */
+    static long
+ml_delete_range(buf, lnum, count)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	count;
+{
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    int		bcount;	    /* number of entries in block */
+    int		idx;
+    int		text_start;
+    int		line_start;
+    int		line_end;
+    long	size;
+    long	n;
+    int		i;
+#ifdef FEAT_BYTEOFF
+    long	m;
+    int		j;
+#endif
+
+    if (lnum < 1 || lnum > buf->b_ml.ml_line_count
+					       || buf->b_ml.ml_mfp == NULL)
+	return -1;
+
+    if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+	return -1;
+    dp = (DATA_BL *)(hp->bh_data);
+    bcount = buf->b_ml.ml_locked_high - buf->b_ml.ml_locked_low + 1;
+    idx = lnum - buf->b_ml.ml_locked_low;
+
+    n = bcount - idx;
+    if (n > count)
+	n = count;
+    if (n == bcount)
+	--n;
+    if (n <= 0)
+	return 0;
+
+    if (lowest_marked && lowest_marked > lnum)
+	lowest_marked = lowest_marked - n > lnum ? lowest_marked - n : lnum;
+    ml_cache_clear(buf);
+
+    /* The text of lines idx to idx + n - 1 is from line_start to line_end. */
+    line_end = idx == 0 ? dp->db_txt_end
+			       : ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
+    line_start = ((dp->db_index[idx + n - 1]) & DB_INDEX_MASK);
+    size = line_end - line_start;
+
+#ifdef FEAT_BYTEOFF
+    /* Update the chunks, for the lines in each chunk at once. */
+    for (i = 0; i < n; i += m)
+    {
+	m = ml_chunk_end(buf, lnum) - lnum;
+	if (m > n - i)
+	    m = n - i;
+	j = idx + i;
+	ml_updatechunk(buf, lnum, m,
+		(long)((j == 0 ? dp->db_txt_end
+			      : ((dp->db_index[j - 1]) & DB_INDEX_MASK))
+		    - ((dp->db_index[j + m - 1]) & DB_INDEX_MASK)),
+		ML_CHNK_DELLINE);
+    }
+#endif
+#ifdef FEAT_NETBEANS_INTG
+    if (netbeans_active())
+	for (i = 0; i < n; ++i)
+	    netbeans_removed(buf, lnum, 0,
+		    (long)((idx + i == 0 ? dp->db_txt_end
+			      : ((dp->db_index[idx + i - 1]) & DB_INDEX_MASK))
+			  - ((dp->db_index[idx + i]) & DB_INDEX_MASK)));
+#endif
+
+    /*
+     * Move the text of the lines that follow over the deleted text and
+     * delete the indexes by moving the next indexes backwards.
+     */
+    text_start = dp->db_txt_start;
+    mch_memmove((char *)dp + text_start + size, (char *)dp + text_start,
+					       (size_t)(line_start - text_start));
+    for (i = idx; i < bcount - n; ++i)
+	dp->db_index[i] = dp->db_index[i + n] + size;
+
+    dp->db_free += size + n * INDEX_SIZE;
+    dp->db_txt_start += size;
+    dp->db_line_count -= n;
+
+    /* The pointer blocks are updated from ml_locked_lineadd later. */
+    buf->b_ml.ml_locked_high -= n;
+    buf->b_ml.ml_locked_lineadd -= n;
+    buf->b_ml.ml_line_count -= n;
+
+    /*
+     * mark the block dirty and make sure it is in the file (for recovery)
+     */
+    buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
+    return n;
+}
+
 /*
  * set the B_MARKED flag for line 'lnum'
  */
@@ -3477,7 +3936,7 @@ ml_flush_line(buf)
 		buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
 #ifdef FEAT_BYTEOFF
 		/* The else case is already covered by the insert and delete */
-		ml_updatechunk(buf, lnum, (long)extra, ML_CHNK_UPDLINE);
+		ml_updatechunk(buf, lnum, 1L, (long)extra, ML_CHNK_UPDLINE);
 #endif
 	    }
 	    else
@@ -3592,11 +4051,16 @@ ml_find_line(buf, lnum, action)
      * Don't do this for ML_FLUSH, because we want to flush the locked block.
      * Don't do this when 'swapfile' is reset, we want to load all the blocks.
      */
+    /* Inserting or deleting lines changes the line numbers of blocks. */
+    if (action == ML_INSERT || action == ML_DELETE)
+	ml_cache_clear(buf);
+
     if (buf->b_ml.ml_locked)
     {
 	if (ML_SIMPLE(action)
 		&& buf->b_ml.ml_locked_low <= lnum
 		&& buf->b_ml.ml_locked_high >= lnum
+		&& !(buf->b_ml.ml_flags & ML_LOCKED_CACHED)
 		&& !mf_dont_release)
 	{
 	    /* remember to update pointer blocks and stack later */
@@ -3676,7 +4140,10 @@ ml_find_line(buf, lnum, action)
 	    buf->b_ml.ml_locked_low = low;
 	    buf->b_ml.ml_locked_high = high;
 	    buf->b_ml.ml_locked_lineadd = 0;
-	    buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+	    buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS
+							  | ML_LOCKED_CACHED);
+	    if (action == ML_FIND)
+		ml_cache_add(buf, hp);
 	    return hp;
 	}
 
@@ -3765,51 +4232,198 @@ error_noblock:
 }
 
 /*
- * add an entry to the info pointer stack
- *
- * return -1 for failure, number of the new entry otherwise
+ * Find the data block containing line "lnum" in the locked block or in the
+ * recently used blocks and lock it, without walking the tree.  The stack does
+ * not lead to a block found in ml_cache.
+ * Returns NULL when the block is not found.
  */
-    static int
-ml_add_stack(buf)
+    static bhdr_T *
+ml_cache_find(buf, lnum)
     buf_T	*buf;
+    linenr_T	lnum;
 {
-    int		top;
-    infoptr_T	*newstack;
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    mlcache_T	*mcp;
+    bhdr_T	*hp;
+    int		i;
 
-    top = buf->b_ml.ml_stack_top;
+    if (mf_dont_release)
+	return NULL;
+    if (buf->b_ml.ml_locked != NULL
+	    && buf->b_ml.ml_locked_low <= lnum
+	    && buf->b_ml.ml_locked_high >= lnum)
+    {
+#ifdef ML_CACHE_DEBUG
+	++ml_count_locked;
+#endif
+	return buf->b_ml.ml_locked;
+    }
 
-    /* may have to increase the stack size */
-    if (top == buf->b_ml.ml_stack_size)
+    /* Blocks that got a new number can't be found by the old number. */
+    if (buf->b_ml.ml_cache_renum != mfp->mf_renum_count)
+	ml_cache_clear(buf);
+    for (i = 0; i < ML_CACHE_SIZE; ++i)
     {
-	CHECK(top > 0, _("Stack size increases")); /* more than 5 levels??? */
+	mcp = &buf->b_ml.ml_cache[i];
+	if (mcp->mc_bnum != 0 && mcp->mc_low <= lnum && mcp->mc_high >= lnum)
+	    break;
+    }
+    if (i == ML_CACHE_SIZE)
+    {
+#ifdef ML_CACHE_DEBUG
+	++ml_count_walked;
+#endif
+	return NULL;
+    }
 
-	newstack = (infoptr_T *)alloc((unsigned)sizeof(infoptr_T) *
-					(buf->b_ml.ml_stack_size + STACK_INCR));
-	if (newstack == NULL)
-	    return -1;
-	mch_memmove(newstack, buf->b_ml.ml_stack,
-					     (size_t)top * sizeof(infoptr_T));
-	vim_free(buf->b_ml.ml_stack);
-	buf->b_ml.ml_stack = newstack;
-	buf->b_ml.ml_stack_size += STACK_INCR;
+    /* Release the locked block, like ml_find_line() does. */
+    if (buf->b_ml.ml_locked != NULL)
+    {
+	mf_put(mfp, buf->b_ml.ml_locked, buf->b_ml.ml_flags & ML_LOCKED_DIRTY,
+					    buf->b_ml.ml_flags & ML_LOCKED_POS);
+	buf->b_ml.ml_locked = NULL;
+	if (buf->b_ml.ml_locked_lineadd != 0)
+	    ml_lineadd(buf, buf->b_ml.ml_locked_lineadd);
     }
 
-    buf->b_ml.ml_stack_top++;
-    return top;
+    if ((hp = mf_get(mfp, mcp->mc_bnum, mcp->mc_page_count)) == NULL)
+    {
+	ml_cache_clear(buf);
+	return NULL;
+    }
+    if (((DATA_BL *)(hp->bh_data))->db_id != DATA_ID)
+    {
+	mf_put(mfp, hp, FALSE, FALSE);
+	ml_cache_clear(buf);
+	return NULL;
+    }
+#ifdef ML_CACHE_DEBUG
+    ++ml_count_cached;
+#endif
+    buf->b_ml.ml_locked = hp;
+    buf->b_ml.ml_locked_low = mcp->mc_low;
+    buf->b_ml.ml_locked_high = mcp->mc_high;
+    buf->b_ml.ml_locked_lineadd = 0;
+    buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+    buf->b_ml.ml_flags |= ML_LOCKED_CACHED;
+    return hp;
 }
 
 /*
- * Update the pointer blocks on the stack for inserted/deleted lines.
- * The stack itself is also updated.
- *
- * When a insert/delete line action fails, the line is not inserted/deleted,
- * but the pointer blocks have already been updated. That is fixed here by
- * walking through the stack.
- *
- * Count is the number of lines added, negative if lines have been deleted.
+ * Remember data block "hp", just locked by ml_find_line(), in the recently
+ * used blocks.  Replaces the oldest entry.
  */
     static void
-ml_lineadd(buf, count)
+ml_cache_add(buf, hp)
+    buf_T	*buf;
+    bhdr_T	*hp;
+{
+    mlcache_T	*mcp;
+    int		i;
+
+    if (buf->b_ml.ml_cache_renum != buf->b_ml.ml_mfp->mf_renum_count)
+	ml_cache_clear(buf);
+    for (i = 0; i < ML_CACHE_SIZE; ++i)
+	if (buf->b_ml.ml_cache[i].mc_bnum == hp->bh_bnum)
+	    break;
+    if (i == ML_CACHE_SIZE)
+    {
+	i = buf->b_ml.ml_cache_next;
+	buf->b_ml.ml_cache_next = (i + 1) % ML_CACHE_SIZE;
+    }
+    mcp = &buf->b_ml.ml_cache[i];
+    mcp->mc_bnum = hp->bh_bnum;
+    mcp->mc_page_count = hp->bh_page_count;
+    mcp->mc_low = buf->b_ml.ml_locked_low;
+    mcp->mc_high = buf->b_ml.ml_locked_high;
+}
+
+/*
+ * Forget the recently used blocks, when line numbers change.
+ */
+    static void
+ml_cache_clear(buf)
+    buf_T	*buf;
+{
+    int		i;
+
+    for (i = 0; i < ML_CACHE_SIZE; ++i)
+	buf->b_ml.ml_cache[i].mc_bnum = 0;
+    buf->b_ml.ml_cache_next = 0;
+    if (buf->b_ml.ml_mfp != NULL)
+	buf->b_ml.ml_cache_renum = buf->b_ml.ml_mfp->mf_renum_count;
+}
+
+/*
+ * Print how often ml_get() found the line in the locked block, in the
+ * recently used blocks or in the tree.
+ * Useful when trying a different ML_CACHE_SIZE.  Called when exiting.
+ */
+    void
+ml_cache_debug_results()
+{
+#ifdef ML_CACHE_DEBUG
+    long	total = ml_count_locked + ml_count_cached + ml_count_walked;
+
+    if (total == 0)
+	return;
+    fprintf(stderr, "\r\n\r\n\r\n\r\n");
+    fprintf(stderr, "Number of data block lookups: %ld\r\n", total);
+    fprintf(stderr, "Found in locked block: %ld%%\r\n",
+						 ml_count_locked * 100 / total);
+    fprintf(stderr, "Found in block cache: %ld%%\r\n",
+						 ml_count_cached * 100 / total);
+    fprintf(stderr, "Found in the tree: %ld%%\r\n",
+						 ml_count_walked * 100 / total);
+#endif
+}
+
+/*
+ * add an entry to the info pointer stack
+ *
+ * return -1 for failure, number of the new entry otherwise
+ */
+    static int
+ml_add_stack(buf)
+    buf_T	*buf;
+{
+    int		top;
+    infoptr_T	*newstack;
+
+    top = buf->b_ml.ml_stack_top;
+
+    /* may have to increase the stack size */
+    if (top == buf->b_ml.ml_stack_size)
+    {
+	CHECK(top > 0, _("Stack size increases")); /* more than 5 levels??? */
+
+	newstack = (infoptr_T *)alloc((unsigned)sizeof(infoptr_T) *
+					(buf->b_ml.ml_stack_size + STACK_INCR));
+	if (newstack == NULL)
+	    return -1;
+	mch_memmove(newstack, buf->b_ml.ml_stack,
+					     (size_t)top * sizeof(infoptr_T));
+	vim_free(buf->b_ml.ml_stack);
+	buf->b_ml.ml_stack = newstack;
+	buf->b_ml.ml_stack_size += STACK_INCR;
+    }
+
+    buf->b_ml.ml_stack_top++;
+    return top;
+}
+
+/*
+ * Update the pointer blocks on the stack for inserted/deleted lines.
+ * The stack itself is also updated.
+ *
+ * When a insert/delete line action fails, the line is not inserted/deleted,
+ * but the pointer blocks have already been updated. That is fixed here by
+ * walking through the stack.
+ *
+ * Count is the number of lines added, negative if lines have been deleted.
+ */
+    static void
+ml_lineadd(buf, count)
     buf_T	*buf;
     int		count;
 {
@@ -4916,6 +5530,255 @@ ml_crypt_prepare(mfp, offset, reading)
 
 #endif
 
+#if defined(FEAT_PERSISTENT_UNDO) || defined(PROTO)
+/*
+ * Checksum of the buffer text, used to check that an undo file belongs to
+ * the text.  The text of each line with its NUL is cut in symbols of three
+ * bytes, the last one padded with NULs.  In each lane the checksum is the
+ * polynomial of all these symbols (plus one) in base ml_sum_base[] modulo
+ * 2^31 - 1.  Unlike a digest like SHA-256 this does not depend on how the
+ * lines are spread over blocks: for text A followed by text B
+ *	sum(AB) = sum(A) * base ^ symbols(B) + sum(B)
+ * Therefore the sum of a data block is kept with the block, in bh_sum[], until
+ * the block changes.  Computing the checksum of the buffer then only needs to
+ * look at the changed blocks and combine the sums following the pointer
+ * blocks, thus like a Merkle tree.
+ * bh_sum[] holds the sums of the lanes followed by the base of each lane to
+ * the power of the number of symbols.
+ */
+# define ML_SUM_PRIME	0x7fffffffUL	/* 2^31 - 1 */
+
+/* Reduce "x", which is below 2^32, modulo ML_SUM_PRIME. */
+# define ML_SUM_MOD(x) ((x) = ((x) & ML_SUM_PRIME) + ((x) >> 31), \
+			(x) >= ML_SUM_PRIME ? ((x) -= ML_SUM_PRIME) : 0)
+
+static UINT32_T ml_sum_base[BH_SUM_LANES] = {
+	0x2f0f1b4d, 0x5a3c6d21, 0x163e2b8f, 0x7134c5e3,
+	0x4b1d07a9, 0x0c5f3e71, 0x3d2a9b17, 0x6e4c1f35};
+
+static UINT32_T ml_sum_muladd __ARGS((UINT32_T a, UINT32_T b, UINT32_T c));
+static UINT32_T ml_sum_pow __ARGS((UINT32_T a, long n));
+static void ml_sum_data __ARGS((DATA_BL *dp, UINT32_T *sum));
+static void ml_sum_append __ARGS((UINT32_T *sum, UINT32_T *part));
+static int ml_sum_tree __ARGS((buf_T *buf, blocknr_T bnum, int page_count, UINT32_T *sum));
+
+/*
+ * Return ("a" * "b" + "c") modulo ML_SUM_PRIME, all three below
+ * ML_SUM_PRIME.  Without a 64 bit long split in 16 bit halves, either way
+ * use that 2^31 == 1.
+ */
+    static UINT32_T
+ml_sum_muladd(a, b, c)
+    UINT32_T	a;
+    UINT32_T	b;
+    UINT32_T	c;
+{
+# if defined(SIZEOF_LONG) && SIZEOF_LONG >= 8
+    unsigned long   x = (unsigned long)a * b + c;   /* below 2^63 */
+
+    x = (x & ML_SUM_PRIME) + (x >> 31);
+    x = (x & ML_SUM_PRIME) + (x >> 31);
+    return (UINT32_T)(x >= ML_SUM_PRIME ? x - ML_SUM_PRIME : x);
+# else
+    UINT32_T	a1 = a >> 16, a0 = a & 0xffff;
+    UINT32_T	b1 = b >> 16, b0 = b & 0xffff;
+    UINT32_T	m = a1 * b0 + a0 * b1;	    /* below 2^32 */
+    UINT32_T	r, t;
+
+    /* a * b = a1 * b1 * 2^32 + m * 2^16 + a0 * b0 */
+    r = ((a1 * b1) << 1) + (m >> 15);
+    ML_SUM_MOD(r);
+    r += (m & 0x7fff) << 16;
+    ML_SUM_MOD(r);
+    t = a0 * b0;
+    ML_SUM_MOD(t);
+    r += t;
+    ML_SUM_MOD(r);
+    r += c;
+    ML_SUM_MOD(r);
+    return r;
+# endif
+}
+
+/*
+ * Return "a" to the power "n" modulo ML_SUM_PRIME.
+ */
+    static UINT32_T
+ml_sum_pow(a, n)
+    UINT32_T	a;
+    long	n;
+{
+    UINT32_T	r = 1;
+
+    for ( ; n > 0; n >>= 1)
+    {
+	if (n & 1)
+	    r = ml_sum_muladd(r, a, 0);
+	a = ml_sum_muladd(a, a, 0);
+    }
+    return r;
+}
+
+/*
+ * Compute the sum of the lines in data block "dp" into "sum[BH_SUM_SIZE]".
+ */
+    static void
+ml_sum_data(dp, sum)
+    DATA_BL	*dp;
+    UINT32_T	*sum;
+{
+    linenr_T	idx;
+    char_u	*p;
+    UINT32_T	sym;
+    long	count = 0;
+    int		i;
+
+    for (i = 0; i < BH_SUM_LANES; ++i)
+	sum[i] = 0;
+    for (idx = 0; idx < dp->db_line_count; ++idx)
+    {
+	p = (char_u *)dp + (dp->db_index[idx] & DB_INDEX_MASK);
+	for (;;)
+	{
+	    sym = (UINT32_T)p[0] << 16;
+	    if (p[0] != NUL)
+	    {
+		sym += (UINT32_T)p[1] << 8;
+		if (p[1] != NUL)
+		    sym += p[2];
+	    }
+	    ++sym;
+	    for (i = 0; i < BH_SUM_LANES; ++i)
+		sum[i] = ml_sum_muladd(sum[i], ml_sum_base[i], sym);
+	    ++count;
+	    if (p[0] == NUL || p[1] == NUL || p[2] == NUL)
+		break;
+	    p += 3;
+	}
+    }
+    for (i = 0; i < BH_SUM_LANES; ++i)
+	sum[BH_SUM_LANES + i] = ml_sum_pow(ml_sum_base[i], count);
+}
+
+/*
+ * Append the text with sum "part" to the text with sum "sum".
+ */
+    static void
+ml_sum_append(sum, part)
+    UINT32_T	*sum;
+    UINT32_T	*part;
+{
+    int		i;
+
+    for (i = 0; i < BH_SUM_LANES; ++i)
+    {
+	sum[i] = ml_sum_muladd(sum[i], part[BH_SUM_LANES + i], part[i]);
+	sum[BH_SUM_LANES + i] = ml_sum_muladd(sum[BH_SUM_LANES + i],
+						    part[BH_SUM_LANES + i], 0);
+    }
+}
+
+/*
+ * Append the sum of the lines in block "bnum" and below it to "sum".  Only
+ * gets the data blocks that have no sum yet.
+ * Return FAIL when a block cannot be read.
+ */
+    static int
+ml_sum_tree(buf, bnum, page_count, sum)
+    buf_T	*buf;
+    blocknr_T	bnum;
+    int		page_count;
+    UINT32_T	*sum;
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    PTR_BL	*pp;
+    blocknr_T	bnum2;
+    int		idx;
+    int		dirty = FALSE;
+    int		retval = OK;
+
+    hp = mf_peek(mfp, bnum);
+    if (hp != NULL && (hp->bh_flags & BH_SUMMED))
+    {
+	ml_sum_append(sum, hp->bh_sum);
+	return OK;
+    }
+
+    if ((hp = mf_get(mfp, bnum, page_count)) == NULL)
+	return FAIL;
+    dp = (DATA_BL *)(hp->bh_data);
+    if (dp->db_id == DATA_ID)
+    {
+	ml_sum_data(dp, hp->bh_sum);
+	hp->bh_flags |= BH_SUMMED;
+	ml_sum_append(sum, hp->bh_sum);
+	mf_put(mfp, hp, FALSE, FALSE);
+	return OK;
+    }
+
+    pp = (PTR_BL *)(dp);
+    if (pp->pb_id != PTR_ID)
+    {
+	EMSG(_("E317: pointer block id wrong"));
+	mf_put(mfp, hp, FALSE, FALSE);
+	return FAIL;
+    }
+    for (idx = 0; idx < (int)pp->pb_count && retval == OK; ++idx)
+    {
+	/* a negative block number may have been changed */
+	bnum2 = pp->pb_pointer[idx].pe_bnum;
+	if (bnum2 < 0)
+	{
+	    bnum2 = mf_trans_del(mfp, bnum2);
+	    if (bnum2 != pp->pb_pointer[idx].pe_bnum)
+	    {
+		pp->pb_pointer[idx].pe_bnum = bnum2;
+		dirty = TRUE;
+	    }
+	}
+	retval = ml_sum_tree(buf, bnum2, pp->pb_pointer[idx].pe_page_count,
+									 sum);
+    }
+    mf_put(mfp, hp, dirty, FALSE);
+    return retval;
+}
+
+/*
+ * Compute the checksum of the text in "buf" into "hash[UNDO_HASH_SIZE]".
+ * Return FAIL when the text cannot be read.
+ */
+    int
+ml_text_hash(buf, hash)
+    buf_T	*buf;
+    char_u	*hash;
+{
+    UINT32_T	sum[BH_SUM_SIZE];
+    int		i;
+
+    if (buf->b_ml.ml_mfp == NULL)
+	return FAIL;
+
+    /* The sums of the blocks are updated when they are released. */
+    ml_flush_line(buf);
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    buf->b_ml.ml_stack_top = 0;
+
+    for (i = 0; i < BH_SUM_LANES; ++i)
+    {
+	sum[i] = 0;
+	sum[BH_SUM_LANES + i] = 1;
+    }
+    if (ml_sum_tree(buf, (blocknr_T)1, 1, sum) == FAIL)
+	return FAIL;
+
+    for (i = 0; i < UNDO_HASH_SIZE; ++i)
+	hash[i] = (char_u)(sum[i / 4] >> (8 * (3 - i % 4)));
+    return OK;
+}
+#endif
+
 
 #if defined(FEAT_BYTEOFF) || defined(PROTO)
 
@@ -4924,15 +5787,19 @@ ml_crypt_prepare(mfp, offset, reading)
 
 /*
  * Keep information for finding byte offset of a line, updtype may be one of:
- * ML_CHNK_ADDLINE: Add len to parent chunk, possibly splitting it
+ * ML_CHNK_ADDLINE: Add "count" lines of together "len" bytes to parent chunk,
+ *		    possibly splitting it
  *	   Careful: ML_CHNK_ADDLINE may cause ml_find_line() to be called.
- * ML_CHNK_DELLINE: Subtract len from parent chunk, possibly deleting it
+ * ML_CHNK_DELLINE: Subtract "count" lines of together "len" bytes from parent
+ *		    chunk, possibly deleting it.  The lines must be in one
+ *		    chunk, see ml_chunk_end().
  * ML_CHNK_UPDLINE: Add len to parent chunk, as a signed entity.
  */
     static void
-ml_updatechunk(buf, line, len, updtype)
+ml_updatechunk(buf, line, count, len, updtype)
     buf_T	*buf;
     linenr_T	line;
+    long	count;
     long	len;
     int		updtype;
 {
@@ -4964,6 +5831,7 @@ ml_updatechunk(buf, line, len, updtype)
 	buf->b_ml.ml_usedchunks = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize = 1;
+	buf->b_ml.ml_chunktree_len = 0;
     }
 
     if (updtype == ML_CHNK_UPDLINE && buf->b_ml.ml_line_count == 1)
@@ -4975,6 +5843,7 @@ ml_updatechunk(buf, line, len, updtype)
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize =
 				  (long)STRLEN(buf->b_ml.ml_line_ptr) + 1;
+	buf->b_ml.ml_chunktree_len = 0;
 	return;
     }
 
@@ -4985,12 +5854,11 @@ ml_updatechunk(buf, line, len, updtype)
     if (buf != ml_upd_lastbuf || line != ml_upd_lastline + 1
 	    || updtype != ML_CHNK_ADDLINE)
     {
-	for (curline = 1, curix = 0;
-	     curix < buf->b_ml.ml_usedchunks - 1
-	     && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	     curix++)
+	curix = ml_find_chunk(buf, line, 0L, FALSE, &curline, &size);
+	if (curix < 0)
 	{
-	    curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+	    buf->b_ml.ml_usedchunks = -1;
+	    return;
 	}
     }
     else if (line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines
@@ -5005,14 +5873,19 @@ ml_updatechunk(buf, line, len, updtype)
     if (updtype == ML_CHNK_DELLINE)
 	len = -len;
     curchnk->mlcs_totalsize += len;
+    ml_chunktree_add(buf, curix, updtype == ML_CHNK_ADDLINE ? count
+			     : updtype == ML_CHNK_DELLINE ? -count : 0L, len);
     if (updtype == ML_CHNK_ADDLINE)
     {
-	curchnk->mlcs_numlines++;
+	curchnk->mlcs_numlines += count;
 
 	/* May resize here so we don't have to do it in both cases below */
-	if (buf->b_ml.ml_usedchunks + 1 >= buf->b_ml.ml_numchunks)
+	if (buf->b_ml.ml_usedchunks + count / MLCS_MINL + 1
+						     >= buf->b_ml.ml_numchunks)
 	{
-	    buf->b_ml.ml_numchunks = buf->b_ml.ml_numchunks * 3 / 2;
+	    while (buf->b_ml.ml_usedchunks + count / MLCS_MINL + 1
+						     >= buf->b_ml.ml_numchunks)
+		buf->b_ml.ml_numchunks = buf->b_ml.ml_numchunks * 3 / 2;
 	    buf->b_ml.ml_chunksize = (chunksize_T *)
 		vim_realloc(buf->b_ml.ml_chunksize,
 			    sizeof(chunksize_T) * buf->b_ml.ml_numchunks);
@@ -5026,54 +5899,64 @@ ml_updatechunk(buf, line, len, updtype)
 
 	if (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL)
 	{
-	    int	    count;	    /* number of entries in block */
+	    int	    bcount;	    /* number of entries in block */
 	    int	    idx;
 	    int	    text_end;
 	    int	    linecnt;
+	    linenr_T lnum;
 
-	    mch_memmove(buf->b_ml.ml_chunksize + curix + 1,
-			buf->b_ml.ml_chunksize + curix,
-			(buf->b_ml.ml_usedchunks - curix) *
-			sizeof(chunksize_T));
-	    /* Compute length of first half of lines in the split chunk */
-	    size = 0;
-	    linecnt = 0;
-	    while (curline < buf->b_ml.ml_line_count
-			&& linecnt < MLCS_MINL)
+	    /* After adding many lines at once the chunk may have to be split
+	     * more than once. */
+	    while (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL)
 	    {
-		if ((hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
-		{
-		    buf->b_ml.ml_usedchunks = -1;
-		    return;
-		}
-		dp = (DATA_BL *)(hp->bh_data);
-		count = (long)(buf->b_ml.ml_locked_high) -
-			(long)(buf->b_ml.ml_locked_low) + 1;
-		idx = curline - buf->b_ml.ml_locked_low;
-		curline = buf->b_ml.ml_locked_high + 1;
-		if (idx == 0)/* first line in block, text at the end */
-		    text_end = dp->db_txt_end;
-		else
-		    text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
-		/* Compute index of last line to use in this MEMLINE */
-		rest = count - idx;
-		if (linecnt + rest > MLCS_MINL)
-		{
-		    idx += MLCS_MINL - linecnt - 1;
-		    linecnt = MLCS_MINL;
-		}
-		else
+		mch_memmove(buf->b_ml.ml_chunksize + curix + 1,
+			    buf->b_ml.ml_chunksize + curix,
+			    (buf->b_ml.ml_usedchunks - curix) *
+			    sizeof(chunksize_T));
+		/* Compute length of first half of lines in the split chunk */
+		size = 0;
+		linecnt = 0;
+		lnum = curline;
+		while (lnum < buf->b_ml.ml_line_count
+			    && linecnt < MLCS_MINL)
 		{
-		    idx = count - 1;
-		    linecnt += rest;
+		    if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+		    {
+			buf->b_ml.ml_usedchunks = -1;
+			return;
+		    }
+		    dp = (DATA_BL *)(hp->bh_data);
+		    bcount = (long)(buf->b_ml.ml_locked_high) -
+			    (long)(buf->b_ml.ml_locked_low) + 1;
+		    idx = lnum - buf->b_ml.ml_locked_low;
+		    lnum = buf->b_ml.ml_locked_high + 1;
+		    if (idx == 0)/* first line in block, text at the end */
+			text_end = dp->db_txt_end;
+		    else
+			text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
+		    /* Compute index of last line to use in this MEMLINE */
+		    rest = bcount - idx;
+		    if (linecnt + rest > MLCS_MINL)
+		    {
+			idx += MLCS_MINL - linecnt - 1;
+			linecnt = MLCS_MINL;
+		    }
+		    else
+		    {
+			idx = bcount - 1;
+			linecnt += rest;
+		    }
+		    size += text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
 		}
-		size += text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
+		buf->b_ml.ml_chunksize[curix].mlcs_numlines = linecnt;
+		buf->b_ml.ml_chunksize[curix + 1].mlcs_numlines -= linecnt;
+		buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
+		buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
+		buf->b_ml.ml_usedchunks++;
+		curline += linecnt;
+		++curix;
 	    }
-	    buf->b_ml.ml_chunksize[curix].mlcs_numlines = linecnt;
-	    buf->b_ml.ml_chunksize[curix + 1].mlcs_numlines -= linecnt;
-	    buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
-	    buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
-	    buf->b_ml.ml_usedchunks++;
+	    buf->b_ml.ml_chunktree_len = 0;
 	    ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
 	    return;
 	}
@@ -5087,6 +5970,7 @@ ml_updatechunk(buf, line, len, updtype)
 	     */
 	    curchnk = buf->b_ml.ml_chunksize + curix + 1;
 	    buf->b_ml.ml_usedchunks++;
+	    buf->b_ml.ml_chunktree_len = 0;
 	    if (line == buf->b_ml.ml_line_count)
 	    {
 		curchnk->mlcs_numlines = 0;
@@ -5120,7 +6004,7 @@ ml_updatechunk(buf, line, len, updtype)
     }
     else if (updtype == ML_CHNK_DELLINE)
     {
-	curchnk->mlcs_numlines--;
+	curchnk->mlcs_numlines -= count;
 	ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
 	if (curix < (buf->b_ml.ml_usedchunks - 1)
 		&& (curchnk->mlcs_numlines + curchnk[1].mlcs_numlines)
@@ -5134,6 +6018,7 @@ ml_updatechunk(buf, line, len, updtype)
 	    buf->b_ml.ml_usedchunks--;
 	    mch_memmove(buf->b_ml.ml_chunksize, buf->b_ml.ml_chunksize + 1,
 			buf->b_ml.ml_usedchunks * sizeof(chunksize_T));
+	    buf->b_ml.ml_chunktree_len = 0;
 	    return;
 	}
 	else if (curix == 0 || (curchnk->mlcs_numlines > 10
@@ -5147,6 +6032,7 @@ ml_updatechunk(buf, line, len, updtype)
 	curchnk[-1].mlcs_numlines += curchnk->mlcs_numlines;
 	curchnk[-1].mlcs_totalsize += curchnk->mlcs_totalsize;
 	buf->b_ml.ml_usedchunks--;
+	buf->b_ml.ml_chunktree_len = 0;
 	if (curix < buf->b_ml.ml_usedchunks)
 	{
 	    mch_memmove(buf->b_ml.ml_chunksize + curix,
@@ -5157,11 +6043,142 @@ ml_updatechunk(buf, line, len, updtype)
 	return;
     }
     ml_upd_lastbuf = buf;
-    ml_upd_lastline = line;
+    ml_upd_lastline = line + count - 1;
     ml_upd_lastcurline = curline;
     ml_upd_lastcurix = curix;
 }
 
+/*
+ * Return the line number just after the chunk that contains line "line".
+ * Returns MAXLNUM when there is no chunk information.
+ */
+    static linenr_T
+ml_chunk_end(buf, line)
+    buf_T	*buf;
+    linenr_T	line;
+{
+    linenr_T	curline;
+    long	size;
+    int		curix;
+
+    if (buf->b_ml.ml_usedchunks == -1 || buf->b_ml.ml_chunksize == NULL)
+	return MAXLNUM;
+    curix = ml_find_chunk(buf, line, 0L, FALSE, &curline, &size);
+    if (curix < 0 || curix == buf->b_ml.ml_usedchunks - 1)
+	return MAXLNUM;
+    return curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+}
+
+/*
+ * (Re)build the Fenwick tree over the chunks, entry "i" holds the sum of the
+ * chunks "i - (i & -i)" up to "i - 1".
+ * Returns FAIL when out of memory.
+ */
+    static int
+ml_chunktree_build(buf)
+    buf_T	*buf;
+{
+    chunksize_T	*tree;
+    int		n = buf->b_ml.ml_usedchunks;
+    int		i, j;
+
+    if (n > buf->b_ml.ml_chunktree_max)
+    {
+	tree = (chunksize_T *)alloc((unsigned)(sizeof(chunksize_T)
+					    * (buf->b_ml.ml_numchunks + 1)));
+	if (tree == NULL)
+	    return FAIL;
+	vim_free(buf->b_ml.ml_chunktree);
+	buf->b_ml.ml_chunktree = tree;
+	buf->b_ml.ml_chunktree_max = buf->b_ml.ml_numchunks;
+    }
+    tree = buf->b_ml.ml_chunktree;
+    for (i = 1; i <= n; ++i)
+	tree[i] = buf->b_ml.ml_chunksize[i - 1];
+    for (i = 1; i <= n; ++i)
+    {
+	j = i + (i & -i);
+	if (j <= n)
+	{
+	    tree[j].mlcs_numlines += tree[i].mlcs_numlines;
+	    tree[j].mlcs_totalsize += tree[i].mlcs_totalsize;
+	}
+    }
+    buf->b_ml.ml_chunktree_len = n;
+    return OK;
+}
+
+/*
+ * Add "lines" and "size" to chunk "ix" in the Fenwick tree, if it is valid.
+ */
+    static void
+ml_chunktree_add(buf, ix, lines, size)
+    buf_T	*buf;
+    int		ix;
+    long	lines;
+    long	size;
+{
+    int		i;
+
+    for (i = ix + 1; i <= buf->b_ml.ml_chunktree_len; i += i & -i)
+    {
+	buf->b_ml.ml_chunktree[i].mlcs_numlines += lines;
+	buf->b_ml.ml_chunktree[i].mlcs_totalsize += size;
+    }
+}
+
+/*
+ * Find the chunk that contains line "lnum", or byte "offset" when it is not
+ * zero.  Never goes beyond the last chunk.
+ * Sets "*curlinep" to the first line in the chunk and "*sizep" to the number
+ * of bytes before it, including a CR for each line when "ffdos" is TRUE and
+ * "offset" is not zero.
+ * Returns the index of the chunk, -1 when out of memory.
+ */
+    static int
+ml_find_chunk(buf, lnum, offset, ffdos, curlinep, sizep)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	offset;
+    int		ffdos;
+    linenr_T	*curlinep;
+    long	*sizep;
+{
+    chunksize_T	*tree;
+    int		n = buf->b_ml.ml_usedchunks - 1; /* last chunk never skipped */
+    int		pos = 0;
+    int		step;
+    linenr_T	lines = 0;
+    long	size = 0;
+    linenr_T	l;
+    long	s;
+
+    if (buf->b_ml.ml_chunktree_len == 0 && ml_chunktree_build(buf) == FAIL)
+	return -1;
+    tree = buf->b_ml.ml_chunktree;
+
+    for (step = 1; step * 2 <= n; step *= 2)
+	;
+    for ( ; step > 0; step /= 2)
+    {
+	if (pos + step > n)
+	    continue;
+	l = lines + tree[pos + step].mlcs_numlines;
+	s = size + tree[pos + step].mlcs_totalsize;
+	/* Skip the chunks when the wanted line or offset is beyond them. */
+	if ((lnum != 0 && lnum >= l + 1)
+		|| (offset != 0 && offset > s + ffdos * l))
+	{
+	    pos += step;
+	    lines = l;
+	    size = s;
+	}
+    }
+    *curlinep = lines + 1;
+    *sizep = size + (offset != 0 && ffdos ? lines : 0);
+    return pos;
+}
+
 /*
  * Find offset for line or line with offset.
  * Find line with offset if "lnum" is 0; return remaining offset in offp
@@ -5206,21 +6223,9 @@ ml_find_line_or_offset(buf, lnum, offp)
      * Find the last chunk before the one containing our line. Last chunk is
      * special because it will never qualify
      */
-    curline = 1;
-    curix = size = 0;
-    while (curix < buf->b_ml.ml_usedchunks - 1
-	    && ((lnum != 0
-	     && lnum >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
-		|| (offset != 0
-	       && offset > size + buf->b_ml.ml_chunksize[curix].mlcs_totalsize
-		      + ffdos * buf->b_ml.ml_chunksize[curix].mlcs_numlines)))
-    {
-	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	size += buf->b_ml.ml_chunksize[curix].mlcs_totalsize;
-	if (offset && ffdos)
-	    size += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	curix++;
-    }
+    curix = ml_find_chunk(buf, lnum, offset, ffdos, &curline, &size);
+    if (curix < 0)
+	return -1;
 
     while ((lnum != 0 && curline < lnum) || (offset != 0 && size < offset))
     {
@@ -5332,3 +6337,302 @@ goto_byte(cnt)
 # endif
 }
 #endif
+
+#if defined(FEAT_MMAP) || defined(PROTO)
+/*
+ * Append the lines of the mapped file "map" of "size" bytes to the empty
+ * buffer "buf".  "st" is the result of stat() for the file.
+ * Only the boundaries of the data blocks are computed here, the blocks are
+ * filled from the mapping when they are used, see ml_fill_mapped().  Blocks
+ * that are changed become normal blocks, thus only those end up in memory
+ * and in the swap file.
+ * When successful the memfile owns "map" and the number of lines is returned.
+ * Returns -1 when the lines were not appended.
+ */
+    linenr_T
+ml_append_mapped(buf, map, size, st)
+    buf_T	*buf;
+    char_u	*map;
+    size_t	size;
+    struct stat	*st;
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    unsigned	page_size = mfp->mf_page_size;
+    int		count_max;
+    garray_T	ga_ptr;		/* PTR_EN for each block, later for the
+				   pointer blocks of each level */
+    garray_T	ga_offset;	/* start of each block in "map" */
+#ifdef FEAT_BYTEOFF
+    garray_T	ga_chunk;	/* chunksize_T for 'fileformat' byte counts */
+    linenr_T	chunk_lines = 0;
+    long	chunk_size = 0;
+#endif
+    PTR_EN	*entries;
+    PTR_EN	*ep;
+    PTR_BL	*pp;
+    bhdr_T	*hp;
+    char_u	*p = map;
+    char_u	*end = map + size;
+    char_u	*start;
+    char_u	*nl = NULL;
+    long	len;
+    unsigned	room;
+    linenr_T	lines;
+    linenr_T	total = 0;
+    blocknr_T	first;
+    int		count;
+    int		n;
+    int		i;
+    int		j;
+    int		k;
+
+    if (mfp == NULL || !(buf->b_ml.ml_flags & ML_EMPTY)
+						   || mfp->mf_map != NULL)
+	return -1;
+
+    ga_init2(&ga_ptr, (int)sizeof(PTR_EN), 1000);
+    ga_init2(&ga_offset, (int)sizeof(off_t), 1000);
+#ifdef FEAT_BYTEOFF
+    ga_init2(&ga_chunk, (int)sizeof(chunksize_T), 100);
+#endif
+
+    /*
+     * Find the block boundaries: fill each block with as many lines as fit
+     * in one page, a line that doesn't fit gets a block of its own.
+     */
+    while (p < end)
+    {
+	if (ga_grow(&ga_ptr, 1) == FAIL || ga_grow(&ga_offset, 2) == FAIL)
+	    goto fail;
+	ep = (PTR_EN *)ga_ptr.ga_data + ga_ptr.ga_len;
+	ep->pe_page_count = 1;
+	start = p;
+	room = page_size - HEADER_SIZE;
+	for (lines = 0; p < end; ++lines)
+	{
+	    nl = memchr(p, NL, end - p);
+	    len = (long)((nl == NULL ? end : nl) - p) + 1; /* text and NUL */
+	    if (len >= MAXCOL)
+		goto fail;
+	    if (len + INDEX_SIZE > room)
+	    {
+		if (lines > 0)
+		    break;
+		ep->pe_page_count = (int)((HEADER_SIZE + INDEX_SIZE + len
+						+ page_size - 1) / page_size);
+		room = len + INDEX_SIZE;
+	    }
+	    room -= len + INDEX_SIZE;
+	    p = (nl == NULL ? end : nl + 1);
+	}
+	ep->pe_line_count = lines;
+	ep->pe_old_lnum = total + 1;
+	((off_t *)ga_offset.ga_data)[ga_offset.ga_len++] = start - map;
+	++ga_ptr.ga_len;
+	total += lines;
+
+#ifdef FEAT_BYTEOFF
+	/* A missing NL at the end still counts as a NUL in the memline. */
+	chunk_lines += lines;
+	chunk_size += (long)(p - start) + (p == end && nl == NULL);
+	if (chunk_lines >= MLCS_MINL || p == end)
+	{
+	    if (ga_grow(&ga_chunk, 2) == FAIL)
+		goto fail;
+	    ((chunksize_T *)ga_chunk.ga_data)[ga_chunk.ga_len].mlcs_numlines
+								 = chunk_lines;
+	    ((chunksize_T *)ga_chunk.ga_data)[ga_chunk.ga_len++].mlcs_totalsize
+								  = chunk_size;
+	    chunk_lines = 0;
+	    chunk_size = 0;
+	}
+#endif
+
+	if ((ga_ptr.ga_len & 1023) == 0)
+	{
+	    ui_breakcheck();
+	    if (got_int)
+		goto fail;
+	}
+    }
+    if (ga_ptr.ga_len == 0)
+	goto fail;
+    ((off_t *)ga_offset.ga_data)[ga_offset.ga_len] = (off_t)size;
+
+    /* Flush the cached line and the locked block before changing the tree. */
+    ml_flush_line(buf);
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    buf->b_ml.ml_stack_top = 0;
+
+    /* Reserve negative numbers for the mapped blocks, they are not in the
+     * swap file. */
+    first = mfp->mf_blocknr_min;
+    entries = (PTR_EN *)ga_ptr.ga_data;
+    count = ga_ptr.ga_len;
+    for (i = 0; i < count; ++i)
+	entries[i].pe_bnum = first - i;
+    mfp->mf_blocknr_min -= count;
+
+    /*
+     * Build the tree bottom up until the entries fit in the root, which also
+     * keeps the entry for the empty line of the buffer.
+     */
+    count_max = (int)((page_size - sizeof(PTR_BL)) / sizeof(PTR_EN) + 1);
+    while (count > count_max - 1)
+    {
+	n = 0;
+	for (i = 0; i < count; i += k)
+	{
+	    if ((hp = ml_new_ptr(mfp)) == NULL)
+		goto fail;
+	    pp = (PTR_BL *)(hp->bh_data);
+	    k = count - i < count_max ? count - i : count_max;
+	    mch_memmove(pp->pb_pointer, entries + i, k * sizeof(PTR_EN));
+	    pp->pb_count = k;
+	    entries[n] = entries[i];
+	    entries[n].pe_bnum = hp->bh_bnum;
+	    entries[n].pe_page_count = 1;
+	    for (j = 1; j < k; ++j)
+		entries[n].pe_line_count += pp->pb_pointer[j].pe_line_count;
+	    mf_put(mfp, hp, TRUE, FALSE);
+	    ++n;
+	}
+	count = n;
+    }
+
+    if ((hp = mf_get(mfp, (blocknr_T)1, 1)) == NULL)
+	goto fail;
+    pp = (PTR_BL *)(hp->bh_data);
+    if (pp->pb_count != 1)
+    {
+	mf_put(mfp, hp, FALSE, FALSE);
+	goto fail;
+    }
+    pp->pb_pointer[count] = pp->pb_pointer[0];
+    pp->pb_pointer[count].pe_old_lnum = total + 1;
+    mch_memmove(pp->pb_pointer, entries, count * sizeof(PTR_EN));
+    pp->pb_count = count + 1;
+    mf_put(mfp, hp, TRUE, FALSE);
+
+    mfp->mf_map = map;
+    mfp->mf_map_size = size;
+    mfp->mf_map_offset = (off_t *)ga_offset.ga_data;
+    mfp->mf_map_first = first;
+    mfp->mf_map_count = ga_ptr.ga_len;
+    mfp->mf_map_dev = st->st_dev;
+    mfp->mf_map_ino = st->st_ino;
+    ga_clear(&ga_ptr);
+
+    buf->b_ml.ml_line_count += total;
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+    ml_cache_clear(buf);
+
+#ifdef FEAT_BYTEOFF
+    /* The last chunk has the empty line that readfile() deletes. */
+    ((chunksize_T *)ga_chunk.ga_data)[ga_chunk.ga_len].mlcs_numlines = 1;
+    ((chunksize_T *)ga_chunk.ga_data)[ga_chunk.ga_len++].mlcs_totalsize = 1;
+    vim_free(buf->b_ml.ml_chunksize);
+    buf->b_ml.ml_chunksize = (chunksize_T *)ga_chunk.ga_data;
+    buf->b_ml.ml_numchunks = ga_chunk.ga_maxlen;
+    buf->b_ml.ml_usedchunks = ga_chunk.ga_len;
+    buf->b_ml.ml_chunktree_len = 0;
+#endif
+    return total;
+
+fail:
+    ga_clear(&ga_ptr);
+    ga_clear(&ga_offset);
+#ifdef FEAT_BYTEOFF
+    ga_clear(&ga_chunk);
+#endif
+    return -1;
+}
+
+/*
+ * Fill mapped block "hp" with the lines from the mapped file.
+ */
+    void
+ml_fill_mapped(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    DATA_BL	*dp = (DATA_BL *)(hp->bh_data);
+    blocknr_T	idx = mfp->mf_map_first - hp->bh_bnum;
+    char_u	*p = mfp->mf_map + mfp->mf_map_offset[idx];
+    char_u	*end = mfp->mf_map + mfp->mf_map_offset[idx + 1];
+    char_u	*nl;
+    char_u	*text;
+    char_u	*q;
+    unsigned	size = hp->bh_page_count * mfp->mf_page_size;
+    unsigned	len;
+    linenr_T	count = 0;
+
+    vim_memset(dp, 0, size);
+    dp->db_id = DATA_ID;
+    dp->db_txt_start = dp->db_txt_end = size;
+    while (p < end)
+    {
+	nl = memchr(p, NL, end - p);
+	len = (unsigned)((nl == NULL ? end : nl) - p);
+	dp->db_txt_start -= len + 1;
+	text = (char_u *)dp + dp->db_txt_start;
+	mch_memmove(text, p, len);
+	text[len] = NUL;
+	/* NULs are replaced by newlines! */
+	for (q = text; (q = memchr(q, NUL, text + len - q)) != NULL; )
+	    *q++ = NL;
+	dp->db_index[count++] = dp->db_txt_start;
+	p += len + 1;
+    }
+    dp->db_line_count = count;
+    dp->db_free = dp->db_txt_start - (HEADER_SIZE + count * INDEX_SIZE);
+}
+
+/*
+ * Called before "fname" is overwritten.  When "buf" has mapped this file,
+ * turn the mapped blocks into normal blocks and drop the mapping.
+ */
+    void
+ml_unmap(buf, fname)
+    buf_T	*buf;
+    char_u	*fname;
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    struct stat	st;
+    linenr_T	lnum;
+    bhdr_T	*hp;
+
+    if (mfp == NULL || mfp->mf_map == NULL
+	    || mch_stat((char *)fname, &st) < 0
+	    || st.st_dev != mfp->mf_map_dev || st.st_ino != mfp->mf_map_ino)
+	return;
+
+    /* Make all mapped blocks dirty, they are kept in memory or written to
+     * the swap file from now on. */
+    ml_flush_line(buf);
+    for (lnum = 1; lnum <= buf->b_ml.ml_line_count;
+					   lnum = buf->b_ml.ml_locked_high + 1)
+    {
+	if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+	    return;
+	if (MF_MAPPED(mfp, hp->bh_bnum))
+	    buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+    }
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+
+    /* The ones that still have a negative number are now counted like any
+     * other negative block. */
+    for (hp = mfp->mf_used_first; hp != NULL; hp = hp->bh_next)
+	if (MF_MAPPED(mfp, hp->bh_bnum))
+	    ++mfp->mf_neg_count;
+    for (hp = mfp->mf_zip_first; hp != NULL; hp = hp->bh_next)
+	if (MF_MAPPED(mfp, hp->bh_bnum))
+	    ++mfp->mf_neg_count;
+
+    munmap(mfp->mf_map, mfp->mf_map_size);
+    mfp->mf_map = NULL;
+    vim_free(mfp->mf_map_offset);
+    mfp->mf_map_offset = NULL;
+    mfp->mf_map_count = 0;
+}
+#endif
@@ -442,7 +442,7 @@ get_number_indent(lnum)
 	    pos.coladd = 0;
 #endif
 	}
-	vim_free(regmatch.regprog);
+	vim_regfree(regmatch.regprog);
     }
 
     if (pos.lnum == 0 || *ml_get_pos(&pos) == NUL)
@@ -2356,17 +2356,15 @@ del_lines(nlines, undo)
     if (undo && u_savedel(first, nlines) == FAIL)
 	return;
 
-    for (n = 0; n < nlines; )
+    if (curbuf->b_ml.ml_flags & ML_EMPTY)	    /* nothing to delete */
+	n = 0;
+    else
     {
-	if (curbuf->b_ml.ml_flags & ML_EMPTY)	    /* nothing to delete */
-	    break;
-
-	ml_delete(first, TRUE);
-	++n;
-
-	/* If we delete the last line in the file, stop */
-	if (first > curbuf->b_ml.ml_line_count)
-	    break;
+	/* Don't delete beyond the last line in the file. */
+	n = curbuf->b_ml.ml_line_count - first + 1;
+	if (n > nlines)
+	    n = nlines;
+	ml_delete_lines(first, n, TRUE);
     }
 
     /* Correct the cursor position before calling deleted_lines_mark(), it may
@@ -9015,7 +9013,7 @@ dos_expandpath(
 # endif
 #endif
     vim_free(buf);
-    vim_free(regmatch.regprog);
+    vim_regfree(regmatch.regprog);
     vim_free(matchname);
 
     matches = gap->ga_len - start_len;
@@ -9248,7 +9246,7 @@ unix_expandpath(gap, path, wildoff, flags, didstar)
     }
 
     vim_free(buf);
-    vim_free(regmatch.regprog);
+    vim_regfree(regmatch.regprog);
 
     matches = gap->ga_len - start_len;
     if (matches > 0)
@@ -9603,7 +9601,7 @@ theend:
 	vim_free(in_curdir);
     }
     ga_clear_strings(&path_ga);
-    vim_free(regmatch.regprog);
+    vim_regfree(regmatch.regprog);
 
     if (sort_again)
 	remove_duplicates(gap);
@@ -3747,6 +3747,27 @@ do_put(regname, dir, count, flags)
 		    i = 1;
 		}
 
+		if (!(flags & PUT_FIXINDENT))
+		{
+		    linenr_T	old_count = curbuf->b_ml.ml_line_count;
+		    int		ret;
+
+		    /* Append the lines in one go, except the last line of a
+		     * characterwise register, it was inserted above. */
+		    ret = ml_append_lines(lnum, y_array + i, NULL,
+				      y_size - i - (y_type == MCHAR), FALSE);
+		    lnum += curbuf->b_ml.ml_line_count - old_count;
+		    nr_lines += curbuf->b_ml.ml_line_count - old_count;
+		    if (ret == FAIL)
+			goto error;
+		    if (y_type == MCHAR)
+		    {
+			++lnum;
+			++nr_lines;
+		    }
+		    continue;
+		}
+
 		for (; i < y_size; ++i)
 		{
 		    if ((y_type != MCHAR || i < y_size - 1)
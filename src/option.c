@@ -1640,6 +1640,13 @@ static struct vimoption
 			    (char_u *)NULL, PV_NONE,
 #endif
 			    {(char_u *)"", (char_u *)0L} SCRIPTID_INIT},
+    {"largefilesize", "lfs", P_NUM|P_VI_DEF,
+#ifdef FEAT_MMAP
+			    (char_u *)&p_lfs, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
     {"laststatus",  "ls",   P_NUM|P_VI_DEF|P_RALL,
 #ifdef FEAT_WINDOWS
 			    (char_u *)&p_ls, PV_NONE,
@@ -2071,6 +2078,9 @@ static struct vimoption
 			    (char_u *)NULL, PV_NONE,
 #endif
 			    {(char_u *)2000L, (char_u *)0L} SCRIPTID_INIT},
+    {"regexpengine", "re",  P_NUM|P_VI_DEF,
+			    (char_u *)&p_re, PV_NONE,
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
     {"relativenumber", "rnu", P_BOOL|P_VI_DEF|P_RWIN,
 			    (char_u *)VAR_WIN, PV_RNU,
 			    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
@@ -2286,7 +2296,7 @@ static struct vimoption
 			    {(char_u *)8L, (char_u *)0L} SCRIPTID_INIT},
     {"shortmess",   "shm",  P_STRING|P_VIM|P_FLAGLIST,
 			    (char_u *)&p_shm, PV_NONE,
-			    {(char_u *)"", (char_u *)"filnxtToO"}
+			    {(char_u *)"S", (char_u *)"filnxtToOS"}
 			    SCRIPTID_INIT},
     {"shortname",   "sn",   P_BOOL|P_VI_DEF,
 #ifdef SHORT_FNAME
@@ -2655,6 +2665,9 @@ static struct vimoption
 			    (char_u *)100L,
 #endif
 				(char_u *)0L} SCRIPTID_INIT},
+    {"undomaxmem",  "umm",  P_NUM|P_VI_DEF,
+			    (char_u *)&p_umm, PV_NONE,
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
     {"undoreload",  "ur",   P_NUM|P_VI_DEF,
 			    (char_u *)&p_ur, PV_NONE,
 			    { (char_u *)10000L, (char_u *)0L} SCRIPTID_INIT},
@@ -3063,7 +3076,7 @@ set_init_1()
     if (mch_getenv((char_u *)"VIM_POSIX") != NULL)
     {
 	set_string_default("cpo", (char_u *)CPO_ALL);
-	set_string_default("shm", (char_u *)"A");
+	set_string_default("shm", (char_u *)"AS");
     }
 
     /*
@@ -7358,7 +7371,7 @@ check_clipboard_option()
 	clip_autoselect = new_autoselect;
 	clip_autoselectml = new_autoselectml;
 	clip_html = new_html;
-	vim_free(clip_exclude_prog);
+	vim_regfree(clip_exclude_prog);
 	clip_exclude_prog = new_exclude_prog;
 #ifdef FEAT_GUI_GTK
 	if (gui.in_use)
@@ -7369,7 +7382,7 @@ check_clipboard_option()
 #endif
     }
     else
-	vim_free(new_exclude_prog);
+	vim_regfree(new_exclude_prog);
 
     return errmsg;
 }
@@ -7405,7 +7418,7 @@ compile_cap_prog(synblock)
 	}
     }
 
-    vim_free(rp);
+    vim_regfree(rp);
     return NULL;
 }
 #endif
@@ -8309,6 +8322,16 @@ set_num_option(opt_idx, varp, value, errbuf, errbuflen, opt_flags)
 	mzvim_reset_timer();
 #endif
 
+    /* 'regexpengine' must be 0, 1 or 2 */
+    else if (pp == &p_re)
+    {
+	if (p_re < 0 || p_re > 2)
+	{
+	    errmsg = e_invarg;
+	    p_re = old_value;
+	}
+    }
+
     /* sync undo before 'undolevels' changes */
     else if (pp == &p_ul)
     {
@@ -8463,6 +8486,11 @@ set_num_option(opt_idx, varp, value, errbuf, errbuflen, opt_flags)
 	errmsg = e_positive;
 	p_report = 1;
     }
+    if (p_umm < 0)
+    {
+	errmsg = e_positive;
+	p_umm = 0;
+    }
     if ((p_sj < -100 || p_sj >= Rows) && full_screen)
     {
 	if (Rows != old_Rows)	/* Rows changed, just adjust p_sj */
@@ -64,6 +64,10 @@
 # include <sys/param.h>	    /* defines BSD, if it's a BSD system */
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
 /*
  * Sun defines FILE on SunOS 4.x.x, Solaris has a typedef for FILE
  */
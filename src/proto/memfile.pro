@@ -6,10 +6,12 @@ void mf_close_file __ARGS((buf_T *buf, int getlines));
 void mf_new_page_size __ARGS((memfile_T *mfp, unsigned new_size));
 bhdr_T *mf_new __ARGS((memfile_T *mfp, int negative, int page_count));
 bhdr_T *mf_get __ARGS((memfile_T *mfp, blocknr_T nr, int page_count));
+bhdr_T *mf_peek __ARGS((memfile_T *mfp, blocknr_T nr));
 void mf_put __ARGS((memfile_T *mfp, bhdr_T *hp, int dirty, int infile));
 void mf_free __ARGS((memfile_T *mfp, bhdr_T *hp));
 int mf_sync __ARGS((memfile_T *mfp, int flags));
 void mf_set_dirty __ARGS((memfile_T *mfp));
+int mf_async_wait __ARGS((memfile_T *mfp));
 int mf_release_all __ARGS((void));
 blocknr_T mf_trans_del __ARGS((memfile_T *mfp, blocknr_T old_nr));
 void mf_set_ffname __ARGS((memfile_T *mfp));
@@ -19,19 +19,27 @@ char_u *ml_get_curline __ARGS((void));
 char_u *ml_get_cursor __ARGS((void));
 char_u *ml_get_buf __ARGS((buf_T *buf, linenr_T lnum, int will_change));
 int ml_line_alloced __ARGS((void));
+linenr_T ml_find_text __ARGS((buf_T *buf, linenr_T lnum, linenr_T last, char_u *str, int len));
 int ml_append __ARGS((linenr_T lnum, char_u *line, colnr_T len, int newfile));
 int ml_append_buf __ARGS((buf_T *buf, linenr_T lnum, char_u *line, colnr_T len, int newfile));
+int ml_append_lines __ARGS((linenr_T lnum, char_u **lines, colnr_T *lens, long count, int newfile));
 int ml_replace __ARGS((linenr_T lnum, char_u *line, int copy));
 int ml_delete __ARGS((linenr_T lnum, int message));
+int ml_delete_lines __ARGS((linenr_T lnum, long count, int message));
 void ml_setmarked __ARGS((linenr_T lnum));
 linenr_T ml_firstmarked __ARGS((void));
 void ml_clearmarked __ARGS((void));
+void ml_cache_debug_results __ARGS((void));
 int resolve_symlink __ARGS((char_u *fname, char_u *buf));
 char_u *makeswapname __ARGS((char_u *fname, char_u *ffname, buf_T *buf, char_u *dir_name));
 char_u *get_file_in_dir __ARGS((char_u *fname, char_u *dname));
 void ml_setflags __ARGS((buf_T *buf));
 char_u *ml_encrypt_data __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsigned size));
 void ml_decrypt_data __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsigned size));
+int ml_text_hash __ARGS((buf_T *buf, char_u *hash));
+linenr_T ml_append_mapped __ARGS((buf_T *buf, char_u *map, size_t size, struct stat *st));
+void ml_fill_mapped __ARGS((memfile_T *mfp, bhdr_T *hp));
+void ml_unmap __ARGS((buf_T *buf, char_u *fname));
 long ml_find_line_or_offset __ARGS((buf_T *buf, linenr_T lnum, long *offp));
 void goto_byte __ARGS((long cnt));
 /* vim: set ft=c : */
@@ -1,9 +1,15 @@
 /* regexp.c */
 int re_multiline __ARGS((regprog_T *prog));
+int re_position __ARGS((regprog_T *prog));
 int re_lookbehind __ARGS((regprog_T *prog));
 char_u *skip_regexp __ARGS((char_u *startp, int dirc, int magic, char_u **newp));
+void vim_regcache_clear __ARGS((void));
+void vim_regcache_stats __ARGS((long *hitsp, long *missesp, int *countp));
+void vim_regfree __ARGS((regprog_T *prog));
 regprog_T *vim_regcomp __ARGS((char_u *expr, int re_flags));
 int vim_regcomp_had_eol __ARGS((void));
+char_u *vim_regliteral __ARGS((regprog_T *prog, int ic, int *lenp));
+int vim_regbytes __ARGS((regprog_T *prog, int ic, char_u *bytes));
 void free_regexp_stuff __ARGS((void));
 int vim_regexec __ARGS((regmatch_T *rmp, char_u *line, colnr_T col));
 int vim_regexec_nl __ARGS((regmatch_T *rmp, char_u *line, colnr_T col));
@@ -26,6 +26,8 @@ void screen_putchar __ARGS((int c, int row, int col, int attr));
 void screen_getbytes __ARGS((int row, int col, char_u *bytes, int *attrp));
 void screen_puts __ARGS((char_u *text, int row, int col, int attr));
 void screen_puts_len __ARGS((char_u *text, int len, int row, int col, int attr));
+void match_cache_free __ARGS((struct mcache_S *mc));
+void match_cache_invalidate __ARGS((buf_T *buf));
 void screen_stop_highlight __ARGS((void));
 void reset_cterm_colors __ARGS((void));
 void screen_draw_rectangle __ARGS((int row, int col, int height, int width, int invert));
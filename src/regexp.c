@@ -200,6 +200,12 @@
 #define LAST_NL		NUPPER + ADD_NL
 #define WITH_NL(op)	((op) >= FIRST_NL && (op) <= LAST_NL)
 
+/* Items handled by regitem(): they don't need the regstack. */
+#define REG_ITEM(op)	((op) == BOL || (op) == EOL || (op) == EXACTLY \
+			    || (op) == BOW || (op) == EOW || (op) == NEWL \
+			    || ((op) >= ANY && (op) <= LAST_NL) \
+			    || ((op) >= MULTIBYTECODE && (op) <= RE_VISUAL))
+
 #define MOPEN		80  /* -89	 Mark this point in input as start of
 				 *	 \( subexpr.  MOPEN + 0 marks start of
 				 *	 match. */
@@ -332,6 +338,11 @@ toggle_Magic(x)
 
 #define MAX_LIMIT	(32767L << 16L)
 
+/* Values for 'regexpengine' and "\%#=". */
+#define AUTOMATIC_ENGINE	0
+#define BACKTRACKING_ENGINE	1
+#define NFA_ENGINE		2
+
 static int re_multi_type __ARGS((int));
 static int cstrncmp __ARGS((char_u *s1, char_u *s2, int *n));
 static char_u *cstrchr __ARGS((char_u *, int));
@@ -568,6 +579,9 @@ init_class_tab()
 #define RF_HASNL    4	/* can match a NL */
 #define RF_ICOMBINE 8	/* ignore combining characters */
 #define RF_LOOKBH   16	/* uses "\@<=" or "\@<!" */
+#define RF_POSITION 32	/* uses the cursor, Visual area, a mark, the line
+			   number or virtual column, or the start or end of
+			   the buffer */
 
 /*
  * Global work variables for vim_regcomp().
@@ -675,6 +689,8 @@ static char_u	*re_put_long __ARGS((char_u *pr, long_u val));
 static int	read_limits __ARGS((long *, long *));
 static void	regtail __ARGS((char_u *, char_u *));
 static void	regoptail __ARGS((char_u *, char_u *));
+static regprog_T *nfa_regcomp __ARGS((regprog_T *r, long size, int engine));
+static int	reg_reqbytes __ARGS((char_u *scan, int ic, char_u *bytes, int *budget));
 
 /*
  * Return TRUE if compiled regular expression "prog" can match a line break.
@@ -686,6 +702,18 @@ re_multiline(prog)
     return (prog->regflags & RF_HASNL);
 }
 
+/*
+ * Return TRUE if what compiled regular expression "prog" matches in a line
+ * depends on more than the text of the line and the column: the cursor, the
+ * Visual area, a mark, the line number or the virtual column.
+ */
+    int
+re_position(prog)
+    regprog_T *prog;
+{
+    return (prog->regflags & RF_POSITION);
+}
+
 /*
  * Return TRUE if compiled regular expression "prog" looks before the start
  * position (pattern contains "\@<=" or "\@<!").
@@ -1008,6 +1036,168 @@ skip_regexp(startp, dirc, magic, newp)
     return p;
 }
 
+/*
+ * Cache of compiled programs, used when vim_regcomp() is called with
+ * RE_CACHE.  Avoids compiling the same pattern again and again, e.g. for
+ * substitute() in a loop.  The programs are shared, each entry holds a
+ * reference.  When the cache is full the least recently used entry is
+ * dropped.
+ */
+#define REGCACHE_SIZE	32
+
+typedef struct
+{
+    char_u	*rc_pat;	/* pattern, NULL for an unused entry */
+    int		rc_flags;	/* flags that matter, see regcache_flags() */
+    regprog_T	*rc_prog;	/* the compiled program */
+    long_u	rc_used;	/* value of regcache_tick when last used */
+} regcache_T;
+
+static regcache_T	regcache[REGCACHE_SIZE];
+static long_u		regcache_tick = 0;
+static long		regcache_hits = 0;
+static long		regcache_misses = 0;
+
+static int regcache_flags __ARGS((int re_flags));
+static regprog_T *regcache_comp __ARGS((char_u *expr, int re_flags));
+
+/* Flags from 'cpoptions' that change how a pattern is compiled. */
+#define RC_CPO_LIT	0x100
+#define RC_CPO_BSL	0x200
+#define RC_ENGINE_SHIFT	12
+
+/*
+ * Return the flags that a cached program must have been compiled with to be
+ * used for "re_flags": those and the options that change compiling.
+ */
+    static int
+regcache_flags(re_flags)
+    int		re_flags;
+{
+    int		flags = re_flags;
+
+    if (vim_strchr(p_cpo, CPO_LITERAL) != NULL)
+	flags |= RC_CPO_LIT;
+    if (vim_strchr(p_cpo, CPO_BACKSL) != NULL)
+	flags |= RC_CPO_BSL;
+    return flags | ((int)p_re << RC_ENGINE_SHIFT);
+}
+
+/*
+ * vim_regcomp() with the cache: return the cached program for "expr" or
+ * compile it and add it to the cache.
+ */
+    static regprog_T *
+regcache_comp(expr, re_flags)
+    char_u	*expr;
+    int		re_flags;
+{
+    regcache_T	*rcp;
+    regcache_T	*lru = NULL;
+    regprog_T	*prog;
+    char_u	*pat;
+    int		flags;
+    int		i;
+    int		save_called_emsg = called_emsg;
+
+    /* "~" depends on the previous substitute string and "\z(" is only for
+     * syntax items, don't cache those. */
+    if (expr == NULL || vim_strchr(expr, '~') != NULL
+#ifdef FEAT_SYN_HL
+	    || reg_do_extmatch != 0
+#endif
+	    )
+	return vim_regcomp(expr, re_flags);
+
+    flags = regcache_flags(re_flags);
+    for (i = 0; i < REGCACHE_SIZE; ++i)
+    {
+	rcp = &regcache[i];
+	if (rcp->rc_pat != NULL && rcp->rc_flags == flags
+					       && STRCMP(rcp->rc_pat, expr) == 0)
+	{
+	    ++regcache_hits;
+	    rcp->rc_used = ++regcache_tick;
+	    ++rcp->rc_prog->regrefcount;
+	    return rcp->rc_prog;
+	}
+	if (lru == NULL || rcp->rc_used < lru->rc_used)
+	    lru = rcp;
+    }
+
+    ++regcache_misses;
+    called_emsg = FALSE;
+    prog = vim_regcomp(expr, re_flags);
+
+    /* A pattern that gives an error message is not cached, the message
+     * must be given each time. */
+    if (prog != NULL && !called_emsg && (pat = vim_strsave(expr)) != NULL)
+    {
+	vim_free(lru->rc_pat);
+	vim_regfree(lru->rc_prog);
+	lru->rc_pat = pat;
+	lru->rc_flags = flags;
+	lru->rc_prog = prog;
+	lru->rc_used = ++regcache_tick;
+	++prog->regrefcount;
+    }
+    called_emsg |= save_called_emsg;
+    return prog;
+}
+
+/*
+ * Drop all programs from the cache.  Needed when 'encoding' changes.
+ */
+    void
+vim_regcache_clear()
+{
+    int		i;
+
+    for (i = 0; i < REGCACHE_SIZE; ++i)
+    {
+	vim_free(regcache[i].rc_pat);
+	regcache[i].rc_pat = NULL;
+	vim_regfree(regcache[i].rc_prog);
+	regcache[i].rc_prog = NULL;
+	regcache[i].rc_used = 0;
+    }
+}
+
+#if defined(FEAT_EVAL) || defined(PROTO)
+/*
+ * Get the number of times a program was found in the cache and not found,
+ * and the number of programs in the cache.
+ */
+    void
+vim_regcache_stats(hitsp, missesp, countp)
+    long	*hitsp;
+    long	*missesp;
+    int		*countp;
+{
+    int		i;
+
+    *hitsp = regcache_hits;
+    *missesp = regcache_misses;
+    *countp = 0;
+    for (i = 0; i < REGCACHE_SIZE; ++i)
+	if (regcache[i].rc_pat != NULL)
+	    ++*countp;
+}
+#endif
+
+/*
+ * Free a program returned by vim_regcomp().  A program that is shared,
+ * because it came from the cache, is only freed when the last user is done
+ * with it.
+ */
+    void
+vim_regfree(prog)
+    regprog_T	*prog;
+{
+    if (prog != NULL && --prog->regrefcount <= 0)
+	vim_free(prog);
+}
+
 /*
  * vim_regcomp() - compile a regular expression into internal code
  * Returns the program in allocated space.  Returns NULL for an error.
@@ -1026,7 +1216,11 @@ skip_regexp(startp, dirc, magic, newp)
  *
  * Beware that the optimization-preparation code in here knows about some
  * of the structure of the compiled regexp.
- * "re_flags": RE_MAGIC and/or RE_STRING.
+ * "re_flags": RE_MAGIC and/or RE_STRING, RE_CACHE to use the cache.
+ * Free the result with vim_regfree().
+ *
+ * Unless 'regexpengine' or a leading "\%#=1" says otherwise, the program is
+ * also translated for the NFA engine, see regexp_nfa.c.
  */
     regprog_T *
 vim_regcomp(expr, re_flags)
@@ -1038,10 +1232,31 @@ vim_regcomp(expr, re_flags)
     char_u	*longest;
     int		len;
     int		flags;
+    long	size;
+    int		engine = (int)p_re;
 
+    if (re_flags & RE_CACHE)
+	return regcache_comp(expr, re_flags & ~RE_CACHE);
     if (expr == NULL)
 	EMSG_RET_NULL(_(e_null));
 
+    /* "\%#=0", "\%#=1" or "\%#=2" at the start selects the engine. */
+    if (STRNCMP(expr, "\\%#=", 4) == 0)
+    {
+	if (expr[4] == '0' + AUTOMATIC_ENGINE
+		|| expr[4] == '0' + BACKTRACKING_ENGINE
+		|| expr[4] == '0' + NFA_ENGINE)
+	{
+	    engine = expr[4] - '0';
+	    expr += 5;
+	}
+	else
+	{
+	    EMSG(_("E839: \\%#= can only be followed by 0, 1, or 2. The automatic engine will be used"));
+	    engine = AUTOMATIC_ENGINE;
+	}
+    }
+
     init_class_tab();
 
     /*
@@ -1060,7 +1275,8 @@ vim_regcomp(expr, re_flags)
 #endif
 
     /* Allocate space. */
-    r = (regprog_T *)lalloc(sizeof(regprog_T) + regsize, TRUE);
+    size = regsize;
+    r = (regprog_T *)lalloc(sizeof(regprog_T) + size, TRUE);
     if (r == NULL)
 	return NULL;
 
@@ -1083,6 +1299,8 @@ vim_regcomp(expr, re_flags)
     r->reganch = 0;
     r->regmust = NULL;
     r->regmlen = 0;
+    r->regnfa = NULL;
+    r->regrefcount = 1;
     r->regflags = regflags;
     if (flags & HASNL)
 	r->regflags |= RF_HASNL;
@@ -1158,6 +1376,8 @@ vim_regcomp(expr, re_flags)
 #ifdef DEBUG
     regdump(expr, r);
 #endif
+    if (engine != BACKTRACKING_ENGINE)
+	r = nfa_regcomp(r, size, engine);
     return r;
 }
 
@@ -1204,6 +1424,143 @@ vim_regcomp_had_eol()
 }
 #endif
 
+/*
+ * Return a literal string that is in the first line of every match of "prog"
+ * and set "*lenp" to its length.  A line that doesn't contain it can't be
+ * where a match starts.  "ic" is TRUE when ignoring case, then only a string
+ * without letters can be used.
+ * Returns NULL when there is no such string.
+ */
+    char_u *
+vim_regliteral(prog, ic, lenp)
+    regprog_T	*prog;
+    int		ic;
+    int		*lenp;
+{
+    char_u	*scan;
+    char_u	*longest = NULL;
+    int		len = 0;
+    int		l;
+    char_u	*p;
+
+    /* The string may be in a later line when the pattern can match a line
+     * break, also in a look-behind. */
+    if (prog == NULL
+		|| (prog->regflags & (RF_HASNL | RF_LOOKBH | RF_ICOMBINE)))
+	return NULL;
+    if (prog->regflags & RF_ICASE)
+	ic = TRUE;
+    else if (prog->regflags & RF_NOICASE)
+	ic = FALSE;
+
+    /* Like the regmust in vim_regcomp(): only the items of a single
+     * top-level branch are always matched. */
+    scan = prog->program + 1;
+    if (OP(regnext(scan)) != END)
+	return NULL;
+    for (scan = OPERAND(scan); scan != NULL; scan = regnext(scan))
+    {
+	if (OP(scan) != EXACTLY)
+	    continue;
+	l = (int)STRLEN(OPERAND(scan));
+	if (l <= len)
+	    continue;
+	if (ic)
+	{
+	    for (p = OPERAND(scan); *p != NUL; ++p)
+		if (*p >= 0x80 || MB_ISLOWER(*p) || MB_ISUPPER(*p))
+		    break;
+	    if (*p != NUL)
+		continue;
+	}
+	longest = OPERAND(scan);
+	len = l;
+    }
+    *lenp = len;
+    return longest;
+}
+
+/*
+ * Set bits in "bytes", which has room for 256 bits, for byte values of which
+ * at least one is in the first line of every match of "prog".  A line
+ * without any of them can't be where a match starts.  Unlike
+ * vim_regliteral() this also works for a pattern with alternatives.  "ic" is
+ * used like there.
+ * Returns FAIL when there are no such bytes.
+ */
+    int
+vim_regbytes(prog, ic, bytes)
+    regprog_T	*prog;
+    int		ic;
+    char_u	*bytes;
+{
+    int		budget = 1000;
+
+    vim_memset(bytes, 0, 256 / 8);
+    if (prog == NULL
+		|| (prog->regflags & (RF_HASNL | RF_LOOKBH | RF_ICOMBINE)))
+	return FAIL;
+    if (prog->regflags & RF_ICASE)
+	ic = TRUE;
+    else if (prog->regflags & RF_NOICASE)
+	ic = FALSE;
+    return reg_reqbytes(prog->program + 1, ic, bytes, &budget);
+}
+
+/*
+ * Add to "bytes" a byte that every match of the nodes starting at "scan"
+ * contains.  For alternatives a byte is added for each of them.  "*budget"
+ * limits the number of nodes looked at.
+ * Returns FAIL when there is no such byte.
+ */
+    static int
+reg_reqbytes(scan, ic, bytes, budget)
+    char_u	*scan;
+    int		ic;
+    char_u	*bytes;
+    int		*budget;
+{
+    char_u	*br;
+    char_u	*p;
+
+    for ( ; scan != NULL && --*budget > 0; scan = regnext(scan))
+    {
+	switch (OP(scan))
+	{
+	    case END:
+	    case BACK:	    /* a loop, give up */
+		return FAIL;
+
+	    case EXACTLY:
+		for (p = OPERAND(scan); *p != NUL; ++p)
+		    if (!ic || (*p < 0x80 && !MB_ISLOWER(*p) && !MB_ISUPPER(*p)))
+		    {
+			bytes[*p >> 3] |= 1 << (*p & 7);
+			return OK;
+		    }
+		break;
+
+	    case BRANCH:
+		/* The nodes of each alternative continue after the group, thus
+		 * the byte may come from there.  Bytes added for alternatives
+		 * before one that fails only make the check weaker. */
+		for (br = scan; br != NULL && OP(br) == BRANCH;
+							      br = regnext(br))
+		    if (reg_reqbytes(OPERAND(br), ic, bytes, budget) == FAIL)
+			break;
+		if (br == NULL)
+		    return FAIL;
+		if (OP(br) != BRANCH)
+		    return OK;
+		/* Skip the alternatives, try the nodes after them. */
+		while ((br = regnext(scan)) != NULL && OP(br) == BRANCH)
+		    scan = br;
+		break;
+	}
+    }
+    return FAIL;
+}
+
 /*
  * reg - regular expression, i.e. main body or parenthesized thing
  *
@@ -1881,18 +2238,22 @@ regatom(flagp)
 		 * pattern -- regardless of whether or not it makes sense. */
 		case '^':
 		    ret = regnode(RE_BOF);
+		    regflags |= RF_POSITION;
 		    break;
 
 		case '$':
 		    ret = regnode(RE_EOF);
+		    regflags |= RF_POSITION;
 		    break;
 
 		case '#':
 		    ret = regnode(CURSOR);
+		    regflags |= RF_POSITION;
 		    break;
 
 		case 'V':
 		    ret = regnode(RE_VISUAL);
+		    regflags |= RF_POSITION;
 		    break;
 
 		/* \%[abc]: Emit as a list of branches, all ending at the last
@@ -2011,6 +2372,7 @@ regatom(flagp)
 				  /* "\%'m", "\%<'m" and "\%>'m": Mark */
 				  c = getchr();
 				  ret = regnode(RE_MARK);
+				  regflags |= RF_POSITION;
 				  if (ret == JUST_CALC_SIZE)
 				      regsize += 2;
 				  else
@@ -2028,6 +2390,8 @@ regatom(flagp)
 				      ret = regnode(RE_COL);
 				  else
 				      ret = regnode(RE_VCOL);
+				  if (c != 'c')
+				      regflags |= RF_POSITION;
 				  if (ret == JUST_CALC_SIZE)
 				      regsize += 5;
 				  else
@@ -3107,6 +3471,7 @@ typedef struct regbehind_S
 static char_u	*reg_getline __ARGS((linenr_T lnum));
 static long	vim_regexec_both __ARGS((char_u *line, colnr_T col, proftime_T *tm));
 static long	regtry __ARGS((regprog_T *prog, colnr_T col));
+static long	reg_found __ARGS((regprog_T *prog, colnr_T col));
 static void	cleanup_subexpr __ARGS((void));
 #ifdef FEAT_SYN_HL
 static void	cleanup_zsubexpr __ARGS((void));
@@ -3132,8 +3497,10 @@ static void	save_se_one __ARGS((save_se_T *savep, char_u **pp));
 	*(pp) = (savep)->se_u.ptr; }
 
 static int	re_num_cmp __ARGS((long_u val, char_u *scan));
+static int	regitem __ARGS((char_u *scan));
 static int	regmatch __ARGS((char_u *prog));
 static int	regrepeat __ARGS((char_u *p, long maxcount));
+static long	nfa_regexec __ARGS((regprog_T *prog, colnr_T col, proftime_T *tm));
 
 #ifdef DEBUG
 int		regnarrate = 0;
@@ -3289,6 +3656,7 @@ free_regexp_stuff()
     ga_clear(&backpos);
     vim_free(reg_tofree);
     vim_free(reg_prev_sub);
+    vim_regcache_clear();
 }
 #endif
 
@@ -3539,8 +3907,12 @@ vim_regexec_both(line, col, tm)
     regline = line;
     reglnum = 0;
 
+    /* The NFA engine tries all start positions at once. */
+    if (prog->regnfa != NULL)
+	retval = nfa_regexec(prog, col, tm);
+
     /* Simplest case: Anchored match need be tried only once. */
-    if (prog->reganch)
+    else if (prog->reganch)
     {
 	int	c;
 
@@ -3710,7 +4082,21 @@ regtry(prog, col)
 
     if (regmatch(prog->program + 1) == 0)
 	return 0;
+    return reg_found(prog, col);
+}
 
+/*
+ * Called when "prog" matched, starting at column "col" in the first line.
+ * Sets the start and end of the whole match when "\zs" and "\ze" didn't and
+ * packages any "\z(...\)" matches.  Expects reginput and reglnum to be just
+ * after the match.
+ * Returns the number of lines contained in the match.
+ */
+    static long
+reg_found(prog, col)
+    regprog_T	*prog;
+    colnr_T	col;
+{
     cleanup_subexpr();
     if (REG_MULTI)
     {
@@ -3789,630 +4175,668 @@ reg_prev_class()
 #endif
 #define ADVANCE_REGINPUT() mb_ptr_adv(reginput)
 
-/*
- * The arguments from BRACE_LIMITS are stored here.  They are actually local
- * to regmatch(), but they are here to reduce the amount of stack space used
- * (it can be called recursively many times).
- */
-static long	bl_minval;
-static long	bl_maxval;
-
-/*
- * regmatch - main matching routine
- *
- * Conceptually the strategy is simple: Check to see whether the current node
- * matches, push an item onto the regstack and loop to see whether the rest
- * matches, and then act accordingly.  In practice we make some effort to
- * avoid using the regstack, in particular by going through "ordinary" nodes
- * (that don't need to know whether the rest of the match failed) by a nested
- * loop.
- *
- * Returns TRUE when there is a match.  Leaves reginput and reglnum just after
- * the last matched character.
- * Returns FALSE when there is no match.  Leaves reginput and reglnum in an
- * undefined state!
- */
-    static int
-regmatch(scan)
-    char_u	*scan;		/* Current node. */
-{
-  char_u	*next;		/* Next node. */
-  int		op;
-  int		c;
-  regitem_T	*rp;
-  int		no;
-  int		status;		/* one of the RA_ values: */
+/* Values for "status" in regmatch() and regitem(). */
 #define RA_FAIL		1	/* something failed, abort */
 #define RA_CONT		2	/* continue in inner loop */
 #define RA_BREAK	3	/* break inner loop */
 #define RA_MATCH	4	/* successful match */
 #define RA_NOMATCH	5	/* didn't match */
 
-  /* Make "regstack" and "backpos" empty.  They are allocated and freed in
-   * vim_regexec_both() to reduce malloc()/free() calls. */
-  regstack.ga_len = 0;
-  backpos.ga_len = 0;
-
-  /*
-   * Repeat until "regstack" is empty.
-   */
-  for (;;)
-  {
-    /* Some patterns my cause a long time to match, even though they are not
-     * illegal.  E.g., "\([a-z]\+\)\+Q".  Allow breaking them with CTRL-C. */
-    fast_breakcheck();
+/*
+ * Match an item that doesn't need the regstack: an assertion such as "^" or
+ * "\<", a character class or a literal string.  Advances reginput (and
+ * reglnum) past the matched text.  Also used by the NFA engine.
+ * Returns RA_CONT when the item matched, RA_NOMATCH when it didn't and
+ * RA_MATCH when a lone composing character matched.
+ */
+    static int
+regitem(scan)
+    char_u	*scan;
+{
+    int		op;
+    int		c;
+    int		status = RA_CONT;
 
-#ifdef DEBUG
-    if (scan != NULL && regnarrate)
+    op = OP(scan);
+    /* Check for character class with NL added. */
+    if (!reg_line_lbr && WITH_NL(op) && REG_MULTI
+				&& *reginput == NUL && reglnum <= reg_maxline)
     {
-	mch_errmsg(regprop(scan));
-	mch_errmsg("(\n");
+	reg_nextline();
+	return RA_CONT;
+    }
+    if (reg_line_lbr && WITH_NL(op) && *reginput == '\n')
+    {
+	ADVANCE_REGINPUT();
+	return RA_CONT;
     }
-#endif
 
-    /*
-     * Repeat for items that can be matched sequentially, without using the
-     * regstack.
-     */
-    for (;;)
+    if (WITH_NL(op))
+	op -= ADD_NL;
+#ifdef FEAT_MBYTE
+    if (has_mbyte)
+	c = (*mb_ptr2char)(reginput);
+    else
+#endif
+	c = *reginput;
+    switch (op)
     {
-	if (got_int || scan == NULL)
+      case BOL:
+	if (reginput != regline)
+	    status = RA_NOMATCH;
+	break;
+
+      case EOL:
+	if (c != NUL)
+	    status = RA_NOMATCH;
+	break;
+
+      case RE_BOF:
+	/* We're not at the beginning of the file when below the first
+	 * line where we started, not at the start of the line or we
+	 * didn't start at the first line of the buffer. */
+	if (reglnum != 0 || reginput != regline
+				      || (REG_MULTI && reg_firstlnum > 1))
+	    status = RA_NOMATCH;
+	break;
+
+      case RE_EOF:
+	if (reglnum != reg_maxline || c != NUL)
+	    status = RA_NOMATCH;
+	break;
+
+      case CURSOR:
+	/* Check if the buffer is in a window and compare the
+	 * reg_win->w_cursor position to the match position. */
+	if (reg_win == NULL
+		|| (reglnum + reg_firstlnum != reg_win->w_cursor.lnum)
+		|| ((colnr_T)(reginput - regline) != reg_win->w_cursor.col))
+	    status = RA_NOMATCH;
+	break;
+
+      case RE_MARK:
+	/* Compare the mark position to the match position.  NOTE: Always
+	 * uses the current buffer. */
 	{
-	    status = RA_FAIL;
-	    break;
+	    int     mark = OPERAND(scan)[0];
+	    int     cmp = OPERAND(scan)[1];
+	    pos_T   *pos;
+
+	    pos = getmark(mark, FALSE);
+	    if (pos == NULL              /* mark doesn't exist */
+		    || pos->lnum <= 0    /* mark isn't set (in curbuf) */
+		    || (pos->lnum == reglnum + reg_firstlnum
+			    ? (pos->col == (colnr_T)(reginput - regline)
+				? (cmp == '<' || cmp == '>')
+				: (pos->col < (colnr_T)(reginput - regline)
+				    ? cmp != '>'
+				    : cmp != '<'))
+			    : (pos->lnum < reglnum + reg_firstlnum
+				? cmp != '>'
+				: cmp != '<')))
+		status = RA_NOMATCH;
 	}
-	status = RA_CONT;
+	break;
 
-#ifdef DEBUG
-	if (regnarrate)
+      case RE_VISUAL:
+#ifdef FEAT_VISUAL
+	/* Check if the buffer is the current buffer. and whether the
+	 * position is inside the Visual area. */
+	if (reg_buf != curbuf || VIsual.lnum == 0)
+	    status = RA_NOMATCH;
+	else
 	{
-	    mch_errmsg(regprop(scan));
-	    mch_errmsg("...\n");
-# ifdef FEAT_SYN_HL
-	    if (re_extmatch_in != NULL)
-	    {
-		int i;
+	    pos_T       top, bot;
+	    linenr_T    lnum;
+	    colnr_T     col;
+	    win_T       *wp = reg_win == NULL ? curwin : reg_win;
+	    int         mode;
 
-		mch_errmsg(_("External submatches:\n"));
-		for (i = 0; i < NSUBEXP; i++)
+	    if (VIsual_active)
+	    {
+		if (lt(VIsual, wp->w_cursor))
 		{
-		    mch_errmsg("    \"");
-		    if (re_extmatch_in->matches[i] != NULL)
-			mch_errmsg(re_extmatch_in->matches[i]);
-		    mch_errmsg("\"\n");
+		    top = VIsual;
+		    bot = wp->w_cursor;
 		}
+		else
+		{
+		    top = wp->w_cursor;
+		    bot = VIsual;
+		}
+		mode = VIsual_mode;
 	    }
-# endif
-	}
-#endif
-	next = regnext(scan);
-
-	op = OP(scan);
-	/* Check for character class with NL added. */
-	if (!reg_line_lbr && WITH_NL(op) && REG_MULTI
-				&& *reginput == NUL && reglnum <= reg_maxline)
-	{
-	    reg_nextline();
-	}
-	else if (reg_line_lbr && WITH_NL(op) && *reginput == '\n')
-	{
-	    ADVANCE_REGINPUT();
-	}
-	else
-	{
-	  if (WITH_NL(op))
-	      op -= ADD_NL;
-#ifdef FEAT_MBYTE
-	  if (has_mbyte)
-	      c = (*mb_ptr2char)(reginput);
-	  else
-#endif
-	      c = *reginput;
-	  switch (op)
-	  {
-	  case BOL:
-	    if (reginput != regline)
-		status = RA_NOMATCH;
-	    break;
-
-	  case EOL:
-	    if (c != NUL)
-		status = RA_NOMATCH;
-	    break;
-
-	  case RE_BOF:
-	    /* We're not at the beginning of the file when below the first
-	     * line where we started, not at the start of the line or we
-	     * didn't start at the first line of the buffer. */
-	    if (reglnum != 0 || reginput != regline
-					  || (REG_MULTI && reg_firstlnum > 1))
-		status = RA_NOMATCH;
-	    break;
-
-	  case RE_EOF:
-	    if (reglnum != reg_maxline || c != NUL)
-		status = RA_NOMATCH;
-	    break;
-
-	  case CURSOR:
-	    /* Check if the buffer is in a window and compare the
-	     * reg_win->w_cursor position to the match position. */
-	    if (reg_win == NULL
-		    || (reglnum + reg_firstlnum != reg_win->w_cursor.lnum)
-		    || ((colnr_T)(reginput - regline) != reg_win->w_cursor.col))
-		status = RA_NOMATCH;
-	    break;
-
-	  case RE_MARK:
-	    /* Compare the mark position to the match position.  NOTE: Always
-	     * uses the current buffer. */
-	    {
-		int	mark = OPERAND(scan)[0];
-		int	cmp = OPERAND(scan)[1];
-		pos_T	*pos;
-
-		pos = getmark(mark, FALSE);
-		if (pos == NULL		     /* mark doesn't exist */
-			|| pos->lnum <= 0    /* mark isn't set (in curbuf) */
-			|| (pos->lnum == reglnum + reg_firstlnum
-				? (pos->col == (colnr_T)(reginput - regline)
-				    ? (cmp == '<' || cmp == '>')
-				    : (pos->col < (colnr_T)(reginput - regline)
-					? cmp != '>'
-					: cmp != '<'))
-				: (pos->lnum < reglnum + reg_firstlnum
-				    ? cmp != '>'
-				    : cmp != '<')))
-		    status = RA_NOMATCH;
-	    }
-	    break;
-
-	  case RE_VISUAL:
-#ifdef FEAT_VISUAL
-	    /* Check if the buffer is the current buffer. and whether the
-	     * position is inside the Visual area. */
-	    if (reg_buf != curbuf || VIsual.lnum == 0)
-		status = RA_NOMATCH;
 	    else
 	    {
-		pos_T	    top, bot;
-		linenr_T    lnum;
-		colnr_T	    col;
-		win_T	    *wp = reg_win == NULL ? curwin : reg_win;
-		int	    mode;
-
-		if (VIsual_active)
+		if (lt(curbuf->b_visual.vi_start, curbuf->b_visual.vi_end))
 		{
-		    if (lt(VIsual, wp->w_cursor))
-		    {
-			top = VIsual;
-			bot = wp->w_cursor;
-		    }
-		    else
-		    {
-			top = wp->w_cursor;
-			bot = VIsual;
-		    }
-		    mode = VIsual_mode;
+		    top = curbuf->b_visual.vi_start;
+		    bot = curbuf->b_visual.vi_end;
 		}
 		else
 		{
-		    if (lt(curbuf->b_visual.vi_start, curbuf->b_visual.vi_end))
-		    {
-			top = curbuf->b_visual.vi_start;
-			bot = curbuf->b_visual.vi_end;
-		    }
-		    else
-		    {
-			top = curbuf->b_visual.vi_end;
-			bot = curbuf->b_visual.vi_start;
-		    }
-		    mode = curbuf->b_visual.vi_mode;
+		    top = curbuf->b_visual.vi_end;
+		    bot = curbuf->b_visual.vi_start;
 		}
-		lnum = reglnum + reg_firstlnum;
-		col = (colnr_T)(reginput - regline);
-		if (lnum < top.lnum || lnum > bot.lnum)
+		mode = curbuf->b_visual.vi_mode;
+	    }
+	    lnum = reglnum + reg_firstlnum;
+	    col = (colnr_T)(reginput - regline);
+	    if (lnum < top.lnum || lnum > bot.lnum)
+		status = RA_NOMATCH;
+	    else if (mode == 'v')
+	    {
+		if ((lnum == top.lnum && col < top.col)
+			|| (lnum == bot.lnum
+				     && col >= bot.col + (*p_sel != 'e')))
 		    status = RA_NOMATCH;
-		else if (mode == 'v')
-		{
-		    if ((lnum == top.lnum && col < top.col)
-			    || (lnum == bot.lnum
-					 && col >= bot.col + (*p_sel != 'e')))
-			status = RA_NOMATCH;
-		}
-		else if (mode == Ctrl_V)
-		{
-		    colnr_T	    start, end;
-		    colnr_T	    start2, end2;
-		    colnr_T	    cols;
-
-		    getvvcol(wp, &top, &start, NULL, &end);
-		    getvvcol(wp, &bot, &start2, NULL, &end2);
-		    if (start2 < start)
-			start = start2;
-		    if (end2 > end)
-			end = end2;
-		    if (top.col == MAXCOL || bot.col == MAXCOL)
-			end = MAXCOL;
-		    cols = win_linetabsize(wp,
-				      regline, (colnr_T)(reginput - regline));
-		    if (cols < start || cols > end - (*p_sel == 'e'))
-			status = RA_NOMATCH;
-		}
 	    }
+	    else if (mode == Ctrl_V)
+	    {
+		colnr_T         start, end;
+		colnr_T         start2, end2;
+		colnr_T         cols;
+
+		getvvcol(wp, &top, &start, NULL, &end);
+		getvvcol(wp, &bot, &start2, NULL, &end2);
+		if (start2 < start)
+		    start = start2;
+		if (end2 > end)
+		    end = end2;
+		if (top.col == MAXCOL || bot.col == MAXCOL)
+		    end = MAXCOL;
+		cols = win_linetabsize(wp,
+				  regline, (colnr_T)(reginput - regline));
+		if (cols < start || cols > end - (*p_sel == 'e'))
+		    status = RA_NOMATCH;
+	    }
+	}
 #else
-	    status = RA_NOMATCH;
+	status = RA_NOMATCH;
 #endif
-	    break;
+	break;
 
-	  case RE_LNUM:
-	    if (!REG_MULTI || !re_num_cmp((long_u)(reglnum + reg_firstlnum),
-									scan))
-		status = RA_NOMATCH;
-	    break;
+      case RE_LNUM:
+	if (!REG_MULTI || !re_num_cmp((long_u)(reglnum + reg_firstlnum),
+								    scan))
+	    status = RA_NOMATCH;
+	break;
 
-	  case RE_COL:
-	    if (!re_num_cmp((long_u)(reginput - regline) + 1, scan))
-		status = RA_NOMATCH;
-	    break;
+      case RE_COL:
+	if (!re_num_cmp((long_u)(reginput - regline) + 1, scan))
+	    status = RA_NOMATCH;
+	break;
 
-	  case RE_VCOL:
-	    if (!re_num_cmp((long_u)win_linetabsize(
-			    reg_win == NULL ? curwin : reg_win,
-			    regline, (colnr_T)(reginput - regline)) + 1, scan))
-		status = RA_NOMATCH;
-	    break;
+      case RE_VCOL:
+	if (!re_num_cmp((long_u)win_linetabsize(
+			reg_win == NULL ? curwin : reg_win,
+			regline, (colnr_T)(reginput - regline)) + 1, scan))
+	    status = RA_NOMATCH;
+	break;
 
-	  case BOW:	/* \<word; reginput points to w */
-	    if (c == NUL)	/* Can't match at end of line */
-		status = RA_NOMATCH;
+      case BOW:     /* \<word; reginput points to w */
+	if (c == NUL)       /* Can't match at end of line */
+	    status = RA_NOMATCH;
 #ifdef FEAT_MBYTE
-	    else if (has_mbyte)
-	    {
-		int this_class;
-
-		/* Get class of current and previous char (if it exists). */
-		this_class = mb_get_class(reginput);
-		if (this_class <= 1)
-		    status = RA_NOMATCH;  /* not on a word at all */
-		else if (reg_prev_class() == this_class)
-		    status = RA_NOMATCH;  /* previous char is in same word */
-	    }
+	else if (has_mbyte)
+	{
+	    int this_class;
+
+	    /* Get class of current and previous char (if it exists). */
+	    this_class = mb_get_class(reginput);
+	    if (this_class <= 1)
+		status = RA_NOMATCH;  /* not on a word at all */
+	    else if (reg_prev_class() == this_class)
+		status = RA_NOMATCH;  /* previous char is in same word */
+	}
 #endif
-	    else
-	    {
-		if (!vim_iswordc(c)
-			|| (reginput > regline && vim_iswordc(reginput[-1])))
-		    status = RA_NOMATCH;
-	    }
-	    break;
-
-	  case EOW:	/* word\>; reginput points after d */
-	    if (reginput == regline)    /* Can't match at start of line */
+	else
+	{
+	    if (!vim_iswordc(c)
+		    || (reginput > regline && vim_iswordc(reginput[-1])))
 		status = RA_NOMATCH;
+	}
+	break;
+
+      case EOW:     /* word\>; reginput points after d */
+	if (reginput == regline)    /* Can't match at start of line */
+	    status = RA_NOMATCH;
 #ifdef FEAT_MBYTE
-	    else if (has_mbyte)
-	    {
-		int this_class, prev_class;
+	else if (has_mbyte)
+	{
+	    int this_class, prev_class;
 
-		/* Get class of current and previous char (if it exists). */
-		this_class = mb_get_class(reginput);
-		prev_class = reg_prev_class();
-		if (this_class == prev_class
-			|| prev_class == 0 || prev_class == 1)
-		    status = RA_NOMATCH;
-	    }
+	    /* Get class of current and previous char (if it exists). */
+	    this_class = mb_get_class(reginput);
+	    prev_class = reg_prev_class();
+	    if (this_class == prev_class
+		    || prev_class == 0 || prev_class == 1)
+		status = RA_NOMATCH;
+	}
 #endif
-	    else
-	    {
-		if (!vim_iswordc(reginput[-1])
-			|| (reginput[0] != NUL && vim_iswordc(c)))
-		    status = RA_NOMATCH;
-	    }
-	    break; /* Matched with EOW */
-
-	  case ANY:
-	    if (c == NUL)
+	else
+	{
+	    if (!vim_iswordc(reginput[-1])
+		    || (reginput[0] != NUL && vim_iswordc(c)))
 		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+	}
+	break; /* Matched with EOW */
 
-	  case IDENT:
-	    if (!vim_isIDc(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case ANY:
+	if (c == NUL)
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case SIDENT:
-	    if (VIM_ISDIGIT(*reginput) || !vim_isIDc(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case IDENT:
+	if (!vim_isIDc(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case KWORD:
-	    if (!vim_iswordp(reginput))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case SIDENT:
+	if (VIM_ISDIGIT(*reginput) || !vim_isIDc(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case SKWORD:
-	    if (VIM_ISDIGIT(*reginput) || !vim_iswordp(reginput))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case KWORD:
+	if (!vim_iswordp(reginput))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case FNAME:
-	    if (!vim_isfilec(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case SKWORD:
+	if (VIM_ISDIGIT(*reginput) || !vim_iswordp(reginput))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case SFNAME:
-	    if (VIM_ISDIGIT(*reginput) || !vim_isfilec(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case FNAME:
+	if (!vim_isfilec(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case PRINT:
-	    if (ptr2cells(reginput) != 1)
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case SFNAME:
+	if (VIM_ISDIGIT(*reginput) || !vim_isfilec(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case SPRINT:
-	    if (VIM_ISDIGIT(*reginput) || ptr2cells(reginput) != 1)
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case PRINT:
+	if (ptr2cells(reginput) != 1)
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case WHITE:
-	    if (!vim_iswhite(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case SPRINT:
+	if (VIM_ISDIGIT(*reginput) || ptr2cells(reginput) != 1)
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case NWHITE:
-	    if (c == NUL || vim_iswhite(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case WHITE:
+	if (!vim_iswhite(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case DIGIT:
-	    if (!ri_digit(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case NWHITE:
+	if (c == NUL || vim_iswhite(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case NDIGIT:
-	    if (c == NUL || ri_digit(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case DIGIT:
+	if (!ri_digit(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case HEX:
-	    if (!ri_hex(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case NDIGIT:
+	if (c == NUL || ri_digit(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case NHEX:
-	    if (c == NUL || ri_hex(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case HEX:
+	if (!ri_hex(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case OCTAL:
-	    if (!ri_octal(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case NHEX:
+	if (c == NUL || ri_hex(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case NOCTAL:
-	    if (c == NUL || ri_octal(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case OCTAL:
+	if (!ri_octal(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case WORD:
-	    if (!ri_word(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case NOCTAL:
+	if (c == NUL || ri_octal(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case NWORD:
-	    if (c == NUL || ri_word(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case WORD:
+	if (!ri_word(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
+
+      case NWORD:
+	if (c == NUL || ri_word(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
+
+      case HEAD:
+	if (!ri_head(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
+
+      case NHEAD:
+	if (c == NUL || ri_head(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case HEAD:
-	    if (!ri_head(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case ALPHA:
+	if (!ri_alpha(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case NHEAD:
-	    if (c == NUL || ri_head(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case NALPHA:
+	if (c == NUL || ri_alpha(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case ALPHA:
-	    if (!ri_alpha(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case LOWER:
+	if (!ri_lower(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case NALPHA:
-	    if (c == NUL || ri_alpha(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case NLOWER:
+	if (c == NUL || ri_lower(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case LOWER:
-	    if (!ri_lower(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case UPPER:
+	if (!ri_upper(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case NLOWER:
-	    if (c == NUL || ri_lower(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case NUPPER:
+	if (c == NUL || ri_upper(c))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
-	  case UPPER:
-	    if (!ri_upper(c))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case EXACTLY:
+	{
+	    int     len;
+	    char_u  *opnd;
 
-	  case NUPPER:
-	    if (c == NUL || ri_upper(c))
+	    opnd = OPERAND(scan);
+	    /* Inline the first byte, for speed. */
+	    if (*opnd != *reginput
+		    && (!ireg_ic || (
+#ifdef FEAT_MBYTE
+			!enc_utf8 &&
+#endif
+			MB_TOLOWER(*opnd) != MB_TOLOWER(*reginput))))
 		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
-
-	  case EXACTLY:
+	    else if (*opnd == NUL)
 	    {
-		int	len;
-		char_u	*opnd;
-
-		opnd = OPERAND(scan);
-		/* Inline the first byte, for speed. */
-		if (*opnd != *reginput
-			&& (!ireg_ic || (
+		/* match empty string always works; happens when "~" is
+		 * empty. */
+	    }
+	    else if (opnd[1] == NUL
 #ifdef FEAT_MBYTE
-			    !enc_utf8 &&
+			&& !(enc_utf8 && ireg_ic)
 #endif
-			    MB_TOLOWER(*opnd) != MB_TOLOWER(*reginput))))
+		    )
+		++reginput;         /* matched a single char */
+	    else
+	    {
+		len = (int)STRLEN(opnd);
+		/* Need to match first byte again for multi-byte. */
+		if (cstrncmp(opnd, reginput, &len) != 0)
 		    status = RA_NOMATCH;
-		else if (*opnd == NUL)
-		{
-		    /* match empty string always works; happens when "~" is
-		     * empty. */
-		}
-		else if (opnd[1] == NUL
 #ifdef FEAT_MBYTE
-			    && !(enc_utf8 && ireg_ic)
-#endif
-			)
-		    ++reginput;		/* matched a single char */
-		else
+		/* Check for following composing character. */
+		else if (enc_utf8
+			   && UTF_COMPOSINGLIKE(reginput, reginput + len))
 		{
-		    len = (int)STRLEN(opnd);
-		    /* Need to match first byte again for multi-byte. */
-		    if (cstrncmp(opnd, reginput, &len) != 0)
+		    /* raaron: This code makes a composing character get
+		     * ignored, which is the correct behavior (sometimes)
+		     * for voweled Hebrew texts. */
+		    if (!ireg_icombine)
 			status = RA_NOMATCH;
-#ifdef FEAT_MBYTE
-		    /* Check for following composing character. */
-		    else if (enc_utf8
-			       && UTF_COMPOSINGLIKE(reginput, reginput + len))
-		    {
-			/* raaron: This code makes a composing character get
-			 * ignored, which is the correct behavior (sometimes)
-			 * for voweled Hebrew texts. */
-			if (!ireg_icombine)
-			    status = RA_NOMATCH;
-		    }
-#endif
-		    else
-			reginput += len;
 		}
+#endif
+		else
+		    reginput += len;
 	    }
-	    break;
+	}
+	break;
 
-	  case ANYOF:
-	  case ANYBUT:
-	    if (c == NUL)
-		status = RA_NOMATCH;
-	    else if ((cstrchr(OPERAND(scan), c) == NULL) == (op == ANYOF))
-		status = RA_NOMATCH;
-	    else
-		ADVANCE_REGINPUT();
-	    break;
+      case ANYOF:
+      case ANYBUT:
+	if (c == NUL)
+	    status = RA_NOMATCH;
+	else if ((cstrchr(OPERAND(scan), c) == NULL) == (op == ANYOF))
+	    status = RA_NOMATCH;
+	else
+	    ADVANCE_REGINPUT();
+	break;
 
 #ifdef FEAT_MBYTE
-	  case MULTIBYTECODE:
-	    if (has_mbyte)
+      case MULTIBYTECODE:
+	if (has_mbyte)
+	{
+	    int     i, len;
+	    char_u  *opnd;
+	    int     opndc = 0, inpc;
+
+	    opnd = OPERAND(scan);
+	    /* Safety check (just in case 'encoding' was changed since
+	     * compiling the program). */
+	    if ((len = (*mb_ptr2len)(opnd)) < 2)
 	    {
-		int	i, len;
-		char_u	*opnd;
-		int	opndc = 0, inpc;
-
-		opnd = OPERAND(scan);
-		/* Safety check (just in case 'encoding' was changed since
-		 * compiling the program). */
-		if ((len = (*mb_ptr2len)(opnd)) < 2)
-		{
-		    status = RA_NOMATCH;
-		    break;
-		}
-		if (enc_utf8)
-		    opndc = mb_ptr2char(opnd);
-		if (enc_utf8 && utf_iscomposing(opndc))
+		status = RA_NOMATCH;
+		break;
+	    }
+	    if (enc_utf8)
+		opndc = mb_ptr2char(opnd);
+	    if (enc_utf8 && utf_iscomposing(opndc))
+	    {
+		/* When only a composing char is given match at any
+		 * position where that composing char appears. */
+		status = RA_NOMATCH;
+		for (i = 0; reginput[i] != NUL; i += utf_char2len(inpc))
 		{
-		    /* When only a composing char is given match at any
-		     * position where that composing char appears. */
-		    status = RA_NOMATCH;
-		    for (i = 0; reginput[i] != NUL; i += utf_char2len(inpc))
+		    inpc = mb_ptr2char(reginput + i);
+		    if (!utf_iscomposing(inpc))
 		    {
-			inpc = mb_ptr2char(reginput + i);
-			if (!utf_iscomposing(inpc))
-			{
-			    if (i > 0)
-				break;
-			}
-			else if (opndc == inpc)
-			{
-			    /* Include all following composing chars. */
-			    len = i + mb_ptr2len(reginput + i);
-			    status = RA_MATCH;
+			if (i > 0)
 			    break;
-			}
+		    }
+		    else if (opndc == inpc)
+		    {
+			/* Include all following composing chars. */
+			len = i + mb_ptr2len(reginput + i);
+			status = RA_MATCH;
+			break;
 		    }
 		}
-		else
-		    for (i = 0; i < len; ++i)
-			if (opnd[i] != reginput[i])
-			{
-			    status = RA_NOMATCH;
-			    break;
-			}
-		reginput += len;
 	    }
 	    else
-		status = RA_NOMATCH;
+		for (i = 0; i < len; ++i)
+		    if (opnd[i] != reginput[i])
+		    {
+			status = RA_NOMATCH;
+			break;
+		    }
+	    reginput += len;
+	}
+	else
+	    status = RA_NOMATCH;
+	break;
+#endif
+
+      case NEWL:
+	if ((c != NUL || !REG_MULTI || reglnum > reg_maxline
+			 || reg_line_lbr) && (c != '\n' || !reg_line_lbr))
+	    status = RA_NOMATCH;
+	else if (reg_line_lbr)
+	    ADVANCE_REGINPUT();
+	else
+	    reg_nextline();
+	break;
+    }
+    return status;
+}
+
+/*
+ * The arguments from BRACE_LIMITS are stored here.  They are actually local
+ * to regmatch(), but they are here to reduce the amount of stack space used
+ * (it can be called recursively many times).
+ */
+static long	bl_minval;
+static long	bl_maxval;
+
+/*
+ * regmatch - main matching routine
+ *
+ * Conceptually the strategy is simple: Check to see whether the current node
+ * matches, push an item onto the regstack and loop to see whether the rest
+ * matches, and then act accordingly.  In practice we make some effort to
+ * avoid using the regstack, in particular by going through "ordinary" nodes
+ * (that don't need to know whether the rest of the match failed) by a nested
+ * loop.
+ *
+ * Returns TRUE when there is a match.  Leaves reginput and reglnum just after
+ * the last matched character.
+ * Returns FALSE when there is no match.  Leaves reginput and reglnum in an
+ * undefined state!
+ */
+    static int
+regmatch(scan)
+    char_u	*scan;		/* Current node. */
+{
+  char_u	*next;		/* Next node. */
+  int		op;
+  regitem_T	*rp;
+  int		no;
+  int		status;		/* one of the RA_ values */
+
+  /* Make "regstack" and "backpos" empty.  They are allocated and freed in
+   * vim_regexec_both() to reduce malloc()/free() calls. */
+  regstack.ga_len = 0;
+  backpos.ga_len = 0;
+
+  /*
+   * Repeat until "regstack" is empty.
+   */
+  for (;;)
+  {
+    /* Some patterns my cause a long time to match, even though they are not
+     * illegal.  E.g., "\([a-z]\+\)\+Q".  Allow breaking them with CTRL-C. */
+    fast_breakcheck();
+
+#ifdef DEBUG
+    if (scan != NULL && regnarrate)
+    {
+	mch_errmsg(regprop(scan));
+	mch_errmsg("(\n");
+    }
+#endif
+
+    /*
+     * Repeat for items that can be matched sequentially, without using the
+     * regstack.
+     */
+    for (;;)
+    {
+	if (got_int || scan == NULL)
+	{
+	    status = RA_FAIL;
 	    break;
+	}
+	status = RA_CONT;
+
+#ifdef DEBUG
+	if (regnarrate)
+	{
+	    mch_errmsg(regprop(scan));
+	    mch_errmsg("...\n");
+# ifdef FEAT_SYN_HL
+	    if (re_extmatch_in != NULL)
+	    {
+		int i;
+
+		mch_errmsg(_("External submatches:\n"));
+		for (i = 0; i < NSUBEXP; i++)
+		{
+		    mch_errmsg("    \"");
+		    if (re_extmatch_in->matches[i] != NULL)
+			mch_errmsg(re_extmatch_in->matches[i]);
+		    mch_errmsg("\"\n");
+		}
+	    }
+# endif
+	}
 #endif
+	next = regnext(scan);
 
+	op = OP(scan);
+	if (REG_ITEM(op))
+	    /* An assertion or an item matching characters. */
+	    status = regitem(scan);
+	else
+	{
+	  switch (op)
+	  {
 	  case NOTHING:
 	    break;
 
@@ -4970,16 +5394,6 @@ regmatch(scan)
 		status = RA_NOMATCH;
 	    break;
 
-	  case NEWL:
-	    if ((c != NUL || !REG_MULTI || reglnum > reg_maxline
-			     || reg_line_lbr) && (c != '\n' || !reg_line_lbr))
-		status = RA_NOMATCH;
-	    else if (reg_line_lbr)
-		ADVANCE_REGINPUT();
-	    else
-		reg_nextline();
-	    break;
-
 	  case END:
 	    status = RA_MATCH;	/* Success! */
 	    break;
@@ -7411,3 +7825,6 @@ reg_submatch(no)
     return retval;
 }
 #endif
+
+/* The NFA engine uses the functions and variables defined above. */
+#include "regexp_nfa.c"
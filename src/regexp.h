@@ -34,6 +34,8 @@ typedef struct
     int			regmlen;
     unsigned		regflags;
     char_u		reghasz;
+    struct nfa_prog_S	*regnfa;		/* NFA program or NULL */
+    int			regrefcount;		/* users, see vim_regfree() */
     char_u		program[1];		/* actually longer.. */
 } regprog_T;
 
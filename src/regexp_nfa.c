@@ -0,0 +1,987 @@
+/* vi:set ts=8 sts=4 sw=4:
+ *
+ * NFA regular expression engine.
+ *
+ * This file is included by "regexp.c".
+ *
+ * The program that vim_regcomp() produces for the backtracking engine is
+ * translated into a list of NFA states.  A match is found by following all
+ * paths through the states at the same time, while going over the text only
+ * once.  The "threads" at a text position are kept in order of priority, so
+ * that the match found is the same as what the backtracking engine finds.
+ * The time used is linear in the length of the text, also for patterns like
+ * "\(a*\)*b" which make the backtracking engine take exponential time.
+ *
+ * Items are matched with regitem() and regrepeat(), thus they work exactly
+ * like in the backtracking engine.  Back references, look-ahead and
+ * look-behind can't be handled this way, patterns with them always use the
+ * backtracking engine.  So do patterns that need too many states.
+ *
+ * For simple patterns the backtracking engine is faster, it is used unless
+ * the NFA engine was asked for with 'regexpengine' or "\%#=2".
+ */
+
+/*
+ * State types.
+ */
+#define NS_EMPTY	0	/* continue with ns_out */
+#define NS_SPLIT	1	/* try ns_out first, then ns_out1 */
+#define NS_SAVE		2	/* remember the position in ns_slot */
+#define NS_ASSERT	3	/* zero-width item, checked with regitem() */
+#define NS_ITEM		4	/* item matched with regitem() */
+#define NS_REPEAT	5	/* one time a simple item, with regrepeat() */
+#define NS_BACK		6	/* loop back, position remembered in ns_slot */
+#define NS_MATCH	7	/* the whole pattern matched */
+
+/* Patterns that need more states use the backtracking engine.  This also
+ * limits the recursion depth of nfa_node() and nfa_addstate(). */
+#define NFA_MAX_STATES	2000
+
+/* Patterns with more BACK nodes use the backtracking engine.  With five
+ * there are 32 combinations of BACK nodes passed, see nfa_mark_T. */
+#define NFA_MAX_BACK	5
+
+/* Slots for the sub-match positions of "\(\)" and "\z(\)", followed by the
+ * position where each BACK node was last passed. */
+#define NFA_SLOT_START(no)	((no) * 2)
+#define NFA_SLOT_END(no)	((no) * 2 + 1)
+#define NFA_SLOT_ZSTART(no)	(NSUBEXP * 2 + (no) * 2)
+#define NFA_SLOT_ZEND(no)	(NSUBEXP * 2 + (no) * 2 + 1)
+#define NFA_SLOT_BACK(no)	(NSUBEXP * 4 + (no))
+#define NFA_MAX_SLOTS		(NSUBEXP * 4 + NFA_MAX_BACK)
+
+typedef struct
+{
+    short	ns_type;	/* NS_ value */
+    short	ns_slot;	/* NS_SAVE, NS_BACK: position to set */
+    int		ns_node;	/* offset of the item in the program */
+    int		ns_out;		/* next state */
+    int		ns_out1;	/* NS_SPLIT: state to try second */
+} nfa_state_T;
+
+/*
+ * Stored after the program in the same allocated block, so that the regprog
+ * can still be freed with vim_free().
+ */
+typedef struct nfa_prog_S
+{
+    int		np_len;		/* number of states, the first one starts */
+    int		np_nslot;	/* number of sub-match positions used */
+    nfa_state_T	np_state[1];	/* actually longer */
+} nfa_prog_T;
+
+/*
+ * Used while translating the program into states.
+ */
+typedef struct
+{
+    char_u	*nc_program;	/* the program being translated */
+    long	nc_size;	/* number of bytes in nc_program */
+    garray_T	nc_states;	/* growarray of nfa_state_T */
+    int		nc_nslot;	/* number of sub-match positions used */
+    int		nc_back[NFA_MAX_BACK];	/* offsets of the BACK nodes */
+    int		nc_nback;	/* number of BACK nodes */
+    int		nc_nrepeat;	/* number of simple repeated items */
+    int		nc_complex;	/* TRUE when a complex item is repeated */
+} nfa_compile_T;
+
+/*
+ * The operand of a "\{}" is translated once for every time it can match.
+ * Each copy has its own states, which are remembered by program offset in
+ * nf_memo[], and ends where the operand loops back to the BRACE_COMPLEX node.
+ */
+typedef struct
+{
+    char_u	*nf_brace;	/* BRACE_COMPLEX node or NULL */
+    int		nf_target;	/* state to continue with at nf_brace */
+    int		*nf_memo;	/* state for each program offset or -1 */
+} nfa_frame_T;
+
+#define NFA_STATE(nc, i) (((nfa_state_T *)(nc)->nc_states.ga_data)[i])
+
+static int	nfa_new_state __ARGS((nfa_compile_T *nc, int type));
+static int	nfa_node __ARGS((nfa_compile_T *nc, char_u *scan, nfa_frame_T *fp));
+static int	nfa_item_ok __ARGS((char_u *scan));
+static int	nfa_simple_repeat __ARGS((nfa_compile_T *nc, int entry, char_u *item, long minval, long maxval, int after));
+static int	nfa_complex_repeat __ARGS((nfa_compile_T *nc, int entry, char_u *brace, long minval, long maxval, int after));
+static int	nfa_copy_operand __ARGS((nfa_compile_T *nc, char_u *brace, int target));
+static void	nfa_set_choice __ARGS((nfa_compile_T *nc, int split, int greedy, int more, int after));
+
+/*
+ * Add a state of type "type".
+ * Returns its index, -1 when there are too many states.
+ */
+    static int
+nfa_new_state(nc, type)
+    nfa_compile_T	*nc;
+    int			type;
+{
+    nfa_state_T		*st;
+
+    if (nc->nc_states.ga_len >= NFA_MAX_STATES
+				      || ga_grow(&nc->nc_states, 1) == FAIL)
+	return -1;
+    st = &NFA_STATE(nc, nc->nc_states.ga_len);
+    st->ns_type = type;
+    st->ns_slot = 0;
+    st->ns_node = 0;
+    st->ns_out = -1;
+    st->ns_out1 = -1;
+    return nc->nc_states.ga_len++;
+}
+
+/*
+ * Return TRUE when the item at "scan" can be matched by the NFA engine.
+ */
+    static int
+nfa_item_ok(scan)
+    char_u	*scan;
+{
+    /* An empty string (from an empty "~") doesn't advance. */
+    if (OP(scan) == EXACTLY && *OPERAND(scan) == NUL)
+	return FALSE;
+#ifdef FEAT_MBYTE
+    /* A lone composing character ends the match right away. */
+    if (OP(scan) == MULTIBYTECODE && enc_utf8
+			       && utf_iscomposing(utf_ptr2char(OPERAND(scan))))
+	return FALSE;
+#endif
+    return TRUE;
+}
+
+/*
+ * Translate the program starting at node "scan" into states.
+ * Returns the index of the state to start with, -1 when the pattern can't be
+ * done by the NFA engine.
+ */
+    static int
+nfa_node(nc, scan, fp)
+    nfa_compile_T	*nc;
+    char_u		*scan;
+    nfa_frame_T		*fp;
+{
+    char_u	*next;
+    long	off;
+    int		op;
+    int		s;
+    int		out;
+    int		i;
+
+    if (scan == NULL)
+	return -1;
+    if (scan == fp->nf_brace)
+	return fp->nf_target;
+    off = (long)(scan - nc->nc_program);
+    if (fp->nf_memo[off] >= 0)
+	return fp->nf_memo[off];
+
+    /* Add the state before translating what follows, a loop may come back
+     * to it. */
+    s = nfa_new_state(nc, NS_EMPTY);
+    if (s < 0)
+	return -1;
+    fp->nf_memo[off] = s;
+
+    op = OP(scan);
+    next = regnext(scan);
+    switch (op)
+    {
+      case BRANCH:
+	out = nfa_node(nc, OPERAND(scan), fp);
+	if (out < 0)
+	    return -1;
+	NFA_STATE(nc, s).ns_out = out;
+	if (next != NULL && OP(next) == BRANCH)
+	{
+	    out = nfa_node(nc, next, fp);
+	    if (out < 0)
+		return -1;
+	    NFA_STATE(nc, s).ns_type = NS_SPLIT;
+	    NFA_STATE(nc, s).ns_out1 = out;
+	}
+	return s;
+
+      case BRACE_LIMITS:
+	if (next == NULL)
+	    return -1;
+	out = nfa_node(nc, regnext(next), fp);
+	if (out < 0)
+	    return -1;
+	if (OP(next) == BRACE_SIMPLE)
+	    return nfa_simple_repeat(nc, s, OPERAND(next),
+				   OPERAND_MIN(scan), OPERAND_MAX(scan), out);
+	if (OP(next) >= BRACE_COMPLEX && OP(next) < BRACE_COMPLEX + 10)
+	    return nfa_complex_repeat(nc, s, next,
+				   OPERAND_MIN(scan), OPERAND_MAX(scan), out);
+	return -1;
+
+      case STAR:
+      case PLUS:
+	out = nfa_node(nc, next, fp);
+	if (out < 0)
+	    return -1;
+	return nfa_simple_repeat(nc, s, OPERAND(scan),
+					 op == STAR ? 0L : 1L, MAX_LIMIT, out);
+
+      case END:
+	NFA_STATE(nc, s).ns_type = NS_MATCH;
+	return s;
+
+      case BACK:
+	/* Going back is a loop for "*" or "\+" with a complex operand.
+	 * Like in regmatch() it fails when at the same position as the
+	 * previous time, each copy of the node uses the same slot. */
+	if (next != NULL && next < scan)
+	    nc->nc_complex = TRUE;
+	for (i = 0; i < nc->nc_nback; ++i)
+	    if (nc->nc_back[i] == (int)off)
+		break;
+	if (i == nc->nc_nback)
+	{
+	    if (i == NFA_MAX_BACK)
+		return -1;
+	    nc->nc_back[nc->nc_nback++] = (int)off;
+	}
+	NFA_STATE(nc, s).ns_type = NS_BACK;
+	NFA_STATE(nc, s).ns_slot = NFA_SLOT_BACK(i);
+	if (NFA_SLOT_BACK(i) >= nc->nc_nslot)
+	    nc->nc_nslot = NFA_SLOT_BACK(i) + 1;
+	break;
+
+      case NOTHING:
+      case NOPEN:
+      case NCLOSE:
+	break;
+
+      default:
+	if (op >= MOPEN && op < MOPEN + NSUBEXP)
+	    NFA_STATE(nc, s).ns_slot = NFA_SLOT_START(op - MOPEN);
+	else if (op >= MCLOSE && op < MCLOSE + NSUBEXP)
+	    NFA_STATE(nc, s).ns_slot = NFA_SLOT_END(op - MCLOSE);
+#ifdef FEAT_SYN_HL
+	else if (op >= ZOPEN && op < ZOPEN + NSUBEXP)
+	    NFA_STATE(nc, s).ns_slot = NFA_SLOT_ZSTART(op - ZOPEN);
+	else if (op >= ZCLOSE && op < ZCLOSE + NSUBEXP)
+	    NFA_STATE(nc, s).ns_slot = NFA_SLOT_ZEND(op - ZCLOSE);
+#endif
+	else if (REG_ITEM(op) && nfa_item_ok(scan))
+	{
+	    NFA_STATE(nc, s).ns_node = (int)off;
+	    switch (op)
+	    {
+		case BOL: case EOL: case BOW: case EOW:
+		case RE_BOF: case RE_EOF: case CURSOR: case RE_MARK:
+		case RE_VISUAL: case RE_LNUM: case RE_COL: case RE_VCOL:
+		    NFA_STATE(nc, s).ns_type = NS_ASSERT;
+		    break;
+		default:
+		    NFA_STATE(nc, s).ns_type = NS_ITEM;
+		    break;
+	    }
+	    break;
+	}
+	else
+	    /* BACKREF, ZREF, MATCH, NOMATCH, BEHIND, etc. */
+	    return -1;
+
+	NFA_STATE(nc, s).ns_type = NS_SAVE;
+	if (NFA_STATE(nc, s).ns_slot >= nc->nc_nslot)
+	    nc->nc_nslot = NFA_STATE(nc, s).ns_slot + 1;
+	break;
+    }
+
+    out = nfa_node(nc, next, fp);
+    if (out < 0)
+	return -1;
+    NFA_STATE(nc, s).ns_out = out;
+    return s;
+}
+
+/*
+ * Set the choices of NS_SPLIT state "split": "more" for another match of the
+ * repeated item and "after" for what follows.
+ */
+    static void
+nfa_set_choice(nc, split, greedy, more, after)
+    nfa_compile_T	*nc;
+    int			split;
+    int			greedy;
+    int			more;
+    int			after;
+{
+    NFA_STATE(nc, split).ns_out = greedy ? more : after;
+    NFA_STATE(nc, split).ns_out1 = greedy ? after : more;
+}
+
+/*
+ * Make the states for STAR, PLUS and BRACE_SIMPLE: simple item "item"
+ * matching "minval" to "maxval" times, then continuing with state "after".
+ * When "minval" is bigger than "maxval" the range is backwards and the
+ * shortest match is used, like in regmatch().
+ * "entry" is the state already added for the node.
+ * Returns "entry" or -1.
+ */
+    static int
+nfa_simple_repeat(nc, entry, item, minval, maxval, after)
+    nfa_compile_T	*nc;
+    int			entry;
+    char_u		*item;
+    long		minval;
+    long		maxval;
+    int			after;
+{
+    int		greedy = (minval <= maxval);
+    long	lo = greedy ? minval : maxval;
+    long	hi = greedy ? maxval : minval;
+    long	i;
+    int		tail = after;
+    int		split;
+    int		rep;
+
+    ++nc->nc_nrepeat;
+    if (lo > NFA_MAX_STATES || (hi != MAX_LIMIT && hi - lo > NFA_MAX_STATES))
+	return -1;
+    if (hi == MAX_LIMIT)
+    {
+	split = nfa_new_state(nc, NS_SPLIT);
+	rep = nfa_new_state(nc, NS_REPEAT);
+	if (rep < 0)
+	    return -1;
+	NFA_STATE(nc, rep).ns_node = (int)(item - nc->nc_program);
+	NFA_STATE(nc, rep).ns_out = split;
+	nfa_set_choice(nc, split, greedy, rep, after);
+	tail = split;
+    }
+    else
+	for (i = lo; i < hi; ++i)
+	{
+	    split = nfa_new_state(nc, NS_SPLIT);
+	    rep = nfa_new_state(nc, NS_REPEAT);
+	    if (rep < 0)
+		return -1;
+	    NFA_STATE(nc, rep).ns_node = (int)(item - nc->nc_program);
+	    NFA_STATE(nc, rep).ns_out = tail;
+	    nfa_set_choice(nc, split, greedy, rep, after);
+	    tail = split;
+	}
+    for (i = 0; i < lo; ++i)
+    {
+	rep = nfa_new_state(nc, NS_REPEAT);
+	if (rep < 0)
+	    return -1;
+	NFA_STATE(nc, rep).ns_node = (int)(item - nc->nc_program);
+	NFA_STATE(nc, rep).ns_out = tail;
+	tail = rep;
+    }
+    NFA_STATE(nc, entry).ns_out = tail;
+    return entry;
+}
+
+/*
+ * Make the states for BRACE_COMPLEX node "brace": its operand matching
+ * "minval" to "maxval" times, then continuing with state "after".
+ * Returns "entry" or -1.
+ */
+    static int
+nfa_complex_repeat(nc, entry, brace, minval, maxval, after)
+    nfa_compile_T	*nc;
+    int			entry;
+    char_u		*brace;
+    long		minval;
+    long		maxval;
+    int			after;
+{
+    int		greedy = (minval <= maxval);
+    long	lo = greedy ? minval : maxval;
+    long	hi = greedy ? maxval : minval;
+    long	i;
+    int		tail = after;
+    int		split;
+    int		more;
+
+    nc->nc_complex = TRUE;
+    if (lo > NFA_MAX_STATES || (hi != MAX_LIMIT && hi - lo > NFA_MAX_STATES))
+	return -1;
+    if (hi == MAX_LIMIT)
+    {
+	split = nfa_new_state(nc, NS_SPLIT);
+	if (split < 0 || (more = nfa_copy_operand(nc, brace, split)) < 0)
+	    return -1;
+	nfa_set_choice(nc, split, greedy, more, after);
+	tail = split;
+    }
+    else
+	for (i = lo; i < hi; ++i)
+	{
+	    split = nfa_new_state(nc, NS_SPLIT);
+	    if (split < 0 || (more = nfa_copy_operand(nc, brace, tail)) < 0)
+		return -1;
+	    nfa_set_choice(nc, split, greedy, more, after);
+	    tail = split;
+	}
+    for (i = 0; i < lo; ++i)
+    {
+	tail = nfa_copy_operand(nc, brace, tail);
+	if (tail < 0)
+	    return -1;
+    }
+    NFA_STATE(nc, entry).ns_out = tail;
+    return entry;
+}
+
+/*
+ * Translate the operand of BRACE_COMPLEX node "brace" once more, continuing
+ * with state "target" where it loops back.
+ * Returns the state to start the copy with or -1.
+ */
+    static int
+nfa_copy_operand(nc, brace, target)
+    nfa_compile_T	*nc;
+    char_u		*brace;
+    int			target;
+{
+    nfa_frame_T	frame;
+    long	i;
+    int		s;
+
+    frame.nf_brace = brace;
+    frame.nf_target = target;
+    frame.nf_memo = (int *)lalloc((long_u)(nc->nc_size * sizeof(int)), TRUE);
+    if (frame.nf_memo == NULL)
+	return -1;
+    for (i = 0; i < nc->nc_size; ++i)
+	frame.nf_memo[i] = -1;
+    s = nfa_node(nc, OPERAND(brace), &frame);
+    vim_free(frame.nf_memo);
+    return s;
+}
+
+/*
+ * Add NFA states to regprog "r", whose program is "size" bytes.
+ * Returns the new regprog, "r" has been freed then.  When the pattern can't
+ * be done with the NFA engine "r" is returned unchanged.
+ * With AUTOMATIC_ENGINE "engine" this is also done when the backtracking
+ * engine, which is faster for simple patterns, can't take much time: no
+ * complex item is repeated and at most two simple items are.
+ */
+    static regprog_T *
+nfa_regcomp(r, size, engine)
+    regprog_T	*r;
+    long	size;
+    int		engine;
+{
+    nfa_compile_T	nc;
+    nfa_frame_T		frame;
+    regprog_T		*nr = NULL;
+    long		off;
+    long		i;
+    int			len;
+
+    nc.nc_program = r->program;
+    nc.nc_size = size;
+    nc.nc_nslot = NFA_SLOT_END(0) + 1;
+    nc.nc_nback = 0;
+    nc.nc_nrepeat = 0;
+    nc.nc_complex = FALSE;
+    ga_init2(&nc.nc_states, (int)sizeof(nfa_state_T), 50);
+    frame.nf_brace = NULL;
+    frame.nf_target = -1;
+    frame.nf_memo = (int *)lalloc((long_u)(size * sizeof(int)), TRUE);
+    if (frame.nf_memo == NULL)
+	return r;
+    for (i = 0; i < size; ++i)
+	frame.nf_memo[i] = -1;
+
+    /* Skip over the REGMAGIC byte.  The first state added is the start. */
+    if (nfa_node(&nc, r->program + 1, &frame) == 0
+	    && (engine == NFA_ENGINE || nc.nc_complex || nc.nc_nrepeat > 2))
+    {
+	/* Put the states in the same block as the program, aligned. */
+	off = (long)(sizeof(regprog_T) + size + sizeof(long) - 1)
+						/ sizeof(long) * sizeof(long);
+	len = nc.nc_states.ga_len;
+	nr = (regprog_T *)lalloc((long_u)(off + sizeof(nfa_prog_T)
+				 + (len - 1) * sizeof(nfa_state_T)), TRUE);
+    }
+    if (nr != NULL)
+    {
+	mch_memmove(nr, r, (size_t)(sizeof(regprog_T) + size));
+	if (r->regmust != NULL)
+	    nr->regmust = nr->program + (r->regmust - r->program);
+	nr->regnfa = (nfa_prog_T *)((char_u *)nr + off);
+	nr->regnfa->np_len = len;
+	nr->regnfa->np_nslot = nc.nc_nslot;
+	mch_memmove(nr->regnfa->np_state, nc.nc_states.ga_data,
+					     (size_t)(len * sizeof(nfa_state_T)));
+	vim_free(r);
+	r = nr;
+    }
+    vim_free(frame.nf_memo);
+    ga_clear(&nc.nc_states);
+    return r;
+}
+
+/*
+ * Matching.
+ */
+
+/*
+ * A thread: the state to continue with and the sub-match positions found so
+ * far.  A thread that matched a multi-byte character or a string first
+ * skips the remaining bytes, it waits for "nt_wait" more bytes.
+ */
+typedef struct
+{
+    int		nt_state;	/* state to continue with */
+    int		nt_wait;	/* number of bytes to skip first */
+    lpos_T	nt_sub[1];	/* sub-match positions, actually longer */
+} nfa_thread_T;
+
+/* Lists of threads: for the current position, for the next position and
+ * for the threads that advanced over the current byte.  Like "regstack"
+ * these are kept between calls.  The item size is one byte, since the size
+ * of a thread depends on the pattern. */
+#define NFA_LIST_INITIAL 4096
+static garray_T	nfa_clist = {0, 0, 1, NFA_LIST_INITIAL, NULL};
+static garray_T	nfa_nlist = {0, 0, 1, NFA_LIST_INITIAL, NULL};
+static garray_T	nfa_pend = {0, 0, 1, NFA_LIST_INITIAL, NULL};
+
+/*
+ * For each state the ID of the list it was last added to.  What a thread can
+ * still match depends on the BACK nodes it passed at the current position,
+ * see nfa_back_mask().  A state is added again for another combination of
+ * them, "nm_seen" has a bit set for each combination added.  Going around a
+ * loop always passes a BACK node, thus a thread that comes back to a state
+ * with the same combination has a lower priority and can be dropped.
+ */
+typedef struct
+{
+    int		nm_listid;
+    unsigned	nm_seen;
+} nfa_mark_T;
+
+static garray_T	nfa_marks = {0, 0, (int)sizeof(nfa_mark_T), 100, NULL};
+static int	nfa_listid;
+
+static nfa_prog_T *nfa_prog;		/* program being executed */
+static char_u	*nfa_program;		/* its backtracking program */
+static int	nfa_tsize;		/* size of an nfa_thread_T in bytes */
+static int	nfa_outofmem;		/* ga_grow() failed */
+
+static void	nfa_addthread __ARGS((garray_T *gap, int state, int wait, lpos_T *sub));
+static int	nfa_back_mask __ARGS((lpos_T *sub, colnr_T col));
+static void	nfa_addstate __ARGS((garray_T *gap, int idx, lpos_T *sub, colnr_T col));
+static void	nfa_advance __ARGS((garray_T *gap, int state, int len, lpos_T *sub, colnr_T col, int at_eol));
+static void	nfa_set_subs __ARGS((lpos_T *sub));
+
+/*
+ * Append a thread to list "gap".
+ */
+    static void
+nfa_addthread(gap, state, wait, sub)
+    garray_T	*gap;
+    int		state;
+    int		wait;
+    lpos_T	*sub;
+{
+    nfa_thread_T	*t;
+
+    if (ga_grow(gap, nfa_tsize) == FAIL)
+    {
+	nfa_outofmem = TRUE;
+	return;
+    }
+    t = (nfa_thread_T *)((char_u *)gap->ga_data + gap->ga_len);
+    t->nt_state = state;
+    t->nt_wait = wait;
+    mch_memmove(t->nt_sub, sub, (size_t)(nfa_prog->np_nslot * sizeof(lpos_T)));
+    gap->ga_len += nfa_tsize;
+}
+
+/*
+ * Return the bits for the BACK nodes in "sub" that were passed at column
+ * "col" in line "reglnum".
+ */
+    static int
+nfa_back_mask(sub, col)
+    lpos_T	*sub;
+    colnr_T	col;
+{
+    int		mask = 0;
+    int		i;
+
+    for (i = NFA_SLOT_BACK(0); i < nfa_prog->np_nslot; ++i)
+	if (sub[i].col == col && sub[i].lnum == reglnum)
+	    mask |= 1 << (i - NFA_SLOT_BACK(0));
+    return mask;
+}
+
+/*
+ * Add state "idx" to list "gap", following all states that don't match a
+ * character, at column "col" in line "reglnum".  A state is only added once
+ * to a list, the first time has the highest priority.  Except when the BACK
+ * nodes passed at this position differ.
+ * "sub" is changed while working but restored before returning.
+ */
+    static void
+nfa_addstate(gap, idx, sub, col)
+    garray_T	*gap;
+    int		idx;
+    lpos_T	*sub;
+    colnr_T	col;
+{
+    nfa_state_T	*st;
+    lpos_T	save;
+    nfa_mark_T	*mark = (nfa_mark_T *)nfa_marks.ga_data + idx;
+    unsigned	back;
+
+    st = &nfa_prog->np_state[idx];
+    /* A loop that didn't advance fails. */
+    if (st->ns_type == NS_BACK && sub[st->ns_slot].lnum == reglnum
+					      && sub[st->ns_slot].col == col)
+	return;
+    back = 1 << nfa_back_mask(sub, col);
+    if (mark->nm_listid != nfa_listid)
+    {
+	mark->nm_listid = nfa_listid;
+	mark->nm_seen = 0;
+    }
+    if (mark->nm_seen & back)
+	return;
+    mark->nm_seen |= back;
+    switch (st->ns_type)
+    {
+	case NS_EMPTY:
+	    nfa_addstate(gap, st->ns_out, sub, col);
+	    break;
+
+	case NS_SPLIT:
+	    nfa_addstate(gap, st->ns_out, sub, col);
+	    nfa_addstate(gap, st->ns_out1, sub, col);
+	    break;
+
+	case NS_SAVE:
+	case NS_BACK:
+	    save = sub[st->ns_slot];
+	    sub[st->ns_slot].lnum = reglnum;
+	    sub[st->ns_slot].col = col;
+	    nfa_addstate(gap, st->ns_out, sub, col);
+	    sub[st->ns_slot] = save;
+	    break;
+
+	case NS_ASSERT:
+	    reginput = regline + col;
+	    if (regitem(nfa_program + st->ns_node) == RA_CONT)
+		nfa_addstate(gap, st->ns_out, sub, col);
+	    break;
+
+	default:
+	    nfa_addthread(gap, idx, 0, sub);
+	    break;
+    }
+}
+
+/*
+ * Add the thread for "state" to "gap" after matching "len" bytes at column
+ * "col".  At the end of the line "gap" is the pending list, the closure is
+ * computed when the next line is there.  Otherwise the thread is added for
+ * column "col" + 1, it waits when more bytes were matched.
+ */
+    static void
+nfa_advance(gap, state, len, sub, col, at_eol)
+    garray_T	*gap;
+    int		state;
+    int		len;
+    lpos_T	*sub;
+    colnr_T	col;
+    int		at_eol;
+{
+    if (at_eol || len > 1)
+	nfa_addthread(gap, state, len - 1, sub);
+    else
+	nfa_addstate(gap, state, sub, col + 1);
+}
+
+/*
+ * Set the sub-match positions of a match from "sub".
+ */
+    static void
+nfa_set_subs(sub)
+    lpos_T	*sub;
+{
+    int		nslot = nfa_prog->np_nslot;
+    int		i;
+    int		s;
+    int		e;
+
+    for (i = 0; i < NSUBEXP; ++i)
+    {
+	s = NFA_SLOT_START(i);
+	e = NFA_SLOT_END(i);
+	if (REG_MULTI)
+	{
+	    if (s < nslot)
+		reg_startpos[i] = sub[s];
+	    else
+		reg_startpos[i].lnum = -1;
+	    if (e < nslot)
+		reg_endpos[i] = sub[e];
+	    else
+		reg_endpos[i].lnum = -1;
+	}
+	else
+	{
+	    reg_startp[i] = s < nslot && sub[s].lnum >= 0
+						? regline + sub[s].col : NULL;
+	    reg_endp[i] = e < nslot && sub[e].lnum >= 0
+						? regline + sub[e].col : NULL;
+	}
+    }
+    need_clear_subexpr = FALSE;
+
+#ifdef FEAT_SYN_HL
+    for (i = 0; i < NSUBEXP; ++i)
+    {
+	s = NFA_SLOT_ZSTART(i);
+	e = NFA_SLOT_ZEND(i);
+	if (REG_MULTI)
+	{
+	    if (s < nslot)
+		reg_startzpos[i] = sub[s];
+	    else
+		reg_startzpos[i].lnum = -1;
+	    if (e < nslot)
+		reg_endzpos[i] = sub[e];
+	    else
+		reg_endzpos[i].lnum = -1;
+	}
+	else
+	{
+	    reg_startzp[i] = s < nslot && sub[s].lnum >= 0
+						? regline + sub[s].col : NULL;
+	    reg_endzp[i] = e < nslot && sub[e].lnum >= 0
+						? regline + sub[e].col : NULL;
+	}
+    }
+    need_clear_zsubexpr = FALSE;
+#endif
+}
+
+/*
+ * Find the first match of "prog" starting at column "col" in "regline",
+ * which is line "reglnum" (zero).
+ * Returns 0 for failure, number of lines contained in the match otherwise.
+ */
+    static long
+nfa_regexec(prog, col, tm)
+    regprog_T	*prog;
+    colnr_T	col;
+    proftime_T	*tm UNUSED;	/* timeout limit or NULL */
+{
+    garray_T	*clist = &nfa_clist;
+    garray_T	*nlist = &nfa_nlist;
+    garray_T	*pend = &nfa_pend;
+    garray_T	*tmp;
+    garray_T	*add;
+    int		at_eol;
+    nfa_thread_T *t;
+    nfa_state_T	*st;
+    lpos_T	sub[NFA_MAX_SLOTS];
+    lpos_T	match_sub[NFA_MAX_SLOTS];
+    int		matched = FALSE;
+    colnr_T	startcol = col;	/* next column to start at, or MAXCOL */
+    linenr_T	lnum;
+    char_u	*s;
+    int		len;
+    int		i;
+#ifdef FEAT_RELTIME
+    int		tm_count = 0;
+#endif
+
+    nfa_prog = prog->regnfa;
+    nfa_program = prog->program;
+    nfa_tsize = (int)(sizeof(nfa_thread_T)
+				  + (nfa_prog->np_nslot - 1) * sizeof(lpos_T));
+    nfa_outofmem = FALSE;
+    if (ga_grow(&nfa_marks, nfa_prog->np_len) == FAIL)
+	return 0L;
+    vim_memset(nfa_marks.ga_data, 0, nfa_prog->np_len * sizeof(nfa_mark_T));
+    nfa_listid = 1;
+    clist->ga_len = 0;
+
+    for (;;)
+    {
+	fast_breakcheck();
+	if (got_int || nfa_outofmem)
+	{
+	    matched = FALSE;
+	    break;
+	}
+
+	/* Start a thread at this position.  It has the lowest priority,
+	 * threads that started earlier come first. */
+	if (!matched && reglnum == 0 && startcol != MAXCOL)
+	{
+	    if (clist->ga_len == 0)
+	    {
+		/* Nothing to continue with, skip to the char we know it must
+		 * start with. */
+		if (prog->regstart != NUL && !prog->reganch)
+		{
+		    if (!ireg_ic
+#ifdef FEAT_MBYTE
+			    && !has_mbyte
+#endif
+			    )
+			s = vim_strbyte(regline + startcol, prog->regstart);
+		    else
+			s = cstrchr(regline + startcol, prog->regstart);
+		    if (s == NULL)
+			break;
+		    startcol = (colnr_T)(s - regline);
+		}
+		col = startcol;
+	    }
+	    if (col == startcol)
+	    {
+		if (ireg_maxcol > 0 && col >= ireg_maxcol)
+		    startcol = MAXCOL;
+		else
+		{
+		    for (i = 0; i < nfa_prog->np_nslot; ++i)
+		    {
+			sub[i].lnum = -1;
+			sub[i].col = -1;
+		    }
+		    sub[NFA_SLOT_START(0)].lnum = 0;
+		    sub[NFA_SLOT_START(0)].col = col;
+		    nfa_addstate(clist, 0, sub, col);
+		    if (prog->reganch || regline[col] == NUL)
+			startcol = MAXCOL;
+#ifdef FEAT_MBYTE
+		    else if (has_mbyte)
+			startcol = col + (*mb_ptr2len)(regline + col);
+#endif
+		    else
+			startcol = col + 1;
+#ifdef FEAT_RELTIME
+		    /* Check for timeout once in a twenty times to avoid
+		     * overhead. */
+		    if (tm != NULL && ++tm_count == 20)
+		    {
+			tm_count = 0;
+			if (profile_passed_limit(tm))
+			    break;
+		    }
+#endif
+		}
+	    }
+	}
+	if (clist->ga_len == 0)
+	{
+	    if (matched || reglnum > 0 || startcol == MAXCOL)
+		break;
+	    ++nfa_listid;
+	    continue;
+	}
+
+	/*
+	 * Let each thread match the item at this position, in order of
+	 * priority.  Within a line the threads for the next byte are added to
+	 * "nlist" directly.  At the end of the line they are kept in "pend"
+	 * until the next line has been obtained.
+	 */
+	at_eol = (regline[col] == NUL);
+	add = at_eol ? pend : nlist;
+	add->ga_len = 0;
+	++nfa_listid;
+	for (i = 0; i < clist->ga_len; i += nfa_tsize)
+	{
+	    t = (nfa_thread_T *)((char_u *)clist->ga_data + i);
+	    if (t->nt_wait > 0)
+	    {
+		nfa_advance(add, t->nt_state, t->nt_wait, t->nt_sub, col, at_eol);
+		continue;
+	    }
+	    st = &nfa_prog->np_state[t->nt_state];
+	    if (st->ns_type == NS_MATCH)
+	    {
+		/* Threads after this one have a lower priority, drop them. */
+		matched = TRUE;
+		mch_memmove(match_sub, t->nt_sub,
+				 (size_t)(nfa_prog->np_nslot * sizeof(lpos_T)));
+		if (match_sub[NFA_SLOT_END(0)].lnum < 0)
+		{
+		    match_sub[NFA_SLOT_END(0)].lnum = reglnum;
+		    match_sub[NFA_SLOT_END(0)].col = col;
+		}
+		break;
+	    }
+
+	    reginput = regline + col;
+	    lnum = reglnum;
+	    if (st->ns_type == NS_ITEM
+			 ? regitem(nfa_program + st->ns_node) == RA_CONT
+			 : regrepeat(nfa_program + st->ns_node, 1L) == 1)
+	    {
+		if (reglnum != lnum)
+		{
+		    /* Matched the line break, it is the next step. */
+		    reglnum = lnum;
+		    regline = reg_getline(reglnum);
+		    len = 1;
+		}
+		else
+		    len = (int)(reginput - regline) - col;
+		if (len > 0)
+		    nfa_advance(add, st->ns_out, len, t->nt_sub, col, at_eol);
+	    }
+	}
+	if (add->ga_len == 0)
+	{
+	    clist->ga_len = 0;
+	    ++nfa_listid;
+	    continue;
+	}
+
+	/* Advance to the next byte or to the next line. */
+	if (!at_eol)
+	    ++col;
+	else if (REG_MULTI && !reg_line_lbr && reglnum <= reg_maxline)
+	{
+	    reg_nextline();
+	    col = 0;
+
+	    ++nfa_listid;
+	    nlist->ga_len = 0;
+	    for (i = 0; i < pend->ga_len; i += nfa_tsize)
+	    {
+		t = (nfa_thread_T *)((char_u *)pend->ga_data + i);
+		if (t->nt_wait > 0)
+		    nfa_addthread(nlist, t->nt_state, t->nt_wait, t->nt_sub);
+		else
+		    nfa_addstate(nlist, t->nt_state, t->nt_sub, col);
+	    }
+	}
+	else
+	    break;
+
+	tmp = clist;
+	clist = nlist;
+	nlist = tmp;
+    }
+
+    /* Free the lists when they got big. */
+    if (nfa_clist.ga_maxlen > NFA_LIST_INITIAL * 8)
+	ga_clear(&nfa_clist);
+    if (nfa_nlist.ga_maxlen > NFA_LIST_INITIAL * 8)
+	ga_clear(&nfa_nlist);
+    if (nfa_pend.ga_maxlen > NFA_LIST_INITIAL * 8)
+	ga_clear(&nfa_pend);
+
+    if (!matched)
+	return 0L;
+    nfa_set_subs(match_sub);
+    reglnum = match_sub[NFA_SLOT_END(0)].lnum;
+    return reg_found(prog, match_sub[NFA_SLOT_START(0)].col);
+}
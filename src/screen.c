@@ -102,6 +102,42 @@ static int	screen_cur_row, screen_cur_col;	/* last known cursor position */
 
 #ifdef FEAT_SEARCH_EXTRA
 static match_T search_hl;	/* used for 'hlsearch' highlight matching */
+
+/*
+ * Cache of the matches found by next_search_hl(), one per window for
+ * 'hlsearch' and one per match item.  An entry remembers where the pattern
+ * matches when searching line "me_lnum" from column "me_col", so that
+ * redrawing an unchanged line does not execute the regexp again.  Only used
+ * for patterns that match within one line and only depend on its text.
+ * The entries are moved along with inserted and deleted lines and dropped
+ * for changed lines in match_cache_changes().
+ */
+# define MCACHE_SIZE	512	/* number of entries, must be a power of two */
+# define MCACHE_HASH(lnum, col) \
+		    (((unsigned)(lnum) * 31 + (unsigned)(col)) & (MCACHE_SIZE - 1))
+
+typedef struct
+{
+    linenr_T	me_lnum;	/* line searched, zero for an unused entry */
+    colnr_T	me_col;		/* column where the search started */
+    colnr_T	me_startcol;	/* start of the match, MAXCOL for no match */
+    colnr_T	me_endcol;	/* end of the match */
+} mcentry_T;
+
+struct mcache_S
+{
+    regprog_T	*mc_prog;	/* the program, we hold a reference */
+    int		mc_ic;		/* "rmm_ic" used for matching */
+    colnr_T	mc_maxcol;	/* "rmm_maxcol" used for matching */
+    int		mc_fnum;	/* number of the buffer searched */
+    int		mc_chartab;	/* value of "chartab_tick" */
+    long	mc_changedtick;	/* b:changedtick the entries are valid for */
+    int		mc_redraw_nr;	/* "mod_reset_nr" when entries were updated */
+    mcentry_T	mc_entry[MCACHE_SIZE];
+};
+
+/* Incremented when b_mod_set is reset for the displayed buffers. */
+static int	mod_reset_nr = 0;
 #endif
 
 #ifdef FEAT_FOLDING
@@ -142,6 +178,10 @@ static void end_search_hl __ARGS((void));
 static void init_search_hl __ARGS((win_T *wp));
 static void prepare_search_hl __ARGS((win_T *wp, linenr_T lnum));
 static void next_search_hl __ARGS((win_T *win, match_T *shl, linenr_T lnum, colnr_T mincol));
+static mcentry_T *match_cache_lookup __ARGS((win_T *win, match_T *shl, linenr_T lnum, colnr_T col));
+static void match_cache_flush __ARGS((struct mcache_S *mc));
+static void match_cache_changes __ARGS((win_T *wp));
+static void match_cache_adjust __ARGS((struct mcache_S *mc, buf_T *buf));
 #endif
 static void screen_start_highlight __ARGS((int attr));
 static void screen_char __ARGS((unsigned off, int row, int col));
@@ -492,6 +532,12 @@ update_screen(type)
     }
 #endif
 
+#ifdef FEAT_SEARCH_EXTRA
+    /* Move cached matches along with changed lines. */
+    FOR_ALL_WINDOWS(wp)
+	match_cache_changes(wp);
+#endif
+
     /*
      * Go from top to bottom through the windows, redrawing the ones that need
      * it.
@@ -552,6 +598,9 @@ update_screen(type)
 #else
 	curbuf->b_mod_set = FALSE;
 #endif
+#ifdef FEAT_SEARCH_EXTRA
+    ++mod_reset_nr;
+#endif
 
     updating_screen = FALSE;
 #ifdef FEAT_GUI
@@ -6994,7 +7043,7 @@ end_search_hl()
 {
     if (search_hl.rm.regprog != NULL)
     {
-	vim_free(search_hl.rm.regprog);
+	vim_regfree(search_hl.rm.regprog);
 	search_hl.rm.regprog = NULL;
     }
 }
@@ -7030,6 +7079,7 @@ init_search_hl(wp)
     search_hl.buf = wp->w_buffer;
     search_hl.lnum = 0;
     search_hl.first_lnum = 0;
+    search_hl.mcache = wp->w_mcache;
     /* time limit is set at the toplevel, for all windows */
 }
 
@@ -7120,6 +7170,7 @@ next_search_hl(win, shl, lnum, mincol)
     linenr_T	l;
     colnr_T	matchcol;
     long	nmatched;
+    mcentry_T	*mep;
 
     if (shl->lnum != 0)
     {
@@ -7183,20 +7234,58 @@ next_search_hl(win, shl, lnum, mincol)
 	    matchcol = shl->rm.endpos[0].col;
 
 	shl->lnum = lnum;
-	nmatched = vim_regexec_multi(&shl->rm, win, shl->buf, lnum, matchcol,
+	mep = match_cache_lookup(win, shl, lnum, matchcol);
+	if (mep != NULL && mep->me_lnum == lnum && mep->me_col == matchcol)
+	{
+	    /* Found in the cache, no need to execute the regexp. */
+	    if (mep->me_startcol == MAXCOL)
+		nmatched = 0;
+	    else
+	    {
+		shl->rm.startpos[0].lnum = 0;
+		shl->rm.startpos[0].col = mep->me_startcol;
+		shl->rm.endpos[0].lnum = 0;
+		shl->rm.endpos[0].col = mep->me_endcol;
+		nmatched = 1;
+	    }
+	}
+	else
+	{
+	    nmatched = vim_regexec_multi(&shl->rm, win, shl->buf, lnum,
+								    matchcol,
 #ifdef FEAT_RELTIME
-		&(shl->tm)
+		    &(shl->tm)
 #else
-		NULL
+		    NULL
+#endif
+		    );
+	    /* Remember the result, unless the search was interrupted. */
+	    if (mep != NULL && !called_emsg && !got_int
+#ifdef FEAT_RELTIME
+		    && !profile_passed_limit(&(shl->tm))
 #endif
-		);
+		    && (nmatched == 0 || (nmatched == 1
+					&& shl->rm.startpos[0].lnum == 0
+					&& shl->rm.endpos[0].lnum == 0)))
+	    {
+		mep->me_lnum = lnum;
+		mep->me_col = matchcol;
+		if (nmatched == 0)
+		    mep->me_startcol = MAXCOL;
+		else
+		{
+		    mep->me_startcol = shl->rm.startpos[0].col;
+		    mep->me_endcol = shl->rm.endpos[0].col;
+		}
+	    }
+	}
 	if (called_emsg || got_int)
 	{
 	    /* Error while handling regexp: stop using this regexp. */
 	    if (shl == &search_hl)
 	    {
 		/* don't free regprog in the match list, it's a copy */
-		vim_free(shl->rm.regprog);
+		vim_regfree(shl->rm.regprog);
 		no_hlsearch = TRUE;
 	    }
 	    shl->rm.regprog = NULL;
@@ -7219,6 +7308,179 @@ next_search_hl(win, shl, lnum, mincol)
 	}
     }
 }
+
+/*
+ * Return the cache entry to use for searching "shl" in line "lnum" from
+ * column "col".  It is a hit when "me_lnum" and "me_col" match, otherwise the
+ * result of the search can be stored in it.
+ * Returns NULL when the cache can't be used for this pattern.
+ */
+    static mcentry_T *
+match_cache_lookup(win, shl, lnum, col)
+    win_T	*win;
+    match_T	*shl;
+    linenr_T	lnum;
+    colnr_T	col;
+{
+    regprog_T		*prog = shl->rm.regprog;
+    struct mcache_S	*mc = shl->mcache;
+
+    /* A pattern that can match across lines, looks back or depends on the
+     * cursor, marks, etc. can't be cached per line. */
+    if (prog == NULL || re_multiline(prog) || re_lookbehind(prog)
+							  || re_position(prog))
+	return NULL;
+
+    if (mc == NULL)
+    {
+	mc = (struct mcache_S *)alloc_clear((unsigned)sizeof(struct mcache_S));
+	if (mc == NULL)
+	    return NULL;
+	mc->mc_changedtick = shl->buf->b_changedtick;
+	mc->mc_redraw_nr = mod_reset_nr;
+	shl->mcache = mc;
+	if (shl == &search_hl)
+	    win->w_mcache = mc;
+    }
+    else if (mc->mc_changedtick != shl->buf->b_changedtick)
+	/* Text changed since match_cache_changes() was called, can't use or
+	 * store entries until the next redraw. */
+	return NULL;
+
+    if (mc->mc_prog != prog
+	    || mc->mc_ic != shl->rm.rmm_ic
+	    || mc->mc_maxcol != shl->rm.rmm_maxcol
+	    || mc->mc_fnum != shl->buf->b_fnum
+	    || mc->mc_chartab != chartab_tick)
+    {
+	/* Another pattern, buffer or 'iskeyword': start all over. */
+	match_cache_flush(mc);
+	++prog->regrefcount;
+	mc->mc_prog = prog;
+	mc->mc_ic = shl->rm.rmm_ic;
+	mc->mc_maxcol = shl->rm.rmm_maxcol;
+	mc->mc_fnum = shl->buf->b_fnum;
+	mc->mc_chartab = chartab_tick;
+    }
+
+    return &mc->mc_entry[MCACHE_HASH(lnum, col)];
+}
+
+/*
+ * Drop all entries of match cache "mc" and the reference to the program.
+ */
+    static void
+match_cache_flush(mc)
+    struct mcache_S *mc;
+{
+    vim_regfree(mc->mc_prog);
+    mc->mc_prog = NULL;
+    vim_memset(mc->mc_entry, 0, sizeof(mc->mc_entry));
+}
+
+/*
+ * Free match cache "mc".
+ */
+    void
+match_cache_free(mc)
+    struct mcache_S *mc;
+{
+    if (mc != NULL)
+    {
+	vim_regfree(mc->mc_prog);
+	vim_free(mc);
+    }
+}
+
+/*
+ * Flush the match caches that hold lines of buffer "buf".  Used when all the
+ * text was replaced without marking the lines as changed, e.g. when reloading
+ * the file.
+ */
+    void
+match_cache_invalidate(buf)
+    buf_T	*buf;
+{
+    tabpage_T	*tp;
+    win_T	*wp;
+    matchitem_T	*cur;
+
+    FOR_ALL_TAB_WINDOWS(tp, wp)
+    {
+	if (wp->w_mcache != NULL && wp->w_mcache->mc_fnum == buf->b_fnum)
+	    match_cache_flush(wp->w_mcache);
+	for (cur = wp->w_match_head; cur != NULL; cur = cur->next)
+	    if (cur->hl.mcache != NULL && cur->hl.mcache->mc_fnum == buf->b_fnum)
+		match_cache_flush(cur->hl.mcache);
+    }
+}
+
+/*
+ * Update the match caches of window "wp" for the changes in its buffer since
+ * the last redraw.  Must be called once in update_screen() before drawing.
+ */
+    static void
+match_cache_changes(wp)
+    win_T	*wp;
+{
+    matchitem_T	*cur;
+
+    if (wp->w_mcache != NULL)
+	match_cache_adjust(wp->w_mcache, wp->w_buffer);
+    for (cur = wp->w_match_head; cur != NULL; cur = cur->next)
+	if (cur->hl.mcache != NULL)
+	    match_cache_adjust(cur->hl.mcache, wp->w_buffer);
+}
+
+    static void
+match_cache_adjust(mc, buf)
+    struct mcache_S *mc;
+    buf_T	    *buf;
+{
+    mcentry_T	*old;
+    mcentry_T	*mep;
+    linenr_T	lnum;
+    int		i;
+
+    if (mc->mc_changedtick != buf->b_changedtick)
+    {
+	/* The changed lines can only be used when they were collected since
+	 * the entries were last updated.  Otherwise drop everything. */
+	if (mc->mc_fnum != buf->b_fnum || !buf->b_mod_set
+				       || mc->mc_redraw_nr + 1 != mod_reset_nr)
+	    match_cache_flush(mc);
+	else
+	{
+	    old = (mcentry_T *)alloc((unsigned)sizeof(mc->mc_entry));
+	    if (old == NULL)
+		match_cache_flush(mc);
+	    else
+	    {
+		mch_memmove(old, mc->mc_entry, sizeof(mc->mc_entry));
+		vim_memset(mc->mc_entry, 0, sizeof(mc->mc_entry));
+		for (i = 0; i < MCACHE_SIZE; ++i)
+		{
+		    lnum = old[i].me_lnum;
+		    if (lnum == 0)
+			continue;
+		    if (lnum >= buf->b_mod_top)
+		    {
+			/* Drop changed lines, move lines below them. */
+			if (lnum + buf->b_mod_xlines < buf->b_mod_bot)
+			    continue;
+			lnum += buf->b_mod_xlines;
+		    }
+		    mep = &mc->mc_entry[MCACHE_HASH(lnum, old[i].me_col)];
+		    *mep = old[i];
+		    mep->me_lnum = lnum;
+		}
+		vim_free(old);
+	    }
+	}
+	mc->mc_changedtick = buf->b_changedtick;
+    }
+    mc->mc_redraw_nr = mod_reset_nr;
+}
 #endif
 
       static void
@@ -34,6 +34,13 @@ static void show_pat_in_path __ARGS((char_u *, int,
 #ifdef FEAT_VIMINFO
 static void wvsp_one __ARGS((FILE *fp, int idx, char *s, int sc));
 #endif
+#ifdef FEAT_SEARCH_EXTRA
+static void search_count_clear __ARGS((void));
+static void search_count_update __ARGS((long msec, int restart));
+static void search_count_slice __ARGS((regmmatch_T *regmatch, long msec));
+static void search_count_show __ARGS((void));
+static void search_count_start __ARGS((char_u *msg, int wrapped));
+#endif
 
 /*
  * This file contains various searching-related routines. These fall into
@@ -213,7 +220,7 @@ search_regcomp(pat, pat_save, pat_use, options, regmatch)
 
     regmatch->rmm_ic = ignorecase(pat);
     regmatch->rmm_maxcol = 0;
-    regmatch->regprog = vim_regcomp(pat, magic ? RE_MAGIC : 0);
+    regmatch->regprog = vim_regcomp(pat, (magic ? RE_MAGIC : 0) + RE_CACHE);
     if (regmatch->regprog == NULL)
 	return FAIL;
     return OK;
@@ -354,6 +361,9 @@ free_search_patterns()
 	mr_pattern = NULL;
     }
 # endif
+# ifdef FEAT_SEARCH_EXTRA
+    search_count_clear();
+# endif
 }
 #endif
 
@@ -556,6 +566,10 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 #ifdef FEAT_SEARCH_EXTRA
     int		break_loop = FALSE;
 #endif
+    char_u	*must = NULL;	/* text a matching line must contain */
+    int		mustlen = 0;
+    linenr_T	last;
+    linenr_T	next_lnum;
 
     if (search_regcomp(pat, RE_SEARCH, pat_use,
 		   (options & (SEARCH_HIS + SEARCH_KEEP)), &regmatch) == FAIL)
@@ -585,6 +599,11 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
     else
 	extra_col = 1;
 
+    /* When searching forward, lines without the literal text that every
+     * match contains are skipped, a block of lines at a time. */
+    if (dir == FORWARD)
+	must = vim_regliteral(regmatch.regprog, regmatch.rmm_ic, &mustlen);
+
     /*
      * find the string
      */
@@ -622,6 +641,23 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 	    for ( ; lnum > 0 && lnum <= buf->b_ml.ml_line_count;
 					   lnum += dir, at_first_line = FALSE)
 	    {
+		/* Skip to the next line that may contain a match. */
+		if (must != NULL)
+		{
+		    last = buf->b_ml.ml_line_count;
+		    if (loop && start_pos.lnum < last)
+			last = start_pos.lnum;
+		    else if (stop_lnum != 0 && stop_lnum < last)
+			last = stop_lnum;
+		    next_lnum = ml_find_text(buf, lnum, last, must, mustlen);
+		    if (next_lnum > last)
+			break;
+		    if (next_lnum != lnum)
+		    {
+			lnum = next_lnum;
+			at_first_line = FALSE;
+		    }
+		}
 		/* Stop after checking "stop_lnum", if it's set. */
 		if (stop_lnum != 0 && (dir == FORWARD
 				       ? lnum > stop_lnum : lnum < stop_lnum))
@@ -956,7 +992,9 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 		lnum = buf->b_ml.ml_line_count;
 	    else
 		lnum = 1;
-	    if (!shortmess(SHM_SEARCH) && (options & SEARCH_MSG))
+	    /* With SEARCH_COUNT the caller shows "W" with the count. */
+	    if (!shortmess(SHM_SEARCH) && (options & SEARCH_MSG)
+						&& !(options & SEARCH_COUNT))
 		give_warning((char_u *)_(dir == BACKWARD
 					  ? top_bot_msg : bot_top_msg), TRUE);
 	}
@@ -969,7 +1007,7 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
     }
     while (--count > 0 && found);   /* stop after count matches or no match */
 
-    vim_free(regmatch.regprog);
+    vim_regfree(regmatch.regprog);
 
     called_emsg |= save_called_emsg;
 
@@ -1079,6 +1117,11 @@ do_search(oap, dirc, pat, count, options, tm)
     char_u	    *dircp;
     char_u	    *strcopy = NULL;
     char_u	    *ps;
+#ifdef FEAT_SEARCH_EXTRA
+    char_u	    *echobuf = NULL;	/* echoed search command for count */
+    int		    show_count;
+    int		    wrapped;
+#endif
 
     /*
      * A line offset is not remembered, this is vi compatible.
@@ -1149,6 +1192,17 @@ do_search(oap, dirc, pat, count, options, tm)
     }
 #endif
 
+#ifdef FEAT_SEARCH_EXTRA
+    /* Show "[N/M]" after the echoed search command, unless 'shortmess' says
+     * not to or the command line is reversed. */
+    show_count = (options & SEARCH_ECHO) && messaging() && !cmd_silent
+			    && msg_silent == 0 && !shortmess(SHM_SEARCHCOUNT)
+# ifdef FEAT_RIGHTLEFT
+			    && !(curwin->w_p_rl && *curwin->w_p_rlc == 's')
+# endif
+			    ;
+#endif
+
     /*
      * Repeat the search when pattern followed by ';', e.g. "/foo/;?bar".
      */
@@ -1296,7 +1350,16 @@ do_search(oap, dirc, pat, count, options, tm)
 		    msg_outtrans(msgbuf);
 		msg_clr_eos();
 		msg_check();
-		vim_free(msgbuf);
+#ifdef FEAT_SEARCH_EXTRA
+		if (show_count)
+		{
+		    /* Kept to show it again with the count. */
+		    vim_free(echobuf);
+		    echobuf = msgbuf;
+		}
+		else
+#endif
+		    vim_free(msgbuf);
 
 		gotocmdline(FALSE);
 		out_flush();
@@ -1346,7 +1409,11 @@ do_search(oap, dirc, pat, count, options, tm)
 		searchstr, count, spats[0].off.end + (options &
 		       (SEARCH_KEEP + SEARCH_PEEK + SEARCH_HIS
 			+ SEARCH_MSG + SEARCH_START
-			+ ((pat != NULL && *pat == ';') ? 0 : SEARCH_NOOF))),
+			+ ((pat != NULL && *pat == ';') ? 0 : SEARCH_NOOF)))
+#ifdef FEAT_SEARCH_EXTRA
+		    + (echobuf != NULL ? SEARCH_COUNT : 0)
+#endif
+		    ,
 		RE_LAST, (linenr_T)0, tm);
 
 	if (dircp != NULL)
@@ -1422,17 +1489,424 @@ do_search(oap, dirc, pat, count, options, tm)
 
     if (options & SEARCH_MARK)
 	setpcmark();
+#ifdef FEAT_SEARCH_EXTRA
+    /* The search wrapped around the end of the buffer when the match is on
+     * the wrong side of the cursor. */
+    wrapped = (dirc == '/' ? lt(pos, curwin->w_cursor)
+						: lt(curwin->w_cursor, pos));
+#endif
     curwin->w_cursor = pos;
     curwin->w_set_curswant = TRUE;
+#ifdef FEAT_SEARCH_EXTRA
+    if (echobuf != NULL)
+    {
+	search_count_start(echobuf, wrapped && !shortmess(SHM_SEARCH));
+	echobuf = NULL;
+    }
+#endif
 
 end_do_search:
     if (options & SEARCH_KEEP)
 	spats[0].off = old_off;
     vim_free(strcopy);
+#ifdef FEAT_SEARCH_EXTRA
+    vim_free(echobuf);
+#endif
 
     return retval;
 }
 
+#if defined(FEAT_SEARCH_EXTRA) || defined(PROTO)
+/*
+ * Counting the matches of the last used search pattern, for the "[N/M]"
+ * shown after a search command and for searchcount().
+ *
+ * Counting all matches in a big buffer takes time.  It is done in slices of
+ * a few milliseconds: one right after the search command and the rest in
+ * search_count_idle(), while waiting for the user to type a key.  Counting
+ * stops when it took 'redrawtime' in total.
+ * The count is for the pattern, the text of the current buffer and the
+ * cursor position.  When one of them changes it is thrown away.
+ */
+# define SC_FIRST_MSEC	20	/* counting time right after a search */
+# define SC_IDLE_MSEC	10	/* counting time between checks for a key */
+
+# define SC_NONE	0	/* nothing counted */
+# define SC_BUSY	1	/* counting, continue at "sc_pos" */
+# define SC_DONE	2	/* all matches counted */
+# define SC_TIMEOUT	3	/* gave up after 'redrawtime' */
+
+static struct
+{
+    int		sc_state;	/* SC_ value */
+    char_u	*sc_pat;	/* pattern being counted */
+    int		sc_magic;	/* 'magic' for "sc_pat" */
+    int		sc_ic;		/* ignore case for "sc_pat" */
+    int		sc_cpo_c;	/* 'cpoptions' contains 'c' */
+    int		sc_fnum;	/* number of the buffer counted */
+    long	sc_changedtick;	/* b:changedtick of that buffer */
+    pos_T	sc_cursor;	/* cursor position for "sc_cur" */
+    pos_T	sc_pos;		/* where to continue counting */
+    long	sc_count;	/* number of matches before "sc_pos" */
+    long	sc_cur;		/* number of matches starting at or before
+				   "sc_cursor", -1 when not known yet */
+    long	sc_total;	/* total from a previous count, -1 if unknown */
+    long	sc_msec;	/* approximate time spent since the cursor
+				   moved */
+    char_u	*sc_msg;	/* search command to show with the count, NULL
+				   when it is no longer on the command line */
+    int		sc_wrapped;	/* the search wrapped around the buffer end */
+} scount;
+
+/*
+ * Throw away the search count.
+ */
+    static void
+search_count_clear()
+{
+    scount.sc_state = SC_NONE;
+    vim_free(scount.sc_pat);
+    scount.sc_pat = NULL;
+    vim_free(scount.sc_msg);
+    scount.sc_msg = NULL;
+}
+
+/*
+ * Make sure the search count is for the last used search pattern, the text
+ * of the current buffer and the cursor position, then count for at most
+ * "msec" milliseconds.
+ * When the count was for something else: start counting again when
+ * "restart" is TRUE, throw it away otherwise.
+ */
+    static void
+search_count_update(msec, restart)
+    long	msec;
+    int		restart;
+{
+    regmmatch_T	regmatch;
+    int		same_text;
+
+    last_pat_prog(&regmatch);
+    if (regmatch.regprog == NULL)
+    {
+	search_count_clear();
+	return;
+    }
+
+    same_text = scount.sc_state != SC_NONE
+		&& STRCMP(scount.sc_pat, spats[last_idx].pat) == 0
+		&& scount.sc_magic == spats[last_idx].magic
+		&& scount.sc_ic == regmatch.rmm_ic
+		&& scount.sc_cpo_c == (vim_strchr(p_cpo, CPO_SEARCH) != NULL)
+		&& scount.sc_fnum == curbuf->b_fnum
+		&& scount.sc_changedtick == curbuf->b_changedtick;
+    if (!same_text || !equalpos(scount.sc_cursor, curwin->w_cursor))
+    {
+	if (!restart)
+	    search_count_clear();
+	else
+	{
+	    /* When only the cursor moved and the total is known, only need
+	     * to find the match at the cursor. */
+	    if (!same_text || scount.sc_total < 0)
+	    {
+		search_count_clear();
+		scount.sc_pat = vim_strsave(spats[last_idx].pat);
+		scount.sc_magic = spats[last_idx].magic;
+		scount.sc_ic = regmatch.rmm_ic;
+		scount.sc_cpo_c = (vim_strchr(p_cpo, CPO_SEARCH) != NULL);
+		scount.sc_fnum = curbuf->b_fnum;
+		scount.sc_changedtick = curbuf->b_changedtick;
+		scount.sc_total = -1;
+	    }
+	    vim_free(scount.sc_msg);
+	    scount.sc_msg = NULL;
+	    scount.sc_wrapped = FALSE;
+	    scount.sc_cursor = curwin->w_cursor;
+	    scount.sc_pos.lnum = 1;
+	    scount.sc_pos.col = 0;
+	    scount.sc_count = 0;
+	    scount.sc_cur = -1;
+	    scount.sc_msec = 0;
+	    scount.sc_state = scount.sc_pat == NULL ? SC_NONE : SC_BUSY;
+	}
+    }
+
+    if (scount.sc_state == SC_BUSY && msec > 0)
+	search_count_slice(&regmatch, msec);
+    vim_regfree(regmatch.regprog);
+}
+
+/*
+ * Count matches of "regmatch" in the current buffer, continuing at
+ * "scount.sc_pos", for at most "msec" milliseconds.
+ * Lines without the literal text of the pattern are skipped with
+ * ml_find_text().  Like "n" the next match is searched for after the end of
+ * a match when 'cpoptions' contains 'c', one character further otherwise.
+ */
+    static void
+search_count_slice(regmatch, msec)
+    regmmatch_T	*regmatch;
+    long	msec;
+{
+    linenr_T	lnum = scount.sc_pos.lnum;
+    colnr_T	col = scount.sc_pos.col;
+    linenr_T	line_count = curbuf->b_ml.ml_line_count;
+    char_u	*must;
+    int		mustlen;
+    long	nmatched;
+    pos_T	start;
+    char_u	*line;
+    char_u	*ptr;
+    int		save_called_emsg = called_emsg;
+#ifdef FEAT_RELTIME
+    proftime_T	tm;
+
+    profile_setlimit(msec, &tm);
+#endif
+
+    must = vim_regliteral(regmatch->regprog, regmatch->rmm_ic, &mustlen);
+    called_emsg = FALSE;
+    while (lnum <= line_count)
+    {
+	if (col == 0 && must != NULL)
+	{
+	    lnum = ml_find_text(curbuf, lnum, line_count, must, mustlen);
+	    if (lnum > line_count)
+		break;
+	}
+	nmatched = vim_regexec_multi(regmatch, curwin, curbuf, lnum, col,
+									NULL);
+	if (called_emsg || got_int)
+	{
+	    search_count_clear();
+	    called_emsg |= save_called_emsg;
+	    return;
+	}
+	if (nmatched == 0)
+	{
+	    ++lnum;
+	    col = 0;
+	}
+	else
+	{
+	    start.lnum = lnum + regmatch->startpos[0].lnum;
+	    start.col = regmatch->startpos[0].col;
+#ifdef FEAT_VIRTUALEDIT
+	    start.coladd = 0;
+#endif
+	    if (scount.sc_cur < 0 && lt(scount.sc_cursor, start))
+	    {
+		scount.sc_cur = scount.sc_count;
+		if (scount.sc_total >= 0)
+		    break;	/* only needed the match at the cursor */
+	    }
+	    ++scount.sc_count;
+
+	    if (!scount.sc_cpo_c
+		    || (regmatch->endpos[0].lnum == 0
+			&& regmatch->endpos[0].col <= regmatch->startpos[0].col))
+	    {
+		lnum = start.lnum;
+		line = ml_get_buf(curbuf, lnum, FALSE);
+		ptr = line + start.col;
+		if (*ptr == NUL)
+		{
+		    ++lnum;
+		    col = 0;
+		}
+		else
+		{
+		    mb_ptr_adv(ptr);
+		    col = (colnr_T)(ptr - line);
+		}
+	    }
+	    else
+	    {
+		lnum += regmatch->endpos[0].lnum;
+		col = regmatch->endpos[0].col;
+	    }
+	}
+	line_breakcheck();
+#ifdef FEAT_RELTIME
+	if (profile_passed_limit(&tm))
+	{
+	    /* Out of time, continue here next time. */
+	    scount.sc_pos.lnum = lnum;
+	    scount.sc_pos.col = col;
+	    scount.sc_msec += msec;
+	    if (scount.sc_msec >= p_rdt)
+		scount.sc_state = SC_TIMEOUT;
+	    called_emsg |= save_called_emsg;
+	    return;
+	}
+#endif
+    }
+
+    if (scount.sc_cur < 0)
+	scount.sc_cur = scount.sc_count;
+    if (scount.sc_total < 0)
+	scount.sc_total = scount.sc_count;
+    scount.sc_state = SC_DONE;
+    called_emsg |= save_called_emsg;
+}
+
+/*
+ * Show the search command "scount.sc_msg" on the command line with the
+ * count at the right end, just before the 'showcmd' area: "[3/17]".
+ * Counting in progress is shown as "[?/17+]", having given up as "[3/>17]".
+ */
+    static void
+search_count_show()
+{
+    char_u	stat[NUMBUFLEN * 2 + 10];
+    char_u	cur[NUMBUFLEN];
+    char_u	*buf;
+    char_u	*p;
+    int		room;
+    int		len;
+    int		n;
+    int		save_msg_scroll = msg_scroll;
+    int		save_redir_off = redir_off;
+
+    if (scount.sc_msg == NULL || msg_scrolled != 0 || need_wait_return)
+	return;
+
+    if (scount.sc_cur < 0)
+	STRCPY(cur, "?");
+    else
+	sprintf((char *)cur, "%ld", scount.sc_cur);
+    if (scount.sc_state == SC_DONE || scount.sc_total >= 0)
+	sprintf((char *)stat, "[%s/%ld]", cur,
+			 scount.sc_total >= 0 ? scount.sc_total : scount.sc_count);
+    else
+	sprintf((char *)stat, scount.sc_state == SC_BUSY ? "[%s/%ld+]"
+				  : "[%s/>%ld]", cur, scount.sc_count);
+    if (scount.sc_wrapped)
+	STRCAT(stat, " W");
+
+    /* Room for the command, at least one space and the count. */
+    len = (int)STRLEN(stat);
+    room = sc_col - 1 - len - 1;
+    if (room < 4)
+	return;
+    buf = alloc((unsigned)(STRLEN(scount.sc_msg) + sc_col + len + 4));
+    if (buf == NULL)
+	return;
+    if (vim_strsize(scount.sc_msg) > room)
+	trunc_string(scount.sc_msg, buf, room);
+    else
+	STRCPY(buf, scount.sc_msg);
+    n = room + 1 - vim_strsize(buf);
+    p = buf + STRLEN(buf);
+    vim_memset(p, ' ', (size_t)n);
+    STRCPY(p + n, stat);
+
+    /* The command was already echoed, don't redirect it again. */
+    msg_scroll = FALSE;
+    redir_off = TRUE;
+    msg_start();
+    msg_outtrans(buf);
+    msg_clr_eos();
+    msg_check();
+    redir_off = save_redir_off;
+    msg_scroll = save_msg_scroll;
+    vim_free(buf);
+}
+
+/*
+ * Start counting matches for the search command that was just executed and
+ * show "msg", the echoed command, with the count.  Takes over "msg".
+ * "wrapped" is TRUE when the search wrapped around the end of the buffer.
+ */
+    static void
+search_count_start(msg, wrapped)
+    char_u	*msg;
+    int		wrapped;
+{
+    search_count_update((long)SC_FIRST_MSEC, TRUE);
+    if (scount.sc_state == SC_NONE)
+	vim_free(msg);
+    else
+    {
+	vim_free(scount.sc_msg);
+	scount.sc_msg = msg;
+	scount.sc_wrapped = wrapped;
+	search_count_show();
+    }
+}
+
+/*
+ * Called when waiting for the user to type a Normal mode command: continue
+ * counting matches until done or a key is typed.  Updates the count shown
+ * with the search command and the status lines, which may use searchcount().
+ */
+    void
+search_count_idle()
+{
+    int		n = 0;
+
+    if (scount.sc_state != SC_BUSY)
+	return;
+    while (!char_avail())
+    {
+	search_count_update((long)SC_IDLE_MSEC, FALSE);
+	if (scount.sc_state == SC_BUSY && ++n % 10 != 0)
+	    continue;
+
+	search_count_show();
+	if (scount.sc_state != SC_BUSY)
+	{
+# if defined(FEAT_STL_OPT) && defined(FEAT_WINDOWS)
+	    if (*p_stl != NUL || *curwin->w_p_stl != NUL)
+	    {
+		status_redraw_all();
+		redraw_statuslines();
+	    }
+# endif
+	    setcursor();
+	    out_flush();
+	    break;
+	}
+	setcursor();
+	out_flush();
+    }
+
+    /* A typed key may overwrite the command line. */
+    vim_free(scount.sc_msg);
+    scount.sc_msg = NULL;
+}
+
+# if defined(FEAT_EVAL) || defined(PROTO)
+/*
+ * Get the search count for searchcount(), counting for at most "msec"
+ * milliseconds first.  "*curp" is set to the number of the match at or
+ * before the cursor, -1 when not known yet.  "*totalp" is set to the number
+ * of matches, or the number found so far.
+ * Returns 0 when counting is done, 1 when it continues while waiting for a
+ * key and 2 when it gave up after 'redrawtime'.
+ */
+    int
+search_count_get(msec, curp, totalp)
+    long	msec;
+    long	*curp;
+    long	*totalp;
+{
+    search_count_update(msec, TRUE);
+    *curp = scount.sc_cur;
+    if (scount.sc_total >= 0)
+	*totalp = scount.sc_total;
+    else
+	*totalp = scount.sc_count;
+    if (scount.sc_state == SC_BUSY)
+	return 1;
+    if (scount.sc_state == SC_TIMEOUT)
+	return 2;
+    return 0;
+}
+# endif
+#endif
+
 #if defined(FEAT_INS_EXPAND) || defined(PROTO)
 /*
  * search_for_exact_line(buf, pos, dir, pat)
@@ -5219,9 +5693,9 @@ exit_matched:
 
 fpip_end:
     vim_free(file_line);
-    vim_free(regmatch.regprog);
-    vim_free(incl_regmatch.regprog);
-    vim_free(def_regmatch.regprog);
+    vim_regfree(regmatch.regprog);
+    vim_regfree(incl_regmatch.regprog);
+    vim_regfree(def_regmatch.regprog);
 
 #ifdef RISCOS
    /* Restore previous file munging state. */
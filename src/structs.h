@@ -291,6 +291,8 @@ struct u_entry
     linenr_T	ue_bot;		/* number of line below undo block */
     linenr_T	ue_lcount;	/* linecount when u_save called */
     char_u	**ue_array;	/* array of lines in undo block */
+    char_u	*ue_packed;	/* lines packed in one block instead of
+				   ue_array, see u_pack_entry() */
     long	ue_size;	/* number of lines in ue_array */
 #ifdef U_DEBUG
     int		ue_magic;	/* magic number to check allocation */
@@ -321,6 +323,14 @@ struct u_header
     int		uh_walk;	/* used by undo_time() */
     u_entry_T	*uh_entry;	/* pointer to first entry */
     u_entry_T	*uh_getbot_entry; /* pointer to where ue_bot must be set */
+    long	uh_spill;	/* offset of the entries in the undo spill
+				   file, -1 when they are in memory */
+    long	uh_ufoff;	/* offset of the entries in b_u_ufp, -1 when
+				   they were read */
+    long	uh_ufsize;	/* size of the record in the appendable undo
+				   file, zero when it must be written */
+    int		uh_ufmeta;	/* links, flags or uh_save_nr changed after
+				   the record was written */
     pos_T	uh_cursor;	/* cursor position before saving */
 #ifdef FEAT_VIRTUALEDIT
     long	uh_cursor_vcol;
@@ -377,16 +387,22 @@ typedef struct block_hdr    bhdr_T;
 typedef struct memfile	    memfile_T;
 typedef long		    blocknr_T;
 
+#define BH_SUM_LANES	8	    /* number of lanes in a text checksum */
+#define BH_SUM_SIZE	(BH_SUM_LANES * 2)
+
 /*
  * for each (previously) used block in the memfile there is one block header.
  *
- * The block may be linked in the used list OR in the free list.
- * The used blocks are also kept in hash lists.
+ * The block may be linked in the used list, the zip list OR the free list.
+ * The used and zipped blocks are also kept in hash lists.
  *
  * The used list is a doubly linked list, most recently used block first.
  *	The blocks in the used list have a block of memory allocated.
  *	mf_used_count is the number of pages in the used list.
- * The hash lists are used to quickly find a block in the used list.
+ * The zip list is a doubly linked list of blocks that were released from
+ *	the used list but are kept in memory in compressed form, most
+ *	recently released first.
+ * The hash lists are used to quickly find a block in the used or zip list.
  * The free list is a single linked list, not sorted.
  *	The blocks in the free list have no block of memory allocated and
  *	the contents of the block in the file (if any) is irrelevant.
@@ -401,10 +417,18 @@ struct block_hdr
     blocknr_T	bh_bnum;	    /* block number */
     char_u	*bh_data;	    /* pointer to memory (for used block) */
     int		bh_page_count;	    /* number of pages in this block */
+    unsigned	bh_zip_len;	    /* size of bh_data when BH_ZIPPED */
 
 #define BH_DIRTY    1
 #define BH_LOCKED   2
-    char	bh_flags;	    /* BH_DIRTY or BH_LOCKED */
+#define BH_ZIPPED   4		    /* bh_data is compressed */
+#define BH_SUMMED   8		    /* bh_sum is valid */
+    char	bh_flags;	    /* BH_DIRTY, BH_LOCKED, BH_ZIPPED,
+				       BH_SUMMED */
+#ifdef FEAT_PERSISTENT_UNDO
+    UINT32_T	bh_sum[BH_SUM_SIZE]; /* checksum of the text in a data block,
+				       see ml_text_hash() */
+#endif
 };
 
 /*
@@ -502,6 +526,8 @@ typedef struct file_buffer buf_T;  /* forward declaration */
 /*
  * Simplistic hashing scheme to quickly locate the blocks in the used list.
  * 64 blocks are found directly (64 * 4K = 256K, most files are smaller).
+ * The hash table for blocks doubles in size when there are more blocks than
+ * lists, to keep finding a block in a huge buffer fast.
  */
 #define MEMHASHSIZE	64
 #define MEMHASH(nr)	((nr) & (MEMHASHSIZE - 1))
@@ -515,16 +541,44 @@ struct memfile
     bhdr_T	*mf_free_first;		/* first block_hdr in free list */
     bhdr_T	*mf_used_first;		/* mru block_hdr in used list */
     bhdr_T	*mf_used_last;		/* lru block_hdr in used list */
+    bhdr_T	*mf_zip_first;		/* mru block_hdr in zip list */
+    bhdr_T	*mf_zip_last;		/* lru block_hdr in zip list */
     unsigned	mf_used_count;		/* number of pages in used list */
     unsigned	mf_used_count_max;	/* maximum number of pages in memory */
-    bhdr_T	*mf_hash[MEMHASHSIZE];	/* array of hash lists */
+    bhdr_T	**mf_hash;		/* array of hash lists */
+    bhdr_T	*mf_hash_init[MEMHASHSIZE]; /* initial array of hash lists */
+    long	mf_hash_mask;		/* number of hash lists - 1 */
+    long	mf_hash_count;		/* number of blocks in hash lists */
     NR_TRANS	*mf_trans[MEMHASHSIZE];	/* array of trans lists */
     blocknr_T	mf_blocknr_max;		/* highest positive block number + 1*/
     blocknr_T	mf_blocknr_min;		/* lowest negative block number - 1 */
     blocknr_T	mf_neg_count;		/* number of negative blocks numbers */
+    long	mf_renum_count;		/* number of blocks that got a new
+					   number */
     blocknr_T	mf_infile_count;	/* number of pages in the file */
     unsigned	mf_page_size;		/* number of bytes in a page */
     int		mf_dirty;		/* TRUE if there are dirty blocks */
+#ifdef FEAT_MMAP
+    /* Mapped blocks are data blocks that are filled from a mapped file when
+     * they are needed.  They have negative numbers from mf_map_first down
+     * and are never read from the swap file. */
+    char_u	*mf_map;		/* read-only mapping of the file */
+    size_t	mf_map_size;		/* size of mf_map */
+    off_t	*mf_map_offset;		/* start of each mapped block in mf_map,
+					   plus the end of the last one */
+    blocknr_T	mf_map_first;		/* number of the first mapped block */
+    blocknr_T	mf_map_count;		/* number of mapped blocks */
+    dev_t	mf_map_dev;		/* device and inode of the mapped file */
+    ino_t	mf_map_ino;
+#endif
+#ifdef FEAT_SWAP_THREAD
+    /* Blocks synced with MFS_ASYNC are written by the swap thread. */
+    int		mf_async_count;		/* jobs queued for the swap thread */
+    int		mf_async_done;		/* jobs it has finished, protected by
+					   the job mutex */
+    int		mf_async_off;		/* TRUE after a write by the thread
+					   failed */
+#endif
 #ifdef FEAT_CRYPT
     buf_T	*mf_buffer;		/* bufer this memfile is for */
     char_u	mf_seed[MF_SEED_LEN];	/* seed for encryption */
@@ -537,6 +591,13 @@ struct memfile
 #endif
 };
 
+#ifdef FEAT_MMAP
+/* TRUE when block "nr" of memfile "mfp" is a mapped block */
+# define MF_MAPPED(mfp, nr) ((mfp)->mf_map != NULL \
+	&& (nr) <= (mfp)->mf_map_first \
+	&& (nr) > (mfp)->mf_map_first - (mfp)->mf_map_count)
+#endif
+
 /*
  * things used in memline.c
  */
@@ -553,6 +614,22 @@ typedef struct info_pointer
     int		ip_index;	/* index for block with current lnum */
 } infoptr_T;	/* block/index pair */
 
+/*
+ * Data blocks recently found by ml_get() are remembered in the memline, to
+ * avoid walking the tree again when going back and forth between a few places
+ * in the buffer.  The line numbers are valid until lines are inserted or
+ * deleted.
+ */
+#define ML_CACHE_SIZE	8
+
+typedef struct ml_cache
+{
+    blocknr_T	mc_bnum;	/* block number, zero when not used */
+    int		mc_page_count;	/* number of pages in the block */
+    linenr_T	mc_low;		/* first line in the block */
+    linenr_T	mc_high;	/* last line in the block */
+} mlcache_T;
+
 #ifdef FEAT_BYTEOFF
 typedef struct ml_chunksize
 {
@@ -580,6 +657,8 @@ typedef struct memline
 #define ML_LINE_DIRTY	2	/* cached line was changed and allocated */
 #define ML_LOCKED_DIRTY	4	/* ml_locked was changed */
 #define ML_LOCKED_POS	8	/* ml_locked needs positive block number */
+#define ML_LOCKED_CACHED 16	/* ml_locked was found in ml_cache, ml_stack
+				   does not lead to it */
     int		ml_flags;
 
     infoptr_T	*ml_stack;	/* stack of pointer blocks (array of IPTRs) */
@@ -593,10 +672,18 @@ typedef struct memline
     linenr_T	ml_locked_low;	/* first line in ml_locked */
     linenr_T	ml_locked_high;	/* last line in ml_locked */
     int		ml_locked_lineadd;  /* number of lines inserted in ml_locked */
+
+    mlcache_T	ml_cache[ML_CACHE_SIZE]; /* recently used data blocks */
+    int		ml_cache_next;	/* entry in ml_cache to replace next */
+    long	ml_cache_renum;	/* mf_renum_count when ml_cache was valid */
 #ifdef FEAT_BYTEOFF
     chunksize_T *ml_chunksize;
     int		ml_numchunks;
     int		ml_usedchunks;
+    chunksize_T *ml_chunktree;	/* Fenwick tree with sums of ml_chunksize */
+    int		ml_chunktree_len;   /* number of chunks in ml_chunktree, zero
+				       when it needs to be rebuilt */
+    int		ml_chunktree_max;   /* allocated size of ml_chunktree - 1 */
 #endif
 } memline_T;
 
@@ -1177,6 +1264,18 @@ struct dictvar_S
 typedef struct qf_info_S qf_info_T;
 #endif
 
+#ifdef FEAT_PROFILE
+/*
+ * Used for ":syntime": timing of executing a syntax pattern.
+ */
+typedef struct {
+    proftime_T	total;		/* total time used */
+    proftime_T	slowest;	/* time of slowest call */
+    long	count;		/* nr of times used */
+    long	match;		/* nr of times matched */
+} syn_time_T;
+#endif
+
 typedef struct {
 #ifdef FEAT_SYN_HL
     hashtab_T	b_keywtab;		/* syntax keywords hash table */
@@ -1198,6 +1297,9 @@ typedef struct {
     char_u	*b_syn_linecont_pat;	/* line continuation pattern */
     regprog_T	*b_syn_linecont_prog;	/* line continuation program */
     int		b_syn_linecont_ic;	/* ignore-case flag for above */
+# ifdef FEAT_PROFILE
+    syn_time_T	b_syn_linecont_time;
+# endif
     int		b_syn_topgrp;		/* for ":syntax include" */
 # ifdef FEAT_CONCEAL
     int		b_syn_conceal;		/* auto-conceal for :syn cmds */
@@ -1219,6 +1321,8 @@ typedef struct {
      * b_sst_freecount	number of free entries in b_sst_array[]
      * b_sst_check_lnum	entries after this lnum need to be checked for
      *			validity (MAXLNUM means no check needed)
+     * b_sst_idle_lnum	parsing ahead while idle was done up to this line
+     * b_sst_idle_tick	b:changedtick when b_sst_idle_lnum was set
      */
     synstate_T	*b_sst_array;
     int		b_sst_len;
@@ -1227,6 +1331,8 @@ typedef struct {
     int		b_sst_freecount;
     linenr_T	b_sst_check_lnum;
     short_u	b_sst_lasttick;	/* last display tick */
+    linenr_T	b_sst_idle_lnum;
+    int		b_sst_idle_tick;
 #endif /* FEAT_SYN_HL */
 
 #ifdef FEAT_SPELL
@@ -1387,6 +1493,16 @@ struct file_buffer
     long	b_u_seq_cur;	/* hu_seq of header below which we are now */
     time_t	b_u_time_cur;	/* uh_time of header below which we are now */
     long	b_u_save_nr_cur; /* file write nr after which we are now */
+    long_u	b_u_mem;	/* bytes used for undo entries */
+    FILE	*b_u_spill_fp;	/* file for entries that don't fit in
+				   'undomaxmem' */
+    char_u	*b_u_spill_fname; /* name of b_u_spill_fp */
+    FILE	*b_u_ufp;	/* undo file that entries are read from */
+    char_u	*b_u_uf_fname;	/* name of the appendable undo file */
+    long	b_u_uf_size;	/* its size after the last write, -1 when it
+				   can't be appended to */
+    time_t	b_u_uf_mtime;	/* its mtime after the last write */
+    long	b_u_uf_live;	/* bytes in it used by current records */
 
     /*
      * variables for "U" command in undo.c
@@ -1797,6 +1913,7 @@ typedef struct
 #ifdef FEAT_RELTIME
     proftime_T	tm;	/* for a time limit */
 #endif
+    struct mcache_S *mcache; /* cached matches or NULL, see screen.c */
 } match_T;
 
 /*
@@ -2071,6 +2188,7 @@ struct window_S
 #ifdef FEAT_SEARCH_EXTRA
     matchitem_T	*w_match_head;		/* head of match list */
     int		w_next_match_id;	/* next match ID */
+    struct mcache_S *w_mcache;		/* cached 'hlsearch' matches */
 #endif
 
     /*
@@ -152,6 +152,12 @@ typedef struct syn_pattern
     char_u	*sp_pattern;		/* regexp to match, pattern */
     regprog_T	*sp_prog;		/* regexp to match, program */
     int		 sp_ic;			/* ignore-case flag for sp_prog */
+    char_u	*sp_must;		/* text a matching line contains or NULL,
+					   points into sp_prog */
+    int		 sp_mustlen;		/* length of sp_must */
+    int		 sp_hasbytes;		/* TRUE when sp_bytes is valid */
+    char_u	 sp_bytes[256 / 8];	/* a matching line contains one of these
+					   bytes, one bit each */
     short	 sp_off_flags;		/* see below */
     int		 sp_offsets[SPO_COUNT];	/* offsets */
     short	*sp_cont_list;		/* cont. group IDs, if non-zero */
@@ -159,6 +165,9 @@ typedef struct syn_pattern
     int		 sp_sync_idx;		/* sync item index (syncing only) */
     int		 sp_line_id;		/* ID of last line where tried */
     int		 sp_startcol;		/* next match in sp_line_id line */
+#ifdef FEAT_PROFILE
+    syn_time_T	 sp_time;		/* timing for ":syntime" */
+#endif
 } synpat_T;
 
 /* The sp_off_flags are computed like this:
@@ -175,6 +184,14 @@ typedef struct syn_pattern
 
 #define SYN_ITEMS(buf)	((synpat_T *)((buf)->b_syn_patterns.ga_data))
 
+#ifdef FEAT_PROFILE
+static int syn_time_on = FALSE;
+# define IF_SYN_TIME(p) (p)
+#else
+# define IF_SYN_TIME(p) NULL
+typedef int syn_time_T;
+#endif
+
 #define NONE_IDX	-2	/* value of sp_sync_idx for "NONE" */
 
 /*
@@ -363,6 +380,13 @@ static short	*current_next_list = NULL; /* when non-zero, nextgroup list */
 static int	current_next_flags = 0; /* flags for current_next_list */
 static int	current_line_id = 0;	/* unique number for current line */
 
+/*
+ * The byte values that appear in line "syn_bytes_lnum" of "syn_buf", one bit
+ * each.  Used to skip patterns whose required text can't be in the line.
+ */
+static char_u	syn_bytes[256 / 8];
+static linenr_T syn_bytes_lnum = 0;	/* zero when "syn_bytes" is invalid */
+
 #define CUR_STATE(idx)	((stateitem_T *)(current_state.ga_data))[idx]
 
 static void syn_sync __ARGS((win_T *wp, linenr_T lnum, synstate_T *last_valid));
@@ -401,7 +425,8 @@ static void limit_pos_zero __ARGS((lpos_T *pos, lpos_T *limit));
 static void syn_add_end_off __ARGS((lpos_T *result, regmmatch_T *regmatch, synpat_T *spp, int idx, int extra));
 static void syn_add_start_off __ARGS((lpos_T *result, regmmatch_T *regmatch, synpat_T *spp, int idx, int extra));
 static char_u *syn_getcurline __ARGS((void));
-static int syn_regexec __ARGS((regmmatch_T *rmp, linenr_T lnum, colnr_T col));
+static int syn_may_match __ARGS((synpat_T *spp, linenr_T lnum));
+static int syn_regexec __ARGS((regmmatch_T *rmp, linenr_T lnum, colnr_T col, syn_time_T *st));
 static int check_keyword_id __ARGS((char_u *line, int startcol, int *endcol, long *flags, short **next_list, stateitem_T *cur_si, int *ccharp));
 static void syn_cmd_case __ARGS((exarg_T *eap, int syncing));
 static void syn_cmd_spell __ARGS((exarg_T *eap, int syncing));
@@ -452,6 +477,19 @@ static void syn_cmd_sync __ARGS((exarg_T *eap, int syncing));
 static int get_id_list __ARGS((char_u **arg, int keylen, short **list));
 static void syn_combine_list __ARGS((short **clstr1, short **clstr2, int list_op));
 static void syn_incl_toplevel __ARGS((int id, int *flagsp));
+#ifdef FEAT_PROFILE
+static void syn_clear_time __ARGS((syn_time_T *st));
+static void syntime_clear __ARGS((void));
+# ifdef __BORLANDC__
+static int _RTLENTRYF syn_compare_syntime __ARGS((const void *v1, const void *v2));
+# else
+static int syn_compare_syntime __ARGS((const void *v1, const void *v2));
+# endif
+static void syntime_add __ARGS((garray_T *gap, syn_time_T *st, int id, char_u *pat));
+static void syntime_report __ARGS((void));
+#endif
+
+static char *(msg_no_items) = N_("No Syntax items defined for this buffer");
 
 /*
  * Start the syntax recognition for a line.  This function is normally called
@@ -491,6 +529,7 @@ syntax_start(wp, lnum)
     }
     changedtick = syn_buf->b_changedtick;
     syn_win = wp;
+    syn_bytes_lnum = 0;
 
     /*
      * Allocate syntax stack when needed.
@@ -966,7 +1005,8 @@ syn_match_linecont(lnum)
     {
 	regmatch.rmm_ic = syn_block->b_syn_linecont_ic;
 	regmatch.regprog = syn_block->b_syn_linecont_prog;
-	return syn_regexec(&regmatch, lnum, (colnr_T)0);
+	return syn_regexec(&regmatch, lnum, (colnr_T)0,
+				  IF_SYN_TIME(&syn_block->b_syn_linecont_time));
     }
     return FALSE;
 }
@@ -1112,6 +1152,7 @@ syn_stack_free_block(block)
 	block->b_sst_array = NULL;
 	block->b_sst_len = 0;
     }
+    block->b_sst_idle_lnum = 0;
 }
 /*
  * Free b_sst_array[] for buffer "buf".
@@ -1415,7 +1456,7 @@ store_current_state()
     }
     if (i >= 0)
     {
-	if (sp != NULL)
+	if (sp != NULL && sp->sst_lnum == current_lnum)
 	{
 	    /* find "sp" in the list and remove it */
 	    if (syn_block->b_sst_first == sp)
@@ -1648,6 +1689,129 @@ syntax_end_parsing(lnum)
 	sp->sst_change_lnum = lnum;
 }
 
+/*
+ * Parse syntax ahead in the current window while waiting for the user to type
+ * a key.  Starting at the last valid saved state, a state is stored for every
+ * so many lines down to the end of the buffer.  A jump to far down in a long
+ * buffer then finds a saved state close by, instead of parsing from a sync
+ * point far away.  This is only useful when saved states within "minlines"
+ * are used, thus when that is more than the distance between the states,
+ * e.g. for "sync fromstart".
+ * Returns as soon as a key is typed.
+ */
+    void
+syntax_idle()
+{
+    win_T	*wp = curwin;
+    synblock_T	*block = wp->w_s;
+    buf_T	*buf = wp->w_buffer;
+    synstate_T	*p;
+    synstate_T	*sp;
+    linenr_T	lnum;
+    linenr_T	prev_lnum = 0;
+    linenr_T	stored_lnum;
+    linenr_T	parsed_lnum;
+    int		dist;
+    int		n = 0;
+
+    /* Saved states are not adjusted for changes until the screen is
+     * updated. */
+    if (!syntax_present(wp) || buf->b_mod_set)
+	return;
+    if (block->b_sst_idle_tick != buf->b_changedtick)
+    {
+	block->b_sst_idle_lnum = 0;
+	block->b_sst_idle_tick = buf->b_changedtick;
+    }
+
+    /* Show the cursor before spending time. */
+    out_flush();
+
+    while (!got_int)
+    {
+	if (block->b_sst_array == NULL || block->b_sst_len <= Rows)
+	    break;
+	dist = buf->b_ml.ml_line_count / (block->b_sst_len - Rows) + 1;
+	if (block->b_syn_sync_minlines < dist)
+	    break;
+
+	/* Find the last valid state before the first state that isn't valid
+	 * or more than "dist" lines further down.  The state for line 1 is
+	 * always known.  Gaps above "b_sst_idle_lnum" were parsed already,
+	 * a state could not be stored there. */
+	lnum = 1;
+	for (p = block->b_sst_first; p != NULL; p = p->sst_next)
+	{
+	    if (p->sst_change_lnum != 0 || (p->sst_lnum > lnum + dist
+				      && p->sst_lnum > block->b_sst_idle_lnum))
+		break;
+	    lnum = p->sst_lnum;
+	}
+	if (p == NULL && (lnum + dist > buf->b_ml.ml_line_count
+			|| block->b_sst_idle_lnum >= buf->b_ml.ml_line_count))
+	    break;		/* all done */
+	if (lnum == prev_lnum)
+	    break;		/* no progress, avoid looping forever */
+	prev_lnum = lnum;
+
+	syntax_start(wp, lnum);
+	if (current_lnum != lnum || INVALID_STATE(&current_state))
+	    break;
+	sp = syn_stack_find_entry(lnum);
+	stored_lnum = lnum;
+	while (current_lnum < buf->b_ml.ml_line_count)
+	{
+	    (void)syn_finish_line(FALSE);
+	    ++current_lnum;
+
+	    while (sp != NULL && sp->sst_lnum < current_lnum)
+		sp = sp->sst_next;
+	    if (sp != NULL && sp->sst_lnum == current_lnum
+						       && syn_stack_equal(sp))
+	    {
+		/* Same state as saved before: it is valid, also the states
+		 * below it that only depended on a change above this line.
+		 * Continue after those. */
+		parsed_lnum = current_lnum;
+		while (sp != NULL && sp->sst_change_lnum <= parsed_lnum)
+		{
+		    if (sp->sst_lnum > parsed_lnum && sp->sst_change_lnum == 0)
+			break;
+		    sp->sst_change_lnum = 0;
+		    sp = sp->sst_next;
+		}
+		break;
+	    }
+	    if ((sp != NULL && sp->sst_lnum == current_lnum)
+				     || current_lnum >= stored_lnum + dist)
+	    {
+		sp = store_current_state();
+		if (sp != NULL && sp->sst_lnum == current_lnum)
+		    stored_lnum = current_lnum;
+		else
+		    /* Could not store the state here, try the next line. */
+		    sp = syn_stack_find_entry(current_lnum);
+	    }
+	    syn_start_line();
+
+	    /* Checking for a typed key takes a bit of time, don't do it for
+	     * every line. */
+	    if (++n >= 20)
+	    {
+		n = 0;
+		if (char_avail() || got_int)
+		{
+		    invalidate_current_state();
+		    return;
+		}
+	    }
+	}
+	block->b_sst_idle_lnum = current_lnum;
+	invalidate_current_state();
+    }
+    invalidate_current_state();
+}
+
 /*
  * End of handling of the state stack.
  ****************************************/
@@ -2055,8 +2219,10 @@ syn_current_attr(syncing, displaying, can_spell, keep_state)
 
 			    regmatch.rmm_ic = spp->sp_ic;
 			    regmatch.regprog = spp->sp_prog;
-			    if (!syn_regexec(&regmatch, current_lnum,
-							     (colnr_T)lc_col))
+			    if (!syn_may_match(spp, current_lnum)
+				    || !syn_regexec(&regmatch, current_lnum,
+					     (colnr_T)lc_col,
+					     IF_SYN_TIME(&spp->sp_time)))
 			    {
 				/* no match in this line, try another one */
 				spp->sp_startcol = MAXCOL;
@@ -2935,7 +3101,9 @@ find_endpos(idx, startpos, m_endpos, hl_endpos, flagsp, end_endpos,
 
 	    regmatch.rmm_ic = spp->sp_ic;
 	    regmatch.regprog = spp->sp_prog;
-	    if (syn_regexec(&regmatch, startpos->lnum, lc_col))
+	    if (syn_may_match(spp, startpos->lnum)
+		    && syn_regexec(&regmatch, startpos->lnum, lc_col,
+						  IF_SYN_TIME(&spp->sp_time)))
 	    {
 		if (best_idx == -1 || regmatch.startpos[0].col
 					      < best_regmatch.startpos[0].col)
@@ -2966,7 +3134,9 @@ find_endpos(idx, startpos, m_endpos, hl_endpos, flagsp, end_endpos,
 		lc_col = 0;
 	    regmatch.rmm_ic = spp_skip->sp_ic;
 	    regmatch.regprog = spp_skip->sp_prog;
-	    if (syn_regexec(&regmatch, startpos->lnum, lc_col)
+	    if (syn_may_match(spp_skip, startpos->lnum)
+		    && syn_regexec(&regmatch, startpos->lnum, lc_col,
+					     IF_SYN_TIME(&spp_skip->sp_time))
 		    && regmatch.startpos[0].col
 					     <= best_regmatch.startpos[0].col)
 	    {
@@ -3209,18 +3379,80 @@ syn_getcurline()
     return ml_get_buf(syn_buf, current_lnum, FALSE);
 }
 
+/*
+ * Return FALSE when pattern "spp" can't match in line "lnum" of "syn_buf",
+ * because the line lacks a byte of the text every match contains, or has
+ * none of the bytes of which every match contains one.  This is much cheaper
+ * than calling syn_regexec(), the bytes of the line are only collected once
+ * for all the patterns tried in it.
+ */
+    static int
+syn_may_match(spp, lnum)
+    synpat_T	*spp;
+    linenr_T	lnum;
+{
+    char_u	*p;
+    int		i;
+
+    if (spp->sp_must == NULL && !spp->sp_hasbytes)
+	return TRUE;
+    if (syn_bytes_lnum != lnum)
+    {
+	vim_memset(syn_bytes, 0, sizeof(syn_bytes));
+	for (p = ml_get_buf(syn_buf, lnum, FALSE); *p != NUL; ++p)
+	    syn_bytes[*p >> 3] |= 1 << (*p & 7);
+	syn_bytes_lnum = lnum;
+    }
+    if (spp->sp_must != NULL)
+    {
+	for (i = 0; i < spp->sp_mustlen; ++i)
+	    if (!(syn_bytes[spp->sp_must[i] >> 3]
+					       & (1 << (spp->sp_must[i] & 7))))
+		return FALSE;
+	return TRUE;
+    }
+    for (i = 0; i < (int)sizeof(syn_bytes); ++i)
+	if (syn_bytes[i] & spp->sp_bytes[i])
+	    return TRUE;
+    return FALSE;
+}
+
 /*
  * Call vim_regexec() to find a match with "rmp" in "syn_buf".
  * Returns TRUE when there is a match.
  */
     static int
-syn_regexec(rmp, lnum, col)
+syn_regexec(rmp, lnum, col, st)
     regmmatch_T	*rmp;
     linenr_T	lnum;
     colnr_T	col;
+    syn_time_T	*st UNUSED;
 {
+    int		r;
+#ifdef FEAT_PROFILE
+    proftime_T	pt;
+
+    if (syn_time_on)
+	profile_start(&pt);
+#endif
+
     rmp->rmm_maxcol = syn_buf->b_p_smc;
-    if (vim_regexec_multi(rmp, syn_win, syn_buf, lnum, col, NULL) > 0)
+    r = vim_regexec_multi(rmp, syn_win, syn_buf, lnum, col, NULL);
+
+#ifdef FEAT_PROFILE
+    if (syn_time_on)
+    {
+	profile_end(&pt);
+	profile_add(&st->total, &pt);
+	if (profile_cmp(&pt, &st->slowest) < 0)
+	    st->slowest = pt;
+	++st->count;
+	if (r > 0)
+	    ++st->match;
+    }
+#endif
+
+    if (r > 0)
     {
 	rmp->startpos[0].lnum += lnum;
 	rmp->endpos[0].lnum += lnum;
@@ -3431,7 +3663,7 @@ syntax_clear(block)
     block->b_syn_sync_maxlines = 0;
     block->b_syn_sync_linebreaks = 0;
 
-    vim_free(block->b_syn_linecont_prog);
+    vim_regfree(block->b_syn_linecont_prog);
     block->b_syn_linecont_prog = NULL;
     vim_free(block->b_syn_linecont_pat);
     block->b_syn_linecont_pat = NULL;
@@ -3477,7 +3709,7 @@ syntax_sync_clear()
     curwin->w_s->b_syn_sync_maxlines = 0;
     curwin->w_s->b_syn_sync_linebreaks = 0;
 
-    vim_free(curwin->w_s->b_syn_linecont_prog);
+    vim_regfree(curwin->w_s->b_syn_linecont_prog);
     curwin->w_s->b_syn_linecont_prog = NULL;
     vim_free(curwin->w_s->b_syn_linecont_pat);
     curwin->w_s->b_syn_linecont_pat = NULL;
@@ -3516,7 +3748,7 @@ syn_clear_pattern(block, i)
     int		i;
 {
     vim_free(SYN_ITEMS(block)[i].sp_pattern);
-    vim_free(SYN_ITEMS(block)[i].sp_prog);
+    vim_regfree(SYN_ITEMS(block)[i].sp_prog);
     /* Only free sp_cont_list and sp_next_list of first start pattern */
     if (i == 0 || SYN_ITEMS(block)[i - 1].sp_type != SPTYPE_START)
     {
@@ -3751,7 +3983,7 @@ syn_cmd_list(eap, syncing)
 
     if (!syntax_present(curwin))
     {
-	MSG(_("No Syntax items defined for this buffer"));
+	MSG(_(msg_no_items));
 	return;
     }
 
@@ -4910,7 +5142,7 @@ syn_cmd_match(eap, syncing)
     /*
      * Something failed, free the allocated memory.
      */
-    vim_free(item.sp_prog);
+    vim_regfree(item.sp_prog);
     vim_free(item.sp_pattern);
     vim_free(syn_opt_arg.cont_list);
     vim_free(syn_opt_arg.cont_in_list);
@@ -5166,7 +5398,7 @@ syn_cmd_region(eap, syncing)
 	{
 	    if (!success)
 	    {
-		vim_free(ppp->pp_synp->sp_prog);
+		vim_regfree(ppp->pp_synp->sp_prog);
 		vim_free(ppp->pp_synp->sp_pattern);
 	    }
 	    vim_free(ppp->pp_synp);
@@ -5567,6 +5799,10 @@ get_syn_pattern(arg, ci)
     if (ci->sp_prog == NULL)
 	return NULL;
     ci->sp_ic = curwin->w_s->b_syn_ic;
+    ci->sp_must = vim_regliteral(ci->sp_prog, ci->sp_ic, &ci->sp_mustlen);
+    if (ci->sp_must == NULL)
+	ci->sp_hasbytes = (vim_regbytes(ci->sp_prog, ci->sp_ic, ci->sp_bytes)
+									== OK);
 
     /*
      * Check for a match, highlight or region offset.
@@ -5925,7 +6161,7 @@ get_id_list(arg, keylen, list)
 			    id = -1;	    /* remember that we found one */
 			}
 		    }
-		    vim_free(regmatch.regprog);
+		    vim_regfree(regmatch.regprog);
 		}
 	    }
 	    vim_free(name);
@@ -6198,7 +6434,7 @@ ex_ownsyntax(eap)
 	curwin->w_p_spell = FALSE;	/* No spell checking */
 	clear_string_option(&curwin->w_s->b_p_spc);
 	clear_string_option(&curwin->w_s->b_p_spf);
-	vim_free(curwin->w_s->b_cap_prog);
+	vim_regfree(curwin->w_s->b_cap_prog);
 	curwin->w_s->b_cap_prog = NULL;
 	clear_string_option(&curwin->w_s->b_p_spl);
 #endif
@@ -6429,6 +6665,220 @@ syn_get_foldlevel(wp, lnum)
 }
 #endif
 
+#if defined(FEAT_PROFILE) || defined(PROTO)
+/*
+ * ":syntime".
+ */
+    void
+ex_syntime(eap)
+    exarg_T	*eap;
+{
+    if (STRCMP(eap->arg, "on") == 0)
+	syn_time_on = TRUE;
+    else if (STRCMP(eap->arg, "off") == 0)
+	syn_time_on = FALSE;
+    else if (STRCMP(eap->arg, "clear") == 0)
+	syntime_clear();
+    else if (STRCMP(eap->arg, "report") == 0)
+	syntime_report();
+    else
+	EMSG2(_(e_invarg2), eap->arg);
+}
+
+    static void
+syn_clear_time(st)
+    syn_time_T *st;
+{
+    profile_zero(&st->total);
+    profile_zero(&st->slowest);
+    st->count = 0;
+    st->match = 0;
+}
+
+/*
+ * Clear the syntax timing for the current buffer.
+ */
+    static void
+syntime_clear()
+{
+    int		idx;
+    synpat_T	*spp;
+
+    if (!syntax_present(curwin))
+    {
+	MSG(_(msg_no_items));
+	return;
+    }
+    for (idx = 0; idx < curwin->w_s->b_syn_patterns.ga_len; ++idx)
+    {
+	spp = &(SYN_ITEMS(curwin->w_s)[idx]);
+	syn_clear_time(&spp->sp_time);
+    }
+    syn_clear_time(&curwin->w_s->b_syn_linecont_time);
+}
+
+#if defined(FEAT_CMDL_COMPL) || defined(PROTO)
+/*
+ * Function given to ExpandGeneric() to obtain the possible arguments of the
+ * ":syntime {on,off,clear,report}" command.
+ */
+    char_u *
+get_syntime_arg(xp, idx)
+    expand_T	*xp UNUSED;
+    int		idx;
+{
+    switch (idx)
+    {
+	case 0: return (char_u *)"on";
+	case 1: return (char_u *)"off";
+	case 2: return (char_u *)"clear";
+	case 3: return (char_u *)"report";
+    }
+    return NULL;
+}
+#endif
+
+typedef struct
+{
+    proftime_T	total;
+    long	count;
+    long	match;
+    proftime_T	slowest;
+    proftime_T	average;
+    int		id;
+    char_u	*pattern;
+} time_entry_T;
+
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+syn_compare_syntime(v1, v2)
+    const void	*v1;
+    const void	*v2;
+{
+    time_entry_T	*s1 = (time_entry_T *)v1;
+    time_entry_T	*s2 = (time_entry_T *)v2;
+
+    return profile_cmp(&s1->total, &s2->total);
+}
+
+/*
+ * Add the timing "st" of pattern "pat" with group "id" to "gap".
+ */
+    static void
+syntime_add(gap, st, id, pat)
+    garray_T	*gap;
+    syn_time_T	*st;
+    int		id;
+    char_u	*pat;
+{
+    time_entry_T *p;
+
+    if (st->count == 0 || ga_grow(gap, 1) == FAIL)
+	return;
+    p = ((time_entry_T *)gap->ga_data) + gap->ga_len;
+    p->total = st->total;
+    p->count = st->count;
+    p->match = st->match;
+    p->slowest = st->slowest;
+    profile_divide(&st->total, st->count, &p->average);
+    p->id = id;
+    p->pattern = pat;
+    ++gap->ga_len;
+}
+
+/*
+ * Display the syntax timing for the current buffer, the pattern that took
+ * the most time first.
+ */
+    static void
+syntime_report()
+{
+    int		idx;
+    synpat_T	*spp;
+    time_entry_T *p;
+    garray_T    ga;
+    proftime_T	total_total;
+    long	total_count = 0;
+    int		len;
+
+    if (!syntax_present(curwin))
+    {
+	MSG(_(msg_no_items));
+	return;
+    }
+
+    ga_init2(&ga, sizeof(time_entry_T), 50);
+    profile_zero(&total_total);
+    for (idx = 0; idx < curwin->w_s->b_syn_patterns.ga_len; ++idx)
+    {
+	spp = &(SYN_ITEMS(curwin->w_s)[idx]);
+	profile_add(&total_total, &spp->sp_time.total);
+	total_count += spp->sp_time.count;
+	syntime_add(&ga, &spp->sp_time, spp->sp_syn.id, spp->sp_pattern);
+    }
+    if (curwin->w_s->b_syn_linecont_pat != NULL)
+    {
+	profile_add(&total_total, &curwin->w_s->b_syn_linecont_time.total);
+	total_count += curwin->w_s->b_syn_linecont_time.count;
+	syntime_add(&ga, &curwin->w_s->b_syn_linecont_time, 0,
+					     curwin->w_s->b_syn_linecont_pat);
+    }
+
+    /* sort on total time */
+    qsort(ga.ga_data, (size_t)ga.ga_len, sizeof(time_entry_T),
+							 syn_compare_syntime);
+
+    MSG_PUTS_TITLE(_("  TOTAL      COUNT  MATCH   SLOWEST     AVERAGE   NAME               PATTERN"));
+    msg_putchar('\n');
+    for (idx = 0; idx < ga.ga_len && !got_int; ++idx)
+    {
+	p = ((time_entry_T *)ga.ga_data) + idx;
+
+	msg_puts((char_u *)profile_msg(&p->total));
+	msg_puts((char_u *)" "); /* make sure there is always a separating space */
+	msg_advance(13);
+	msg_outnum(p->count);
+	msg_puts((char_u *)" ");
+	msg_advance(20);
+	msg_outnum(p->match);
+	msg_puts((char_u *)" ");
+	msg_advance(26);
+	msg_puts((char_u *)profile_msg(&p->slowest));
+	msg_puts((char_u *)" ");
+	msg_advance(38);
+	msg_puts((char_u *)profile_msg(&p->average));
+	msg_puts((char_u *)" ");
+	msg_advance(50);
+	if (p->id == 0)
+	    msg_puts((char_u *)"linecont");
+	else
+	    msg_outtrans(HL_TABLE()[p->id - 1].sg_name);
+	msg_puts((char_u *)" ");
+
+	msg_advance(69);
+	if (Columns < 80)
+	    len = 20; /* will wrap anyway */
+	else
+	    len = Columns - 70;
+	if (len > (int)STRLEN(p->pattern))
+	    len = (int)STRLEN(p->pattern);
+	msg_outtrans_len(p->pattern, len);
+	msg_putchar('\n');
+    }
+    ga_clear(&ga);
+    if (!got_int)
+    {
+	msg_putchar('\n');
+	msg_puts((char_u *)profile_msg(&total_total));
+	msg_advance(13);
+	msg_outnum(total_count);
+	msg_putchar('\n');
+    }
+}
+#endif
+
 #endif /* FEAT_SYN_HL */
 
 
@@ -2413,7 +2413,7 @@ line_read_in:
 	{
 	    /* Go back from converted pattern to original pattern. */
 	    vim_free(pats->pat);
-	    vim_free(pats->regmatch.regprog);
+	    vim_regfree(pats->regmatch.regprog);
 	    orgpat.regmatch.rm_ic = pats->regmatch.rm_ic;
 	    pats = &orgpat;
 	}
@@ -2474,7 +2474,7 @@ line_read_in:
 
 findtag_end:
     vim_free(lbuf);
-    vim_free(pats->regmatch.regprog);
+    vim_regfree(pats->regmatch.regprog);
     vim_free(tag_fname);
 #ifdef FEAT_EMACS_TAGS
     vim_free(ebuf);
@@ -98,16 +98,37 @@ static void u_freeheader __ARGS((buf_T *buf, u_header_T *uhp, u_header_T **uhpp)
 static void u_freebranch __ARGS((buf_T *buf, u_header_T *uhp, u_header_T **uhpp));
 static void u_freeentries __ARGS((buf_T *buf, u_header_T *uhp, u_header_T **uhpp));
 static void u_freeentry __ARGS((u_entry_T *, long));
+static int u_put_num __ARGS((char_u *p, long_u n));
+static char_u *u_get_num __ARGS((char_u *p, long_u *np));
+static long_u u_packed_len __ARGS((char_u *packed, long size));
+static int u_packed_check __ARGS((char_u *packed, long_u len, long size));
+static long_u u_entry_mem __ARGS((u_entry_T *uep));
+static void u_pack_entry __ARGS((u_entry_T *uep));
+static int u_unpack_entry __ARGS((u_entry_T *uep));
+static int u_spill_header __ARGS((buf_T *buf, u_header_T *uhp));
+static u_entry_T *u_read_spill __ARGS((buf_T *buf, long off));
+static int u_load_header __ARGS((buf_T *buf, u_header_T *uhp));
+static void u_spill_old __ARGS((buf_T *buf));
+static void u_header_changed __ARGS((buf_T *buf, u_header_T *uhp));
 #ifdef FEAT_PERSISTENT_UNDO
+static void u_compute_sha256 __ARGS((buf_T *buf, linenr_T last, char_u *hash));
 static void corruption_error __ARGS((char *mesg, char_u *file_name));
 static void u_free_uhp __ARGS((u_header_T *uhp));
 static size_t fwrite_crypt __ARGS((buf_T *buf UNUSED, char_u *ptr, size_t len, FILE *fp));
 static char_u *read_string_decrypt __ARGS((buf_T *buf UNUSED, FILE *fd, int len));
 static int serialize_header __ARGS((FILE *fp, buf_T *buf, char_u *hash));
-static int serialize_uhp __ARGS((FILE *fp, buf_T *buf, u_header_T *uhp));
-static u_header_T *unserialize_uhp __ARGS((FILE *fp, char_u *file_name));
+static int serialize_state __ARGS((FILE *fp, buf_T *buf, char_u *hash));
+static int serialize_uhp __ARGS((FILE *fp, u_header_T *uhp));
+static int serialize_entries __ARGS((FILE *fp, buf_T *buf, u_header_T *uhp));
+static u_header_T *unserialize_uhp __ARGS((FILE *fp, buf_T *buf, int lazy, char_u *file_name));
+static int unserialize_entries __ARGS((FILE *fp, buf_T *buf, u_entry_T **list, char_u *file_name));
 static int serialize_uep __ARGS((FILE *fp, buf_T *buf, u_entry_T *uep));
-static u_entry_T *unserialize_uep __ARGS((FILE *fp, int *error, char_u *file_name));
+static u_entry_T *unserialize_uep __ARGS((FILE *fp, buf_T *buf, int packed, int *error, char_u *file_name));
+static long u_log_end_record __ARGS((FILE *fp, long lenpos));
+static int u_log_uhp __ARGS((FILE *fp, buf_T *buf, u_header_T *uhp, int append, int track));
+static int u_log_read __ARGS((FILE *fp, long end, u_header_T **uhp_table, int num_head, long *head_seqs, int lazy, int track, long *num_read, char_u *file_name));
+static int u_read_ufentries __ARGS((buf_T *buf, long off, u_entry_T **list));
+static int uhp_table_find __ARGS((u_header_T **uhp_table, long num_head, long seq));
 static void serialize_pos __ARGS((pos_T pos, FILE *fp));
 static void unserialize_pos __ARGS((pos_T *pos, FILE *fp));
 static void serialize_visualinfo __ARGS((visualinfo_T *info, FILE *fp));
@@ -116,6 +137,9 @@ static void put_header_ptr __ARGS((FILE	*fp, u_header_T *uhp));
 #endif
 
 #define U_ALLOC_LINE(size) lalloc((long_u)(size), FALSE)
+
+/* TRUE when the entries of "uhp" are in the spill file or the undo file. */
+#define UH_NOT_LOADED(uhp) ((uhp)->uh_spill >= 0 || (uhp)->uh_ufoff >= 0)
 static char_u *u_save_line __ARGS((linenr_T));
 
 /* used in undo_end() to report number of added and deleted lines */
@@ -421,6 +445,12 @@ u_savecommon(top, bot, newbot, reload)
 	curbuf->b_new_change = TRUE;
 #endif
 
+	/* The last change of the newest header is complete, the text it saved
+	 * can be packed now. */
+	if (curbuf->b_u_curhead == NULL && curbuf->b_u_newhead != NULL
+				    && curbuf->b_u_newhead->uh_entry != NULL)
+	    u_pack_entry(curbuf->b_u_newhead->uh_entry);
+
 	if (p_ul >= 0)
 	{
 	    /*
@@ -488,15 +518,22 @@ u_savecommon(top, bot, newbot, reload)
 	{
 	    uhp->uh_alt_prev.ptr = old_curhead->uh_alt_prev.ptr;
 	    if (uhp->uh_alt_prev.ptr != NULL)
+	    {
 		uhp->uh_alt_prev.ptr->uh_alt_next.ptr = uhp;
+		uhp->uh_alt_prev.ptr->uh_ufmeta = TRUE;
+	    }
 	    old_curhead->uh_alt_prev.ptr = uhp;
+	    old_curhead->uh_ufmeta = TRUE;
 	    if (curbuf->b_u_oldhead == old_curhead)
 		curbuf->b_u_oldhead = uhp;
 	}
 	else
 	    uhp->uh_alt_prev.ptr = NULL;
 	if (curbuf->b_u_newhead != NULL)
+	{
 	    curbuf->b_u_newhead->uh_prev.ptr = uhp;
+	    curbuf->b_u_newhead->uh_ufmeta = TRUE;
+	}
 
 	uhp->uh_seq = ++curbuf->b_u_seq_last;
 	curbuf->b_u_seq_cur = uhp->uh_seq;
@@ -507,6 +544,10 @@ u_savecommon(top, bot, newbot, reload)
 	uhp->uh_walk = 0;
 	uhp->uh_entry = NULL;
 	uhp->uh_getbot_entry = NULL;
+	uhp->uh_spill = -1;
+	uhp->uh_ufoff = -1;
+	uhp->uh_ufsize = 0;
+	uhp->uh_ufmeta = FALSE;
 	uhp->uh_cursor = curwin->w_cursor;	/* save cursor pos. for undo */
 #ifdef FEAT_VIRTUALEDIT
 	if (virtual_active() && curwin->w_cursor.coladd > 0)
@@ -529,12 +570,25 @@ u_savecommon(top, bot, newbot, reload)
 	if (curbuf->b_u_oldhead == NULL)
 	    curbuf->b_u_oldhead = uhp;
 	++curbuf->b_u_numhead;
+
+	/* Older undo blocks may not fit in 'undomaxmem' now. */
+	u_spill_old(curbuf);
     }
     else
     {
 	if (p_ul < 0)		/* no undo at all */
 	    return OK;
 
+	/* Entries are added to the newest header, after ":undojoin" it may
+	 * still be in the undo file. */
+	if (curbuf->b_u_newhead != NULL)
+	{
+	    if (UH_NOT_LOADED(curbuf->b_u_newhead)
+		    && u_load_header(curbuf, curbuf->b_u_newhead) == FAIL)
+		return FAIL;
+	    u_header_changed(curbuf, curbuf->b_u_newhead);
+	}
+
 	/*
 	 * When saving a single line, and it has been saved just before, it
 	 * doesn't make sense saving it again.  Saves a lot of memory when
@@ -569,6 +623,9 @@ u_savecommon(top, bot, newbot, reload)
 		/* If it's the same line we can skip saving it again. */
 		if (uep->ue_size == 1 && uep->ue_top == top)
 		{
+		    /* The line may change again, it can't stay packed. */
+		    if (uep->ue_packed != NULL && u_unpack_entry(uep) == FAIL)
+			break;
 		    if (i > 0)
 		    {
 			/* It's not the last entry: get ue_bot for the last
@@ -607,6 +664,9 @@ u_savecommon(top, bot, newbot, reload)
 
 	/* find line number for ue_bot for previous u_save() */
 	u_getbot();
+
+	/* The previous change is complete, pack the text it saved. */
+	u_pack_entry(curbuf->b_u_newhead->uh_entry);
     }
 
 #if !defined(UNIX) && !defined(DJGPP) && !defined(WIN32) && !defined(__EMX__)
@@ -670,6 +730,7 @@ u_savecommon(top, bot, newbot, reload)
     }
     else
 	uep->ue_array = NULL;
+    curbuf->b_u_mem += u_entry_mem(uep);
     uep->ue_next = curbuf->b_u_newhead->uh_entry;
     curbuf->b_u_newhead->uh_entry = uep;
     curbuf->b_u_synced = FALSE;
@@ -699,12 +760,36 @@ nomem:
 # define UF_HEADER_MAGIC	0x5fd0	/* magic at start of header */
 # define UF_HEADER_END_MAGIC	0xe7aa	/* magic after last header */
 # define UF_ENTRY_MAGIC		0xf518	/* magic at start of entry */
+# define UF_ENTRY_PACKED_MAGIC	0xf519	/* idem, packed entry */
 # define UF_ENTRY_END_MAGIC	0x3581	/* magic after last entry */
-# define UF_VERSION		2	/* 2-byte undofile version number */
-# define UF_VERSION_CRYPT	0x8002	/* idem, encrypted */
+# define UF_VERSION		3	/* 2-byte undofile version number */
+# define UF_VERSION_CRYPT	0x8003	/* idem, encrypted */
+# define UF_VERSION_PREV	2	/* version without packed entries */
+# define UF_VERSION_PREV_CRYPT	0x8002	/* idem, encrypted */
+# define UF_VERSION_LOG		4	/* appendable, not encrypted */
+
+/*
+ * An appendable undo file starts with the magic, the version and the offset
+ * of the last written state record.  It is followed by records that start
+ * with a 2-byte magic and the 4-byte length of what follows.  When writing
+ * again only changed headers are appended, followed by a new state record.
+ * Only then the offset at the start is updated.  For every header the last
+ * record before the state record is used.
+ */
+# define UF_LOG_STATE_OFF	(UF_START_MAGIC_LEN + 2)
+# define UF_LOG_START		(UF_LOG_STATE_OFF + 4)
+# define UF_STATE_MAGIC		0x5fd1	/* record with the buffer state */
+# define UF_META_MAGIC		0x5fd2	/* record with changed header links */
+# define UF_META_LEN		26	/* length of a UF_META_MAGIC record */
+# define UF_LOG_SLACK		65536L	/* unused bytes allowed in the file
+					   besides as many as are used */
 
 /* extra fields for header */
 # define UF_LAST_SAVE_NR	1
+# define UF_HASH_KIND		2	/* how the hash was computed */
+
+/* values for UF_HASH_KIND, SHA-256 when missing */
+# define UF_HASH_TEXT_SUM	1	/* checksum from ml_text_hash() */
 
 /* extra fields for uhp */
 # define UHP_SAVE_NR		1
@@ -712,20 +797,37 @@ nomem:
 static char_u e_not_open[] = N_("E828: Cannot open undo file for writing: %s");
 
 /*
- * Compute the hash for the current buffer text into hash[UNDO_HASH_SIZE].
+ * Compute the hash for the text of "buf" into hash[UNDO_HASH_SIZE].  This is
+ * a checksum that is kept up-to-date for each block of text, it only needs to
+ * be computed for the text that changed, see ml_text_hash().
+ * Return FAIL when the text cannot be read.
  */
-    void
-u_compute_hash(hash)
-    char_u *hash;
+    int
+u_compute_hash(buf, hash)
+    buf_T	*buf;
+    char_u	*hash;
+{
+    return ml_text_hash(buf, hash);
+}
+
+/*
+ * Compute the SHA-256 hash of lines 1 to "last" of "buf" into
+ * hash[UNDO_HASH_SIZE].  This is what undo files without UF_HASH_KIND use.
+ */
+    static void
+u_compute_sha256(buf, last, hash)
+    buf_T	*buf;
+    linenr_T	last;
+    char_u	*hash;
 {
     context_sha256_T	ctx;
     linenr_T		lnum;
     char_u		*p;
 
     sha256_start(&ctx);
-    for (lnum = 1; lnum < curbuf->b_ml.ml_line_count; ++lnum)
+    for (lnum = 1; lnum <= last; ++lnum)
     {
-	p = ml_get(lnum);
+	p = ml_get_buf(buf, lnum, FALSE);
 	sha256_update(&ctx, p, (UINT32_T)(STRLEN(p) + 1));
     }
     sha256_finish(&ctx, hash);
@@ -876,7 +978,7 @@ fwrite_crypt(buf, ptr, len, fp)
 
 /*
  * Read a string of length "len" from "fd".
- * When 'key' is set decrypt the bytes.
+ * When "buf" is not NULL and 'key' is set decrypt the bytes.
  */
     static char_u *
 read_string_decrypt(buf, fd, len)
@@ -888,7 +990,7 @@ read_string_decrypt(buf, fd, len)
 
     ptr = read_string(fd, len);
 #ifdef FEAT_CRYPT
-    if (ptr != NULL && *buf->b_p_key != NUL)
+    if (ptr != NULL && buf != NULL && *buf->b_p_key != NUL)
 	crypt_decode(ptr, len);
 #endif
     return ptr;
@@ -930,6 +1032,20 @@ serialize_header(fp, buf, hash)
 #endif
 	put_bytes(fp, (long_u)UF_VERSION, 2);
 
+    return serialize_state(fp, buf, hash);
+}
+
+/*
+ * Write the state of the undo info of "buf": the text hash, the "U" line and
+ * the sequence numbers.
+ */
+    static int
+serialize_state(fp, buf, hash)
+    FILE	*fp;
+    buf_T	*buf;
+    char_u	*hash;
+{
+    int len;
 
     /* Write a hash of the buffer text, so that we can verify it is still the
      * same when reading the buffer text. */
@@ -960,22 +1076,21 @@ serialize_header(fp, buf, hash)
     putc(UF_LAST_SAVE_NR, fp);
     put_bytes(fp, (long_u)buf->b_u_save_nr_last, 4);
 
+    putc(1, fp);
+    putc(UF_HASH_KIND, fp);
+    putc(UF_HASH_TEXT_SUM, fp);
+
     putc(0, fp);  /* end marker */
 
     return OK;
 }
 
     static int
-serialize_uhp(fp, buf, uhp)
+serialize_uhp(fp, uhp)
     FILE	*fp;
-    buf_T	*buf;
     u_header_T	*uhp;
 {
     int		i;
-    u_entry_T	*uep;
-
-    if (put_bytes(fp, (long_u)UF_HEADER_MAGIC, 2) == FAIL)
-	return FAIL;
 
     put_header_ptr(fp, uhp->uh_next.ptr);
     put_header_ptr(fp, uhp->uh_prev.ptr);
@@ -1009,29 +1124,71 @@ serialize_uhp(fp, buf, uhp)
     putc(UHP_SAVE_NR, fp);
     put_bytes(fp, (long_u)uhp->uh_save_nr, 4);
 
-    putc(0, fp);  /* end marker */
+    if (putc(0, fp) == EOF)  /* end marker */
+	return FAIL;
+    return OK;
+}
 
-    /* Write all the entries. */
-    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+/*
+ * Write the entries of "uhp".
+ */
+    static int
+serialize_entries(fp, buf, uhp)
+    FILE	*fp;
+    buf_T	*buf;
+    u_header_T	*uhp;
+{
+    u_entry_T	*uep;
+    u_entry_T	*spilled = NULL;
+    int		retval = OK;
+
+    /* Entries that were moved to the spill file or are still in the undo
+     * file that was read are read back one header at a time. */
+    if (uhp->uh_spill >= 0)
     {
-	put_bytes(fp, (long_u)UF_ENTRY_MAGIC, 2);
-	if (serialize_uep(fp, buf, uep) == FAIL)
+	spilled = u_read_spill(buf, uhp->uh_spill);
+	if (spilled == NULL)
 	    return FAIL;
     }
-    put_bytes(fp, (long_u)UF_ENTRY_END_MAGIC, 2);
-    return OK;
+    else if (uhp->uh_ufoff >= 0
+	       && u_read_ufentries(buf, uhp->uh_ufoff, &spilled) == FAIL)
+	return FAIL;
+    for (uep = spilled != NULL ? spilled : uhp->uh_entry; uep != NULL;
+							  uep = uep->ue_next)
+    {
+	put_bytes(fp, (long_u)(uep->ue_packed != NULL
+			       ? UF_ENTRY_PACKED_MAGIC : UF_ENTRY_MAGIC), 2);
+	if (serialize_uep(fp, buf, uep) == FAIL)
+	{
+	    retval = FAIL;
+	    break;
+	}
+    }
+    while (spilled != NULL)
+    {
+	uep = spilled;
+	spilled = uep->ue_next;
+	u_freeentry(uep, uep->ue_size);
+    }
+    if (retval == OK)
+	put_bytes(fp, (long_u)UF_ENTRY_END_MAGIC, 2);
+    return retval;
 }
 
+/*
+ * Read an undo header.  Its entries are read with "buf" for decrypting.
+ * When "lazy" is TRUE they are left in the file, their offset is stored in
+ * uh_ufoff.
+ */
     static u_header_T *
-unserialize_uhp(fp, file_name)
+unserialize_uhp(fp, buf, lazy, file_name)
     FILE	*fp;
+    buf_T	*buf;
+    int		lazy;
     char_u	*file_name;
 {
     u_header_T	*uhp;
     int		i;
-    u_entry_T	*uep, *last_uep;
-    int		c;
-    int		error;
 
     uhp = (u_header_T *)U_ALLOC_LINE(sizeof(u_header_T));
     if (uhp == NULL)
@@ -1040,6 +1197,8 @@ unserialize_uhp(fp, file_name)
 #ifdef U_DEBUG
     uhp->uh_magic = UH_MAGIC;
 #endif
+    uhp->uh_spill = -1;
+    uhp->uh_ufoff = -1;
     uhp->uh_next.seq = get4c(fp);
     uhp->uh_prev.seq = get4c(fp);
     uhp->uh_alt_next.seq = get4c(fp);
@@ -1091,31 +1250,57 @@ unserialize_uhp(fp, file_name)
 	}
     }
 
-    /* Unserialize the uep list. */
+    if (lazy)
+	uhp->uh_ufoff = ftell(fp);
+    else if (unserialize_entries(fp, buf, &uhp->uh_entry, file_name) == FAIL)
+    {
+	vim_free(uhp);
+	return NULL;
+    }
+    return uhp;
+}
+
+/*
+ * Read the list of entries of a header into "*list".
+ */
+    static int
+unserialize_entries(fp, buf, list, file_name)
+    FILE	*fp;
+    buf_T	*buf;
+    u_entry_T	**list;
+    char_u	*file_name;
+{
+    u_entry_T	*uep, *last_uep;
+    int		c;
+    int		error;
+
+    *list = NULL;
     last_uep = NULL;
-    while ((c = get2c(fp)) == UF_ENTRY_MAGIC)
+    while ((c = get2c(fp)) == UF_ENTRY_MAGIC || c == UF_ENTRY_PACKED_MAGIC)
     {
 	error = FALSE;
-	uep = unserialize_uep(fp, &error, file_name);
+	uep = unserialize_uep(fp, buf, c == UF_ENTRY_PACKED_MAGIC, &error,
+								   file_name);
 	if (last_uep == NULL)
-	    uhp->uh_entry = uep;
+	    *list = uep;
 	else
 	    last_uep->ue_next = uep;
 	last_uep = uep;
 	if (uep == NULL || error)
-	{
-	    u_free_uhp(uhp);
-	    return NULL;
-	}
+	    goto error;
     }
-    if (c != UF_ENTRY_END_MAGIC)
+    if (c == UF_ENTRY_END_MAGIC)
+	return OK;
+    corruption_error("entry end", file_name);
+
+error:
+    while (*list != NULL)
     {
-	corruption_error("entry end", file_name);
-	u_free_uhp(uhp);
-	return NULL;
+	uep = *list;
+	*list = uep->ue_next;
+	u_freeentry(uep, uep->ue_size);
     }
-
-    return uhp;
+    return FAIL;
 }
 
 /*
@@ -1134,6 +1319,17 @@ serialize_uep(fp, buf, uep)
     put_bytes(fp, (long_u)uep->ue_bot, 4);
     put_bytes(fp, (long_u)uep->ue_lcount, 4);
     put_bytes(fp, (long_u)uep->ue_size, 4);
+    if (uep->ue_packed != NULL)
+    {
+	/* The packed block as a whole, it only makes sense with the buffer
+	 * text, which the hash makes sure of. */
+	len = u_packed_len(uep->ue_packed, uep->ue_size);
+	if (put_bytes(fp, (long_u)len, 4) == FAIL)
+	    return FAIL;
+	if (fwrite_crypt(buf, uep->ue_packed, len, fp) != 1)
+	    return FAIL;
+	return OK;
+    }
     for (i = 0; i < uep->ue_size; ++i)
     {
 	len = STRLEN(uep->ue_array[i]);
@@ -1146,8 +1342,10 @@ serialize_uep(fp, buf, uep)
 }
 
     static u_entry_T *
-unserialize_uep(fp, error, file_name)
+unserialize_uep(fp, buf, packed, error, file_name)
     FILE	*fp;
+    buf_T	*buf;	    /* for decrypting, NULL when not encrypted */
+    int		packed;	    /* entry was written as a packed block */
     int		*error;
     char_u	*file_name;
 {
@@ -1168,6 +1366,20 @@ unserialize_uep(fp, error, file_name)
     uep->ue_bot = get4c(fp);
     uep->ue_lcount = get4c(fp);
     uep->ue_size = get4c(fp);
+    if (packed)
+    {
+	line_len = get4c(fp);
+	if (line_len >= 0)
+	    uep->ue_packed = read_string_decrypt(buf, fp, line_len);
+	if (uep->ue_packed == NULL || u_packed_check(uep->ue_packed,
+				 (long_u)line_len, uep->ue_size) == FAIL)
+	{
+	    if (line_len < 0 || uep->ue_packed != NULL)
+		corruption_error("packed entry", file_name);
+	    *error = TRUE;
+	}
+	return uep;
+    }
     if (uep->ue_size > 0)
     {
 	array = (char_u **)U_ALLOC_LINE(sizeof(char_u *) * uep->ue_size);
@@ -1186,7 +1398,7 @@ unserialize_uep(fp, error, file_name)
     {
 	line_len = get4c(fp);
 	if (line_len >= 0)
-	    line = read_string_decrypt(curbuf, fp, line_len);
+	    line = read_string_decrypt(buf, fp, line_len);
 	else
 	{
 	    line = NULL;
@@ -1283,95 +1495,552 @@ put_header_ptr(fp, uhp)
 }
 
 /*
- * Write the undo tree in an undo file.
- * When "name" is not NULL, use it as the name of the undo file.
- * Otherwise use buf->b_ffname to generate the undo file name.
- * "buf" must never be null, buf->b_ffname is used to obtain the original file
- * permissions.
- * "forceit" is TRUE for ":wundo!", FALSE otherwise.
- * "hash[UNDO_HASH_SIZE]" must be the hash value of the buffer text.
+ * Fill in the length of a record in an appendable undo file.  The length is
+ * at "lenpos", the record ends at the current position.
+ * Returns the size of the record, including magic and length, -1 when
+ * failing.
  */
-    void
-u_write_undo(name, forceit, buf, hash)
-    char_u	*name;
-    int		forceit;
-    buf_T	*buf;
-    char_u	*hash;
+    static long
+u_log_end_record(fp, lenpos)
+    FILE	*fp;
+    long	lenpos;
 {
+    long	end = ftell(fp);
+
+    if (end < 0 || fseek(fp, lenpos, SEEK_SET) != 0
+	    || put_bytes(fp, (long_u)(end - lenpos - 4), 4) == FAIL
+	    || fseek(fp, end, SEEK_SET) != 0)
+	return -1;
+    return end - lenpos + 2;
+}
+
+/*
+ * Write a record for header "uhp" to appendable undo file "fp".
+ * When "append" is TRUE nothing is written for a header that did not change
+ * since it was written, and only its links, flags and save number when only
+ * those changed.
+ * When "track" is TRUE "fp" is the undo file that is appended to later.
+ */
+    static int
+u_log_uhp(fp, buf, uhp, append, track)
+    FILE	*fp;
+    buf_T	*buf;
     u_header_T	*uhp;
-    char_u	*file_name;
-    int		mark;
-#ifdef U_DEBUG
-    int		headers_written = 0;
+    int		append;
+    int		track;
+{
+    long	lenpos;
+    long	size;
+
+    if (append && uhp->uh_ufsize > 0)
+    {
+	if (!uhp->uh_ufmeta)
+	    return OK;
+	put_bytes(fp, (long_u)UF_META_MAGIC, 2);
+	put_bytes(fp, (long_u)UF_META_LEN, 4);
+	put_bytes(fp, (long_u)uhp->uh_seq, 4);
+	put_header_ptr(fp, uhp->uh_next.ptr);
+	put_header_ptr(fp, uhp->uh_prev.ptr);
+	put_header_ptr(fp, uhp->uh_alt_next.ptr);
+	put_header_ptr(fp, uhp->uh_alt_prev.ptr);
+	put_bytes(fp, (long_u)uhp->uh_flags, 2);
+	if (put_bytes(fp, (long_u)uhp->uh_save_nr, 4) == FAIL)
+	    return FAIL;
+	uhp->uh_ufmeta = FALSE;
+	return OK;
+    }
+
+    lenpos = ftell(fp) + 2;
+    if (lenpos < 2
+	    || put_bytes(fp, (long_u)UF_HEADER_MAGIC, 2) == FAIL
+	    || put_bytes(fp, (long_u)0, 4) == FAIL
+	    || serialize_uhp(fp, uhp) == FAIL
+	    || serialize_entries(fp, buf, uhp) == FAIL
+	    || (size = u_log_end_record(fp, lenpos)) < 0)
+	return FAIL;
+    if (track)
+    {
+	buf->b_u_uf_live += size;
+	uhp->uh_ufsize = size;
+	uhp->uh_ufmeta = FALSE;
+    }
+    return OK;
+}
+
+/*
+ * A header record or links record found by u_log_read().
+ */
+typedef struct
+{
+    long	ur_seq;
+    long	ur_off;		/* offset of the record */
+    long	ur_size;	/* size of a header record, zero for links */
+    long	ur_link[4];	/* next, prev, alt_next and alt_prev seq */
+    int		ur_flags;	/* uh_flags from a links record or -1 */
+    long	ur_save_nr;	/* uh_save_nr from a links record or -1 */
+    int		ur_used;	/* header is in the undo tree */
+} u_logrec_T;
+
+static int
+#ifdef __BORLANDC__
+_RTLENTRYF
 #endif
-    int		fd;
-    FILE	*fp = NULL;
-    int		perm;
-    int		write_ok = FALSE;
-#ifdef UNIX
-    int		st_old_valid = FALSE;
-    struct stat	st_old;
-    struct stat	st_new;
+u_logrec_compare __ARGS((const void *s1, const void *s2));
+
+/*
+ * Sort records on sequence number, then on the order they were written.
+ */
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
 #endif
-#ifdef FEAT_CRYPT
-    int		do_crypt = FALSE;
+u_logrec_compare(s1, s2)
+    const void	*s1;
+    const void	*s2;
+{
+    u_logrec_T	*r1 = (u_logrec_T *)s1;
+    u_logrec_T	*r2 = (u_logrec_T *)s2;
+
+    if (r1->ur_seq != r2->ur_seq)
+	return r1->ur_seq < r2->ur_seq ? -1 : 1;
+    return r1->ur_off < r2->ur_off ? -1 : r1->ur_off > r2->ur_off;
+}
+
+/* Get a 2 or 4 byte number from memory, MSB first. */
+# define U_MEM2(p) (((int)(p)[0] << 8) + (int)(p)[1])
+# define U_MEM4(p) (((long)(p)[0] << 24) + ((long)(p)[1] << 16) \
+				       + ((long)(p)[2] << 8) + (long)(p)[3])
+
+/*
+ * Read the headers of appendable undo file "fp" into "uhp_table", which has
+ * room for "num_head" headers.  "end" is the offset of the state record,
+ * records after it are not used.  For each header the last written record is
+ * used, the links of a header record can be updated by a later links record.
+ * The headers that can be reached from "head_seqs", the sequence numbers of
+ * the old, new and current header, are the ones in the undo tree.
+ * The records are found by jumping over them, with mmap() when possible.
+ * Only the headers in use are read.  When "lazy" is TRUE their entries are
+ * read later.
+ * "*num_read" is incremented for every header stored in "uhp_table".
+ */
+    static int
+u_log_read(fp, end, uhp_table, num_head, head_seqs, lazy, track, num_read,
+								    file_name)
+    FILE	*fp;
+    long	end;
+    u_header_T	**uhp_table;
+    int		num_head;
+    long	*head_seqs;
+    int		lazy;
+    int		track;
+    long	*num_read;
+    char_u	*file_name;
+{
+    garray_T	ga;
+    u_logrec_T	*recs;
+    u_logrec_T	*rec;
+    char_u	rbuf[UF_META_LEN + 6];
+    char_u	*p;
+    char_u	*map = NULL;
+    long	off;
+    long	len;
+    int		magic;
+    long	seq;
+    int		n = 0;
+    int		i;
+    int		k;
+    int		lo, hi;
+    int		*stack = NULL;
+    int		sp = 0;
+    int		used = 0;
+    u_header_T	*uhp;
+    char	*mesg = NULL;
+    int		retval = FAIL;
+
+    ga_init2(&ga, (int)sizeof(u_logrec_T), 100);
+#ifdef FEAT_MMAP
+    map = (char_u *)mmap(NULL, (size_t)end, PROT_READ, MAP_PRIVATE,
+						       fileno(fp), (off_t)0);
+    if (map == (char_u *)MAP_FAILED)
+	map = NULL;
 #endif
 
-    if (name == NULL)
+    /* Collect the header and links records, jumping from record to record
+     * using the length. */
+    for (off = UF_LOG_START; off < end; off += len + 6)
     {
-	file_name = u_get_undo_file_name(buf->b_ffname, FALSE);
-	if (file_name == NULL)
+	len = end - off < UF_META_LEN + 6 ? end - off : UF_META_LEN + 6;
+	if (len < 6)
+	    break;
+	if (map != NULL)
+	    p = map + off;
+	else
 	{
-	    if (p_verbose > 0)
-	    {
-		verbose_enter();
-		smsg((char_u *)
-		   _("Cannot write undo file in any directory in 'undodir'"));
-		verbose_leave();
-	    }
-	    return;
+	    if (fseek(fp, off, SEEK_SET) != 0
+				   || fread(rbuf, (size_t)len, (size_t)1, fp) != 1)
+		break;
+	    p = rbuf;
+	}
+	magic = U_MEM2(p);
+	len = U_MEM4(p + 2);
+	if (len < 0 || len > end - off - 6)
+	    break;
+	if (magic == UF_STATE_MAGIC)
+	    continue;
+	if (!(magic == UF_HEADER_MAGIC && len > 20)
+			     && !(magic == UF_META_MAGIC && len == UF_META_LEN))
+	    break;
+	if (ga_grow(&ga, 1) == FAIL)
+	    goto theend;
+	rec = (u_logrec_T *)ga.ga_data + ga.ga_len++;
+	rec->ur_off = off;
+	rec->ur_used = FALSE;
+	p += 6;
+	if (magic == UF_HEADER_MAGIC)
+	{
+	    rec->ur_size = len + 6;
+	    rec->ur_seq = U_MEM4(p + 16);
+	    rec->ur_flags = -1;
+	    rec->ur_save_nr = -1;
 	}
+	else
+	{
+	    rec->ur_size = 0;
+	    rec->ur_seq = U_MEM4(p);
+	    rec->ur_flags = U_MEM2(p + 20);
+	    rec->ur_save_nr = U_MEM4(p + 22);
+	    p += 4;
+	}
+	for (k = 0; k < 4; ++k)
+	    rec->ur_link[k] = U_MEM4(p + k * 4);
+    }
+    if (off != end)
+    {
+	mesg = "record";
+	goto theend;
     }
-    else
-	file_name = name;
 
-    /*
-     * Decide about the permission to use for the undo file.  If the buffer
-     * has a name use the permission of the original file.  Otherwise only
-     * allow the user to access the undo file.
-     */
-    perm = 0600;
-    if (buf->b_ffname != NULL)
+    /* Keep the last header record for each sequence number, with the links
+     * of the links records written after it. */
+    recs = (u_logrec_T *)ga.ga_data;
+    if (ga.ga_len > 0)
+	qsort((void *)recs, (size_t)ga.ga_len, sizeof(u_logrec_T),
+							     u_logrec_compare);
+    for (i = 0; i < ga.ga_len; ++i)
     {
-#ifdef UNIX
-	if (mch_stat((char *)buf->b_ffname, &st_old) >= 0)
+	rec = &recs[i];
+	if (rec->ur_size > 0)
 	{
-	    perm = st_old.st_mode;
-	    st_old_valid = TRUE;
+	    if (n == 0 || recs[n - 1].ur_seq != rec->ur_seq)
+		++n;
+	    recs[n - 1] = *rec;
+	}
+	else if (n > 0 && recs[n - 1].ur_seq == rec->ur_seq)
+	{
+	    for (k = 0; k < 4; ++k)
+		recs[n - 1].ur_link[k] = rec->ur_link[k];
+	    recs[n - 1].ur_flags = rec->ur_flags;
+	    recs[n - 1].ur_save_nr = rec->ur_save_nr;
+	}
+	else
+	{
+	    mesg = "links record";
+	    goto theend;
 	}
-#else
-	perm = mch_getperm(buf->b_ffname);
-	if (perm < 0)
-	    perm = 0600;
-#endif
     }
 
-    /* strip any s-bit */
-    perm = perm & 0777;
-
-    /* If the undo file already exists, verify that it actually is an undo
-     * file, and delete it. */
-    if (mch_getperm(file_name) >= 0)
+    /* Find the headers in the undo tree: start at the old, new and current
+     * header and follow the links.  Records of freed headers are not
+     * reached. */
+    if (n > 0)
     {
-	if (name == NULL || !forceit)
+	stack = (int *)U_ALLOC_LINE(sizeof(int) * n);
+	if (stack == NULL)
+	    goto theend;
+    }
+    for (rec = NULL; ; rec = &recs[stack[--sp]])
+    {
+	for (k = 0; k < 4; ++k)
 	{
-	    /* Check we can read it and it's an undo file. */
-	    fd = mch_open((char *)file_name, O_RDONLY|O_EXTRA, 0);
-	    if (fd < 0)
+	    seq = rec == NULL ? (k < 3 ? head_seqs[k] : 0) : rec->ur_link[k];
+	    if (seq <= 0)
+		continue;
+	    lo = 0;
+	    hi = n;
+	    while (lo < hi)
 	    {
-		if (name != NULL || p_verbose > 0)
-		{
-		    if (name == NULL)
+		i = (lo + hi) / 2;
+		if (recs[i].ur_seq < seq)
+		    lo = i + 1;
+		else
+		    hi = i;
+	    }
+	    if (lo == n || recs[lo].ur_seq != seq)
+	    {
+		mesg = "missing header";
+		goto theend;
+	    }
+	    if (!recs[lo].ur_used)
+	    {
+		recs[lo].ur_used = TRUE;
+		++used;
+		stack[sp++] = lo;
+	    }
+	}
+	if (sp == 0)
+	    break;
+    }
+    if (used != num_head)
+    {
+	mesg = "num_head";
+	goto theend;
+    }
+
+    /* Read the headers in use, in sequence number order. */
+    for (i = 0; i < n; ++i)
+    {
+	if (!recs[i].ur_used)
+	    continue;
+	if (fseek(fp, recs[i].ur_off + 6, SEEK_SET) != 0)
+	{
+	    mesg = "header";
+	    goto theend;
+	}
+	uhp = unserialize_uhp(fp, NULL, lazy, file_name);
+	if (uhp == NULL)
+	    goto theend;
+	uhp_table[(*num_read)++] = uhp;
+	uhp->uh_next.seq = recs[i].ur_link[0];
+	uhp->uh_prev.seq = recs[i].ur_link[1];
+	uhp->uh_alt_next.seq = recs[i].ur_link[2];
+	uhp->uh_alt_prev.seq = recs[i].ur_link[3];
+	if (recs[i].ur_flags >= 0)
+	    uhp->uh_flags = recs[i].ur_flags;
+	if (recs[i].ur_save_nr >= 0)
+	    uhp->uh_save_nr = recs[i].ur_save_nr;
+	if (track)
+	    uhp->uh_ufsize = recs[i].ur_size;
+	if (uhp->uh_seq != recs[i].ur_seq)
+	{
+	    mesg = "uh_seq";
+	    goto theend;
+	}
+    }
+    retval = OK;
+
+theend:
+    if (mesg != NULL)
+	corruption_error(mesg, file_name);
+#ifdef FEAT_MMAP
+    if (map != NULL)
+	munmap((char *)map, (size_t)end);
+#endif
+    vim_free(stack);
+    ga_clear(&ga);
+    return retval;
+}
+
+/*
+ * Read the entries at offset "off" in the undo file that "buf" was read from
+ * into "*list".
+ */
+    static int
+u_read_ufentries(buf, off, list)
+    buf_T	*buf;
+    long	off;
+    u_entry_T	**list;
+{
+    if (buf->b_u_ufp == NULL || fseek(buf->b_u_ufp, off, SEEK_SET) != 0)
+    {
+	corruption_error("entries", buf->b_u_uf_fname);
+	return FAIL;
+    }
+    return unserialize_entries(buf->b_u_ufp, NULL, list, buf->b_u_uf_fname);
+}
+
+static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+uhp_compare __ARGS((const void *s1, const void *s2));
+
+/*
+ * Sort undo headers on sequence number.
+ */
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+uhp_compare(s1, s2)
+    const void	*s1;
+    const void	*s2;
+{
+    long	seq1 = (*(u_header_T **)s1)->uh_seq;
+    long	seq2 = (*(u_header_T **)s2)->uh_seq;
+
+    return seq1 < seq2 ? -1 : seq1 > seq2;
+}
+
+/*
+ * Find the header with sequence number "seq" in the sorted "uhp_table".
+ * Returns its index, -1 when not found.
+ */
+    static int
+uhp_table_find(uhp_table, num_head, seq)
+    u_header_T	**uhp_table;
+    long	num_head;
+    long	seq;
+{
+    long	lo = 0;
+    long	hi = num_head;
+    long	i;
+
+    if (seq <= 0)
+	return -1;
+    while (lo < hi)
+    {
+	i = (lo + hi) / 2;
+	if (uhp_table[i]->uh_seq < seq)
+	    lo = i + 1;
+	else
+	    hi = i;
+    }
+    if (lo < num_head && uhp_table[lo]->uh_seq == seq)
+	return (int)lo;
+    return -1;
+}
+
+/*
+ * Write the undo tree in an undo file.
+ * When "name" is not NULL, use it as the name of the undo file.
+ * Otherwise use buf->b_ffname to generate the undo file name.
+ * "buf" must never be null, buf->b_ffname is used to obtain the original file
+ * permissions.
+ * "forceit" is TRUE for ":wundo!", FALSE otherwise.
+ * "hash[UNDO_HASH_SIZE]" must be the hash value of the buffer text.
+ */
+    void
+u_write_undo(name, forceit, buf, hash)
+    char_u	*name;
+    int		forceit;
+    buf_T	*buf;
+    char_u	*hash;
+{
+    u_header_T	*uhp;
+    char_u	*file_name;
+    int		mark;
+#ifdef U_DEBUG
+    int		headers_written = 0;
+#endif
+    int		fd;
+    FILE	*fp = NULL;
+    int		perm;
+    int		write_ok = FALSE;
+    int		log = TRUE;	/* write an appendable undo file */
+    int		append = FALSE;	/* append to the existing undo file */
+    int		track;		/* remember the file for appending */
+    long	state_off;
+    struct stat	st_uf;
+#ifdef UNIX
+    int		st_old_valid = FALSE;
+    struct stat	st_old;
+    struct stat	st_new;
+#endif
+#ifdef FEAT_CRYPT
+    int		do_crypt = FALSE;
+#endif
+
+    if (name == NULL)
+    {
+	file_name = u_get_undo_file_name(buf->b_ffname, FALSE);
+	if (file_name == NULL)
+	{
+	    if (p_verbose > 0)
+	    {
+		verbose_enter();
+		smsg((char_u *)
+		   _("Cannot write undo file in any directory in 'undodir'"));
+		verbose_leave();
+	    }
+	    return;
+	}
+    }
+    else
+	file_name = name;
+
+#ifdef FEAT_CRYPT
+    /* The encrypted format is always written as a whole. */
+    if (*buf->b_p_key != NUL)
+	log = FALSE;
+#endif
+    track = log && name == NULL;
+
+    /* When the undo file is still the one written or read before and not
+     * too much of it is unused, only append what changed. */
+    if (track && buf->b_u_uf_fname != NULL && buf->b_u_uf_size >= 0
+	    && fnamecmp(file_name, buf->b_u_uf_fname) == 0
+	    && (buf->b_u_numhead > 0 || buf->b_u_line_ptr != NULL)
+	    && buf->b_u_uf_size <= buf->b_u_uf_live * 2 + UF_LOG_SLACK
+	    && mch_stat((char *)file_name, &st_uf) >= 0
+	    && (long)st_uf.st_size == buf->b_u_uf_size
+	    && st_uf.st_mtime == buf->b_u_uf_mtime)
+    {
+	fp = mch_fopen((char *)file_name, "r+b");
+	if (fp != NULL && fseek(fp, 0L, SEEK_END) == 0)
+	{
+	    append = TRUE;
+	    if (p_verbose > 0)
+	    {
+		verbose_enter();
+		smsg((char_u *)_("Appending to undo file: %s"), file_name);
+		verbose_leave();
+	    }
+	    goto write_undo;
+	}
+	if (fp != NULL)
+	    fclose(fp);
+	fp = NULL;
+    }
+    if (name == NULL)
+	buf->b_u_uf_size = -1;
+
+    /*
+     * Decide about the permission to use for the undo file.  If the buffer
+     * has a name use the permission of the original file.  Otherwise only
+     * allow the user to access the undo file.
+     */
+    perm = 0600;
+    if (buf->b_ffname != NULL)
+    {
+#ifdef UNIX
+	if (mch_stat((char *)buf->b_ffname, &st_old) >= 0)
+	{
+	    perm = st_old.st_mode;
+	    st_old_valid = TRUE;
+	}
+#else
+	perm = mch_getperm(buf->b_ffname);
+	if (perm < 0)
+	    perm = 0600;
+#endif
+    }
+
+    /* strip any s-bit */
+    perm = perm & 0777;
+
+    /* If the undo file already exists, verify that it actually is an undo
+     * file, and delete it. */
+    if (mch_getperm(file_name) >= 0)
+    {
+	if (name == NULL || !forceit)
+	{
+	    /* Check we can read it and it's an undo file. */
+	    fd = mch_open((char *)file_name, O_RDONLY|O_EXTRA, 0);
+	    if (fd < 0)
+	    {
+		if (name != NULL || p_verbose > 0)
+		{
+		    if (name == NULL)
 			verbose_enter();
 		    smsg((char_u *)
 		      _("Will not overwrite with undo file, cannot read: %s"),
@@ -1466,13 +2135,25 @@ u_write_undo(name, forceit, buf, hash)
 	goto theend;
     }
 
+write_undo:
     /* Undo must be synced. */
     u_sync(TRUE);
 
     /*
-     * Write the header.
+     * Write the header.  For an appendable file the state record comes
+     * last, the header only has its offset.
      */
-    if (serialize_header(fp, buf, hash) == FAIL)
+    if (log)
+    {
+	if (!append && (fwrite(UF_START_MAGIC, (size_t)UF_START_MAGIC_LEN,
+							  (size_t)1, fp) != 1
+		    || put_bytes(fp, (long_u)UF_VERSION_LOG, 2) == FAIL
+		    || put_bytes(fp, (long_u)0, 4) == FAIL))
+	    goto write_error;
+	if (track && !append)
+	    buf->b_u_uf_live = 0;
+    }
+    else if (serialize_header(fp, buf, hash) == FAIL)
 	goto write_error;
 #ifdef FEAT_CRYPT
     if (*buf->b_p_key != NUL)
@@ -1493,7 +2174,14 @@ u_write_undo(name, forceit, buf, hash)
 #ifdef U_DEBUG
 	    ++headers_written;
 #endif
-	    if (serialize_uhp(fp, buf, uhp) == FAIL)
+	    if (log)
+	    {
+		if (u_log_uhp(fp, buf, uhp, append, track) == FAIL)
+		    goto write_error;
+	    }
+	    else if (put_bytes(fp, (long_u)UF_HEADER_MAGIC, 2) == FAIL
+		    || serialize_uhp(fp, uhp) == FAIL
+		    || serialize_entries(fp, buf, uhp) == FAIL)
 		goto write_error;
 	}
 
@@ -1512,7 +2200,22 @@ u_write_undo(name, forceit, buf, hash)
 	    uhp = uhp->uh_next.ptr;
     }
 
-    if (put_bytes(fp, (long_u)UF_HEADER_END_MAGIC, 2) == OK)
+    if (log)
+    {
+	/* Write the state record, after flushing everything else point the
+	 * header to it. */
+	state_off = ftell(fp);
+	if (state_off >= 0
+		&& put_bytes(fp, (long_u)UF_STATE_MAGIC, 2) == OK
+		&& put_bytes(fp, (long_u)0, 4) == OK
+		&& serialize_state(fp, buf, hash) == OK
+		&& u_log_end_record(fp, state_off + 2) >= 0
+		&& fflush(fp) == 0
+		&& fseek(fp, (long)UF_LOG_STATE_OFF, SEEK_SET) == 0
+		&& put_bytes(fp, (long_u)state_off, 4) == OK)
+	    write_ok = TRUE;
+    }
+    else if (put_bytes(fp, (long_u)UF_HEADER_END_MAGIC, 2) == OK)
 	write_ok = TRUE;
 #ifdef U_DEBUG
     if (headers_written != buf->b_u_numhead)
@@ -1521,10 +2224,31 @@ u_write_undo(name, forceit, buf, hash)
 #endif
 
 write_error:
-    fclose(fp);
+    if (fclose(fp) != 0)
+	write_ok = FALSE;
     if (!write_ok)
 	EMSG2(_("E829: write error in undo file: %s"), file_name);
 
+    /* Remember the size and time of the file, it can be appended to when
+     * it didn't change. */
+    if (track)
+    {
+	if (write_ok && mch_stat((char *)file_name, &st_uf) >= 0)
+	{
+	    if (!append)
+	    {
+		vim_free(buf->b_u_uf_fname);
+		buf->b_u_uf_fname = vim_strsave(file_name);
+	    }
+	    buf->b_u_uf_size = (long)st_uf.st_size;
+	    buf->b_u_uf_mtime = st_uf.st_mtime;
+	}
+	else
+	    buf->b_u_uf_size = -1;
+    }
+    if (append)
+	goto theend;
+
 #if defined(MACOS_CLASSIC) || defined(WIN3264)
     /* Copy file attributes; for systems where this can only be done after
      * closing the file. */
@@ -1556,12 +2280,12 @@ theend:
  * If "name" is not NULL use it as the undo file name.  This also means being
  * a bit more verbose.
  * Otherwise use curbuf->b_ffname to generate the undo file name.
- * "hash[UNDO_HASH_SIZE]" must be the hash value of the buffer text.
+ * The hash of the buffer text is only computed when the undo file was found
+ * and looks valid.
  */
     void
-u_read_undo(name, hash, orig_name)
+u_read_undo(name, orig_name)
     char_u *name;
-    char_u *hash;
     char_u *orig_name;
 {
     char_u	*file_name;
@@ -1573,17 +2297,26 @@ u_read_undo(name, hash, orig_name)
     linenr_T	line_count;
     int		num_head = 0;
     long	old_header_seq, new_header_seq, cur_header_seq;
+    long	head_seqs[3];
     long	seq_last, seq_cur;
     long	last_save_nr = 0;
-    short	old_idx = -1, new_idx = -1, cur_idx = -1;
+    int		old_idx = -1, new_idx = -1, cur_idx = -1;
     long	num_read_uhps = 0;
     time_t	seq_time;
     int		i, j;
     int		c;
     u_header_T	*uhp;
     u_header_T	**uhp_table = NULL;
+    u_entry_T	*uep;
+    char_u	hash[UNDO_HASH_SIZE];
     char_u	read_hash[UNDO_HASH_SIZE];
+    int		hash_kind = 0;
     char_u	magic_buf[UF_START_MAGIC_LEN];
+    int		log = FALSE;	/* appendable undo file */
+    int		lazy = FALSE;	/* leave entries in the file */
+    long	state_off = 0;
+    long	state_end = 0;
+    struct stat	st_uf;
 #ifdef U_DEBUG
     int		*uhp_table_used;
 #endif
@@ -1647,7 +2380,7 @@ u_read_undo(name, hash, orig_name)
 	goto error;
     }
     version = get2c(fp);
-    if (version == UF_VERSION_CRYPT)
+    if (version == UF_VERSION_CRYPT || version == UF_VERSION_PREV_CRYPT)
     {
 #ifdef FEAT_CRYPT
 	if (*curbuf->b_p_key == NUL)
@@ -1667,7 +2400,25 @@ u_read_undo(name, hash, orig_name)
 	goto error;
 #endif
     }
-    else if (version != UF_VERSION)
+    else if (version == UF_VERSION_LOG)
+    {
+	/* The state follows the last written headers. */
+	log = TRUE;
+	state_off = get4c(fp);
+	if (state_off < UF_LOG_START || fseek(fp, state_off, SEEK_SET) != 0
+					       || get2c(fp) != UF_STATE_MAGIC)
+	{
+	    corruption_error("state", file_name);
+	    goto error;
+	}
+	state_end = state_off + 6 + get4c(fp);
+#ifdef UNIX
+	/* The file can be kept open while it is replaced, read the entries
+	 * only when they are needed. */
+	lazy = name == NULL;
+#endif
+    }
+    else if (version != UF_VERSION && version != UF_VERSION_PREV)
     {
 	EMSG2(_("E824: Incompatible undo file: %s"), file_name);
 	goto error;
@@ -1679,20 +2430,6 @@ u_read_undo(name, hash, orig_name)
 	goto error;
     }
     line_count = (linenr_T)get4c(fp);
-    if (memcmp(hash, read_hash, UNDO_HASH_SIZE) != 0
-				  || line_count != curbuf->b_ml.ml_line_count)
-    {
-	if (p_verbose > 0 || name != NULL)
-	{
-	    if (name == NULL)
-		verbose_enter();
-	    give_warning((char_u *)
-		      _("File contents changed, cannot use undo info"), TRUE);
-	    if (name == NULL)
-		verbose_leave();
-	}
-	goto error;
-    }
 
     /* Read undo data for "U" command. */
     str_len = get4c(fp);
@@ -1731,12 +2468,52 @@ u_read_undo(name, hash, orig_name)
 	    case UF_LAST_SAVE_NR:
 		last_save_nr = get4c(fp);
 		break;
+	    case UF_HASH_KIND:
+		hash_kind = getc(fp);
+		while (--len > 0)
+		    (void)getc(fp);
+		break;
 	    default:
 		/* field not supported, skip */
 		while (--len >= 0)
 		    (void)getc(fp);
 	}
     }
+    if (log && ftell(fp) != state_end)
+    {
+	corruption_error("state", file_name);
+	goto error;
+    }
+
+    /* Now that the undo file looks usable check that it belongs to the
+     * text.  Files without UF_HASH_KIND have a SHA-256 hash, for ":wundo"
+     * it did not include the last line. */
+    if (line_count == curbuf->b_ml.ml_line_count)
+    {
+	if (hash_kind == UF_HASH_TEXT_SUM)
+	{
+	    if (u_compute_hash(curbuf, hash) == FAIL)
+		goto error;
+	}
+	else if (hash_kind == 0)
+	    u_compute_sha256(curbuf,
+			  name == NULL ? line_count : line_count - 1, hash);
+    }
+    if (line_count != curbuf->b_ml.ml_line_count
+	    || (hash_kind != 0 && hash_kind != UF_HASH_TEXT_SUM)
+	    || memcmp(hash, read_hash, UNDO_HASH_SIZE) != 0)
+    {
+	if (p_verbose > 0 || name != NULL)
+	{
+	    if (name == NULL)
+		verbose_enter();
+	    give_warning((char_u *)
+		      _("File contents changed, cannot use undo info"), TRUE);
+	    if (name == NULL)
+		verbose_leave();
+	}
+	goto error;
+    }
 
     /* uhp_table will store the freshly created undo headers we allocate
      * until we insert them into curbuf. The table remains sorted by the
@@ -1750,7 +2527,14 @@ u_read_undo(name, hash, orig_name)
 	    goto error;
     }
 
-    while ((c = get2c(fp)) == UF_HEADER_MAGIC)
+    head_seqs[0] = old_header_seq;
+    head_seqs[1] = new_header_seq;
+    head_seqs[2] = cur_header_seq;
+    if (log && u_log_read(fp, state_off, uhp_table, num_head, head_seqs,
+		       lazy, name == NULL, &num_read_uhps, file_name) == FAIL)
+	goto error;
+
+    while (!log && (c = get2c(fp)) == UF_HEADER_MAGIC)
     {
 	if (num_read_uhps >= num_head)
 	{
@@ -1758,7 +2542,7 @@ u_read_undo(name, hash, orig_name)
 	    goto error;
 	}
 
-	uhp = unserialize_uhp(fp, file_name);
+	uhp = unserialize_uhp(fp, curbuf, FALSE, file_name);
 	if (uhp == NULL)
 	    goto error;
 	uhp_table[num_read_uhps++] = uhp;
@@ -1769,7 +2553,7 @@ u_read_undo(name, hash, orig_name)
 	corruption_error("num_head", file_name);
 	goto error;
     }
-    if (c != UF_HEADER_END_MAGIC)
+    if (!log && c != UF_HEADER_END_MAGIC)
     {
 	corruption_error("end marker", file_name);
 	goto error;
@@ -1778,74 +2562,45 @@ u_read_undo(name, hash, orig_name)
 #ifdef U_DEBUG
     uhp_table_used = (int *)alloc_clear(
 				     (unsigned)(sizeof(int) * num_head + 1));
-# define SET_FLAG(j) ++uhp_table_used[j]
+# define SET_FLAG(j) ((j) >= 0 ? ++uhp_table_used[j] : 0)
 #else
 # define SET_FLAG(j)
 #endif
 
-    /* We have put all of the headers into a table. Now we iterate through the
-     * table and swizzle each sequence number we have stored in uh_*_seq into
-     * a pointer corresponding to the header with that sequence number. */
+    /* We have put all of the headers into a table.  Sort it on sequence
+     * number, then iterate through the table and swizzle each sequence number
+     * we have stored in uh_*_seq into a pointer corresponding to the header
+     * with that sequence number. */
+    if (num_head > 0)
+	qsort((void *)uhp_table, (size_t)num_head, sizeof(u_header_T *),
+								 uhp_compare);
     for (i = 0; i < num_head; i++)
     {
 	uhp = uhp_table[i];
-	if (uhp == NULL)
-	    continue;
-	for (j = 0; j < num_head; j++)
-	    if (uhp_table[j] != NULL && i != j
-			      && uhp_table[i]->uh_seq == uhp_table[j]->uh_seq)
-	    {
-		corruption_error("duplicate uh_seq", file_name);
-		goto error;
-	    }
-	for (j = 0; j < num_head; j++)
-	    if (uhp_table[j] != NULL
-				  && uhp_table[j]->uh_seq == uhp->uh_next.seq)
-	    {
-		uhp->uh_next.ptr = uhp_table[j];
-		SET_FLAG(j);
-		break;
-	    }
-	for (j = 0; j < num_head; j++)
-	    if (uhp_table[j] != NULL
-				  && uhp_table[j]->uh_seq == uhp->uh_prev.seq)
-	    {
-		uhp->uh_prev.ptr = uhp_table[j];
-		SET_FLAG(j);
-		break;
-	    }
-	for (j = 0; j < num_head; j++)
-	    if (uhp_table[j] != NULL
-			      && uhp_table[j]->uh_seq == uhp->uh_alt_next.seq)
-	    {
-		uhp->uh_alt_next.ptr = uhp_table[j];
-		SET_FLAG(j);
-		break;
-	    }
-	for (j = 0; j < num_head; j++)
-	    if (uhp_table[j] != NULL
-			      && uhp_table[j]->uh_seq == uhp->uh_alt_prev.seq)
-	    {
-		uhp->uh_alt_prev.ptr = uhp_table[j];
-		SET_FLAG(j);
-		break;
-	    }
-	if (old_header_seq > 0 && old_idx < 0 && uhp->uh_seq == old_header_seq)
-	{
-	    old_idx = i;
-	    SET_FLAG(i);
-	}
-	if (new_header_seq > 0 && new_idx < 0 && uhp->uh_seq == new_header_seq)
+	if (i > 0 && uhp_table[i - 1]->uh_seq == uhp->uh_seq)
 	{
-	    new_idx = i;
-	    SET_FLAG(i);
-	}
-	if (cur_header_seq > 0 && cur_idx < 0 && uhp->uh_seq == cur_header_seq)
-	{
-	    cur_idx = i;
-	    SET_FLAG(i);
+	    corruption_error("duplicate uh_seq", file_name);
+	    goto error;
 	}
+	j = uhp_table_find(uhp_table, num_head, uhp->uh_next.seq);
+	uhp->uh_next.ptr = j < 0 ? NULL : uhp_table[j];
+	SET_FLAG(j);
+	j = uhp_table_find(uhp_table, num_head, uhp->uh_prev.seq);
+	uhp->uh_prev.ptr = j < 0 ? NULL : uhp_table[j];
+	SET_FLAG(j);
+	j = uhp_table_find(uhp_table, num_head, uhp->uh_alt_next.seq);
+	uhp->uh_alt_next.ptr = j < 0 ? NULL : uhp_table[j];
+	SET_FLAG(j);
+	j = uhp_table_find(uhp_table, num_head, uhp->uh_alt_prev.seq);
+	uhp->uh_alt_prev.ptr = j < 0 ? NULL : uhp_table[j];
+	SET_FLAG(j);
     }
+    old_idx = uhp_table_find(uhp_table, num_head, old_header_seq);
+    new_idx = uhp_table_find(uhp_table, num_head, new_header_seq);
+    cur_idx = uhp_table_find(uhp_table, num_head, cur_header_seq);
+    SET_FLAG(old_idx);
+    SET_FLAG(new_idx);
+    SET_FLAG(cur_idx);
 
     /* Now that we have read the undo info successfully, free the current undo
      * info and use the info from the file. */
@@ -1861,6 +2616,34 @@ u_read_undo(name, hash, orig_name)
     curbuf->b_u_seq_cur = seq_cur;
     curbuf->b_u_time_cur = seq_time;
     curbuf->b_u_save_nr_last = last_save_nr;
+    for (i = 0; i < num_head; ++i)
+    {
+	for (uep = uhp_table[i]->uh_entry; uep != NULL; uep = uep->ue_next)
+	    curbuf->b_u_mem += u_entry_mem(uep);
+	curbuf->b_u_uf_live += uhp_table[i]->uh_ufsize;
+    }
+    u_spill_old(curbuf);
+
+    if (lazy)
+    {
+	/* Keep the file open for reading the entries. */
+	curbuf->b_u_ufp = fp;
+	fp = NULL;
+    }
+    if (log && name == NULL)
+    {
+	/* The file can be appended to, unless something follows the state
+	 * record. */
+	curbuf->b_u_uf_fname = vim_strsave(file_name);
+	if (mch_stat((char *)file_name, &st_uf) >= 0
+				   && (long)st_uf.st_size == state_end)
+	{
+	    curbuf->b_u_uf_size = (long)st_uf.st_size;
+	    curbuf->b_u_uf_mtime = st_uf.st_mtime;
+	}
+	else
+	    curbuf->b_u_uf_size = -1;
+    }
 
     curbuf->b_u_synced = TRUE;
     vim_free(uhp_table);
@@ -2304,18 +3087,27 @@ undo_time(step, sec, file, absolute)
 		while (uhp->uh_alt_prev.ptr != NULL)
 		    uhp = uhp->uh_alt_prev.ptr;
 		if (last->uh_alt_next.ptr != NULL)
+		{
 		    last->uh_alt_next.ptr->uh_alt_prev.ptr =
 							last->uh_alt_prev.ptr;
+		    last->uh_alt_next.ptr->uh_ufmeta = TRUE;
+		}
 		last->uh_alt_prev.ptr->uh_alt_next.ptr = last->uh_alt_next.ptr;
+		last->uh_alt_prev.ptr->uh_ufmeta = TRUE;
 		last->uh_alt_prev.ptr = NULL;
 		last->uh_alt_next.ptr = uhp;
+		last->uh_ufmeta = TRUE;
 		uhp->uh_alt_prev.ptr = last;
+		uhp->uh_ufmeta = TRUE;
 
 		if (curbuf->b_u_oldhead == uhp)
 		    curbuf->b_u_oldhead = last;
 		uhp = last;
 		if (uhp->uh_next.ptr != NULL)
+		{
 		    uhp->uh_next.ptr->uh_prev.ptr = uhp;
+		    uhp->uh_next.ptr->uh_ufmeta = TRUE;
+		}
 	    }
 	    curbuf->b_u_curhead = uhp;
 
@@ -2411,6 +3203,15 @@ u_undoredo(undo)
     curbuf->b_op_end.lnum = 0;
     curbuf->b_op_end.col = 0;
 
+    if (UH_NOT_LOADED(curhead) && u_load_header(curbuf, curhead) == FAIL)
+    {
+#ifdef FEAT_AUTOCMD
+	unblock_autocmds();
+#endif
+	return;
+    }
+    u_header_changed(curbuf, curhead);
+
     for (uep = curhead->uh_entry; uep != NULL; uep = nuep)
     {
 	top = uep->ue_top;
@@ -2427,6 +3228,15 @@ u_undoredo(undo)
 	    changed();		/* don't want UNCHANGED now */
 	    return;
 	}
+	if (uep->ue_packed != NULL && u_unpack_entry(uep) == FAIL)
+	{
+#ifdef FEAT_AUTOCMD
+	    unblock_autocmds();
+#endif
+	    changed();		/* don't want UNCHANGED now */
+	    return;
+	}
+	curbuf->b_u_mem -= u_entry_mem(uep);
 
 	oldsize = bot - top - 1;    /* number of lines before undo */
 	newsize = uep->ue_size;	    /* number of lines after undo */
@@ -2476,26 +3286,27 @@ u_undoredo(undo)
 		 * We have messed up the entry list, repair is impossible.
 		 * we have to free the rest of the list.
 		 */
-		while (uep != NULL)
+		nuep = uep->ue_next;
+		u_freeentry(uep, uep->ue_size);
+		for (uep = nuep; uep != NULL; uep = nuep)
 		{
 		    nuep = uep->ue_next;
+		    curbuf->b_u_mem -= u_entry_mem(uep);
 		    u_freeentry(uep, uep->ue_size);
-		    uep = nuep;
 		}
 		break;
 	    }
-	    /* delete backwards, it goes faster in most cases */
 	    for (lnum = bot - 1, i = oldsize; --i >= 0; --lnum)
 	    {
 		/* what can we do when we run out of memory? */
 		if ((newarray[i] = u_save_line(lnum)) == NULL)
 		    do_outofmem_msg((long_u)0);
-		/* remember we deleted the last line in the buffer, and a
-		 * dummy empty line will be inserted */
-		if (curbuf->b_ml.ml_line_count == 1)
-		    empty_buffer = TRUE;
-		ml_delete(lnum, FALSE);
 	    }
+	    /* remember we delete the last line in the buffer, and a dummy
+	     * empty line will be inserted */
+	    if (curbuf->b_ml.ml_line_count == oldsize)
+		empty_buffer = TRUE;
+	    ml_delete_lines(top + 1, oldsize, FALSE);
 	}
 	else
 	    newarray = NULL;
@@ -2503,18 +3314,20 @@ u_undoredo(undo)
 	/* insert the lines in u_array between top and bot */
 	if (newsize)
 	{
-	    for (lnum = top, i = 0; i < newsize; ++i, ++lnum)
+	    /*
+	     * If the file is empty, there is an empty line 1 that we should
+	     * get rid of, by replacing it with the first new line
+	     */
+	    if (empty_buffer && top == 0)
 	    {
-		/*
-		 * If the file is empty, there is an empty line 1 that we
-		 * should get rid of, by replacing it with the new line
-		 */
-		if (empty_buffer && lnum == 0)
-		    ml_replace((linenr_T)1, uep->ue_array[i], TRUE);
-		else
-		    ml_append(lnum, uep->ue_array[i], (colnr_T)0, FALSE);
-		vim_free(uep->ue_array[i]);
+		ml_replace((linenr_T)1, uep->ue_array[0], TRUE);
+		ml_append_lines((linenr_T)1, uep->ue_array + 1, NULL,
+						       newsize - 1L, FALSE);
 	    }
+	    else
+		ml_append_lines(top, uep->ue_array, NULL, newsize, FALSE);
+	    for (i = 0; i < newsize; ++i)
+		vim_free(uep->ue_array[i]);
 	    vim_free((char_u *)uep->ue_array);
 	}
 
@@ -2544,6 +3357,7 @@ u_undoredo(undo)
 	uep->ue_size = oldsize;
 	uep->ue_array = newarray;
 	uep->ue_bot = top + newsize + 1;
+	curbuf->b_u_mem += u_entry_mem(uep);
 
 	/*
 	 * insert this entry in front of the new entry list
@@ -2941,7 +3755,9 @@ u_find_first_changed()
 
     /* Check that the last undo block was for the whole file. */
     uep = uhp->uh_entry;
-    if (uep->ue_top != 0 || uep->ue_bot != 0)
+    if (uep == NULL || uep->ue_top != 0 || uep->ue_bot != 0)
+	return;
+    if (uep->ue_packed != NULL && u_unpack_entry(uep) == FAIL)
 	return;
 
     for (lnum = 1; lnum < curbuf->b_ml.ml_line_count
@@ -2949,6 +3765,7 @@ u_find_first_changed()
 	if (STRCMP(ml_get_buf(curbuf, lnum, FALSE),
 						uep->ue_array[lnum - 1]) != 0)
 	{
+	    u_header_changed(curbuf, uhp);
 	    clearpos(&(uhp->uh_cursor));
 	    uhp->uh_cursor.lnum = lnum;
 	    return;
@@ -2956,6 +3773,7 @@ u_find_first_changed()
     if (curbuf->b_ml.ml_line_count != uep->ue_size)
     {
 	/* lines added or deleted at the end, put the cursor there */
+	u_header_changed(curbuf, uhp);
 	clearpos(&(uhp->uh_cursor));
 	uhp->uh_cursor.lnum = lnum;
     }
@@ -2979,7 +3797,10 @@ u_update_save_nr(buf)
     else
 	uhp = buf->b_u_newhead;
     if (uhp != NULL)
+    {
 	uhp->uh_save_nr = buf->b_u_save_nr_last;
+	uhp->uh_ufmeta = TRUE;
+    }
 }
 
     static void
@@ -2990,6 +3811,8 @@ u_unch_branch(uhp)
 
     for (uh = uhp; uh != NULL; uh = uh->uh_prev.ptr)
     {
+	if (!(uh->uh_flags & UH_CHANGED))
+	    uh->uh_ufmeta = TRUE;
 	uh->uh_flags |= UH_CHANGED;
 	if (uh->uh_alt_next.ptr != NULL)
 	    u_unch_branch(uh->uh_alt_next.ptr);	    /* recursive */
@@ -3067,20 +3890,29 @@ u_freeheader(buf, uhp, uhpp)
 	u_freebranch(buf, uhp->uh_alt_next.ptr, uhpp);
 
     if (uhp->uh_alt_prev.ptr != NULL)
+    {
 	uhp->uh_alt_prev.ptr->uh_alt_next.ptr = NULL;
+	uhp->uh_alt_prev.ptr->uh_ufmeta = TRUE;
+    }
 
     /* Update the links in the list to remove the header. */
     if (uhp->uh_next.ptr == NULL)
 	buf->b_u_oldhead = uhp->uh_prev.ptr;
     else
+    {
 	uhp->uh_next.ptr->uh_prev.ptr = uhp->uh_prev.ptr;
+	uhp->uh_next.ptr->uh_ufmeta = TRUE;
+    }
 
     if (uhp->uh_prev.ptr == NULL)
 	buf->b_u_newhead = uhp->uh_next.ptr;
     else
 	for (uhap = uhp->uh_prev.ptr; uhap != NULL;
 						 uhap = uhap->uh_alt_next.ptr)
+	{
 	    uhap->uh_next.ptr = uhp->uh_next.ptr;
+	    uhap->uh_ufmeta = TRUE;
+	}
 
     u_freeentries(buf, uhp, uhpp);
 }
@@ -3105,7 +3937,10 @@ u_freebranch(buf, uhp, uhpp)
     }
 
     if (uhp->uh_alt_prev.ptr != NULL)
+    {
 	uhp->uh_alt_prev.ptr->uh_alt_next.ptr = NULL;
+	uhp->uh_alt_prev.ptr->uh_ufmeta = TRUE;
+    }
 
     next = uhp;
     while (next != NULL)
@@ -3138,9 +3973,11 @@ u_freeentries(buf, uhp, uhpp)
     if (uhpp != NULL && uhp == *uhpp)
 	*uhpp = NULL;
 
+    buf->b_u_uf_live -= uhp->uh_ufsize;
     for (uep = uhp->uh_entry; uep != NULL; uep = nuep)
     {
 	nuep = uep->ue_next;
+	buf->b_u_mem -= u_entry_mem(uep);
 	u_freeentry(uep, uep->ue_size);
     }
 
@@ -3159,15 +3996,514 @@ u_freeentry(uep, n)
     u_entry_T	*uep;
     long	    n;
 {
-    while (n > 0)
-	vim_free(uep->ue_array[--n]);
+    if (uep->ue_array != NULL)
+	while (n > 0)
+	    vim_free(uep->ue_array[--n]);
     vim_free((char_u *)uep->ue_array);
+    vim_free(uep->ue_packed);
 #ifdef U_DEBUG
     uep->ue_magic = 0;
 #endif
     vim_free((char_u *)uep);
 }
 
+/*
+ * The text saved in an entry can be packed into one block of memory, which
+ * avoids an allocation for each line.  For each line there are two numbers:
+ * the number of bytes at the start and at the end that it has in common with
+ * the line that takes its place in the buffer when the entry is undone.  The
+ * remaining bytes of the line follow, with a NUL.  The numbers use seven bits
+ * per byte, the high bit is set when another byte follows.  Lines that don't
+ * have a line in the buffer to compare with have two zero numbers.
+ *
+ * That line in the buffer is known when the change is complete: it is the
+ * text that is there when the entry is undone.  A change of a few bytes in a
+ * long line then takes just a few bytes.
+ */
+
+/*
+ * Store number "n" at "p", unless "p" is NULL.
+ * Returns the number of bytes used.
+ */
+    static int
+u_put_num(p, n)
+    char_u	*p;
+    long_u	n;
+{
+    int		len = 1;
+
+    while (n >= 0x80)
+    {
+	if (p != NULL)
+	    *p++ = (char_u)(n | 0x80);
+	n >>= 7;
+	++len;
+    }
+    if (p != NULL)
+	*p = (char_u)n;
+    return len;
+}
+
+/*
+ * Get a number stored by u_put_num() at "p" in "*np".
+ * Returns a pointer to the byte after it.
+ */
+    static char_u *
+u_get_num(p, np)
+    char_u	*p;
+    long_u	*np;
+{
+    long_u	n = 0;
+    int		shift = 0;
+
+    while (*p & 0x80)
+    {
+	n |= (long_u)(*p++ & 0x7f) << shift;
+	shift += 7;
+    }
+    *np = n | ((long_u)*p++ << shift);
+    return p;
+}
+
+/*
+ * Return the number of bytes in packed block "packed" with "size" lines.
+ */
+    static long_u
+u_packed_len(packed, size)
+    char_u	*packed;
+    long	size;
+{
+    char_u	*p = packed;
+    long_u	n;
+    long	i;
+
+    for (i = 0; i < size; ++i)
+    {
+	p = u_get_num(p, &n);
+	p = u_get_num(p, &n);
+	p += STRLEN(p) + 1;
+    }
+    return (long_u)(p - packed);
+}
+
+/*
+ * Check that packed block "packed" of "len" bytes, read from a file, holds
+ * exactly "size" lines.
+ */
+    static int
+u_packed_check(packed, len, size)
+    char_u	*packed;
+    long_u	len;
+    long	size;
+{
+    long_u	i = 0;
+    long	lnum;
+    int		nums;
+    int		nlen;
+
+    if (size < 0)
+	return FAIL;
+    for (lnum = 0; lnum < size; ++lnum)
+    {
+	for (nums = 0; nums < 2; ++nums)
+	{
+	    for (nlen = 1; i < len && (packed[i] & 0x80); ++nlen)
+		++i;
+	    if (i >= len || nlen > 9)	/* more than 63 bits */
+		return FAIL;
+	    ++i;
+	}
+	while (i < len && packed[i] != NUL)
+	    ++i;
+	if (i >= len)
+	    return FAIL;
+	++i;
+    }
+    return i == len ? OK : FAIL;
+}
+
+/*
+ * Return the number of bytes entry "uep" uses for its text.
+ */
+    static long_u
+u_entry_mem(uep)
+    u_entry_T	*uep;
+{
+    long_u	mem = sizeof(u_entry_T);
+    long	i;
+
+    if (uep->ue_packed != NULL)
+	mem += u_packed_len(uep->ue_packed, uep->ue_size);
+    else if (uep->ue_array != NULL)
+	for (i = 0; i < uep->ue_size; ++i)
+	    mem += sizeof(char_u *) + STRLEN(uep->ue_array[i]) + 1;
+    return mem;
+}
+
+/*
+ * Pack the lines of entry "uep" of the current buffer into one block.  Must
+ * only be called when the buffer has the text it will have when "uep" is
+ * undone: the change that "uep" was saved for is complete.
+ * When out of memory the lines are kept as they are.
+ */
+    static void
+u_pack_entry(uep)
+    u_entry_T	*uep;
+{
+    linenr_T	bot;
+    long	i;
+    int		pass;
+    char_u	*packed = NULL;
+    char_u	*p = NULL;
+    char_u	*line;
+    char_u	*ref;
+    long_u	len = 0;
+    size_t	linelen, reflen;
+    size_t	pre, suf;
+
+    if (uep == NULL || uep->ue_array == NULL)
+	return;
+    bot = uep->ue_bot == 0 ? curbuf->b_ml.ml_line_count + 1 : uep->ue_bot;
+    if (uep->ue_top >= bot || bot > curbuf->b_ml.ml_line_count + 1)
+	return;
+
+    /* First pass: compute the size, second pass: fill the block. */
+    for (pass = 1; pass <= 2; ++pass)
+    {
+	for (i = 0; i < uep->ue_size; ++i)
+	{
+	    line = uep->ue_array[i];
+	    linelen = STRLEN(line);
+	    pre = 0;
+	    suf = 0;
+	    if (uep->ue_top + 1 + i < bot)
+	    {
+		ref = ml_get(uep->ue_top + 1 + i);
+		reflen = STRLEN(ref);
+		while (pre < linelen && pre < reflen && line[pre] == ref[pre])
+		    ++pre;
+		while (suf < linelen - pre && suf < reflen - pre
+			  && line[linelen - suf - 1] == ref[reflen - suf - 1])
+		    ++suf;
+	    }
+	    if (pass == 1)
+		len += u_put_num(NULL, (long_u)pre) + u_put_num(NULL,
+					 (long_u)suf) + linelen - pre - suf + 1;
+	    else
+	    {
+		p += u_put_num(p, (long_u)pre);
+		p += u_put_num(p, (long_u)suf);
+		mch_memmove(p, line + pre, linelen - pre - suf);
+		p += linelen - pre - suf;
+		*p++ = NUL;
+	    }
+	}
+	if (pass == 1)
+	{
+	    if ((packed = U_ALLOC_LINE(len)) == NULL)
+		return;
+	    p = packed;
+	}
+    }
+
+    curbuf->b_u_mem -= u_entry_mem(uep);
+    for (i = 0; i < uep->ue_size; ++i)
+	vim_free(uep->ue_array[i]);
+    vim_free((char_u *)uep->ue_array);
+    uep->ue_array = NULL;
+    uep->ue_packed = packed;
+    curbuf->b_u_mem += u_entry_mem(uep);
+}
+
+/*
+ * Turn the packed lines of entry "uep" back into an array of lines, using
+ * the lines in the current buffer.
+ * Returns FAIL when out of memory or the lines don't match the buffer.
+ */
+    static int
+u_unpack_entry(uep)
+    u_entry_T	*uep;
+{
+    char_u	**array;
+    char_u	*p = uep->ue_packed;
+    char_u	*mid;
+    char_u	*ref;
+    long_u	pre, suf;
+    size_t	midlen, reflen;
+    linenr_T	lnum;
+    long	i;
+    int		corrupt = FALSE;
+
+    array = (char_u **)U_ALLOC_LINE(sizeof(char_u *) * uep->ue_size);
+    if (array == NULL)
+    {
+	do_outofmem_msg((long_u)0);
+	return FAIL;
+    }
+    for (i = 0; i < uep->ue_size; ++i)
+    {
+	p = u_get_num(p, &pre);
+	p = u_get_num(p, &suf);
+	mid = p;
+	midlen = STRLEN(mid);
+	p += midlen + 1;
+
+	lnum = uep->ue_top + 1 + i;
+	reflen = 0;
+	if (pre + suf > 0)
+	{
+	    if (lnum > curbuf->b_ml.ml_line_count
+		       || (reflen = STRLEN(ml_get(lnum))) < pre + suf)
+	    {
+		corrupt = TRUE;
+		break;
+	    }
+	}
+	array[i] = U_ALLOC_LINE(pre + midlen + suf + 1);
+	if (array[i] == NULL)
+	    break;
+	if (pre + suf > 0)
+	{
+	    /* get the line again, allocating may have flushed it */
+	    ref = ml_get(lnum);
+	    mch_memmove(array[i], ref, (size_t)pre);
+	    mch_memmove(array[i] + pre + midlen, ref + reflen - suf,
+								 (size_t)suf);
+	}
+	mch_memmove(array[i] + pre, mid, midlen);
+	array[i][pre + midlen + suf] = NUL;
+    }
+    if (i < uep->ue_size)
+    {
+	if (corrupt)
+	    EMSG2(_(e_intern2), "u_unpack_entry()");
+	else
+	    do_outofmem_msg((long_u)0);
+	while (--i >= 0)
+	    vim_free(array[i]);
+	vim_free((char_u *)array);
+	return FAIL;
+    }
+
+    curbuf->b_u_mem -= u_entry_mem(uep);
+    vim_free(uep->ue_packed);
+    uep->ue_packed = NULL;
+    uep->ue_array = array;
+    curbuf->b_u_mem += u_entry_mem(uep);
+    return OK;
+}
+
+/*
+ * When the undo entries of "buf" use more memory than 'undomaxmem', move the
+ * entries of the oldest undo blocks to the spill file, until they use three
+ * quarters of it.  The newest block and the one to be redone next stay in
+ * memory.  The entries are read back when needed for undo or redo.
+ */
+    static void
+u_spill_old(buf)
+    buf_T	*buf;
+{
+    u_header_T	*uhp;
+
+    if (p_umm <= 0 || buf->b_u_mem <= (long_u)p_umm * 1024)
+	return;
+#ifdef FEAT_CRYPT
+    /* Don't write the text of an encrypted buffer unencrypted. */
+    if (*buf->b_p_key != NUL)
+	return;
+#endif
+    for (uhp = buf->b_u_oldhead; uhp != NULL
+		 && buf->b_u_mem > (long_u)p_umm * 768; uhp = uhp->uh_prev.ptr)
+	if (uhp != buf->b_u_newhead && uhp != buf->b_u_curhead
+		&& uhp->uh_entry != NULL && u_spill_header(buf, uhp) == FAIL)
+	    break;
+}
+
+/*
+ * Append the entries of header "uhp" to the spill file of "buf" and free
+ * them.  The spill file is a temp file, only used by this Vim, thus the
+ * numbers are written as they are in memory.
+ * Returns FAIL when the entries could not be written, they stay in memory.
+ */
+    static int
+u_spill_header(buf, uhp)
+    buf_T	*buf;
+    u_header_T	*uhp;
+{
+    FILE	*fp;
+    u_entry_T	*uep;
+    u_entry_T	*nuep;
+    long	off;
+    long	count = 0;
+    long	hdr[5];
+    long	i;
+
+    if (buf->b_u_spill_fp == NULL)
+    {
+	if (buf->b_u_spill_fname == NULL
+		   && (buf->b_u_spill_fname = vim_tempname('u')) == NULL)
+	    return FAIL;
+	buf->b_u_spill_fp = mch_fopen((char *)buf->b_u_spill_fname, "w+b");
+	if (buf->b_u_spill_fp == NULL)
+	    return FAIL;
+    }
+    fp = buf->b_u_spill_fp;
+    if (fseek(fp, 0L, SEEK_END) != 0 || (off = ftell(fp)) < 0)
+	return FAIL;
+
+    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+	++count;
+    fwrite(&count, sizeof(count), (size_t)1, fp);
+    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+    {
+	hdr[0] = uep->ue_top;
+	hdr[1] = uep->ue_bot;
+	hdr[2] = uep->ue_lcount;
+	hdr[3] = uep->ue_size;
+	if (uep->ue_packed != NULL)
+	{
+	    hdr[4] = (long)u_packed_len(uep->ue_packed, uep->ue_size);
+	    fwrite(hdr, sizeof(hdr), (size_t)1, fp);
+	    fwrite(uep->ue_packed, (size_t)hdr[4], (size_t)1, fp);
+	}
+	else
+	{
+	    /* Write the lines packed, without a line to compare with. */
+	    hdr[4] = 0;
+	    for (i = 0; i < uep->ue_size; ++i)
+		hdr[4] += (long)STRLEN(uep->ue_array[i]) + 3;
+	    fwrite(hdr, sizeof(hdr), (size_t)1, fp);
+	    for (i = 0; i < uep->ue_size; ++i)
+	    {
+		putc(0, fp);
+		putc(0, fp);
+		fwrite(uep->ue_array[i], STRLEN(uep->ue_array[i]) + 1,
+							       (size_t)1, fp);
+	    }
+	}
+    }
+    if (fflush(fp) != 0 || ferror(fp))
+    {
+	clearerr(fp);
+	return FAIL;
+    }
+
+    for (uep = uhp->uh_entry; uep != NULL; uep = nuep)
+    {
+	nuep = uep->ue_next;
+	buf->b_u_mem -= u_entry_mem(uep);
+	u_freeentry(uep, uep->ue_size);
+    }
+    uhp->uh_entry = NULL;
+    uhp->uh_spill = off;
+    return OK;
+}
+
+/*
+ * Read the entries written by u_spill_header() at offset "off" in the spill
+ * file of "buf".  They are packed.
+ * Returns the list of entries, NULL when reading fails.
+ */
+    static u_entry_T *
+u_read_spill(buf, off)
+    buf_T	*buf;
+    long	off;
+{
+    FILE	*fp = buf->b_u_spill_fp;
+    u_entry_T	*first = NULL;
+    u_entry_T	*last = NULL;
+    u_entry_T	*uep;
+    long	count;
+    long	hdr[5];
+    long	i;
+
+    if (fp == NULL || fseek(fp, off, SEEK_SET) != 0
+			    || fread(&count, sizeof(count), (size_t)1, fp) != 1)
+	goto error;
+    for (i = 0; i < count; ++i)
+    {
+	if (fread(hdr, sizeof(hdr), (size_t)1, fp) != 1)
+	    goto error;
+	uep = (u_entry_T *)U_ALLOC_LINE(sizeof(u_entry_T));
+	if (uep == NULL)
+	    goto error;
+	vim_memset(uep, 0, sizeof(u_entry_T));
+#ifdef U_DEBUG
+	uep->ue_magic = UE_MAGIC;
+#endif
+	if (last == NULL)
+	    first = uep;
+	else
+	    last->ue_next = uep;
+	last = uep;
+	uep->ue_top = hdr[0];
+	uep->ue_bot = hdr[1];
+	uep->ue_lcount = hdr[2];
+	uep->ue_size = hdr[3];
+	if (hdr[4] > 0 && ((uep->ue_packed = U_ALLOC_LINE(hdr[4])) == NULL
+		|| fread(uep->ue_packed, (size_t)hdr[4], (size_t)1, fp) != 1
+		|| u_packed_check(uep->ue_packed, (long_u)hdr[4],
+						     uep->ue_size) == FAIL))
+	    goto error;
+    }
+    return first;
+
+error:
+    EMSG2(_("E838: Cannot read undo spill file: %s"), buf->b_u_spill_fname);
+    while (first != NULL)
+    {
+	uep = first;
+	first = uep->ue_next;
+	u_freeentry(uep, uep->ue_size);
+    }
+    return NULL;
+}
+
+/*
+ * Read the entries of header "uhp" back from the spill file of "buf" or the
+ * undo file it was read from.
+ */
+    static int
+u_load_header(buf, uhp)
+    buf_T	*buf;
+    u_header_T	*uhp;
+{
+    u_entry_T	*uep = NULL;
+
+    if (uhp->uh_spill >= 0)
+    {
+	uep = u_read_spill(buf, uhp->uh_spill);
+	if (uep == NULL)
+	    return FAIL;
+	uhp->uh_spill = -1;
+    }
+#ifdef FEAT_PERSISTENT_UNDO
+    else if (uhp->uh_ufoff >= 0)
+    {
+	if (u_read_ufentries(buf, uhp->uh_ufoff, &uep) == FAIL)
+	    return FAIL;
+	uhp->uh_ufoff = -1;
+    }
+#endif
+    uhp->uh_entry = uep;
+    for ( ; uep != NULL; uep = uep->ue_next)
+	buf->b_u_mem += u_entry_mem(uep);
+    return OK;
+}
+
+/*
+ * Called when the entries, cursor or marks of "uhp" change: it has to be
+ * written to the undo file again.
+ */
+    static void
+u_header_changed(buf, uhp)
+    buf_T	*buf;
+    u_header_T	*uhp;
+{
+    buf->b_u_uf_live -= uhp->uh_ufsize;
+    uhp->uh_ufsize = 0;
+}
+
 /*
  * invalidate the undo buffer; called when storage has already been released
  */
@@ -3273,6 +4609,23 @@ u_blockfree(buf)
     while (buf->b_u_oldhead != NULL)
 	u_freeheader(buf, buf->b_u_oldhead, NULL);
     vim_free(buf->b_u_line_ptr);
+    buf->b_u_mem = 0;
+    if (buf->b_u_spill_fp != NULL)
+    {
+	fclose(buf->b_u_spill_fp);
+	buf->b_u_spill_fp = NULL;
+	mch_remove(buf->b_u_spill_fname);
+    }
+    vim_free(buf->b_u_spill_fname);
+    buf->b_u_spill_fname = NULL;
+    if (buf->b_u_ufp != NULL)
+    {
+	fclose(buf->b_u_ufp);
+	buf->b_u_ufp = NULL;
+    }
+    vim_free(buf->b_u_uf_fname);
+    buf->b_u_uf_fname = NULL;
+    buf->b_u_uf_live = 0;
 }
 
 /*
@@ -333,6 +333,11 @@ static char *(features[]) =
 #else
 	"-mksession",
 #endif
+#ifdef FEAT_MMAP
+	"+mmap",
+#else
+	"-mmap",
+#endif
 #ifdef FEAT_MODIFY_FNAME
 	"+modify_fname",
 #else
@@ -542,6 +547,11 @@ static char *(features[]) =
 #else
 	"-sun_workshop",
 #endif
+#ifdef FEAT_SWAP_THREAD
+	"+swapthread",
+#else
+	"-swapthread",
+#endif
 #ifdef FEAT_SYN_HL
 	"+syntax",
 #else
@@ -528,6 +528,16 @@ typedef unsigned long u8char_T;	    /* long should be 32 bits or more */
 #  endif
 # endif
 
+/*
+ * Use SSE2 instructions for scanning text when the compiler generates them
+ * anyway, which is always the case for x86-64.
+ */
+#if (defined(__SSE2__) || defined(_M_X64) \
+	|| (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(PROTO)
+# define USE_SSE2
+# include <emmintrin.h>
+#endif
+
 /* ================ end of the header file puzzle =============== */
 
 /*
@@ -776,6 +786,7 @@ extern char *(*dyn_libintl_textdomain)(const char *domainname);
 #define EXPAND_FILETYPE		37
 #define EXPAND_FILES_IN_PATH	38
 #define EXPAND_OWNSYNTAX	39
+#define EXPAND_SYNTIME		40
 
 /* Values for exmode_active (0 is no exmode) */
 #define EXMODE_NORMAL		1
@@ -897,6 +908,7 @@ extern char *(*dyn_libintl_textdomain)(const char *domainname);
 #define SEARCH_MARK  0x200  /* set previous context mark */
 #define SEARCH_KEEP  0x400  /* keep previous search pattern */
 #define SEARCH_PEEK  0x800  /* peek for typed char, cancel search */
+#define SEARCH_COUNT 0x1000 /* match count is shown, no wrap message */
 
 /* Values for find_ident_under_cursor() */
 #define FIND_IDENT	1	/* find identifier (word) */
@@ -991,6 +1003,7 @@ extern char *(*dyn_libintl_textdomain)(const char *domainname);
 #define RE_MAGIC	1	/* 'magic' option */
 #define RE_STRING	2	/* match in string instead of buffer text */
 #define RE_STRICT	4	/* don't allow [abc] without ] */
+#define RE_CACHE	8	/* may return a shared program from the cache */
 
 #ifdef FEAT_SYN_HL
 /* values for reg_do_extmatch */
@@ -1037,6 +1050,7 @@ extern char *(*dyn_libintl_textdomain)(const char *domainname);
 #define MFS_STOP	2	/* stop syncing when a character is available */
 #define MFS_FLUSH	4	/* flushed file to disk */
 #define MFS_ZERO	8	/* only write block 0 */
+#define MFS_ASYNC	16	/* let the swap thread write and flush */
 
 /* flags for buf_copy_options() */
 #define BCO_ENTER	1	/* going to enter the buffer */
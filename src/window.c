@@ -4416,6 +4416,7 @@ win_free(wp, tp)
 
 #ifdef FEAT_SEARCH_EXTRA
     clear_matches(wp);
+    match_cache_free(wp->w_mcache);
 #endif
 
 #ifdef FEAT_JUMPLIST
@@ -6493,6 +6494,7 @@ match_add(wp, grp, pat, prio, id)
     m->match.regprog = regprog;
     m->match.rmm_ic = FALSE;
     m->match.rmm_maxcol = 0;
+    m->hl.mcache = NULL;
 
     /* Insert new match.  The match list is in ascending order with regard to
      * the match priorities. */
@@ -6548,7 +6550,8 @@ match_delete(wp, id, perr)
 	wp->w_match_head = cur->next;
     else
 	prev->next = cur->next;
-    vim_free(cur->match.regprog);
+    vim_regfree(cur->match.regprog);
+    match_cache_free(cur->hl.mcache);
     vim_free(cur->pattern);
     vim_free(cur);
     redraw_later(SOME_VALID);
@@ -6567,7 +6570,8 @@ clear_matches(wp)
     while (wp->w_match_head != NULL)
     {
 	m = wp->w_match_head->next;
-	vim_free(wp->w_match_head->match.regprog);
+	vim_regfree(wp->w_match_head->match.regprog);
+	match_cache_free(wp->w_match_head->hl.mcache);
 	vim_free(wp->w_match_head->pattern);
 	vim_free(wp->w_match_head);
 	wp->w_match_head = m;